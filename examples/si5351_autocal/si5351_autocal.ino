@@ -0,0 +1,112 @@
+/*
+ * si5351_autocal.ino - Automatic calibration with the Si5351Arduino library
+ *
+ * Copyright (C) 2015 - 2019 Jason Milldrum <milldrum@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Finds the correction of the crystal with Si5351Calibrator. CLK0 runs at
+ * 10 MHz into a frequency counter, and the measurement callback asks for
+ * the reading over the serial port, so a person or a script on the host
+ * reading the counter can answer. Replace measure() with a function that
+ * reads your own counter to calibrate without anyone at the bench.
+ *
+ * Type the reading in Hz, with up to two decimals (10000123.4), and press
+ * enter. Two readings are usually enough.
+ */
+
+#include "si5351.h"
+#include "si5351_calibrate.h"
+#include "Wire.h"
+
+// Resolution of the counter: 1 Hz, for a 1 s gate
+#define COUNTER_RESOLUTION  100ULL
+
+Si5351 si5351;
+
+// Read a frequency in Hz from the serial port, as Hz * 100
+uint8_t measure(uint64_t *freq, void *ctx)
+{
+  uint64_t value = 0;
+  int8_t decimals = -1;
+  char c;
+
+  Serial.println(F("Enter the counter reading of CLK0 in Hz:"));
+  while (true)
+  {
+    while (Serial.available() == 0);
+    c = Serial.read();
+    if (c >= '0' && c <= '9' && decimals < 2)
+    {
+      value = value * 10 + (c - '0');
+      if (decimals >= 0)
+      {
+        decimals++;
+      }
+    }
+    else if (c == '.' && decimals < 0)
+    {
+      decimals = 0;
+    }
+    else if ((c == '\n' || c == '\r') && value != 0)
+    {
+      break;
+    }
+  }
+  if (decimals < 0)
+  {
+    decimals = 0;
+  }
+  while (decimals < 2)
+  {
+    value *= 10;
+    decimals++;
+  }
+
+  *freq = value;
+  return 0;
+}
+
+void setup()
+{
+  struct Si5351CalResult result;
+  Si5351Calibrator cal(&si5351, measure);
+
+  Serial.begin(57600);
+
+  // The crystal load value needs to match in order to have an accurate calibration
+  si5351.init(SI5351_CRYSTAL_LOAD_8PF, 0, 0);
+
+  cal.set_output(SI5351_CLK0, 1000000000ULL);
+  cal.set_resolution(COUNTER_RESOLUTION);
+  if (cal.run(&result) != 0)
+  {
+    Serial.println(F("Calibration did not converge"));
+  }
+
+  Serial.print(F("Correction: "));
+  Serial.print(result.correction);
+  Serial.print(F(" ppb, +/- "));
+  Serial.print(result.uncertainty);
+  Serial.print(F(" ppb after "));
+  Serial.print(result.measurements);
+  Serial.println(F(" measurements"));
+  Serial.println(F("Pass the correction to init() or set_correction() from now on."));
+}
+
+void loop()
+{
+}
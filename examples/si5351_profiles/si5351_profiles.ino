@@ -0,0 +1,94 @@
+/*
+ * si5351_profiles.ino - Receive/transmit switching with the Si5351Arduino library
+ *
+ * Copyright (C) 2015 - 2019 Jason Milldrum <milldrum@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * A 20 m transceiver with a 9 MHz IF. In receive, CLK0 is the local
+ * oscillator and CLK2 the BFO. In transmit, CLK1 drives the PA directly.
+ * The push-to-talk key on pin 2 switches between the two, and sending 'c'
+ * on the serial port puts a 10 MHz calibration signal on CLK0 until the
+ * key is next pressed. Each switch only writes the registers that differ
+ * between the two setups.
+ */
+
+#include "si5351.h"
+#include "si5351_profile.h"
+#include "Wire.h"
+
+#define PTT_PIN     2
+
+Si5351 si5351;
+Si5351Profiles profiles(&si5351);
+struct Si5351Profile rx_profile, tx_profile, cal_profile;
+uint8_t rx_index, tx_index, cal_index;
+
+void rx(Si5351 &dev)
+{
+  dev.set_freq(2320000000ULL, SI5351_CLK0);  // 14.200 MHz + 9 MHz
+  dev.set_freq(900150000ULL, SI5351_CLK2);   // 9.0015 MHz BFO
+  dev.drive_strength(SI5351_CLK0, SI5351_DRIVE_2MA);
+  dev.drive_strength(SI5351_CLK2, SI5351_DRIVE_2MA);
+}
+
+void tx(Si5351 &dev)
+{
+  dev.set_freq(1420000000ULL, SI5351_CLK1);  // 14.200 MHz
+  dev.drive_strength(SI5351_CLK1, SI5351_DRIVE_8MA);
+}
+
+void cal(Si5351 &dev)
+{
+  dev.set_freq(1000000000ULL, SI5351_CLK0);  // 10 MHz
+}
+
+void setup()
+{
+  Serial.begin(57600);
+  si5351.init(SI5351_CRYSTAL_LOAD_8PF, 0, 0);
+
+  rx_index = profiles.add(&rx_profile, "rx", rx);
+  tx_index = profiles.add(&tx_profile, "tx", tx);
+  cal_index = profiles.add(&cal_profile, "cal", cal);
+  profiles.select(rx_index);
+
+  pinMode(PTT_PIN, INPUT_PULLUP);
+}
+
+void loop()
+{
+  uint8_t want = profiles.current();
+
+  if(Serial.available() && Serial.read() == 'c')
+  {
+    want = cal_index;
+  }
+  else if(digitalRead(PTT_PIN) == LOW)
+  {
+    want = tx_index;
+  }
+  else if(want != cal_index)
+  {
+    want = rx_index;
+  }
+
+  if(want != profiles.current())
+  {
+    profiles.select(want);
+    Serial.println(want == tx_index ? "TX" : want == rx_index ? "RX" : "CAL");
+  }
+}
@@ -0,0 +1,83 @@
+/*
+ * si5351_quadrature.ino - Quadrature VFO with the Si5351Arduino library
+ *
+ * Copyright (C) 2015 - 2019 Jason Milldrum <milldrum@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * An I/Q local oscillator for a direct conversion SDR on 40 m. CLK0 is
+ * the I output and CLK1 the Q output, 90 degrees behind. Send '+' or '-'
+ * on the serial port to tune in 1 kHz steps. Within the band, each step
+ * only rewrites the PLL, so the outputs stay in quadrature without a PLL
+ * reset.
+ */
+
+#include "si5351.h"
+#include "si5351_phase.h"
+#include "Wire.h"
+
+#define BAND_LO     700000000ULL   // 7.000 MHz
+#define BAND_HI     730000000ULL   // 7.300 MHz
+#define STEP        100000ULL      // 1 kHz
+
+Si5351 si5351;
+Si5351PhasePlan iq(&si5351, SI5351_PLLA);
+uint64_t freq = 707400000ULL;
+
+void setup()
+{
+  Serial.begin(57600);
+  si5351.init(SI5351_CRYSTAL_LOAD_8PF, 0, 0);
+
+  iq.add_output(SI5351_CLK0, 0);
+  iq.add_output(SI5351_CLK1, 90);
+  iq.set_band(BAND_LO, BAND_HI);
+  iq.set_freq(freq);
+
+  Serial.print("Divider ");
+  Serial.println(iq.get_divider());
+}
+
+void loop()
+{
+  struct Si5351PhaseStats stats;
+  char c;
+
+  if(!Serial.available())
+  {
+    return;
+  }
+
+  c = Serial.read();
+  if(c == '+' && freq + STEP <= BAND_HI)
+  {
+    freq += STEP;
+  }
+  else if(c == '-' && freq - STEP >= BAND_LO)
+  {
+    freq -= STEP;
+  }
+  else
+  {
+    return;
+  }
+
+  iq.set_freq(freq);
+  iq.get_stats(&stats);
+  Serial.print((unsigned long)(freq / SI5351_FREQ_MULT));
+  Serial.print(" Hz, PLL resets so far: ");
+  Serial.println(stats.replans);
+}
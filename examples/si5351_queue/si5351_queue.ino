@@ -0,0 +1,100 @@
+/*
+ * si5351_queue.ino - Tuning from an interrupt with the Si5351Arduino library
+ *
+ * Copyright (C) 2015 - 2019 Jason Milldrum <milldrum@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * The Si5351 can't be programmed from inside of an interrupt handler,
+ * since the I2C transfers need interrupts of their own. Here a rotary
+ * encoder on pins 2 and 3 steps CLK0 in 100 Hz steps and a key on pin 4
+ * turns the output on and off. The interrupt handlers only put commands
+ * into a Si5351Queue, and loop() carries them out with poll().
+ */
+
+#include "si5351.h"
+#include "si5351_queue.h"
+#include "Wire.h"
+
+#define ENC_A_PIN   2
+#define ENC_B_PIN   3
+#define KEY_PIN     4
+
+Si5351 si5351;
+Si5351Queue queue(&si5351);
+
+volatile unsigned long long freq = 1000000000ULL;  // 10 MHz
+unsigned long last_report = 0;
+
+void encoder_isr()
+{
+  if(digitalRead(ENC_B_PIN))
+  {
+    freq += 10000ULL;
+  }
+  else
+  {
+    freq -= 10000ULL;
+  }
+  queue.set_freq(freq, SI5351_CLK0);
+}
+
+void key_isr()
+{
+  queue.output_enable(SI5351_CLK0, digitalRead(KEY_PIN) == LOW);
+}
+
+void setup()
+{
+  Serial.begin(57600);
+  si5351.init(SI5351_CRYSTAL_LOAD_8PF, 0, 0);
+  si5351.set_freq(freq, SI5351_CLK0);
+  si5351.output_enable(SI5351_CLK0, 0);
+
+  pinMode(ENC_A_PIN, INPUT_PULLUP);
+  pinMode(ENC_B_PIN, INPUT_PULLUP);
+  pinMode(KEY_PIN, INPUT_PULLUP);
+  attachInterrupt(digitalPinToInterrupt(ENC_A_PIN), encoder_isr, FALLING);
+  // Pin change interrupts are board specific; poll the key on boards
+  // where pin 4 can't interrupt
+  if(digitalPinToInterrupt(KEY_PIN) != NOT_AN_INTERRUPT)
+  {
+    attachInterrupt(digitalPinToInterrupt(KEY_PIN), key_isr, CHANGE);
+  }
+}
+
+void loop()
+{
+  struct Si5351QueueStats stats;
+
+  queue.poll();
+
+  // Report the queue once a second
+  if(millis() - last_report >= 1000)
+  {
+    last_report = millis();
+    queue.get_stats(&stats);
+    Serial.print("applied: ");
+    Serial.print(stats.applied);
+    Serial.print("  max depth: ");
+    Serial.print(stats.max_depth);
+    Serial.print("  overflows: ");
+    Serial.print(stats.overflows);
+    Serial.print("  max latency (us): ");
+    Serial.println(stats.latency_max);
+    queue.reset_stats();
+  }
+}
@@ -0,0 +1,99 @@
+/*
+ * si5351_sequence.ino - Timed transmit/receive switching with the Si5351Arduino library
+ *
+ * Copyright (C) 2015 - 2019 Jason Milldrum <milldrum@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * A 20 m transceiver with a 9 MHz IF. In receive, CLK0 is the local
+ * oscillator and CLK2 the BFO. In transmit, CLK1 drives the PA. The
+ * push-to-talk key on pin 2 runs a timed turnaround in each direction,
+ * and the serial port shows how late the latest step of each one was.
+ */
+
+#include "si5351.h"
+#include "si5351_sequence.h"
+#include "Wire.h"
+
+#define PTT_PIN     2
+
+Si5351 si5351;
+Si5351Sequence to_tx(&si5351);
+Si5351Sequence to_rx(&si5351);
+bool transmitting = false;
+
+// Receive outputs off, PA drive up and tuned 50 us later, PA on at 600 us
+void rx_to_tx(Si5351 &dev, Si5351Sequence &seq)
+{
+  seq.at(0);
+  dev.output_enable(SI5351_CLK0, 0);
+  dev.output_enable(SI5351_CLK2, 0);
+  seq.at(50);
+  dev.drive_strength(SI5351_CLK1, SI5351_DRIVE_8MA);
+  dev.set_freq(1420000000ULL, SI5351_CLK1);  // 14.200 MHz
+  seq.at(600);
+  dev.output_enable(SI5351_CLK1, 1);
+}
+
+// PA off, then the receive outputs back on 100 us later
+void tx_to_rx(Si5351 &dev, Si5351Sequence &seq)
+{
+  seq.at(0);
+  dev.output_enable(SI5351_CLK1, 0);
+  seq.at(100);
+  dev.output_enable(SI5351_CLK0, 1);
+  dev.output_enable(SI5351_CLK2, 1);
+}
+
+void setup()
+{
+  Serial.begin(57600);
+  si5351.init(SI5351_CRYSTAL_LOAD_8PF, 0, 0);
+
+  // Receive setup, with the PA output tuned but off
+  si5351.set_freq(2320000000ULL, SI5351_CLK0);  // 14.200 MHz + 9 MHz
+  si5351.set_freq(900150000ULL, SI5351_CLK2);   // 9.0015 MHz BFO
+  si5351.set_freq(1420000000ULL, SI5351_CLK1);
+  si5351.output_enable(SI5351_CLK1, 0);
+
+  to_tx.compile(rx_to_tx);
+  to_rx.compile(tx_to_rx);
+
+  pinMode(PTT_PIN, INPUT_PULLUP);
+}
+
+void loop()
+{
+  bool key = (digitalRead(PTT_PIN) == LOW);
+
+  if(key != transmitting)
+  {
+    transmitting = key;
+    if(transmitting)
+    {
+      to_tx.run();
+      Serial.print("TX, latest step ");
+      Serial.print(to_tx.late_max());
+    }
+    else
+    {
+      to_rx.run();
+      Serial.print("RX, latest step ");
+      Serial.print(to_rx.late_max());
+    }
+    Serial.println(" us late");
+  }
+}
@@ -0,0 +1,725 @@
+/*
+ * si5351_bench.cpp - Host benchmark of the Si5351Arduino library
+ *
+ * Copyright (C) 2015 - 2019 Jason Milldrum <milldrum@gmail.com>
+ *                           Dana H. Myers <k6jq@comcast.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Runs the library against the simulated bus in extras/sim and reports,
+ * for each workload, the host calculation time per operation, the bus
+ * transactions and bytes per operation, and the worst output frequency
+ * error as decoded from the simulated registers.
+ *
+ * Build and run on Linux from the top of the library with:
+ *
+ *   g++ -O2 -Isrc -Iextras/sim -o si5351_bench extras/bench/si5351_bench.cpp \
+ *       src/si5351.cpp src/si5351_group.cpp src/si5351_profile.cpp
+ *   ./si5351_bench --check extras/bench/baseline.txt
+ *
+ * With --check, the program exits with status 1 if any workload uses more
+ * transactions or bytes per operation, more transactions in its worst
+ * set_freq() call, or has a larger frequency error, than the committed
+ * baseline. The high_retune and group_retune workloads must in any case stay within
+ * SI5351_SET_FREQ_HIGH_MAX_TX transactions per set_freq(). Time per operation is reported but never
+ * checked, since it depends on the host. Use --out to write a new results
+ * file (in the same format as the baseline).
+ *
+ * Built with -DSI5351_STATS as well, it also checks that the counters of
+ * get_stats() agree with the simulated bus over the high_retune workload,
+ * and that they show the register reads that workload leaves out.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "si5351.h"
+#include "si5351_group.h"
+#include "si5351_profile.h"
+#include "si5351_simbus.h"
+
+#define BENCH_REPEAT        5
+
+struct Result
+{
+	std::string name;
+	uint32_t ops;
+	double ns_per_op;
+	double tx_per_op;
+	double bytes_per_op;
+	double max_err_hz;
+	uint32_t max_tx;
+};
+
+struct Bench
+{
+	Si5351SimBus bus;
+	Si5351RegSim *dev;
+	Si5351 si;
+	uint32_t ops;
+	uint32_t total_ops;
+	uint32_t max_tx;
+	long double max_err;
+
+	Bench(): bus(400000UL), dev(bus.add_device(SI5351_BUS_BASE_ADDR)),
+		si(SI5351_BUS_BASE_ADDR, &bus), ops(0), total_ops(0), max_tx(0), max_err(0)
+	{
+		si.init(SI5351_CRYSTAL_LOAD_8PF, 0, 0);
+		bus.clear_counters();
+	}
+
+	// Only count the bus traffic from here on
+	void restart_counting(void)
+	{
+		bus.clear_counters();
+#if defined(SI5351_STATS)
+		si.reset_stats();
+#endif
+		ops = 0;
+	}
+
+	void op(void)
+	{
+		ops++;
+		total_ops++;
+	}
+
+	// Set an output and record how far the registers are from the request
+	void set_freq(uint64_t freq, enum si5351_clock clk)
+	{
+		uint32_t tx = bus.transactions;
+
+		op();
+		if(si.set_freq(freq, clk) != 0)
+		{
+			return;
+		}
+		if(bus.transactions - tx > max_tx)
+		{
+			max_tx = bus.transactions - tx;
+		}
+		check(dev, freq, clk);
+	}
+
+	void check(Si5351RegSim *sim, uint64_t freq, int clk)
+	{
+		unsigned __int128 num, den;
+		long double err;
+
+		if(!sim->clk_rational(clk, &num, &den))
+		{
+			return;
+		}
+		err = (long double)num / (long double)den - (long double)freq / SI5351_FREQ_MULT;
+		if(err < 0)
+		{
+			err = -err;
+		}
+		if(err > max_err)
+		{
+			max_err = err;
+		}
+	}
+};
+
+typedef void (*workload_fn)(Bench &);
+
+static uint32_t lcg_state;
+
+static uint32_t lcg(void)
+{
+	lcg_state = lcg_state * 1664525UL + 1013904223UL;
+	return lcg_state >> 8;
+}
+
+static void wl_init(Bench &b)
+{
+	for(int i = 0; i < 50; i++)
+	{
+		b.si.init(SI5351_CRYSTAL_LOAD_8PF, 0, 0);
+		b.op();
+	}
+}
+
+static void wl_reset(Bench &b)
+{
+	for(int i = 0; i < 50; i++)
+	{
+		b.si.reset();
+		b.op();
+	}
+}
+
+static void wl_set_pll(Bench &b)
+{
+	for(int i = 0; i < 500; i++)
+	{
+		b.si.set_pll(i & 1 ? 85000000000ULL : 80000000000ULL + i * 1000ULL, SI5351_PLLA);
+		b.op();
+	}
+}
+
+static void wl_set_vcxo(Bench &b)
+{
+	for(int i = 0; i < 500; i++)
+	{
+		b.si.set_vcxo(87600000000ULL + i * 100ULL, 40 + (i % 100));
+		b.op();
+	}
+}
+
+// 10 Hz tuning steps across 10 kHz of the 40 m band
+static void wl_vfo_step(Bench &b)
+{
+	for(uint64_t f = 7000000ULL; f < 7010000ULL; f += 10)
+	{
+		b.set_freq(f * SI5351_FREQ_MULT, SI5351_CLK0);
+	}
+}
+
+// Random hops between 5 kHz channels from 1.8 to 30 MHz
+static void wl_channel_hop(Bench &b)
+{
+	lcg_state = 1;
+	for(int i = 0; i < 1000; i++)
+	{
+		uint64_t f = 1800000ULL + (lcg() % 5640) * 5000ULL;
+		b.set_freq(f * SI5351_FREQ_MULT, SI5351_CLK0);
+	}
+}
+
+// A WSPR transmission on 20 m: 162 symbols of 4-FSK at 1.4648 Hz spacing
+static void wl_wspr(Bench &b)
+{
+	lcg_state = 7;
+	for(int i = 0; i < 162; i++)
+	{
+		b.set_freq(1409710000ULL + (lcg() % 4) * 146ULL, SI5351_CLK0);
+	}
+}
+
+// Logarithmic sweep across the whole output range
+static void wl_sweep(Bench &b)
+{
+	long double f = SI5351_CLKOUT_MIN_FREQ;
+
+	while(f <= SI5351_CLKOUT_MAX_FREQ)
+	{
+		b.set_freq((uint64_t)(f * SI5351_FREQ_MULT), SI5351_CLK0);
+		f *= 1.02L;
+	}
+}
+
+// Bring up all 8 outputs from reset
+static void wl_eight_outputs(Bench &b)
+{
+	static const uint64_t freqs[8] = {10000000ULL, 14200000ULL, 28400000ULL,
+		3500000ULL, 50000000ULL, 125000000ULL, 50000000ULL, 25000000ULL};
+
+	for(int i = 0; i < 20; i++)
+	{
+		b.si.reset();
+		b.restart_counting();
+		for(int clk = 0; clk < 8; clk++)
+		{
+			b.set_freq(freqs[clk] * SI5351_FREQ_MULT, (enum si5351_clock)clk);
+		}
+	}
+}
+
+// Three devices on one bus, planned jointly, switching between two sets
+// of 20 outputs
+static void wl_group(Bench &b)
+{
+	static const uint64_t sets[2][20] = {
+		{10000000ULL, 20000000ULL, 25000000ULL, 50000000ULL, 100000000ULL,
+		 12288000ULL, 24576000ULL, 6144000ULL, 3072000ULL, 48000ULL,
+		 27000000ULL, 13500000ULL, 74250000ULL, 148500000ULL, 33333333ULL,
+		 14074000ULL, 7074000ULL, 3573000ULL, 1000000ULL, 32768ULL},
+		{10000000ULL, 20000000ULL, 25000000ULL, 50000000ULL, 100000000ULL,
+		 11289600ULL, 22579200ULL, 5644800ULL, 2822400ULL, 44100ULL,
+		 27000000ULL, 13500000ULL, 74250000ULL, 148500000ULL, 33333333ULL,
+		 14074100ULL, 7074100ULL, 3573100ULL, 1000000ULL, 32768ULL},
+	};
+	Si5351Group group(&b.bus);
+	struct Si5351GroupOutput o;
+
+	b.bus.add_device(SI5351_BUS_BASE_ADDR + 1);
+	b.bus.add_device(SI5351_BUS_BASE_ADDR + 2);
+	group.add_device(SI5351_BUS_BASE_ADDR);
+	group.add_device(SI5351_BUS_BASE_ADDR + 1);
+	group.add_device(SI5351_BUS_BASE_ADDR + 2);
+	group.init(SI5351_CRYSTAL_LOAD_8PF, 0, 0);
+	b.restart_counting();
+
+	for(int i = 0; i < 20; i++)
+	{
+		const uint64_t *set = sets[i & 1];
+
+		group.clear();
+		for(int j = 0; j < 20; j++)
+		{
+			group.add_output(set[j] * SI5351_FREQ_MULT);
+		}
+		b.op();
+		if(group.plan() != 0 || group.commit() != 0)
+		{
+			continue;
+		}
+		for(int j = 0; j < 20; j++)
+		{
+			group.get_output(j, &o);
+			b.check(b.bus.device(SI5351_BUS_BASE_ADDR + o.dev), o.freq, o.clk);
+		}
+	}
+}
+
+// One output hopping between frequencies above 100 MHz while the other
+// five keep running. CLK1 and CLK4 are on PLLB, which leaves CLK0, CLK2-3
+// and CLK5 on PLLA: the worst case of three multisynth bursts.
+static void wl_high_retune(Bench &b)
+{
+	static const uint64_t others[5] = {10000000ULL, 14200000ULL, 28400000ULL,
+		3500000ULL, 50000000ULL};
+	static const uint64_t high[4] = {120000000ULL, 144000000ULL, 160000000ULL,
+		120000000ULL};
+
+	b.si.set_ms_source(SI5351_CLK1, SI5351_PLLB);
+	b.si.set_ms_source(SI5351_CLK4, SI5351_PLLB);
+	for(int clk = 1; clk < 6; clk++)
+	{
+		b.set_freq(others[clk - 1] * SI5351_FREQ_MULT, (enum si5351_clock)clk);
+	}
+	b.restart_counting();
+	b.max_tx = 0;
+	for(int i = 0; i < 100; i++)
+	{
+		b.set_freq(high[i % 4] * SI5351_FREQ_MULT, SI5351_CLK0);
+	}
+	for(int clk = 1; clk < 6; clk++)
+	{
+		b.check(b.dev, others[clk - 1] * SI5351_FREQ_MULT, clk);
+	}
+}
+
+// Five outputs planned by Si5351Group on CLK0-CLK4, three of them in
+// integer mode and two from the crystal, then CLK5 hopping above 100 MHz
+// through the Si5351 object that Si5351Group::commit() left behind.
+// Retuning the PLL takes the integer outputs out of integer mode, and must
+// leave the crystal outputs alone.
+static void wl_group_retune(Bench &b)
+{
+	static const uint64_t others[5] = {10000000ULL, 20000000ULL, 25000000ULL,
+		50000000ULL, 12500000ULL};
+	static const uint64_t high[4] = {120000000ULL, 144000000ULL, 160000000ULL,
+		120000000ULL};
+	Si5351Group group(&b.bus);
+	struct Si5351GroupOutput o;
+	Si5351 *si;
+	uint32_t tx;
+
+	group.add_device(SI5351_BUS_BASE_ADDR);
+	group.init(SI5351_CRYSTAL_LOAD_8PF, 0, 0);
+	for(int i = 0; i < 5; i++)
+	{
+		group.add_output(others[i] * SI5351_FREQ_MULT, 0, i);
+	}
+	if(group.plan() != 0 || group.commit() != 0)
+	{
+		return;
+	}
+	si = group.device(0);
+
+	b.restart_counting();
+	b.max_tx = 0;
+	for(int i = 0; i < 100; i++)
+	{
+		// Plan again every few hops, so that the outputs go back into
+		// integer mode
+		if(i % 4 == 0)
+		{
+			group.plan();
+			group.commit();
+		}
+		tx = b.bus.transactions;
+		b.op();
+		if(si->set_freq(high[i % 4] * SI5351_FREQ_MULT, SI5351_CLK5) != 0)
+		{
+			continue;
+		}
+		if(b.bus.transactions - tx > b.max_tx)
+		{
+			b.max_tx = b.bus.transactions - tx;
+		}
+		b.check(b.dev, high[i % 4] * SI5351_FREQ_MULT, SI5351_CLK5);
+	}
+	for(int i = 0; i < 5; i++)
+	{
+		group.get_output(i, &o);
+		b.check(b.dev, o.freq, o.clk);
+	}
+}
+
+// Three transceiver configurations: receive (LO and BFO), transmit and a
+// calibration output. Each one sets all three outputs, so that replaying
+// the calls also works from any of the others.
+static const uint64_t profile_freqs[3][3] = {
+	{2320000000ULL, 0, 900150000ULL},
+	{0, 1420000000ULL, 0},
+	{1000000000ULL, 0, 2500000000ULL},
+};
+
+static void profile_setup(Si5351 &si, const uint64_t *f)
+{
+	for(int clk = 0; clk < 3; clk++)
+	{
+		if(f[clk])
+		{
+			si.set_freq(f[clk], (enum si5351_clock)clk);
+			si.set_clock_pwr((enum si5351_clock)clk, 1);
+			si.drive_strength((enum si5351_clock)clk, clk == 1 ? SI5351_DRIVE_8MA : SI5351_DRIVE_2MA);
+			si.output_enable((enum si5351_clock)clk, 1);
+		}
+		else
+		{
+			si.output_enable((enum si5351_clock)clk, 0);
+			si.set_clock_pwr((enum si5351_clock)clk, 0);
+		}
+	}
+}
+
+static void profile_rx(Si5351 &si) { profile_setup(si, profile_freqs[0]); }
+static void profile_tx(Si5351 &si) { profile_setup(si, profile_freqs[1]); }
+static void profile_cal(Si5351 &si) { profile_setup(si, profile_freqs[2]); }
+
+// Receive, transmit, receive, transmit, calibrate, and over again
+static const uint8_t profile_order[5] = {0, 1, 0, 1, 2};
+
+static void profile_check(Bench &b, int p)
+{
+	for(int clk = 0; clk < 3; clk++)
+	{
+		if(profile_freqs[p][clk])
+		{
+			b.check(b.dev, profile_freqs[p][clk], clk);
+		}
+	}
+}
+
+// The profile switches done by replaying the calls
+static void wl_profile_replay(Bench &b)
+{
+	static void (*const build[3])(Si5351 &) = {profile_rx, profile_tx, profile_cal};
+
+	for(int i = 0; i < 100; i++)
+	{
+		int p = profile_order[i % 5];
+
+		b.op();
+		build[p](b.si);
+		profile_check(b, p);
+	}
+}
+
+// The same switches with Si5351Profiles
+static void wl_profile_switch(Bench &b)
+{
+	static struct Si5351Profile profile[3];
+	Si5351Profiles profiles(&b.si);
+
+	profiles.add(&profile[0], "rx", profile_rx);
+	profiles.add(&profile[1], "tx", profile_tx);
+	profiles.add(&profile[2], "cal", profile_cal);
+	profiles.select(0);
+	b.restart_counting();
+
+	for(int i = 1; i <= 100; i++)
+	{
+		int p = profile_order[i % 5];
+
+		b.op();
+		profiles.select(p);
+		profile_check(b, p);
+	}
+}
+
+struct Workload
+{
+	const char *name;
+	workload_fn fn;
+};
+
+static const Workload workloads[] = {
+	{"init", wl_init},
+	{"reset", wl_reset},
+	{"set_pll", wl_set_pll},
+	{"set_vcxo", wl_set_vcxo},
+	{"vfo_step", wl_vfo_step},
+	{"channel_hop", wl_channel_hop},
+	{"wspr_tones", wl_wspr},
+	{"sweep", wl_sweep},
+	{"eight_outputs", wl_eight_outputs},
+	{"group_plan", wl_group},
+	{"high_retune", wl_high_retune},
+	{"group_retune", wl_group_retune},
+	{"profile_replay", wl_profile_replay},
+	{"profile_switch", wl_profile_switch},
+};
+
+static Result run(const Workload &w)
+{
+	Result r;
+	double best_ns = 0;
+
+	r.name = w.name;
+	for(int rep = 0; rep < BENCH_REPEAT; rep++)
+	{
+		Bench b;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		w.fn(b);
+		double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+		ns /= b.total_ops;
+		if(rep == 0 || ns < best_ns)
+		{
+			best_ns = ns;
+		}
+		r.ops = b.ops;
+		r.tx_per_op = (double)b.bus.transactions / b.ops;
+		r.bytes_per_op = (double)(b.bus.bytes_written + b.bus.bytes_read) / b.ops;
+		r.max_err_hz = (double)b.max_err;
+		r.max_tx = b.max_tx;
+	}
+	r.ns_per_op = best_ns;
+
+	return r;
+}
+
+#if defined(SI5351_STATS)
+// The library's own counters against those of the simulated bus
+static int check_stats(void)
+{
+	Bench b;
+	struct Si5351Stats st;
+	uint32_t tx = 0, bytes = 0;
+	int bad = 0;
+
+	wl_high_retune(b);
+	b.si.get_stats(&st);
+	for(int op = 0; op < SI5351_OP_COUNT; op++)
+	{
+		tx += st.op[op].transactions;
+		bytes += st.op[op].bytes_written + st.op[op].bytes_read;
+	}
+
+	printf("\nget_stats() over high_retune: %u transactions, %u bytes, %u set_freq() calls, "
+		"%u read-modify-write reads, %u left out\n", tx, bytes, st.op[SI5351_OP_SET_FREQ].calls,
+		st.op[SI5351_OP_SET_FREQ].rmw_reads, st.op[SI5351_OP_SET_FREQ].rmw_reads_avoided);
+	if(tx != b.bus.transactions || bytes != b.bus.bytes_written + b.bus.bytes_read)
+	{
+		printf("FAIL get_stats() counted %u transactions and %u bytes, the bus saw %u and %u\n",
+			tx, bytes, b.bus.transactions, b.bus.bytes_written + b.bus.bytes_read);
+		bad++;
+	}
+	if(st.op[SI5351_OP_SET_FREQ].calls != b.ops)
+	{
+		printf("FAIL get_stats() counted %u set_freq() calls, the workload made %u\n",
+			st.op[SI5351_OP_SET_FREQ].calls, b.ops);
+		bad++;
+	}
+	if(st.op[SI5351_OP_SET_FREQ].rmw_reads_avoided == 0)
+	{
+		printf("FAIL get_stats() counted no register reads left out of high_retune\n");
+		bad++;
+	}
+
+	return bad;
+}
+#endif
+
+static bool load_baseline(const char *path, std::vector<Result> *out)
+{
+	FILE *f = fopen(path, "r");
+	char line[256];
+
+	if(!f)
+	{
+		perror(path);
+		return false;
+	}
+	while(fgets(line, sizeof(line), f))
+	{
+		char name[64];
+		Result r;
+
+		if(line[0] == '#')
+		{
+			continue;
+		}
+		r.max_tx = 0;
+		if(sscanf(line, "%63s %u %lf %lf %lf %u", name, &r.ops, &r.tx_per_op,
+			&r.bytes_per_op, &r.max_err_hz, &r.max_tx) >= 5)
+		{
+			r.name = name;
+			r.ns_per_op = 0;
+			out->push_back(r);
+		}
+	}
+	fclose(f);
+	return true;
+}
+
+static void write_results(FILE *f, const std::vector<Result> &results)
+{
+	fprintf(f, "# workload ops tx_per_op bytes_per_op max_err_hz max_tx\n");
+	for(size_t i = 0; i < results.size(); i++)
+	{
+		const Result &r = results[i];
+		fprintf(f, "%s %u %.3f %.3f %.6f %u\n", r.name.c_str(), r.ops, r.tx_per_op,
+			r.bytes_per_op, r.max_err_hz, r.max_tx);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	const char *out_path = NULL;
+	const char *check_path = NULL;
+	std::vector<Result> results;
+	int failed = 0;
+
+	for(int i = 1; i < argc; i++)
+	{
+		if(!strcmp(argv[i], "--out") && i + 1 < argc)
+		{
+			out_path = argv[++i];
+		}
+		else if(!strcmp(argv[i], "--check") && i + 1 < argc)
+		{
+			check_path = argv[++i];
+		}
+		else
+		{
+			fprintf(stderr, "usage: si5351_bench [--out FILE] [--check BASELINE]\n");
+			return 2;
+		}
+	}
+
+	printf("%-14s %6s %10s %8s %9s %12s %6s\n", "workload", "ops", "ns/op", "tx/op", "bytes/op",
+		"max err Hz", "max tx");
+	for(size_t i = 0; i < sizeof(workloads) / sizeof(workloads[0]); i++)
+	{
+		Result r = run(workloads[i]);
+		printf("%-14s %6u %10.1f %8.2f %9.2f %12.6f %6u\n", r.name.c_str(), r.ops,
+			r.ns_per_op, r.tx_per_op, r.bytes_per_op, r.max_err_hz, r.max_tx);
+		results.push_back(r);
+	}
+
+	// The documented bound holds whatever the baseline says
+	for(size_t i = 0; i < results.size(); i++)
+	{
+		if((results[i].name == "high_retune" || results[i].name == "group_retune") &&
+			results[i].max_tx > SI5351_SET_FREQ_HIGH_MAX_TX)
+		{
+			printf("FAIL %s: %u transactions in one set_freq(), bound %u\n", results[i].name.c_str(),
+				results[i].max_tx, (unsigned)SI5351_SET_FREQ_HIGH_MAX_TX);
+			failed++;
+		}
+	}
+
+#if defined(SI5351_STATS)
+	failed += check_stats();
+#endif
+
+	if(out_path)
+	{
+		FILE *f = fopen(out_path, "w");
+		if(!f)
+		{
+			perror(out_path);
+			return 1;
+		}
+		write_results(f, results);
+		fclose(f);
+	}
+
+	if(check_path)
+	{
+		std::vector<Result> base;
+
+		if(!load_baseline(check_path, &base))
+		{
+			return 1;
+		}
+		for(size_t i = 0; i < base.size(); i++)
+		{
+			const Result *r = NULL;
+
+			for(size_t j = 0; j < results.size(); j++)
+			{
+				if(results[j].name == base[i].name)
+				{
+					r = &results[j];
+				}
+			}
+			if(!r)
+			{
+				printf("FAIL %s: workload missing\n", base[i].name.c_str());
+				failed++;
+				continue;
+			}
+			if(r->tx_per_op > base[i].tx_per_op + 0.005)
+			{
+				printf("FAIL %s: %.3f transactions/op, baseline %.3f\n", r->name.c_str(),
+					r->tx_per_op, base[i].tx_per_op);
+				failed++;
+			}
+			if(r->bytes_per_op > base[i].bytes_per_op + 0.005)
+			{
+				printf("FAIL %s: %.3f bytes/op, baseline %.3f\n", r->name.c_str(),
+					r->bytes_per_op, base[i].bytes_per_op);
+				failed++;
+			}
+			if(base[i].max_tx && r->max_tx > base[i].max_tx)
+			{
+				printf("FAIL %s: %u transactions in one operation, baseline %u\n", r->name.c_str(),
+					r->max_tx, base[i].max_tx);
+				failed++;
+			}
+			if(r->max_err_hz > base[i].max_err_hz * 1.01 + 0.000001)
+			{
+				printf("FAIL %s: max error %.6f Hz, baseline %.6f Hz\n", r->name.c_str(),
+					r->max_err_hz, base[i].max_err_hz);
+				failed++;
+			}
+		}
+		if(failed)
+		{
+			printf("%d regression(s) against %s\n", failed, check_path);
+		}
+		else
+		{
+			printf("no regressions against %s\n", check_path);
+		}
+	}
+
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,154 @@
+/*
+ * si5351_bypass.cpp - Outputs straight from the crystal with Si5351Group
+ *
+ * Copyright (C) 2015 - 2019 Jason Milldrum <milldrum@gmail.com>
+ *                           Dana H. Myers <k6jq@comcast.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Plans one device with a 25 MHz crystal for a board that needs the
+ * reference rate and two divisions of it (25, 12.5 and 3.125 MHz) next to
+ * an audio clock (12.288 and 24.576 MHz) and a radio pair (14.074 and
+ * 7.037 MHz). With the bypass turned off, the three reference rate
+ * outputs take up a PLL, and the radio pair has to run fractionally from
+ * the PLL of the audio clock. With the bypass, they run from the crystal,
+ * and the audio clock and the radio pair get an integer PLL each. The
+ * frequencies of the simulated outputs are checked in both cases, and the
+ * crystal fanout must be on only while it is used. A correction of the
+ * crystal must turn the bypass off under the default policy.
+ *
+ * Build and run on Linux from the top of the library with:
+ *
+ *   g++ -O2 -Isrc -Iextras/sim -o si5351_bypass extras/bench/si5351_bypass.cpp \
+ *       src/si5351.cpp src/si5351_group.cpp
+ *   ./si5351_bypass
+ *
+ * The program exits with status 1 if an output is off frequency, the
+ * bypass doesn't free a PLL, or the fanout or correction rules are broken.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "si5351.h"
+#include "si5351_group.h"
+#include "si5351_simbus.h"
+
+static const uint64_t freqs[] = {2500000000ULL, 1250000000ULL, 312500000ULL,
+	1228800000ULL, 2457600000ULL, 1407400000ULL, 703700000ULL};
+
+#define OUTPUTS     (sizeof(freqs) / sizeof(freqs[0]))
+
+// Plan and commit the outputs, check them against tol Hz and print a
+// summary. Returns the number of outputs off frequency.
+static int run(const char *name, Si5351Group &group, Si5351RegSim *chip, long double tol,
+	uint8_t *bypassed, uint8_t *fractional)
+{
+	struct Si5351GroupOutput o;
+	long double err, worst = 0.0L;
+	uint8_t i, plls = 0, bad = 0;
+	bool pll_used[2] = {false, false};
+
+	group.clear();
+	for(i = 0; i < OUTPUTS; i++)
+	{
+		group.add_output(freqs[i]);
+	}
+	if(group.plan() != 0 || group.commit() != 0)
+	{
+		printf("%-18s could not be planned\n", name);
+		return OUTPUTS;
+	}
+
+	*bypassed = 0;
+	for(i = 0; i < OUTPUTS; i++)
+	{
+		group.get_output(i, &o);
+		if(o.bypass)
+		{
+			(*bypassed)++;
+		}
+		else
+		{
+			pll_used[o.pll] = true;
+		}
+		err = chip->clk_freq(o.clk) - (long double)o.freq / SI5351_FREQ_MULT;
+		err = err < 0 ? -err : err;
+		worst = err > worst ? err : worst;
+		if(err > tol || !chip->clk_enabled(o.clk))
+		{
+			bad++;
+		}
+	}
+	plls = pll_used[0] + pll_used[1];
+	*fractional = OUTPUTS - *bypassed - group.integer_count();
+
+	printf("%-18s %9u %9u %11u %5u %14.6f\n", name, *bypassed, group.integer_count(), *fractional, plls,
+		(double)worst);
+	return bad;
+}
+
+int main(void)
+{
+	Si5351SimBus bus(400000UL);
+	Si5351RegSim *chip = bus.add_device(SI5351_BUS_BASE_ADDR);
+	Si5351Group group(&bus);
+	uint8_t off_bypassed, on_bypassed, corr_bypassed, off_frac, on_frac, corr_frac;
+	int bad = 0;
+
+	group.add_device(SI5351_BUS_BASE_ADDR);
+	group.init(SI5351_CRYSTAL_LOAD_8PF, 0, 0);
+
+	printf("%-18s %9s %9s %11s %5s %14s\n", "policy", "bypassed", "integer", "fractional", "PLLs",
+		"worst err Hz");
+
+	group.set_bypass(SI5351_GROUP_BYPASS_OFF);
+	bad += run("bypass off", group, chip, 0.01L, &off_bypassed, &off_frac);
+	if(chip->regs[SI5351_FANOUT_ENABLE] & SI5351_XTAL_ENABLE)
+	{
+		printf("FAIL the crystal fanout is on with nothing using it\n");
+		bad++;
+	}
+
+	group.set_bypass(SI5351_GROUP_BYPASS_EXACT);
+	bad += run("bypass exact", group, chip, 0.01L, &on_bypassed, &on_frac);
+	if(!(chip->regs[SI5351_FANOUT_ENABLE] & SI5351_XTAL_ENABLE))
+	{
+		printf("FAIL the crystal fanout is off\n");
+		bad++;
+	}
+	if(off_bypassed != 0 || on_bypassed != 3 || on_frac != 0 || off_frac == 0)
+	{
+		printf("FAIL the bypass did not free a PLL for the other outputs\n");
+		bad++;
+	}
+
+	// The simulated crystal is exact, so the corrected outputs are off by
+	// the correction
+	group.set_correction(-6190);
+	bad += run("exact, corrected", group, chip, 160.0L, &corr_bypassed, &corr_frac);
+	if(corr_bypassed != 0 || (chip->regs[SI5351_FANOUT_ENABLE] & SI5351_XTAL_ENABLE))
+	{
+		printf("FAIL outputs ran from a corrected crystal\n");
+		bad++;
+	}
+
+	if(bad)
+	{
+		printf("FAIL %d checks\n", bad);
+	}
+	return bad ? 1 : 0;
+}
@@ -0,0 +1,209 @@
+/*
+ * si5351_calibrate.cpp - Calibration with Si5351Calibrator on the simulator
+ *
+ * Copyright (C) 2015 - 2019 Jason Milldrum <milldrum@gmail.com>
+ *                           Dana H. Myers <k6jq@comcast.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Calibrates a production run of 1000 simulated boards, each with a
+ * crystal somewhere within +/-150 ppm. The counter is modelled as a
+ * reciprocal-free gated counter: the 10 MHz output is counted over a gate
+ * of 1 s or 10 s that starts at a random point of its cycle, so each
+ * reading is off by up to one count. Every board is calibrated twice,
+ * once by halving the range on the sign of each reading (what a search
+ * that ignores how far off the reading is does) and once with
+ * Si5351Calibrator. The measurements per board, the worst error of the
+ * correction found, the worst remaining error of the output (which also
+ * includes the step of the PLL, about 30 ppb) and the worst ratio of the
+ * correction error to the reported uncertainty are printed.
+ *
+ * Build and run on Linux from the top of the library with:
+ *
+ *   g++ -O2 -Isrc -Iextras/sim -o si5351_calibrate extras/bench/si5351_calibrate.cpp \
+ *       src/si5351.cpp src/si5351_calibrate.cpp
+ *   ./si5351_calibrate
+ *
+ * The program exits with status 1 if a board fails to converge, has a
+ * correction further off than its reported uncertainty plus one count, or
+ * takes more than three measurements on average.
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "si5351.h"
+#include "si5351_calibrate.h"
+#include "si5351_simbus.h"
+
+#define BOARDS          1000
+#define RANGE_PPB       150000
+#define TARGET          1000000000ULL
+
+// Simple repeatable pseudo-random sequence
+static uint32_t rng = 2468;
+
+static uint32_t next(void)
+{
+	rng = rng * 1103515245UL + 12345;
+	return rng >> 16;
+}
+
+/*
+ * A gated counter on CLK0 of a simulated board
+ */
+struct Counter
+{
+	Si5351RegSim *chip;
+	double xtal_ppb;
+	uint32_t gate_s;
+	uint32_t count;
+};
+
+static uint8_t measure(uint64_t *freq, void *ctx)
+{
+	struct Counter *c = (struct Counter *)ctx;
+	long double cycles = c->chip->clk_freq(0) * (1.0L + c->xtal_ppb * 1e-9L) * c->gate_s;
+
+	cycles = floorl(cycles + (next() % 1000) / 1000.0L);
+	*freq = (uint64_t)llroundl(cycles * SI5351_FREQ_MULT / c->gate_s);
+	c->count++;
+	return 0;
+}
+
+// Output error in ppb with the correction in place
+static double error_ppb(const struct Counter *c)
+{
+	long double f = c->chip->clk_freq(0) * (1.0L + c->xtal_ppb * 1e-9L);
+
+	return (double)((f * SI5351_FREQ_MULT - TARGET) / TARGET * 1e9L);
+}
+
+// Search on the sign of each reading alone, to one count
+static int32_t bisect(Si5351 &si, struct Counter *c, int32_t count_ppb)
+{
+	int32_t lo = -RANGE_PPB * 2, hi = RANGE_PPB * 2, mid = 0;
+	uint64_t f;
+
+	si.set_freq(TARGET, SI5351_CLK0);
+	while(hi - lo > count_ppb)
+	{
+		mid = lo + (hi - lo) / 2;
+		si.set_correction(mid, SI5351_PLL_INPUT_XO);
+		measure(&f, c);
+		if(f == TARGET)
+		{
+			break;
+		}
+		if(f > TARGET)
+		{
+			lo = mid;
+		}
+		else
+		{
+			hi = mid;
+		}
+	}
+	return mid;
+}
+
+int main(void)
+{
+	static const uint32_t gates[] = {1, 10};
+	int bad = 0;
+	size_t g;
+
+	printf("%-6s %-18s %10s %10s %10s %10s\n", "gate", "method", "meas/board", "corr ppb", "out ppb", "corr/unc");
+	for(g = 0; g < sizeof(gates) / sizeof(gates[0]); g++)
+	{
+		uint32_t bisect_meas = 0, cal_meas = 0;
+		double worst_bisect = 0.0, worst_bisect_out = 0.0, worst = 0.0, worst_out = 0.0, worst_ratio = 0.0, e;
+		int32_t count_ppb = (int32_t)(1000000000LL / (TARGET / SI5351_FREQ_MULT) / gates[g]);
+		int unconverged = 0, outside = 0;
+		int i;
+
+		for(i = 0; i < BOARDS; i++)
+		{
+			double xtal = (double)((int32_t)(next() % (2 * RANGE_PPB + 1)) - RANGE_PPB);
+			Si5351SimBus bus(400000UL);
+			struct Counter c = {bus.add_device(SI5351_BUS_BASE_ADDR), xtal, gates[g], 0};
+			Si5351 si(SI5351_BUS_BASE_ADDR, &bus);
+			Si5351Calibrator cal(&si, measure, &c);
+			struct Si5351CalResult res;
+
+			si.init(SI5351_CRYSTAL_LOAD_8PF, 0, 0);
+			e = fabs(bisect(si, &c, count_ppb) - xtal);
+			bisect_meas += c.count;
+			if(e > worst_bisect)
+			{
+				worst_bisect = e;
+			}
+			if(fabs(error_ppb(&c)) > worst_bisect_out)
+			{
+				worst_bisect_out = fabs(error_ppb(&c));
+			}
+
+			si.set_correction(0, SI5351_PLL_INPUT_XO);
+			cal.set_resolution(SI5351_FREQ_MULT / gates[g]);
+			if(cal.run(&res) != 0)
+			{
+				unconverged++;
+			}
+			cal_meas += res.measurements;
+			if(fabs(error_ppb(&c)) > worst_out)
+			{
+				worst_out = fabs(error_ppb(&c));
+			}
+			e = fabs(res.correction - xtal);
+			if(e > worst)
+			{
+				worst = e;
+			}
+			if(e / res.uncertainty > worst_ratio)
+			{
+				worst_ratio = e / res.uncertainty;
+			}
+			if(e > res.uncertainty + count_ppb)
+			{
+				outside++;
+			}
+		}
+
+		printf("%-6s %-18s %10.2f %10.1f %10.1f %10s\n", gates[g] == 1 ? "1 s" : "10 s", "sign bisection",
+			(double)bisect_meas / BOARDS, worst_bisect, worst_bisect_out, "-");
+		printf("%-6s %-18s %10.2f %10.1f %10.1f %10.2f\n", gates[g] == 1 ? "1 s" : "10 s", "Si5351Calibrator",
+			(double)cal_meas / BOARDS, worst, worst_out, worst_ratio);
+
+		if(unconverged)
+		{
+			printf("FAIL %d boards did not converge\n", unconverged);
+			bad++;
+		}
+		if(outside)
+		{
+			printf("FAIL %d boards were further off than their uncertainty\n", outside);
+			bad++;
+		}
+		if(cal_meas > 3 * BOARDS)
+		{
+			printf("FAIL more than three measurements per board\n");
+			bad++;
+		}
+	}
+
+	return bad ? 1 : 0;
+}
@@ -0,0 +1,341 @@
+/*
+ * si5351_coalesce.cpp - Si5351Coalescer on the simulator
+ *
+ * Copyright (C) 2015 - 2019 Jason Milldrum <milldrum@gmail.com>
+ *                           Dana H. Myers <k6jq@comcast.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Drives Si5351Coalescer on a simulated chip with a made-up clock that
+ * only moves when the program says so. Three cases are run:
+ *
+ *   knob      - CLK0 gets a new target every 200 us for a second, and
+ *               service() runs every 2 ms with no budget
+ *   budget    - CLK0 and CLK1 both get a new target every 100 us for a
+ *               second, and service() runs as often, with a budget of
+ *               4 bytes per millisecond and a burst of 32
+ *   priority  - a disable, an enable and frequency changes wait while the
+ *               budget is spent
+ *
+ * For each one the coalesce ratio, the worst staleness and the bus
+ * traffic are printed.
+ *
+ * Build and run on Linux from the top of the library with:
+ *
+ *   g++ -O2 -Isrc -Iextras/sim -o si5351_coalesce extras/bench/si5351_coalesce.cpp \
+ *       src/si5351.cpp src/si5351_coalesce.cpp
+ *   ./si5351_coalesce
+ *
+ * The program exits with status 1 if an output is left off its newest
+ * target after service(), a target waits longer than one service
+ * interval with no budget (or than it takes the budget to get round both
+ * outputs with one), more is charged than the budget allows or much less
+ * is written than it allows, the outputs don't get an even share, a
+ * disable waits for the budget, an enable goes out before the frequency
+ * of its output, or an output that doesn't exist is queued.
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "si5351.h"
+#include "si5351_coalesce.h"
+#include "si5351_simbus.h"
+
+#define RUN_US          1000000UL
+#define KNOB_BASE       700000000ULL
+#define KNOB_STEP       1000ULL
+#define KNOB_EVENT_US   200
+#define KNOB_SERVICE_US 2000
+#define BUDGET_RATE     4
+#define BUDGET_BURST    32
+#define BUDGET_US       100
+#define LOG_MAX         64
+
+static uint32_t now_us;
+
+static uint32_t fake_clock(void)
+{
+	return now_us;
+}
+
+/*
+ * Simulated bus and chip, counting the multisynth parameter writes of
+ * each output and logging the order of the writes
+ */
+class Watch
+{
+public:
+	Si5351SimBus sim;
+	Si5351RegSim *chip;
+	uint32_t ms_writes[SI5351_MS_COUNT];
+	uint8_t reg[LOG_MAX];
+	uint8_t data[LOG_MAX];
+	uint8_t n;
+
+	Watch(): sim(400000UL), chip(sim.add_device(SI5351_BUS_BASE_ADDR))
+	{
+		clear();
+		sim.set_observer(observe, this);
+	}
+
+	void clear(void)
+	{
+		memset(ms_writes, 0, sizeof(ms_writes));
+		n = 0;
+	}
+
+	// Position in the log of the first write to reg at or after from, or
+	// LOG_MAX if there is none
+	uint8_t find(uint8_t r, uint8_t from)
+	{
+		for(; from < n; from++)
+		{
+			if(reg[from] == r)
+			{
+				return from;
+			}
+		}
+		return LOG_MAX;
+	}
+
+private:
+	static void observe(uint8_t, uint8_t r, uint8_t len, const uint8_t *d, void *ctx)
+	{
+		Watch *w = (Watch *)ctx;
+		uint8_t c;
+
+		for(c = 0; c < SI5351_MS_COUNT; c++)
+		{
+			if(r < SI5351_CLK0_PARAMETERS + 8 * (c + 1) && r + len > SI5351_CLK0_PARAMETERS + 8 * c)
+			{
+				w->ms_writes[c]++;
+			}
+		}
+		if(w->n < LOG_MAX)
+		{
+			w->reg[w->n] = r;
+			w->data[w->n] = d[0];
+			w->n++;
+		}
+	}
+};
+
+static bool on_target(Watch &w, uint8_t clk, uint64_t want)
+{
+	return fabsl(w.chip->clk_freq(clk) - (long double)want / SI5351_FREQ_MULT) < 1.0L;
+}
+
+static void print(const char *name, Watch &w, Si5351Coalescer &tuner, uint32_t us, uint32_t bytes)
+{
+	struct Si5351CoalesceStats st;
+
+	tuner.get_stats(&st);
+	printf("%-10s %9u %8u %7.1f %11u %9u %11.2f\n", name, st.requested, st.applied,
+		st.applied ? (double)st.requested / st.applied : 0.0, st.staleness_max, st.urgent,
+		us ? (double)(w.sim.bytes_written - bytes) * 1000.0 / us : 0.0);
+}
+
+// A tuning knob far faster than the bus is asked to follow
+static int knob(Watch &w, Si5351 &si)
+{
+	Si5351Coalescer tuner(&si);
+	struct Si5351CoalesceStats st;
+	uint64_t want = 0;
+	uint32_t t, bytes = w.sim.bytes_written, services = 0;
+	int bad = 0;
+
+	now_us = 0;
+	tuner.set_clock(fake_clock);
+	for(t = 0; t < RUN_US; t += KNOB_EVENT_US)
+	{
+		now_us = t;
+		want = KNOB_BASE + KNOB_STEP * (t / KNOB_EVENT_US + 1);
+		tuner.set_freq(want, SI5351_CLK0);
+		if((t + KNOB_EVENT_US) % KNOB_SERVICE_US == 0)
+		{
+			tuner.service();
+			services++;
+			if(tuner.pending() || !on_target(w, 0, want))
+			{
+				printf("FAIL knob: CLK0 not at its newest target after service() at %u us\n", t);
+				bad++;
+				break;
+			}
+		}
+	}
+	print("knob", w, tuner, RUN_US, bytes);
+
+	tuner.get_stats(&st);
+	if(st.applied != services || st.requested != st.applied + st.coalesced)
+	{
+		printf("FAIL knob: %u requested, %u written, %u coalesced over %u service() calls\n",
+			st.requested, st.applied, st.coalesced, services);
+		bad++;
+	}
+	if(st.staleness_max > KNOB_SERVICE_US)
+	{
+		printf("FAIL knob: a target waited %u us, service() runs every %u us\n", st.staleness_max,
+			KNOB_SERVICE_US);
+		bad++;
+	}
+	return bad;
+}
+
+// Two outputs that both want more than the budget gives
+static int budget(Watch &w, Si5351 &si)
+{
+	Si5351Coalescer tuner(&si);
+	struct Si5351CoalesceStats st;
+	uint64_t want = 0;
+	uint32_t t, bytes = w.sim.bytes_written, charged, allowed;
+	uint32_t wait = 2 * SI5351_COALESCE_FREQ_COST * 1000 / BUDGET_RATE + BUDGET_US;
+	int bad = 0;
+
+	now_us = 0;
+	tuner.set_clock(fake_clock);
+	tuner.set_budget(BUDGET_RATE, BUDGET_BURST);
+	w.clear();
+	for(t = 0; t < RUN_US; t += BUDGET_US)
+	{
+		now_us = t;
+		want = KNOB_BASE + KNOB_STEP * (t / BUDGET_US + 1);
+		tuner.set_freq(want, SI5351_CLK0);
+		tuner.set_freq(want * 2, SI5351_CLK1);
+		tuner.service();
+	}
+	print("budget", w, tuner, RUN_US, bytes);
+
+	// The bucket holds a burst to begin with and refills at the rate after
+	// that, and is never left idle while there is work
+	tuner.get_stats(&st);
+	charged = st.applied * SI5351_COALESCE_FREQ_COST;
+	allowed = BUDGET_BURST + BUDGET_RATE * (RUN_US / 1000);
+	if(charged > allowed || charged + SI5351_COALESCE_FREQ_COST < allowed - BUDGET_BURST)
+	{
+		printf("FAIL budget: %u bytes charged in %lu ms, %u allowed\n", charged, RUN_US / 1000, allowed);
+		bad++;
+	}
+
+	// Whatever is still waiting goes out as the budget refills
+	while(tuner.pending() && now_us < RUN_US + wait)
+	{
+		now_us += BUDGET_US;
+		tuner.service();
+	}
+	if(tuner.pending() || !on_target(w, 0, want) || !on_target(w, 1, want * 2))
+	{
+		printf("FAIL budget: CLK0 and CLK1 not at their newest targets at the end\n");
+		bad++;
+	}
+	if(w.ms_writes[0] > w.ms_writes[1] + 1 || w.ms_writes[1] > w.ms_writes[0] + 1)
+	{
+		printf("FAIL budget: CLK0 written %u times, CLK1 %u times\n", w.ms_writes[0], w.ms_writes[1]);
+		bad++;
+	}
+	if(st.staleness_max > wait)
+	{
+		printf("FAIL budget: a target waited %u us, the budget gets round in %u us\n",
+			st.staleness_max, wait);
+		bad++;
+	}
+	return bad;
+}
+
+// A disable goes out at once; an enable waits for its frequency
+static int priority(Watch &w, Si5351 &si)
+{
+	Si5351Coalescer tuner(&si);
+	uint8_t oe, ms, i;
+	int bad = 0;
+
+	si.set_freq(1000000000ULL, SI5351_CLK0);
+	si.set_freq(1000000000ULL, SI5351_CLK1);
+	si.set_freq(1000000000ULL, SI5351_CLK2);
+	si.output_enable(SI5351_CLK1, 0);
+
+	now_us = 0;
+	tuner.set_clock(fake_clock);
+	tuner.set_budget(1, SI5351_COALESCE_FREQ_COST);
+
+	// Spend the burst
+	tuner.set_freq(1100000000ULL, SI5351_CLK0);
+	tuner.set_freq(1100000000ULL, SI5351_CLK2);
+	tuner.service();
+
+	tuner.set_freq(1200000000ULL, SI5351_CLK1);
+	tuner.output_enable(SI5351_CLK1, 1);
+	tuner.output_enable(SI5351_CLK2, 0);
+	w.clear();
+	tuner.service();
+	if(w.n != 1 || w.reg[0] != SI5351_OUTPUT_ENABLE_CTRL || !(w.data[0] & (1 << SI5351_CLK2)))
+	{
+		printf("FAIL priority: the disable of CLK2 was not the only write with the budget spent\n");
+		bad++;
+	}
+
+	w.clear();
+	for(i = 0; i < 8 && tuner.pending(); i++)
+	{
+		now_us += SI5351_COALESCE_FREQ_COST * 1000;
+		tuner.service();
+	}
+	ms = w.find(SI5351_CLK0_PARAMETERS + 8 * SI5351_CLK1, 0);
+	oe = w.find(SI5351_OUTPUT_ENABLE_CTRL, 0);
+	if(tuner.pending() || ms == LOG_MAX || oe == LOG_MAX || oe < ms || (w.data[oe] & (1 << SI5351_CLK1)))
+	{
+		printf("FAIL priority: CLK1 was not enabled after its frequency was written\n");
+		bad++;
+	}
+	if(!on_target(w, 1, 1200000000ULL) || !on_target(w, 2, 1100000000ULL) ||
+		!(w.chip->regs[SI5351_OUTPUT_ENABLE_CTRL] & (1 << SI5351_CLK2)))
+	{
+		printf("FAIL priority: CLK1 and CLK2 did not end up where they were asked to\n");
+		bad++;
+	}
+	print("priority", w, tuner, 0, 0);
+
+	// An output that doesn't exist is never queued
+	tuner.output_enable((enum si5351_clock)SI5351_CLK_COUNT, 0);
+	tuner.set_freq(1000000000ULL, (enum si5351_clock)SI5351_CLK_COUNT);
+	if(tuner.pending())
+	{
+		printf("FAIL priority: output %u was queued\n", (unsigned)SI5351_CLK_COUNT);
+		bad++;
+	}
+	return bad;
+}
+
+int main(void)
+{
+	Watch w;
+	Si5351 si(SI5351_BUS_BASE_ADDR, &w.sim);
+	int bad = 0;
+
+	si.init(SI5351_CRYSTAL_LOAD_8PF, 0, 0);
+	si.set_freq(KNOB_BASE, SI5351_CLK0);
+	si.set_freq(KNOB_BASE * 2, SI5351_CLK1);
+
+	printf("%-10s %9s %8s %7s %11s %9s %11s\n", "case", "requested", "written", "ratio",
+		"stale max", "disables", "bus B/ms");
+	bad += knob(w, si);
+	bad += budget(w, si);
+	bad += priority(w, si);
+
+	return bad ? 1 : 0;
+}
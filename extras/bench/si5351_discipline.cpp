@@ -0,0 +1,152 @@
+/*
+ * si5351_discipline.cpp - A disciplining loop with Si5351Discipline on the simulator
+ *
+ * Copyright (C) 2015 - 2019 Jason Milldrum <milldrum@gmail.com>
+ *                           Dana H. Myers <k6jq@comcast.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Plays an hour of a GPS disciplining loop at one update per second: the
+ * correction of the crystal wanders by a few ppb each second. Two
+ * simulated devices with outputs on both PLLs follow it, one with
+ * Si5351::set_correction() and one with Si5351Discipline. After every
+ * update the PLL registers of the two have to match, and the multisynths
+ * and PLL reset register of the second must not have been written. The
+ * bus traffic and time per update are printed for both, at 400 kHz.
+ *
+ * Build and run on Linux from the top of the library with:
+ *
+ *   g++ -O2 -Isrc -Iextras/sim -o si5351_discipline extras/bench/si5351_discipline.cpp \
+ *       src/si5351.cpp src/si5351_discipline.cpp
+ *   ./si5351_discipline
+ *
+ * The program exits with status 1 if the registers differ or anything
+ * besides the PLL feedback dividers is written.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "si5351.h"
+#include "si5351_discipline.h"
+#include "si5351_simbus.h"
+
+#define UPDATES     3600
+
+/*
+ * Simulated bus and chip, counting writes outside of the PLL registers
+ */
+class PllWatch
+{
+public:
+	Si5351SimBus sim;
+	Si5351RegSim *chip;
+	uint32_t other_writes;
+
+	PllWatch(): sim(400000UL), chip(sim.add_device(SI5351_BUS_BASE_ADDR)), other_writes(0)
+	{
+		sim.set_observer(observe, this);
+	}
+
+private:
+	static void observe(uint8_t, uint8_t reg, uint8_t len, const uint8_t *, void *ctx)
+	{
+		if(reg < SI5351_PLLA_PARAMETERS || reg + len > SI5351_PLLB_PARAMETERS + SI5351_PARAMETERS_LENGTH)
+		{
+			((PllWatch *)ctx)->other_writes++;
+		}
+	}
+};
+
+// Simple repeatable pseudo-random sequence
+static uint32_t rng = 12345;
+
+static int32_t wander(void)
+{
+	rng = rng * 1103515245UL + 12345;
+	return (int32_t)((rng >> 16) % 11) - 5;
+}
+
+static void setup(Si5351 &si)
+{
+	si.init(SI5351_CRYSTAL_LOAD_8PF, 0, 0);
+	si.set_freq(1000000000ULL, SI5351_CLK0);
+	si.set_freq(1420000000ULL, SI5351_CLK1);
+	si.set_ms_source(SI5351_CLK2, SI5351_PLLB);
+	si.set_freq(2500000000ULL, SI5351_CLK2);
+}
+
+int main(void)
+{
+	PllWatch plain_bus, disc_bus;
+	Si5351 plain(SI5351_BUS_BASE_ADDR, &plain_bus.sim);
+	Si5351 si(SI5351_BUS_BASE_ADDR, &disc_bus.sim);
+	Si5351Discipline disc(&si);
+	struct Si5351DisciplineStats st;
+	uint32_t plain_tx, plain_bytes, disc_tx, disc_bytes;
+	uint64_t plain_ns, disc_ns;
+	int32_t corr = 0;
+	int mismatches = 0;
+	int i;
+
+	setup(plain);
+	setup(si);
+	plain_tx = plain_bus.sim.transactions;
+	plain_bytes = plain_bus.sim.bytes_written;
+	plain_ns = plain_bus.sim.bus_time_ns;
+	disc_tx = disc_bus.sim.transactions;
+	disc_bytes = disc_bus.sim.bytes_written;
+	disc_ns = disc_bus.sim.bus_time_ns;
+	disc_bus.other_writes = 0;
+
+	for(i = 0; i < UPDATES; i++)
+	{
+		corr += wander();
+		plain.set_correction(corr, SI5351_PLL_INPUT_XO);
+		disc.set_correction(corr);
+		if(memcmp(&plain_bus.chip->regs[SI5351_PLLA_PARAMETERS], &disc_bus.chip->regs[SI5351_PLLA_PARAMETERS],
+			2 * SI5351_PARAMETERS_LENGTH) != 0)
+		{
+			mismatches++;
+		}
+	}
+
+	disc.get_stats(&st);
+	printf("%-26s %8s %10s %12s\n", "per update", "tx", "bytes", "bus us");
+	printf("%-26s %8.2f %10.2f %12.1f\n", "Si5351::set_correction()",
+		(double)(plain_bus.sim.transactions - plain_tx) / UPDATES,
+		(double)(plain_bus.sim.bytes_written - plain_bytes) / UPDATES,
+		(plain_bus.sim.bus_time_ns - plain_ns) / 1000.0 / UPDATES);
+	printf("%-26s %8.2f %10.2f %12.1f\n", "Si5351Discipline",
+		(double)(disc_bus.sim.transactions - disc_tx) / UPDATES,
+		(double)(disc_bus.sim.bytes_written - disc_bytes) / UPDATES,
+		(disc_bus.sim.bus_time_ns - disc_ns) / 1000.0 / UPDATES);
+	printf("\n%u updates, %u with nothing to write, %u PLL register bytes in %u writes\n",
+		st.updates, st.unchanged, st.bytes, st.writes);
+	printf("final correction %d ppb\n", corr);
+
+	if(mismatches)
+	{
+		printf("FAIL the PLL registers differed after %d updates\n", mismatches);
+	}
+	if(disc_bus.other_writes)
+	{
+		printf("FAIL %u writes outside of the PLL feedback registers\n", disc_bus.other_writes);
+	}
+
+	return (mismatches || disc_bus.other_writes) ? 1 : 0;
+}
@@ -0,0 +1,74 @@
+#!/bin/sh
+#
+# si5351_footprint.sh - Flash and RAM of the Si5351 class per build option
+#
+# Copyright (C) 2015 - 2019 Jason Milldrum <milldrum@gmail.com>
+#                           Dana H. Myers <k6jq@comcast.net>
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+# Compiles src/si5351.cpp once for each chip variant and each optional
+# feature, and prints the code size of the object, the size of one Si5351
+# object, which is the RAM every instance takes, and whether the build
+# calls operator new, which links the heap in. Code the application never
+# calls is left out by the linker either way, so the code column is what
+# a sketch that calls everything would carry.
+#
+# Run from the top of the library with:
+#
+#   sh extras/bench/si5351_footprint.sh
+#
+# The host compiler is used by default. For the real numbers of a part,
+# point it at its toolchain, for example:
+#
+#   CXX=avr-g++ SIZE=avr-size NM=avr-nm CXXFLAGS="-mmcu=atmega328p -Os" \
+#       sh extras/bench/si5351_footprint.sh
+
+CXX=${CXX:-g++}
+SIZE=${SIZE:-size}
+NM=${NM:-nm}
+CXXFLAGS=${CXXFLAGS:--Os}
+TMP=${TMPDIR:-/tmp}/si5351_footprint.$$
+
+mkdir -p "$TMP" || exit 1
+trap 'rm -rf "$TMP"' EXIT
+
+printf '#include "si5351.h"\nchar si5351_footprint_probe[sizeof(Si5351)];\n' > "$TMP/probe.cpp"
+
+# Print one row: a name, then the compiler flags of the build
+footprint()
+{
+	name=$1
+	shift
+	$CXX $CXXFLAGS -ffunction-sections -fdata-sections -Isrc "$@" -c src/si5351.cpp -o "$TMP/si5351.o" || exit 1
+	$CXX $CXXFLAGS -Isrc "$@" -c "$TMP/probe.cpp" -o "$TMP/probe.o" || exit 1
+	code=$($SIZE "$TMP/si5351.o" | awk 'NR == 2 { print $1 + $2 }')
+	ram=$($NM -S -t d "$TMP/probe.o" | awk '/si5351_footprint_probe/ { print $2 + 0 }')
+	heap=$($NM -u -C "$TMP/si5351.o" | grep -q 'operator new' && echo yes || echo no)
+	printf '%-32s %8s %8s %6s\n' "$name" "$code" "$ram" "$heap"
+}
+
+printf '%-32s %8s %8s %6s\n' "build" "code" "object" "heap"
+footprint "all variants"
+footprint "Si5351A (8 outputs)" -DSI5351_VARIANT=SI5351_VARIANT_A
+footprint "Si5351A MSOP10" -DSI5351_VARIANT=SI5351_VARIANT_A3
+footprint "Si5351B" -DSI5351_VARIANT=SI5351_VARIANT_B
+footprint "Si5351C" -DSI5351_VARIANT=SI5351_VARIANT_C
+footprint "SI5351_COMPACT" -DSI5351_COMPACT
+footprint "SI5351_COMPACT + SI5351_STATUS" -DSI5351_COMPACT -DSI5351_STATUS
+footprint "SI5351_COMPACT, Si5351A MSOP10" -DSI5351_COMPACT -DSI5351_VARIANT=SI5351_VARIANT_A3
+footprint "SI5351_STATS" -DSI5351_STATS
+footprint "SI5351_TRACE" -DSI5351_TRACE
+footprint "SI5351_RESOLUTION_HZ" -DSI5351_RESOLUTION=SI5351_RESOLUTION_HZ
+footprint "SI5351_RESOLUTION_MICRO" -DSI5351_RESOLUTION=SI5351_RESOLUTION_MICRO
@@ -0,0 +1,248 @@
+/*
+ * si5351_phase.cpp - Quadrature tuning with Si5351PhasePlan on the simulator
+ *
+ * Copyright (C) 2015 - 2019 Jason Milldrum <milldrum@gmail.com>
+ *                           Dana H. Myers <k6jq@comcast.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Tunes an I/Q pair (CLK0 at 0 degrees, CLK1 at 90) across the 40 m and
+ * 20 m bands, first the way the si5351_phase example does it (an even
+ * divider worked out for every step, set_freq_manual() on both outputs,
+ * the phase word and a PLL reset), and then with Si5351PhasePlan. After
+ * every step the simulated registers are decoded, and the frequencies and
+ * the phase between the outputs are checked. A three-phase set at 0, 120
+ * and 240 degrees is also planned once, to show the inversion and the
+ * phase error report.
+ *
+ * The manual way goes wrong at the bottom of 40 m, where the largest even
+ * divider is 128 and so is the 90 degree offset, one more than the 7-bit
+ * phase register holds.
+ *
+ * Build and run on Linux from the top of the library with:
+ *
+ *   g++ -O2 -Isrc -Iextras/sim -o si5351_phase extras/bench/si5351_phase.cpp \
+ *       src/si5351.cpp src/si5351_phase.cpp
+ *   ./si5351_phase
+ *
+ * The program exits with status 1 if a step of the planner lands on the
+ * wrong frequency or phase, or if it resets the PLL more than once per
+ * band.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "si5351.h"
+#include "si5351_phase.h"
+#include "si5351_simbus.h"
+
+/*
+ * Simulated bus and chip, counting PLL resets
+ */
+class ResetWatch
+{
+public:
+	Si5351SimBus sim;
+	Si5351RegSim *chip;
+	uint32_t resets;
+
+	ResetWatch(): sim(400000UL), chip(sim.add_device(SI5351_BUS_BASE_ADDR)), resets(0)
+	{
+		sim.set_observer(observe, this);
+	}
+
+private:
+	static void observe(uint8_t, uint8_t reg, uint8_t len, const uint8_t *data, void *ctx)
+	{
+		if(reg <= SI5351_PLL_RESET && reg + len > SI5351_PLL_RESET && data[SI5351_PLL_RESET - reg])
+		{
+			((ResetWatch *)ctx)->resets++;
+		}
+	}
+};
+
+struct Band
+{
+	const char *name;
+	uint64_t lo;
+	uint64_t hi;
+	uint64_t step;
+};
+
+static const struct Band bands[] = {
+	{"40 m", 700000000ULL, 730000000ULL, 100000ULL},
+	{"20 m", 1400000000ULL, 1435000000ULL, 500000ULL},
+};
+
+#define BANDS       (sizeof(bands) / sizeof(bands[0]))
+
+// Phase of an integer-mode output in degrees, from the registers
+static double phase_of(const Si5351RegSim *chip, int clk)
+{
+	const uint8_t *ms = &chip->regs[SI5351_CLK0_PARAMETERS + clk * 8];
+	uint32_t p1 = ((uint32_t)(ms[2] & 0x03) << 16) | ((uint32_t)ms[3] << 8) | ms[4];
+	double div = (p1 + 512) / 128.0;
+	double deg = (chip->regs[SI5351_CLK0_PHASE_OFFSET + clk] & 0x7F) * 90.0 / div;
+
+	if(chip->regs[SI5351_CLK0_CTRL + clk] & SI5351_CLK_INVERT)
+	{
+		deg += 180.0;
+	}
+	return deg;
+}
+
+// Check the outputs after a step, and count the bad ones
+static int check(const Si5351RegSim *chip, uint64_t freq, const int *clks, const double *want, int n, double tol)
+{
+	long double f = (long double)freq / SI5351_FREQ_MULT;
+	double d;
+	int i, bad = 0;
+
+	for(i = 0; i < n; i++)
+	{
+		if(chip->clk_freq(clks[i]) - f > 1 || f - chip->clk_freq(clks[i]) > 1)
+		{
+			bad++;
+			continue;
+		}
+		d = phase_of(chip, clks[i]) - phase_of(chip, clks[0]) - (want[i] - want[0]);
+		while(d > 180.0)
+		{
+			d -= 360.0;
+		}
+		while(d < -180.0)
+		{
+			d += 360.0;
+		}
+		if(d > tol || d < -tol)
+		{
+			bad++;
+		}
+	}
+	return bad;
+}
+
+int main(void)
+{
+	static const int iq_clks[] = {0, 1};
+	static const double iq_deg[] = {0.0, 90.0};
+	static const int three_clks[] = {0, 1, 2};
+	static const double three_deg[] = {0.0, 120.0, 240.0};
+	struct Si5351PhaseStats st;
+	int bad = 0, failed = 0, wrong;
+	size_t b;
+
+	printf("%-22s %6s %6s %8s %8s %10s\n", "case", "steps", "wrong", "resets", "tx/step", "bus us");
+
+	// The manual way, as in the si5351_phase example
+	{
+		ResetWatch bus;
+		Si5351 si(SI5351_BUS_BASE_ADDR, &bus.sim);
+		uint32_t steps = 0, tx;
+		uint64_t ns;
+
+		si.init(SI5351_CRYSTAL_LOAD_8PF, 0, 0);
+		wrong = 0;
+		bus.resets = 0;
+		tx = bus.sim.transactions;
+		ns = bus.sim.bus_time_ns;
+		for(b = 0; b < BANDS; b++)
+		{
+			for(uint64_t f = bands[b].lo; f <= bands[b].hi; f += bands[b].step)
+			{
+				uint64_t div = (SI5351_PLL_VCO_MAX * SI5351_FREQ_MULT / f) & ~1ULL;
+
+				si.set_freq_manual(f, f * div, SI5351_CLK0);
+				si.set_freq_manual(f, f * div, SI5351_CLK1);
+				si.set_phase(SI5351_CLK0, 0);
+				si.set_phase(SI5351_CLK1, (uint8_t)div);
+				si.pll_reset(SI5351_PLLA);
+				wrong += check(bus.chip, f, iq_clks, iq_deg, 2, 0.01) ? 1 : 0;
+				steps++;
+			}
+		}
+		printf("%-22s %6u %6d %8u %8.1f %10.1f\n", "I/Q, manual", steps, wrong, bus.resets,
+			(double)(bus.sim.transactions - tx) / steps, (bus.sim.bus_time_ns - ns) / 1000.0);
+	}
+
+	// The same with the planner
+	{
+		ResetWatch bus;
+		Si5351 si(SI5351_BUS_BASE_ADDR, &bus.sim);
+		Si5351PhasePlan iq(&si);
+		uint32_t steps = 0, tx;
+		uint64_t ns;
+
+		si.init(SI5351_CRYSTAL_LOAD_8PF, 0, 0);
+		iq.add_output(SI5351_CLK0, 0);
+		iq.add_output(SI5351_CLK1, 90);
+		wrong = 0;
+		bus.resets = 0;
+		tx = bus.sim.transactions;
+		ns = bus.sim.bus_time_ns;
+		for(b = 0; b < BANDS; b++)
+		{
+			iq.set_band(bands[b].lo, bands[b].hi);
+			for(uint64_t f = bands[b].lo; f <= bands[b].hi; f += bands[b].step)
+			{
+				if(iq.set_freq(f) != 0 || check(bus.chip, f, iq_clks, iq_deg, 2, 0.01))
+				{
+					wrong++;
+				}
+				steps++;
+			}
+		}
+		failed += wrong;
+		iq.get_stats(&st);
+		printf("%-22s %6u %6d %8u %8.1f %10.1f\n", "I/Q, Si5351PhasePlan", steps, wrong, bus.resets,
+			(double)(bus.sim.transactions - tx) / steps, (bus.sim.bus_time_ns - ns) / 1000.0);
+		printf("  %u retunes rewrote only the PLL, %u needed a new divider\n", st.pll_only, st.replans);
+		if(bus.resets > BANDS)
+		{
+			printf("FAIL the planner reset the PLL %u times over %u bands\n", bus.resets, (unsigned)BANDS);
+			bad++;
+		}
+	}
+
+	// Three phases 120 degrees apart
+	{
+		ResetWatch bus;
+		Si5351 si(SI5351_BUS_BASE_ADDR, &bus.sim);
+		Si5351PhasePlan tri(&si);
+
+		si.init(SI5351_CRYSTAL_LOAD_8PF, 0, 0);
+		tri.add_output(SI5351_CLK0, 0);
+		tri.add_output(SI5351_CLK1, 120);
+		tri.add_output(SI5351_CLK2, 240);
+		if(tri.set_freq(1000000000ULL) != 0)
+		{
+			failed++;
+		}
+		failed += check(bus.chip, 1000000000ULL, three_clks, three_deg, 3, tri.phase_error() / 100.0 + 0.01);
+		printf("\nthree-phase at 10 MHz: divider %u, phase error %.2f degrees, CLK2 %s\n",
+			tri.get_divider(), tri.phase_error() / 100.0,
+			(bus.chip->regs[SI5351_CLK2_CTRL] & SI5351_CLK_INVERT) ? "inverted" : "not inverted");
+	}
+
+	if(failed)
+	{
+		printf("FAIL %d planned steps ended up at the wrong frequency or phase\n", failed);
+		bad++;
+	}
+
+	return bad ? 1 : 0;
+}
@@ -0,0 +1,261 @@
+/*
+ * si5351_pingpong.cpp - Output disturbance of large jumps on the simulator
+ *
+ * Copyright (C) 2015 - 2019 Jason Milldrum <milldrum@gmail.com>
+ *                           Dana H. Myers <k6jq@comcast.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Compares set_freq() with set_freq_pingpong() on jumps that need a new
+ * VCO frequency. After every register write the simulated registers are
+ * decoded, and an output counts as disturbed while it is at neither its
+ * old nor its new frequency, or when the PLL it runs from is reset. The
+ * dead time of a jump is the bus time from the start of the first
+ * disturbing write to the end of the last one, at 400 kHz.
+ *
+ * Two cases are run: CLK0 alone jumping between frequencies above
+ * 100 MHz, and a single jump of CLK0 while CLK1 and CLK2 run from the
+ * same PLL below 100 MHz.
+ *
+ * Build and run on Linux from the top of the library with:
+ *
+ *   g++ -O2 -Isrc -Iextras/sim -o si5351_pingpong extras/bench/si5351_pingpong.cpp \
+ *       src/si5351.cpp
+ *   ./si5351_pingpong
+ *
+ * The program exits with status 1 if set_freq_pingpong() fails, lands on
+ * the wrong frequency, disturbs another output, or has a dead time that
+ * isn't shorter than that of set_freq().
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "si5351.h"
+#include "si5351_simbus.h"
+
+static const uint64_t jumps[] = {112000000ULL, 146000000ULL, 175000000ULL,
+	200000000ULL, 125000000ULL, 160000000ULL, 220000000ULL, 104000000ULL};
+
+#define JUMPS       (sizeof(jumps) / sizeof(jumps[0]))
+
+/*
+ * Simulated bus and chip, with the outputs looked at after every write of
+ * the jump being watched. Reads don't change the outputs.
+ */
+class Watch
+{
+public:
+	Si5351SimBus sim;
+	Si5351RegSim *chip;
+
+	// Outputs to watch, and what they are expected to be before and after
+	uint8_t mask;
+	long double before[8];
+	long double after[8];
+
+	// Results for the jump being watched
+	uint32_t start_tx;
+	uint32_t dead_tx;
+	uint64_t dead_start_ns;
+	uint64_t dead_end_ns;
+	uint8_t hit;
+
+	Watch(): sim(400000UL), chip(sim.add_device(SI5351_BUS_BASE_ADDR)), mask(0)
+	{
+		sim.set_observer(observe, this);
+	}
+
+	void watch(uint8_t m)
+	{
+		mask = m;
+		start_tx = sim.transactions;
+		dead_tx = 0;
+		dead_start_ns = 0;
+		dead_end_ns = 0;
+		hit = 0;
+		for(int clk = 0; clk < 8; clk++)
+		{
+			before[clk] = chip->clk_freq(clk);
+			after[clk] = before[clk];
+		}
+	}
+
+private:
+	static bool near(long double a, long double b)
+	{
+		return a - b < 0.5 && b - a < 0.5;
+	}
+
+	static void observe(uint8_t, uint8_t reg, uint8_t len, const uint8_t *data, void *ctx)
+	{
+		uint8_t reset = (reg <= SI5351_PLL_RESET && reg + len > SI5351_PLL_RESET) ?
+			data[SI5351_PLL_RESET - reg] : 0;
+
+		((Watch *)ctx)->look(reset);
+	}
+
+	void look(uint8_t reset)
+	{
+		bool dead = false;
+
+		for(int clk = 0; clk < 8; clk++)
+		{
+			long double f;
+			uint8_t pll_bit;
+
+			if(!(mask & (1 << clk)))
+			{
+				continue;
+			}
+			f = chip->clk_freq(clk);
+			pll_bit = (chip->regs[SI5351_CLK0_CTRL + clk] & SI5351_CLK_PLL_SELECT) ?
+				SI5351_PLL_RESET_B : SI5351_PLL_RESET_A;
+			if((reset & pll_bit) || (!near(f, before[clk]) && !near(f, after[clk])))
+			{
+				hit |= 1 << clk;
+				dead = true;
+			}
+		}
+		if(dead)
+		{
+			if(dead_tx == 0)
+			{
+				dead_start_ns = sim.start_ns;
+			}
+			dead_end_ns = sim.bus_time_ns;
+			dead_tx++;
+		}
+	}
+};
+
+struct Totals
+{
+	uint32_t jumps;
+	uint32_t tx;
+	uint32_t dead_tx;
+	uint64_t bus_ns;
+	uint64_t dead_ns;
+	uint64_t worst_dead_ns;
+	uint8_t hit;
+	int failed;
+};
+
+// Jump CLK0 to freq and add up what it cost
+static void jump(Watch &bus, Si5351 &si, bool pingpong, uint64_t freq, uint8_t mask, struct Totals *t)
+{
+	uint64_t start = bus.sim.bus_time_ns;
+	uint64_t dead;
+	uint8_t ret;
+
+	bus.watch(mask);
+	bus.after[0] = (long double)freq / SI5351_FREQ_MULT;
+	ret = pingpong ? si.set_freq_pingpong(freq, SI5351_CLK0) : si.set_freq(freq, SI5351_CLK0);
+	if(ret != 0 || !(bus.chip->clk_freq(0) - bus.after[0] < 1 && bus.after[0] - bus.chip->clk_freq(0) < 1))
+	{
+		t->failed++;
+	}
+
+	dead = bus.dead_tx ? bus.dead_end_ns - bus.dead_start_ns : 0;
+	t->jumps++;
+	t->tx += bus.sim.transactions - bus.start_tx;
+	t->dead_tx += bus.dead_tx;
+	t->bus_ns += bus.sim.bus_time_ns - start;
+	t->dead_ns += dead;
+	if(dead > t->worst_dead_ns)
+	{
+		t->worst_dead_ns = dead;
+	}
+	t->hit |= bus.hit;
+}
+
+// CLK0 alone, jumping around above 100 MHz
+static struct Totals run_alone(bool pingpong)
+{
+	Watch bus;
+	Si5351 si(SI5351_BUS_BASE_ADDR, &bus.sim);
+	struct Totals t = {};
+
+	si.init(SI5351_CRYSTAL_LOAD_8PF, 0, 0);
+	si.set_freq(jumps[0] * SI5351_FREQ_MULT, SI5351_CLK0);
+	for(int rep = 0; rep < 10; rep++)
+	{
+		for(size_t i = 1; i < JUMPS; i++)
+		{
+			jump(bus, si, pingpong, jumps[i] * SI5351_FREQ_MULT, 0x01, &t);
+		}
+	}
+
+	return t;
+}
+
+// One jump of CLK0 with CLK1 and CLK2 on the same PLL
+static struct Totals run_shared(bool pingpong)
+{
+	Watch bus;
+	Si5351 si(SI5351_BUS_BASE_ADDR, &bus.sim);
+	struct Totals t = {};
+
+	si.init(SI5351_CRYSTAL_LOAD_8PF, 0, 0);
+	si.set_freq(jumps[0] * SI5351_FREQ_MULT, SI5351_CLK0);
+	si.set_freq(1000000000ULL, SI5351_CLK1);
+	si.set_freq(1420000000ULL, SI5351_CLK2);
+	jump(bus, si, pingpong, jumps[1] * SI5351_FREQ_MULT, 0x07, &t);
+
+	return t;
+}
+
+static void print(const char *name, const struct Totals &t)
+{
+	printf("%-20s %5u %8.1f %10.1f %9.1f %12.1f %13.1f   %s%s%s\n", name, t.jumps,
+		(double)t.tx / t.jumps, t.bus_ns / 1000.0 / t.jumps, (double)t.dead_tx / t.jumps,
+		t.dead_ns / 1000.0 / t.jumps, t.worst_dead_ns / 1000.0,
+		(t.hit & 0x01) ? "CLK0 " : "", (t.hit & 0x02) ? "CLK1 " : "", (t.hit & 0x04) ? "CLK2" : "");
+}
+
+int main(void)
+{
+	struct Totals a_reset = run_alone(false);
+	struct Totals a_pp = run_alone(true);
+	struct Totals s_reset = run_shared(false);
+	struct Totals s_pp = run_shared(true);
+	int bad = 0;
+
+	printf("%-20s %5s %8s %10s %9s %12s %13s   %s\n", "case", "jumps", "tx/jump", "bus us",
+		"dead tx", "dead us", "worst dead us", "disturbed");
+	print("alone, set_freq", a_reset);
+	print("alone, pingpong", a_pp);
+	print("shared, set_freq", s_reset);
+	print("shared, pingpong", s_pp);
+
+	if(a_pp.failed || s_pp.failed)
+	{
+		printf("FAIL set_freq_pingpong() did not reach the requested frequency\n");
+		bad++;
+	}
+	if(s_pp.hit & 0x06)
+	{
+		printf("FAIL set_freq_pingpong() disturbed an output it should leave alone\n");
+		bad++;
+	}
+	if(a_pp.worst_dead_ns >= a_reset.worst_dead_ns || s_pp.worst_dead_ns >= s_reset.worst_dead_ns)
+	{
+		printf("FAIL set_freq_pingpong() is not quicker to switch than set_freq()\n");
+		bad++;
+	}
+
+	return bad ? 1 : 0;
+}
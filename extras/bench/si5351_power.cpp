@@ -0,0 +1,199 @@
+/*
+ * si5351_power.cpp - Power management with Si5351Power on the simulator
+ *
+ * Copyright (C) 2015 - 2019 Jason Milldrum <milldrum@gmail.com>
+ *                           Dana H. Myers <k6jq@comcast.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Sets up a board with a 10 MHz output into 15 pF on CLK0, a 50 MHz one
+ * into 5 pF on CLK2, the crystal passed through on CLK6, and CLK1 set up
+ * once and then disabled. Everything else is left as reset() leaves it,
+ * powered up and disabled, and the MS0/MS4 fanout is on as at power up.
+ * Si5351Power must power down the drivers of the five unused outputs,
+ * turn off the MS0/MS4 fanout and turn on the crystal fanout, and pick
+ * 4 mA for CLK0 and 6 mA for CLK2. The same changes made by hand with
+ * set_clock_pwr(), drive_strength() and set_clock_fanout() are shown for
+ * comparison. A second apply() must write nothing, and sleep() followed
+ * by resume() must leave every register as it was, with the outputs
+ * back on the same frequencies.
+ *
+ * Build and run on Linux from the top of the library with:
+ *
+ *   g++ -O2 -Isrc -Iextras/sim -o si5351_power extras/bench/si5351_power.cpp \
+ *       src/si5351.cpp src/si5351_power.cpp
+ *   ./si5351_power
+ *
+ * The program exits with status 1 if an output is powered or driven the
+ * wrong way, or if sleep and resume don't bring the same state back.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "si5351.h"
+#include "si5351_power.h"
+#include "si5351_simbus.h"
+
+// Outputs that have to stay powered
+#define POWERED     ((1 << 0) | (1 << 2) | (1 << 6))
+
+static void setup(Si5351 &si)
+{
+	si.init(SI5351_CRYSTAL_LOAD_8PF, 0, 0);
+	si.set_clock_fanout(SI5351_FANOUT_MS, 1);
+	si.set_freq(1000000000ULL, SI5351_CLK0);
+	si.set_freq(1200000000ULL, SI5351_CLK1);
+	si.output_enable(SI5351_CLK1, 0);
+	si.set_freq(5000000000ULL, SI5351_CLK2);
+	si.set_clock_source(SI5351_CLK6, SI5351_CLK_SRC_XTAL);
+	si.output_enable(SI5351_CLK6, 1);
+}
+
+// Number of powered up output drivers
+static int powered(const Si5351RegSim *chip)
+{
+	int c, n = 0;
+
+	for(c = 0; c < 8; c++)
+	{
+		if(!(chip->regs[SI5351_CLK0_CTRL + c] & SI5351_CLK_POWERDOWN))
+		{
+			n++;
+		}
+	}
+	return n;
+}
+
+int main(void)
+{
+	Si5351SimBus hand_bus(400000UL), bus(400000UL);
+	Si5351RegSim *hand_chip = hand_bus.add_device(SI5351_BUS_BASE_ADDR);
+	Si5351RegSim *chip = bus.add_device(SI5351_BUS_BASE_ADDR);
+	Si5351 hand(SI5351_BUS_BASE_ADDR, &hand_bus);
+	Si5351 si(SI5351_BUS_BASE_ADDR, &bus);
+	Si5351Power pwr(&si);
+	uint8_t before[256];
+	double f0, f2, f6;
+	uint32_t tx, bytes;
+	int c, before_on, bad = 0;
+
+	// By hand
+	setup(hand);
+	tx = hand_bus.transactions;
+	bytes = hand_bus.bytes_written;
+	for(c = 0; c < 8; c++)
+	{
+		if(!(POWERED & (1 << c)))
+		{
+			hand.set_clock_pwr((enum si5351_clock)c, 0);
+		}
+	}
+	hand.drive_strength(SI5351_CLK0, SI5351_DRIVE_4MA);
+	hand.drive_strength(SI5351_CLK2, SI5351_DRIVE_6MA);
+	hand.set_clock_fanout(SI5351_FANOUT_MS, 0);
+	hand.set_clock_fanout(SI5351_FANOUT_XO, 1);
+	printf("%-22s %8s %10s\n", "", "tx", "bytes");
+	printf("%-22s %8u %10u\n", "by hand", hand_bus.transactions - tx, hand_bus.bytes_written - bytes);
+
+	// With Si5351Power
+	setup(si);
+	before_on = powered(chip);
+	pwr.set_load(SI5351_CLK0, 15);
+	pwr.set_load(SI5351_CLK2, 5);
+	tx = bus.transactions;
+	bytes = bus.bytes_written;
+	pwr.apply();
+	printf("%-22s %8u %10u\n", "Si5351Power::apply()", bus.transactions - tx, bus.bytes_written - bytes);
+	printf("\n%d output drivers powered before, %d after\n", before_on, powered(chip));
+
+	for(c = 0; c < 8; c++)
+	{
+		if(!(chip->regs[SI5351_CLK0_CTRL + c] & SI5351_CLK_POWERDOWN) != !!(POWERED & (1 << c)))
+		{
+			printf("FAIL CLK%d is powered %s\n", c, (POWERED & (1 << c)) ? "down" : "up");
+			bad++;
+		}
+	}
+	if((chip->regs[SI5351_CLK0_CTRL] & SI5351_CLK_DRIVE_STRENGTH_MASK) != SI5351_CLK_DRIVE_STRENGTH_4MA ||
+		(chip->regs[SI5351_CLK2_CTRL] & SI5351_CLK_DRIVE_STRENGTH_MASK) != SI5351_CLK_DRIVE_STRENGTH_6MA)
+	{
+		printf("FAIL wrong drive strengths\n");
+		bad++;
+	}
+	if(chip->regs[SI5351_FANOUT_ENABLE] != SI5351_XTAL_ENABLE)
+	{
+		printf("FAIL fanout enables are 0x%02X\n", chip->regs[SI5351_FANOUT_ENABLE]);
+		bad++;
+	}
+	if(memcmp(&chip->regs[SI5351_CLK0_CTRL], &hand_chip->regs[SI5351_CLK0_CTRL], 8) != 0 ||
+		chip->regs[SI5351_FANOUT_ENABLE] != hand_chip->regs[SI5351_FANOUT_ENABLE])
+	{
+		printf("FAIL the registers differ from the ones set by hand\n");
+		bad++;
+	}
+
+	tx = bus.transactions;
+	if(pwr.apply() != 0)
+	{
+		printf("FAIL a second apply() wrote to the device\n");
+		bad++;
+	}
+
+	// Sleep and wake up
+	memcpy(before, chip->regs, sizeof(before));
+	f0 = (double)chip->clk_freq(0);
+	f2 = (double)chip->clk_freq(2);
+	f6 = (double)chip->clk_freq(6);
+	tx = bus.transactions;
+	bytes = bus.bytes_written;
+	pwr.sleep();
+	printf("sleep():  %u tx, %u bytes, %d output drivers powered\n",
+		bus.transactions - tx, bus.bytes_written - bytes, powered(chip));
+	for(c = 0; c < 8; c++)
+	{
+		if(chip->clk_enabled(c))
+		{
+			printf("FAIL CLK%d is still on while asleep\n", c);
+			bad++;
+		}
+	}
+	if(chip->regs[SI5351_FANOUT_ENABLE] & (SI5351_CLKIN_ENABLE | SI5351_XTAL_ENABLE | SI5351_MULTISYNTH_ENABLE))
+	{
+		printf("FAIL a fanout is on while asleep\n");
+		bad++;
+	}
+
+	tx = bus.transactions;
+	bytes = bus.bytes_written;
+	pwr.resume();
+	printf("resume(): %u tx, %u bytes, %d output drivers powered\n",
+		bus.transactions - tx, bus.bytes_written - bytes, powered(chip));
+	if(memcmp(before, chip->regs, sizeof(before)) != 0)
+	{
+		printf("FAIL the registers differ after resume()\n");
+		bad++;
+	}
+	if(!chip->clk_enabled(0) || !chip->clk_enabled(2) || !chip->clk_enabled(6) ||
+		(double)chip->clk_freq(0) != f0 || (double)chip->clk_freq(2) != f2 || (double)chip->clk_freq(6) != f6)
+	{
+		printf("FAIL the outputs didn't come back\n");
+		bad++;
+	}
+
+	return bad ? 1 : 0;
+}
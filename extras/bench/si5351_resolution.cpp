@@ -0,0 +1,309 @@
+/*
+ * si5351_resolution.cpp - set_freq() and set_freq_native() per resolution policy
+ *
+ * Copyright (C) 2015 - 2019 Jason Milldrum <milldrum@gmail.com>
+ *                           Dana H. Myers <k6jq@comcast.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Tunes CLK0 through three workloads: a 40 m VFO in 10 Hz steps, and the
+ * four WSPR tones (1.4648 Hz apart) on 20 m and on 2200 m. Each frequency
+ * is given once to set_freq() in Hz * 100 and once to set_freq_native()
+ * in the unit of the SI5351_RESOLUTION the program was built with. The
+ * time per call is measured on the simulated bus. The writes of one pass
+ * are logged through the bus observer and replayed on their own, along
+ * with as many one-register reads as the pass made, and the time that
+ * takes is subtracted, so what is left is the calculation. It is given
+ * in nanoseconds and, on x86, in TSC cycles. The
+ * worst error from the wanted frequency is taken from the registers of a
+ * simulated chip.
+ *
+ * Build and run on Linux from the top of the library, once per policy:
+ *
+ *   for r in HZ CENTI MICRO; do
+ *     g++ -O2 -DSI5351_RESOLUTION=SI5351_RESOLUTION_$r -Isrc -Iextras/sim \
+ *         -o si5351_resolution extras/bench/si5351_resolution.cpp src/si5351.cpp &&
+ *     ./si5351_resolution
+ *   done
+ *
+ * The program exits with status 1 if the two paths program different
+ * registers for a frequency both can express (every 40 m VFO step), with
+ * the PLL at its usual 800 MHz or at 800 MHz + 0.5 Hz.
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <chrono>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC
+#endif
+
+#include "si5351.h"
+#include "si5351_simbus.h"
+
+#define REPEAT          5
+#define WSPR_SPACING    (12000.0L / 8192.0L)
+#define WSPR_SYMBOLS    4096
+
+#if SI5351_RESOLUTION == SI5351_RESOLUTION_HZ
+#define POLICY          "SI5351_RESOLUTION_HZ (1 Hz, uint32_t)"
+#elif SI5351_RESOLUTION == SI5351_RESOLUTION_MICRO
+#define POLICY          "SI5351_RESOLUTION_MICRO (1 uHz, uint64_t)"
+#else
+#define POLICY          "SI5351_RESOLUTION_CENTI (0.01 Hz, uint64_t)"
+#endif
+
+struct Workload
+{
+	const char *name;
+	long double base;
+	long double step;
+	uint32_t count;
+	uint8_t wspr;
+};
+
+static const struct Workload workloads[] =
+{
+	{"vfo_40m", 7000000.0L, 10.0L, 30001, 0},
+	{"wspr_20m", 14097100.0L, WSPR_SPACING, WSPR_SYMBOLS, 1},
+	{"wspr_2200m", 137500.0L, WSPR_SPACING, WSPR_SYMBOLS, 1}
+};
+
+// Wanted frequency of call n, in Hz
+static long double target(const struct Workload *w, uint32_t n)
+{
+	if(w->wspr)
+	{
+		return w->base + w->step * ((n * 7 + n / 3) % 4);
+	}
+	return w->base + w->step * n;
+}
+
+static uint64_t to_centi(long double hz)
+{
+	return (uint64_t)llroundl(hz * SI5351_FREQ_MULT);
+}
+
+static si5351_freq_t to_native(long double hz)
+{
+	return (si5351_freq_t)llroundl(hz * SI5351_RES_MULT);
+}
+
+// Bus observer that appends each write to a log as register, length, data
+static void record(uint8_t, uint8_t reg, uint8_t len, const uint8_t *data, void *ctx)
+{
+	std::vector<uint8_t> *log = (std::vector<uint8_t> *)ctx;
+
+	log->push_back(reg);
+	log->push_back(len);
+	log->insert(log->end(), data, data + len);
+}
+
+// Best of REPEAT runs of a workload through one path, in ns and cycles
+// per call, less the time the same writes take on the bus by themselves
+static void time_path(const struct Workload *w, bool native, double *ns, double *cycles)
+{
+	Si5351SimBus bus(400000UL);
+	Si5351 si(SI5351_BUS_BASE_ADDR, &bus);
+	uint64_t centi[WSPR_SYMBOLS > 30001 ? WSPR_SYMBOLS : 30001];
+	si5351_freq_t res[WSPR_SYMBOLS > 30001 ? WSPR_SYMBOLS : 30001];
+	std::vector<uint8_t> log;
+	double bus_ns = 1e30, bus_cycles = 0;
+	uint32_t n, tx, reads = 0;
+	uint8_t reg;
+	size_t i;
+	int r, pass;
+
+	bus.add_device(SI5351_BUS_BASE_ADDR);
+	si.init(SI5351_CRYSTAL_LOAD_8PF, 0, 0);
+	for(n = 0; n < w->count; n++)
+	{
+		centi[n] = to_centi(target(w, n));
+		res[n] = to_native(target(w, n));
+	}
+
+	// One pass to reach the steady state, and one to log its writes
+	for(pass = 0; pass < 2; pass++)
+	{
+		bus.set_observer(pass ? record : NULL, &log);
+		tx = bus.transactions;
+		for(n = 0; n < w->count; n++)
+		{
+			if(native)
+			{
+				si.set_freq_native(res[n], SI5351_CLK0);
+			}
+			else
+			{
+				si.set_freq(centi[n], SI5351_CLK0);
+			}
+		}
+	}
+	bus.set_observer(NULL);
+	for(i = 0; i < log.size(); i += 2 + log[i + 1])
+	{
+		tx++;
+	}
+	reads = (bus.transactions - tx) / bus.read_transactions();
+
+	*ns = 1e30;
+	*cycles = 0;
+	for(r = 0; r < REPEAT; r++)
+	{
+		auto t0 = std::chrono::steady_clock::now();
+#if defined(HAVE_TSC)
+		uint64_t c0 = __rdtsc();
+#endif
+		for(n = 0; n < w->count; n++)
+		{
+			if(native)
+			{
+				si.set_freq_native(res[n], SI5351_CLK0);
+			}
+			else
+			{
+				si.set_freq(centi[n], SI5351_CLK0);
+			}
+		}
+#if defined(HAVE_TSC)
+		uint64_t c1 = __rdtsc();
+#endif
+		auto t1 = std::chrono::steady_clock::now();
+		double t = std::chrono::duration<double, std::nano>(t1 - t0).count() / w->count;
+		if(t < *ns)
+		{
+			*ns = t;
+#if defined(HAVE_TSC)
+			*cycles = (double)(c1 - c0) / w->count;
+#endif
+		}
+
+		t0 = std::chrono::steady_clock::now();
+#if defined(HAVE_TSC)
+		c0 = __rdtsc();
+#endif
+		for(i = 0; i < log.size(); i += 2 + log[i + 1])
+		{
+			bus.write(SI5351_BUS_BASE_ADDR, log[i], log[i + 1], &log[i + 2]);
+		}
+		for(n = 0; n < reads; n++)
+		{
+			bus.read(SI5351_BUS_BASE_ADDR, SI5351_CLK0_CTRL, 1, &reg);
+		}
+#if defined(HAVE_TSC)
+		c1 = __rdtsc();
+#endif
+		t1 = std::chrono::steady_clock::now();
+		t = std::chrono::duration<double, std::nano>(t1 - t0).count() / w->count;
+		if(t < bus_ns)
+		{
+			bus_ns = t;
+#if defined(HAVE_TSC)
+			bus_cycles = (double)(c1 - c0) / w->count;
+#endif
+		}
+	}
+
+	*ns -= bus_ns;
+	*cycles -= bus_cycles;
+}
+
+int main(void)
+{
+	Si5351SimBus bus(400000UL), native_bus(400000UL);
+	Si5351RegSim *chip = bus.add_device(SI5351_BUS_BASE_ADDR);
+	Si5351RegSim *native_chip = native_bus.add_device(SI5351_BUS_BASE_ADDR);
+	Si5351 si(SI5351_BUS_BASE_ADDR, &bus);
+	Si5351 native_si(SI5351_BUS_BASE_ADDR, &native_bus);
+	long double err, worst, native_worst;
+	double ns, cycles, native_ns, native_cycles;
+	uint32_t n, differ;
+	size_t i;
+	int bad = 0;
+
+	// Let the CPU clock settle before anything is timed
+	time_path(&workloads[0], false, &ns, &cycles);
+
+	printf("%s\n\n", POLICY);
+	printf("%-12s %-18s %10s %12s %14s\n", "workload", "path", "ns/call", "cycles/call", "worst err Hz");
+
+	for(i = 0; i < sizeof(workloads) / sizeof(workloads[0]); i++)
+	{
+		const struct Workload *w = &workloads[i];
+
+		si.init(SI5351_CRYSTAL_LOAD_8PF, 0, 0);
+		native_si.init(SI5351_CRYSTAL_LOAD_8PF, 0, 0);
+		worst = 0;
+		native_worst = 0;
+		differ = 0;
+		for(n = 0; n < w->count; n++)
+		{
+			si.set_freq(to_centi(target(w, n)), SI5351_CLK0);
+			native_si.set_freq_native(to_native(target(w, n)), SI5351_CLK0);
+
+			err = fabsl(chip->clk_freq(0) - target(w, n));
+			worst = err > worst ? err : worst;
+			err = fabsl(native_chip->clk_freq(0) - target(w, n));
+			native_worst = err > native_worst ? err : native_worst;
+			if(memcmp(chip->regs, native_chip->regs, sizeof(chip->regs)) != 0)
+			{
+				differ++;
+			}
+		}
+
+		time_path(w, false, &ns, &cycles);
+		time_path(w, true, &native_ns, &native_cycles);
+		printf("%-12s %-18s %10.1f %12.0f %14.6f\n", w->name, "set_freq()", ns, cycles, (double)worst);
+		printf("%-12s %-18s %10.1f %12.0f %14.6f\n", "", "set_freq_native()", native_ns, native_cycles,
+			(double)native_worst);
+
+		if(!w->wspr && differ)
+		{
+			printf("FAIL %u of %u %s steps programmed different registers\n", differ, w->count, w->name);
+			bad++;
+		}
+	}
+
+	// A PLL a fraction of a Hz off the native grid
+	si.init(SI5351_CRYSTAL_LOAD_8PF, 0, 0);
+	native_si.init(SI5351_CRYSTAL_LOAD_8PF, 0, 0);
+	si.set_pll(SI5351_PLL_FIXED + 50, SI5351_PLLA);
+	native_si.set_pll(SI5351_PLL_FIXED + 50, SI5351_PLLA);
+	differ = 0;
+	for(n = 0; n < workloads[0].count; n++)
+	{
+		si.set_freq(to_centi(target(&workloads[0], n)), SI5351_CLK0);
+		native_si.set_freq_native(to_native(target(&workloads[0], n)), SI5351_CLK0);
+		if(memcmp(chip->regs, native_chip->regs, sizeof(chip->regs)) != 0)
+		{
+			differ++;
+		}
+	}
+	if(differ)
+	{
+		printf("FAIL %u of %u %s steps programmed different registers with the PLL at 800 MHz + 0.5 Hz\n",
+			differ, workloads[0].count, workloads[0].name);
+		bad++;
+	}
+
+	return bad ? 1 : 0;
+}
@@ -0,0 +1,167 @@
+/*
+ * si5351_sequence.cpp - Transmit/receive turnaround timing on the simulator
+ *
+ * Copyright (C) 2015 - 2019 Jason Milldrum <milldrum@gmail.com>
+ *                           Dana H. Myers <k6jq@comcast.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Runs a receive-to-transmit turnaround both as a chain of Si5351 calls
+ * and as a compiled Si5351Sequence, on a simulated 400 kHz bus. Time is
+ * the simulated bus time, plus 1 us for every look at the clock to stand
+ * in for the CPU. The timing of each step is printed, together with the
+ * bus transactions and writes of the output enable register it took.
+ *
+ * Build and run on Linux from the top of the library with:
+ *
+ *   g++ -O2 -Isrc -Iextras/sim -o si5351_sequence extras/bench/si5351_sequence.cpp \
+ *       src/si5351.cpp src/si5351_sequence.cpp
+ *   ./si5351_sequence
+ *
+ * The program exits with status 1 if the sequence leaves the device in a
+ * different state than the chain of calls, makes more than one write of
+ * the output enable register per step, reads the device while running,
+ * or starts a step more than 100 us late.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "si5351.h"
+#include "si5351_sequence.h"
+#include "si5351_simbus.h"
+
+#define LATE_LIMIT_US   100
+
+// Counts the writes that reach the output enable register
+static void count_oe(uint8_t, uint8_t reg, uint8_t len, const uint8_t *, void *ctx)
+{
+	if(reg <= SI5351_OUTPUT_ENABLE_CTRL && reg + len > SI5351_OUTPUT_ENABLE_CTRL)
+	{
+		(*(uint32_t *)ctx)++;
+	}
+}
+
+static Si5351SimBus *clock_bus;
+static uint64_t cpu_ns;
+
+static uint32_t sim_clock(void)
+{
+	cpu_ns += 1000;
+	return (uint32_t)((clock_bus->bus_time_ns + cpu_ns) / 1000);
+}
+
+// Receive: CLK0 is the local oscillator and CLK2 the BFO
+static void setup_rx(Si5351 &si)
+{
+	si.init(SI5351_CRYSTAL_LOAD_8PF, 0, 0);
+	si.set_freq(2320000000ULL, SI5351_CLK0);
+	si.set_freq(900150000ULL, SI5351_CLK2);
+	si.set_freq(1420000000ULL, SI5351_CLK1);
+	si.output_enable(SI5351_CLK1, 0);
+}
+
+// Receive to transmit: receive outputs off, then the PA drive set up and
+// tuned 50 us later, and CLK1 on once things have settled at 600 us
+static void rx_to_tx(Si5351 &si, Si5351Sequence &seq)
+{
+	seq.at(0);
+	si.output_enable(SI5351_CLK0, 0);
+	si.output_enable(SI5351_CLK2, 0);
+	seq.at(50);
+	si.drive_strength(SI5351_CLK1, SI5351_DRIVE_8MA);
+	si.set_freq(1420050000ULL, SI5351_CLK1);
+	seq.at(600);
+	si.output_enable(SI5351_CLK1, 1);
+}
+
+int main(void)
+{
+	Si5351SimBus chain_bus(400000UL), seq_bus(400000UL);
+	Si5351RegSim *chain_chip = chain_bus.add_device(SI5351_BUS_BASE_ADDR);
+	Si5351RegSim *seq_chip = seq_bus.add_device(SI5351_BUS_BASE_ADDR);
+	Si5351 chain(SI5351_BUS_BASE_ADDR, &chain_bus);
+	Si5351 si(SI5351_BUS_BASE_ADDR, &seq_bus);
+	Si5351Sequence seq(&si);
+	struct Si5351SeqTiming t;
+	uint32_t tx, bus_ns, bytes_read, oe_writes = 0;
+	int bad = 0;
+	uint8_t i;
+
+	// The same turnaround as plain calls, as fast as they go
+	setup_rx(chain);
+	tx = chain_bus.transactions;
+	bus_ns = (uint32_t)chain_bus.bus_time_ns;
+	chain.output_enable(SI5351_CLK0, 0);
+	chain.output_enable(SI5351_CLK2, 0);
+	chain.drive_strength(SI5351_CLK1, SI5351_DRIVE_8MA);
+	chain.set_freq(1420050000ULL, SI5351_CLK1);
+	chain.output_enable(SI5351_CLK1, 1);
+	printf("chain of calls:  %u transactions, %.1f us of bus time\n",
+		chain_bus.transactions - tx, ((uint32_t)chain_bus.bus_time_ns - bus_ns) / 1000.0);
+
+	setup_rx(si);
+	clock_bus = &seq_bus;
+	seq.set_clock(sim_clock);
+	if(seq.compile(rx_to_tx) != 0)
+	{
+		printf("FAIL compile() failed\n");
+		return 1;
+	}
+
+	tx = seq_bus.transactions;
+	bus_ns = (uint32_t)seq_bus.bus_time_ns;
+	bytes_read = seq_bus.bytes_read;
+	seq_bus.set_observer(count_oe, &oe_writes);
+	seq.run();
+	seq_bus.set_observer(NULL);
+	bytes_read = seq_bus.bytes_read - bytes_read;
+	printf("sequence:        %u transactions, %.1f us of bus time, %u bytes read\n\n",
+		seq_bus.transactions - tx, ((uint32_t)seq_bus.bus_time_ns - bus_ns) / 1000.0,
+		bytes_read);
+
+	printf("%4s %8s %8s %8s %8s\n", "step", "at us", "start us", "end us", "late us");
+	for(i = 0; seq.get_timing(i, &t) == 0; i++)
+	{
+		printf("%4u %8u %8u %8u %8u\n", i, t.at, t.start, t.end, t.start - t.at);
+	}
+	printf("\nlatest step: %u us late\n", seq.late_max());
+
+	if(memcmp(seq_chip->regs, chain_chip->regs, sizeof(seq_chip->regs)) != 0 ||
+		si.clk_freq[1] != chain.clk_freq[1])
+	{
+		printf("FAIL the sequence left the device in a different state\n");
+		bad++;
+	}
+	if(oe_writes > seq.steps())
+	{
+		printf("FAIL %u writes of the output enable register in %u steps\n", oe_writes, seq.steps());
+		bad++;
+	}
+	if(bytes_read)
+	{
+		printf("FAIL the sequence read the device while running\n");
+		bad++;
+	}
+	if(seq.late_max() > LATE_LIMIT_US)
+	{
+		printf("FAIL a step started more than %u us late\n", LATE_LIMIT_US);
+		bad++;
+	}
+
+	return bad ? 1 : 0;
+}
@@ -0,0 +1,288 @@
+/*
+ * si5351_ssc.cpp - Spread spectrum on PLLA on the simulator
+ *
+ * Copyright (C) 2015 - 2019 Jason Milldrum <milldrum@gmail.com>
+ *                           Dana H. Myers <k6jq@comcast.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Clocks a 25 MHz output from PLLA with spread spectrum and follows the
+ * envelope of its frequency over a sweep in the simulated registers: 0.5%
+ * down spread, then +/-0.5% center spread, then down spread again after
+ * PLLA is retuned from 800 to 870 MHz, then after Si5351Discipline has
+ * moved the correction by 0.1%, then as selected from a profile. For each case the lowest and
+ * highest frequency and the modulation rate are printed, along with a
+ * rough estimate of how much the spread lowers the peak of a harmonic in
+ * the 120 kHz bandwidth of a CISPR receiver. The spread parameters must
+ * go to the chip in one 13-byte burst each time.
+ *
+ * Build and run on Linux from the top of the library with:
+ *
+ *   g++ -O2 -Isrc -Iextras/sim -o si5351_ssc extras/bench/si5351_ssc.cpp src/si5351.cpp \
+ *       src/si5351_discipline.cpp src/si5351_profile.cpp
+ *   ./si5351_ssc
+ *
+ * The formulas of AN619 put the ends of the sweep at nominal / (1 + s)
+ * and nominal / (1 - s) for a spread s, so 2.5% down spread reaches
+ * 2.44% below nominal.
+ *
+ * The program exits with status 1 if an envelope is off from that by more
+ * than 2% of the spread, the rate by more than 1%, the spread parameters take
+ * more than one write (other than in a profile switch, which sends only the
+ * bytes that change), or spreads out of range are accepted. The spread
+ * registers after the discipline and the profile must also match those of
+ * a device set up directly with the same correction and spread, and
+ * set_freq() above 100 MHz must stay within SI5351_SET_FREQ_HIGH_MAX_TX
+ * transactions with the spread on.
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "si5351.h"
+#include "si5351_discipline.h"
+#include "si5351_profile.h"
+#include "si5351_simbus.h"
+
+#define OUT_FREQ        2500000000ULL
+#define RBW_HZ          120000.0
+#define DISCIPLINE_PPB  1000000L
+
+/*
+ * Simulated bus and chip, counting writes to the spread spectrum registers
+ */
+class SscWatch
+{
+public:
+	Si5351SimBus sim;
+	Si5351RegSim *chip;
+	uint32_t ssc_writes;
+	uint32_t ssc_bytes;
+
+	SscWatch(): sim(400000UL), chip(sim.add_device(SI5351_BUS_BASE_ADDR)), ssc_writes(0), ssc_bytes(0)
+	{
+		sim.set_observer(observe, this);
+	}
+
+private:
+	static void observe(uint8_t, uint8_t reg, uint8_t len, const uint8_t *, void *ctx)
+	{
+		SscWatch *w = (SscWatch *)ctx;
+
+		if(reg <= SI5351_SSC_PARAM12 && reg + len > SI5351_SSC_PARAM0)
+		{
+			w->ssc_writes++;
+			w->ssc_bytes += len;
+		}
+	}
+};
+
+// Follow CLK0 over one sweep and check its envelope against the spread
+// in hundredths of a percent above and below the nominal frequency. Unless
+// burst is false, the spread parameters must have gone out in one write.
+static int check(const char *name, SscWatch &bus, double up, double down, bool burst = true)
+{
+	const Si5351RegSim *chip = bus.chip;
+	long double nominal = chip->clk_freq(0), f, lo = nominal, hi = nominal;
+	uint32_t period = chip->ssc_period(), c;
+	double rate = period ? (double)chip->pll_ref(0) / period : 0.0;
+	double want_rate = SI5351_SSC_RATE_DEFAULT;
+	double lo_pct, hi_pct, width;
+	int bad = 0, h;
+
+	for(c = 0; c < period; c++)
+	{
+		f = chip->clk_freq_at(0, c);
+		lo = f < lo ? f : lo;
+		hi = f > hi ? f : hi;
+	}
+	lo_pct = (double)((lo - nominal) / nominal * 100.0L);
+	hi_pct = (double)((hi - nominal) / nominal * 100.0L);
+
+	printf("%-24s %10.3f %+8.4f%% %+8.4f%% %9.0f  %u/%u", name, (double)nominal / 1e6,
+		lo_pct, hi_pct, rate, bus.ssc_writes, bus.ssc_bytes);
+	width = (double)(hi - lo);
+	for(h = 1; h <= 10; h *= 10)
+	{
+		printf("  %5.1f", width * h > RBW_HZ ? 10.0 * log10(width * h / RBW_HZ) : 0.0);
+	}
+	printf("\n");
+
+	// AN619 puts the ends at nominal / (1 + s) and nominal / (1 - s)
+	if(fabs(-lo_pct - 100.0 * (down / 10000.0) / (1.0 + down / 10000.0)) > 0.02 * (up + down) / 100.0 ||
+		fabs(hi_pct - 100.0 * (up / 10000.0) / (1.0 - up / 10000.0)) > 0.02 * (up + down) / 100.0)
+	{
+		printf("FAIL %s: envelope %+.4f%% to %+.4f%%\n", name, lo_pct, hi_pct);
+		bad++;
+	}
+	if(fabs(rate - want_rate) > 0.01 * want_rate)
+	{
+		printf("FAIL %s: modulation rate %.0f Hz\n", name, rate);
+		bad++;
+	}
+	if(burst && (bus.ssc_writes != 1 || bus.ssc_bytes != SI5351_SSC_LENGTH))
+	{
+		printf("FAIL %s: spread parameters took %u writes\n", name, bus.ssc_writes);
+		bad++;
+	}
+	bus.ssc_writes = 0;
+	bus.ssc_bytes = 0;
+	return bad;
+}
+
+// Spread spectrum registers of a device set up directly with corr and a
+// 0.5% down spread, compared with those of chip
+static int check_regs(const char *name, const Si5351RegSim *chip, int32_t corr)
+{
+	SscWatch ref_bus;
+	Si5351 ref(SI5351_BUS_BASE_ADDR, &ref_bus.sim);
+	uint8_t i;
+
+	ref.init(SI5351_CRYSTAL_LOAD_8PF, 0, corr);
+	ref.set_freq(OUT_FREQ, SI5351_CLK0);
+	ref.set_ssc(SI5351_SSC_DOWN, 50);
+	for(i = SI5351_SSC_PARAM0; i <= SI5351_SSC_PARAM12; i++)
+	{
+		if(chip->regs[i] != ref_bus.chip->regs[i])
+		{
+			printf("FAIL %s: spread register %u is %02x, set up directly %02x\n", name, i,
+				chip->regs[i], ref_bus.chip->regs[i]);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static void build_ssc(Si5351 &si)
+{
+	si.set_freq(OUT_FREQ, SI5351_CLK0);
+	si.set_ssc(SI5351_SSC_DOWN, 50);
+}
+
+static void build_plain(Si5351 &si)
+{
+	si.set_freq(OUT_FREQ * 2, SI5351_CLK0);
+}
+
+int main(void)
+{
+	SscWatch bus;
+	Si5351 si(SI5351_BUS_BASE_ADDR, &bus.sim);
+	int bad = 0;
+
+	si.init(SI5351_CRYSTAL_LOAD_8PF, 0, 0);
+	si.set_freq(OUT_FREQ, SI5351_CLK0);
+	bus.ssc_writes = 0;
+	bus.ssc_bytes = 0;
+
+	printf("%-24s %10s %9s %9s %9s  %s  %s\n", "case", "MHz", "low", "high", "rate Hz", "writes/bytes",
+		"dB lower at h1, h10");
+
+	si.set_ssc(SI5351_SSC_DOWN, 50);
+	bad += check("0.5% down", bus, 0.0, 50.0);
+
+	si.set_ssc(SI5351_SSC_CENTER, 50);
+	bad += check("+/-0.5% center", bus, 50.0, 50.0);
+
+	si.set_ssc(SI5351_SSC_DOWN, 50);
+	bus.ssc_writes = 0;
+	bus.ssc_bytes = 0;
+	si.set_pll(87000000000ULL, SI5351_PLLA);
+	bad += check("0.5% down, PLLA 870 MHz", bus, 0.0, 50.0);
+
+	si.set_ssc(SI5351_SSC_DOWN, 250);
+	bad += check("2.5% down", bus, 0.0, 250.0);
+
+	// The discipline moves PLLA on its own, and the spread must follow
+	{
+		Si5351Discipline discipline(&si);
+
+		si.set_pll(SI5351_PLL_FIXED, SI5351_PLLA);
+		si.set_freq(OUT_FREQ, SI5351_CLK0);
+		si.set_ssc(SI5351_SSC_DOWN, 50);
+		bus.ssc_writes = 0;
+		bus.ssc_bytes = 0;
+		discipline.set_correction(DISCIPLINE_PPB);
+		bad += check("0.5% down, disciplined", bus, 0.0, 50.0);
+		bad += check_regs("0.5% down, disciplined", bus.chip, DISCIPLINE_PPB);
+		discipline.set_correction(0);
+	}
+
+	// A profile that turns spread spectrum on, selected from one that doesn't
+	{
+		Si5351Profiles profiles(&si);
+		struct Si5351Profile plain, spread;
+		uint8_t p_plain, p_spread;
+
+		si.set_ssc(SI5351_SSC_OFF, 0);
+		p_plain = profiles.add(&plain, "plain", build_plain);
+		p_spread = profiles.add(&spread, "spread", build_ssc);
+		profiles.select(p_plain);
+		if(bus.chip->ssc_enabled())
+		{
+			printf("FAIL spread spectrum on in a profile without it\n");
+			bad++;
+		}
+		bus.ssc_writes = 0;
+		bus.ssc_bytes = 0;
+		profiles.select(p_spread);
+		// Only the spread bytes that differ from the other profile are sent
+		bad += check("0.5% down, profile", bus, 0.0, 50.0, false);
+		bad += check_regs("0.5% down, profile", bus.chip, 0);
+
+		// The device object knows spread spectrum is on, so a retune keeps it
+		si.set_pll(87000000000ULL, SI5351_PLLA);
+		bad += check("0.5% down, profile, 870", bus, 0.0, 50.0);
+		profiles.select(p_plain);
+		si.set_ssc(SI5351_SSC_OFF, 0);
+	}
+
+	si.set_ssc(SI5351_SSC_OFF, 0);
+	if(bus.chip->ssc_enabled())
+	{
+		printf("FAIL spread spectrum still on\n");
+		bad++;
+	}
+
+	if(si.set_ssc(SI5351_SSC_DOWN, 251) == 0 || si.set_ssc(SI5351_SSC_CENTER, 151) == 0 ||
+		si.set_ssc(SI5351_SSC_DOWN, 50, 1000) == 0 || bus.chip->ssc_enabled())
+	{
+		printf("FAIL a spread out of range was accepted\n");
+		bad++;
+	}
+
+	// Above 100 MHz set_freq() moves PLLA, and with it the spread, within
+	// the documented bound
+	{
+		uint32_t tx;
+
+		si.set_ssc(SI5351_SSC_DOWN, 50);
+		bus.ssc_writes = 0;
+		bus.ssc_bytes = 0;
+		tx = bus.sim.transactions;
+		si.set_freq(12000000000ULL, SI5351_CLK1);
+		tx = bus.sim.transactions - tx;
+		if(bus.ssc_writes != 1 || tx > SI5351_SET_FREQ_HIGH_MAX_TX)
+		{
+			printf("FAIL set_freq() above 100 MHz: %u transactions, %u spread writes, bound %u\n",
+				tx, bus.ssc_writes, (unsigned)SI5351_SET_FREQ_HIGH_MAX_TX);
+			bad++;
+		}
+	}
+
+	return bad ? 1 : 0;
+}
@@ -0,0 +1,150 @@
+/*
+ * si5351_tempco.cpp - Temperature compensation with Si5351TempComp on the simulator
+ *
+ * Copyright (C) 2015 - 2019 Jason Milldrum <milldrum@gmail.com>
+ *                           Dana H. Myers <k6jq@comcast.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Models a crystal with the cubic temperature curve of an AT cut, about
+ * +/-10 ppm between -10 and 60 degrees Celsius, plus a fixed 3 ppm error
+ * at room temperature. Two days of a synthetic temperature profile (a
+ * daily swing from -5 to 55 degrees, sensor noise and a few sudden steps)
+ * are fed to Si5351TempComp at one sample every 10 s, with a 29-point
+ * curve taken from the model every 2.5 degrees and a threshold of 100 ppb,
+ * above the 80 ppb that sensor noise of 0.1 degree makes on the steep
+ * ends of the curve. After every sample, the 10 MHz output of the
+ * simulated chip is worked out with the crystal at its true frequency and
+ * compared with 10 MHz.
+ *
+ * Build and run on Linux from the top of the library with:
+ *
+ *   g++ -O2 -Isrc -Iextras/sim -o si5351_tempco extras/bench/si5351_tempco.cpp \
+ *       src/si5351.cpp src/si5351_discipline.cpp src/si5351_tempco.cpp
+ *   ./si5351_tempco
+ *
+ * The program exits with status 1 if the compensated output is ever off
+ * by more than the threshold plus 100 ppb of interpolation error, or if
+ * more than one sample in five writes to the chip.
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "si5351.h"
+#include "si5351_discipline.h"
+#include "si5351_tempco.h"
+#include "si5351_simbus.h"
+
+#define SAMPLES         (2 * 24 * 360)
+#define OFFSET_PPB      3000
+#define TARGET_HZ       10000000.0L
+#define THRESHOLD_PPB   100
+#define INTERP_PPB      100
+#define POINTS          29
+
+// Crystal error at a temperature in degrees, without the room offset
+static double crystal_ppb(double t)
+{
+	double d = t - 25.0;
+
+	return 0.35 * d * d * d - 150.0 * d;
+}
+
+// Temperature of the synthetic profile at sample n, in tenths of a degree
+static int16_t profile(int n)
+{
+	static uint32_t rng = 4321;
+	double t = 25.0 + 30.0 * sin(2.0 * M_PI * n / (24 * 360));
+
+	// A door opens for ten minutes twice a day
+	if(n % (12 * 360) >= 3 * 360 && n % (12 * 360) < 3 * 360 + 60)
+	{
+		t -= 8.0;
+	}
+
+	rng = rng * 1103515245UL + 12345;
+	t += ((int)((rng >> 16) % 3) - 1) / 10.0;
+
+	return (int16_t)lround(t * 10.0);
+}
+
+int main(void)
+{
+	struct Si5351TempPoint curve[POINTS];
+	Si5351SimBus bus(400000UL);
+	Si5351RegSim *chip = bus.add_device(SI5351_BUS_BASE_ADDR);
+	Si5351 si(SI5351_BUS_BASE_ADDR, &bus);
+	Si5351Discipline disc(&si);
+	struct Si5351DisciplineStats ds;
+	struct Si5351TempCompStats ts;
+	double worst_raw = 0.0, worst = 0.0, true_ppb, err;
+	uint32_t tx;
+	int16_t temp;
+	int i;
+
+	for(i = 0; i < POINTS; i++)
+	{
+		curve[i].temp = (int16_t)(-100 + i * 25);
+		curve[i].ppb = (int32_t)lround(crystal_ppb(-10.0 + i * 2.5));
+	}
+
+	Si5351TempComp comp(&disc, curve, POINTS);
+	comp.set_offset(OFFSET_PPB);
+	comp.set_threshold(THRESHOLD_PPB);
+
+	si.init(SI5351_CRYSTAL_LOAD_8PF, 0, 0);
+	si.set_freq((uint64_t)(TARGET_HZ * SI5351_FREQ_MULT), SI5351_CLK0);
+	tx = bus.transactions;
+
+	for(i = 0; i < SAMPLES; i++)
+	{
+		temp = profile(i);
+		true_ppb = crystal_ppb(temp / 10.0) + OFFSET_PPB;
+		comp.update(temp);
+
+		err = (double)((chip->clk_freq(0) * (1.0L + true_ppb * 1e-9L) - TARGET_HZ) / TARGET_HZ * 1e9L);
+		if(fabs(err) > worst)
+		{
+			worst = fabs(err);
+		}
+		if(fabs(true_ppb) > worst_raw)
+		{
+			worst_raw = fabs(true_ppb);
+		}
+	}
+
+	comp.get_stats(&ts);
+	disc.get_stats(&ds);
+	printf("%d samples over two days, threshold %d ppb\n", SAMPLES, THRESHOLD_PPB);
+	printf("worst output error: %.0f ppb uncompensated, %.1f ppb compensated\n", worst_raw, worst);
+	printf("%u corrections applied, %u held, %u transactions, %u PLL register bytes\n",
+		ts.applied, ts.held, bus.transactions - tx, ds.bytes);
+
+	if(worst > THRESHOLD_PPB + INTERP_PPB)
+	{
+		printf("FAIL the compensated output was off by more than %d ppb\n", THRESHOLD_PPB + INTERP_PPB);
+		return 1;
+	}
+	if(ts.applied > SAMPLES / 5)
+	{
+		printf("FAIL too many corrections were written\n");
+		return 1;
+	}
+
+	return 0;
+}
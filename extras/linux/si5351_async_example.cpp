@@ -0,0 +1,178 @@
+/*
+ * si5351_async_example.cpp - Drive Si5351Async from a C++20 coroutine
+ *
+ * Copyright (C) 2015 - 2019 Jason Milldrum <milldrum@gmail.com>
+ *                           Dana H. Myers <k6jq@comcast.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * A coroutine initializes a simulated device, sets three outputs and
+ * reads the status, while the main loop does nothing but call step() the
+ * way a DSP loop would between blocks. Each simulated transfer stays busy
+ * for a few polls, like an interrupt-driven I2C driver would. Afterwards
+ * the outputs are checked against the register model, and two more runs
+ * show init() giving up on a missing device and on a device that never
+ * finishes its own start-up.
+ *
+ * Build and run from the top of the library with:
+ *
+ *   g++ -std=c++20 -O2 -Isrc -Iextras/sim -o si5351_async_example \
+ *       extras/linux/si5351_async_example.cpp src/si5351.cpp src/si5351_async.cpp
+ *   ./si5351_async_example
+ */
+
+#include <stdio.h>
+
+#include "si5351.h"
+#include "si5351_async.h"
+#include "si5351_coro.h"
+#include "si5351_simbus.h"
+
+// Number of polls each simulated transfer stays busy for
+#define BUSY_POLLS      3
+
+/*
+ * Runs transfers on a simulated bus, but only reports them as done after
+ * a few polls. With stuck_init set, the device never clears SYS_INIT.
+ */
+class SlowSimBus : public Si5351AsyncBus
+{
+public:
+	SlowSimBus(Si5351SimBus *sim, bool stuck_init = false) : sim(sim), stuck_init(stuck_init), polls(0), result(0) {}
+	uint8_t start_probe(uint8_t dev_addr)
+	{
+		return start(sim->probe(dev_addr));
+	}
+	uint8_t start_write(uint8_t dev_addr, uint8_t reg, uint8_t len, const uint8_t *data)
+	{
+		return start(sim->write(dev_addr, reg, len, data));
+	}
+	uint8_t start_read(uint8_t dev_addr, uint8_t reg, uint8_t len, uint8_t *data)
+	{
+		uint8_t ret = sim->read(dev_addr, reg, len, data);
+
+		if(stuck_init && reg == SI5351_DEVICE_STATUS)
+		{
+			data[0] |= 0x80;
+		}
+		return start(ret);
+	}
+	uint8_t poll(void)
+	{
+		if(polls > 0)
+		{
+			polls--;
+			return SI5351_ASYNC_BUS_BUSY;
+		}
+		return result;
+	}
+private:
+	uint8_t start(uint8_t ret)
+	{
+		result = ret;
+		polls = BUSY_POLLS;
+		return 0;
+	}
+	Si5351SimBus *sim;
+	bool stuck_init;
+	int polls;
+	uint8_t result;
+};
+
+static const uint64_t freqs[3] = {1000000000ULL, 1409710000ULL, 2500000000ULL};
+
+static Si5351Task bring_up(Si5351Async &dev, uint8_t *result)
+{
+	uint8_t ret;
+
+	ret = co_await si5351_co_init(dev, SI5351_CRYSTAL_LOAD_8PF, 0, 0, 100);
+	if(ret != SI5351_ASYNC_OK)
+	{
+		*result = ret;
+		co_return;
+	}
+
+	for(int clk = 0; clk < 3; clk++)
+	{
+		ret = co_await si5351_co_set_freq(dev, freqs[clk], (enum si5351_clock)clk);
+		if(ret != SI5351_ASYNC_OK)
+		{
+			*result = ret;
+			co_return;
+		}
+	}
+
+	*result = co_await si5351_co_update_status(dev);
+}
+
+// Returns the result of bring_up() and the number of steps it took
+static uint8_t run(Si5351SimBus *sim, uint8_t addr, bool stuck_init, unsigned long *steps)
+{
+	SlowSimBus bus(sim, stuck_init);
+	Si5351Async dev(addr, &bus);
+	uint8_t result = SI5351_ASYNC_PENDING;
+
+	Si5351Task task = bring_up(dev, &result);
+	for(*steps = 0; !task.done(); (*steps)++)
+	{
+		// The rest of the main loop would go here
+		dev.step();
+	}
+
+	return result;
+}
+
+int main(void)
+{
+	Si5351SimBus sim;
+	Si5351RegSim *chip = sim.add_device(SI5351_BUS_BASE_ADDR);
+	unsigned long steps;
+	uint8_t ret;
+	int bad = 0;
+
+	ret = run(&sim, SI5351_BUS_BASE_ADDR, false, &steps);
+	printf("bring-up: status %u after %lu steps, %u transfers\n", ret, steps, sim.transactions);
+	if(ret != SI5351_ASYNC_OK)
+	{
+		bad++;
+	}
+	for(int clk = 0; clk < 3; clk++)
+	{
+		long double err = chip->clk_freq(clk) - (long double)freqs[clk] / SI5351_FREQ_MULT;
+
+		printf("  CLK%d: %.3Lf Hz (%s)\n", clk, chip->clk_freq(clk), chip->clk_enabled(clk) ? "on" : "off");
+		if(err > 1 || err < -1 || !chip->clk_enabled(clk))
+		{
+			bad++;
+		}
+	}
+
+	ret = run(&sim, SI5351_BUS_BASE_ADDR + 1, false, &steps);
+	printf("missing device: status %u after %lu steps\n", ret, steps);
+	if(ret != SI5351_ASYNC_NOT_FOUND)
+	{
+		bad++;
+	}
+
+	ret = run(&sim, SI5351_BUS_BASE_ADDR, true, &steps);
+	printf("stuck in SYS_INIT: status %u after %lu steps\n", ret, steps);
+	if(ret != SI5351_ASYNC_TIMEOUT)
+	{
+		bad++;
+	}
+
+	return bad ? 1 : 0;
+}
@@ -0,0 +1,193 @@
+/*
+ * si5351_linux_bus_test.cpp - Si5351LinuxBus against a stand-in for ioctl(2)
+ *
+ * Copyright (C) 2015 - 2019 Jason Milldrum <milldrum@gmail.com>
+ *                           Dana H. Myers <k6jq@comcast.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Runs Si5351LinuxBus with its ioctl replaced by a function that checks
+ * each I2C_RDWR request and carries it out on a simulated chip, so no
+ * adapter is needed. The same set of calls is made through the Linux bus
+ * and through a simulated bus with combined reads, and the two chips
+ * compared. Then the ioctl is made to fail.
+ *
+ * Build and run on Linux from the top of the library with:
+ *
+ *   g++ -O2 -Isrc -Iextras/sim -o si5351_linux_bus_test \
+ *       extras/linux/si5351_linux_bus_test.cpp src/si5351.cpp src/si5351_linux.cpp
+ *   ./si5351_linux_bus_test
+ *
+ * or with make -C extras/linux test.
+ *
+ * The program exits with status 1 if a write is not exactly one message,
+ * a read is not one combined transaction of a one-byte register address
+ * write and a read, an access takes other than one ioctl, the chips end
+ * up different, or a failed or unopened adapter is not reported.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+
+#include "si5351.h"
+#include "si5351_linux.h"
+#include "si5351_simbus.h"
+
+#define FAKE_FD         42
+#define BURST_LEN       31
+
+static Si5351RegSim chip;
+static uint32_t calls, writes, reads, malformed;
+static bool failing;
+
+// Stand-in for ioctl(2): one I2C_RDWR with either a single write message
+// or a register address write and a read joined by a repeated START
+static int fake_ioctl(int fd, unsigned long req, void *arg)
+{
+	struct i2c_rdwr_ioctl_data *x = (struct i2c_rdwr_ioctl_data *)arg;
+	struct i2c_msg *m = x->msgs;
+	uint16_t i;
+
+	calls++;
+	if(fd != FAKE_FD || req != I2C_RDWR)
+	{
+		malformed++;
+		errno = EINVAL;
+		return -1;
+	}
+	if(failing)
+	{
+		errno = EIO;
+		return -1;
+	}
+
+	if(x->nmsgs == 1 && m[0].addr == SI5351_BUS_BASE_ADDR && m[0].flags == 0 && m[0].len >= 2)
+	{
+		chip.write(m[0].buf[0], m[0].len - 1, &m[0].buf[1]);
+		writes++;
+		return 1;
+	}
+	if(x->nmsgs == 2 && m[0].addr == SI5351_BUS_BASE_ADDR && m[0].flags == 0 && m[0].len == 1 &&
+		m[1].addr == SI5351_BUS_BASE_ADDR && m[1].flags == I2C_M_RD && m[1].len >= 1)
+	{
+		for(i = 0; i < m[1].len; i++)
+		{
+			m[1].buf[i] = chip.read((uint8_t)(m[0].buf[0] + i));
+		}
+		reads++;
+		return 2;
+	}
+
+	printf("FAIL ioctl with %u messages, first %u bytes flags %04x\n", x->nmsgs,
+		x->nmsgs ? m[0].len : 0, x->nmsgs ? m[0].flags : 0);
+	malformed++;
+	errno = EINVAL;
+	return -1;
+}
+
+// Calls that write bursts and single registers and read-modify-write
+static void exercise(Si5351 &si)
+{
+	si.init(SI5351_CRYSTAL_LOAD_8PF, 0, 0);
+	si.set_freq(1410000000ULL, SI5351_CLK0);
+	si.set_freq(12000000000ULL, SI5351_CLK1);
+	si.drive_strength(SI5351_CLK0, SI5351_DRIVE_4MA);
+	si.set_clock_invert(SI5351_CLK1, 1);
+	si.output_enable(SI5351_CLK2, 0);
+}
+
+int main(void)
+{
+	Si5351LinuxBus bus(FAKE_FD, fake_ioctl);
+	Si5351SimBus sim(400000UL, true);
+	Si5351RegSim *sim_chip = sim.add_device(SI5351_BUS_BASE_ADDR);
+	Si5351 si(SI5351_BUS_BASE_ADDR, &bus);
+	Si5351 ref(SI5351_BUS_BASE_ADDR, &sim);
+	uint8_t out[BURST_LEN], in[BURST_LEN];
+	uint8_t i;
+	int bad = 0;
+
+	// The driver through both buses
+	exercise(si);
+	exercise(ref);
+	printf("%u ioctls: %u writes, %u combined reads; simulated bus: %u transactions\n",
+		calls, writes, reads, sim.transactions);
+	if(malformed || writes == 0 || reads == 0)
+	{
+		printf("FAIL %u malformed ioctls\n", malformed);
+		bad++;
+	}
+	if(calls != sim.transactions)
+	{
+		printf("FAIL %u ioctls for %u bus accesses\n", calls, sim.transactions);
+		bad++;
+	}
+	if(memcmp(chip.regs, sim_chip->regs, sizeof(chip.regs)) != 0)
+	{
+		printf("FAIL the chip behind the Linux bus differs from the simulated one\n");
+		bad++;
+	}
+
+	// A burst as long as the Wire library allows, and read back in one go
+	for(i = 0; i < BURST_LEN; i++)
+	{
+		out[i] = (uint8_t)(i * 7 + 1);
+	}
+	calls = 0;
+	if(bus.write(SI5351_BUS_BASE_ADDR, SI5351_CLK0_PARAMETERS, BURST_LEN, out) != 0 ||
+		bus.read(SI5351_BUS_BASE_ADDR, SI5351_CLK0_PARAMETERS, BURST_LEN, in) != 0 ||
+		memcmp(out, in, BURST_LEN) != 0 || calls != 2)
+	{
+		printf("FAIL a %u-byte burst did not come back the same in two ioctls\n", BURST_LEN);
+		bad++;
+	}
+
+	// A failing adapter
+	failing = true;
+	if(bus.write(SI5351_BUS_BASE_ADDR, SI5351_CLK0_CTRL, 1, out) == 0 ||
+		bus.read(SI5351_BUS_BASE_ADDR, SI5351_DEVICE_STATUS, 1, in) == 0 ||
+		bus.probe(SI5351_BUS_BASE_ADDR) == 0)
+	{
+		printf("FAIL an ioctl error was not returned\n");
+		bad++;
+	}
+	if(si.init(SI5351_CRYSTAL_LOAD_8PF, 0, 0))
+	{
+		printf("FAIL init() succeeded with no device answering\n");
+		bad++;
+	}
+	failing = false;
+
+	// An adapter that never opened makes no ioctl at all
+	{
+		Si5351LinuxBus closed(-1, fake_ioctl);
+
+		calls = 0;
+		if(closed.is_open() || closed.write(SI5351_BUS_BASE_ADDR, SI5351_CLK0_CTRL, 1, out) == 0 ||
+			closed.read(SI5351_BUS_BASE_ADDR, SI5351_DEVICE_STATUS, 1, in) == 0 || calls != 0)
+		{
+			printf("FAIL an unopened adapter was used\n");
+			bad++;
+		}
+	}
+
+	return bad ? 1 : 0;
+}
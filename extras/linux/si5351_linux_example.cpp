@@ -0,0 +1,70 @@
+/*
+ * si5351_linux_example.cpp - Simple example of using the Si5351 library
+ * from Linux userspace
+ *
+ * Copyright (C) 2015 - 2019 Jason Milldrum <milldrum@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Build from the top of the library with:
+ *
+ *   g++ -O2 -Isrc -o si5351_linux_example extras/linux/si5351_linux_example.cpp \
+ *       src/si5351.cpp src/si5351_linux.cpp
+ *
+ * or with make -C extras/linux, which puts it in extras/linux/build.
+ *
+ * Then run it with the I2C adapter and the CLK0 frequency in Hz:
+ *
+ *   ./si5351_linux_example /dev/i2c-1 10000000
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "si5351.h"
+#include "si5351_linux.h"
+
+int main(int argc, char **argv)
+{
+	if(argc != 3)
+	{
+		fprintf(stderr, "usage: %s /dev/i2c-N freq_hz\n", argv[0]);
+		return 2;
+	}
+
+	Si5351LinuxBus bus(argv[1]);
+	if(!bus.is_open())
+	{
+		perror(argv[1]);
+		return 1;
+	}
+
+	Si5351 si5351(SI5351_BUS_BASE_ADDR, &bus);
+	if(!si5351.init(SI5351_CRYSTAL_LOAD_8PF, 0, 0))
+	{
+		fprintf(stderr, "No Si5351 found at address 0x%02x\n", SI5351_BUS_BASE_ADDR);
+		return 1;
+	}
+
+	si5351.set_freq(strtoull(argv[2], NULL, 0) * SI5351_FREQ_MULT, SI5351_CLK0);
+
+	si5351.update_status();
+	printf("SYS_INIT: %u  LOL_A: %u  LOL_B: %u  LOS: %u  REVID: %u\n",
+		si5351.dev_status.SYS_INIT, si5351.dev_status.LOL_A,
+		si5351.dev_status.LOL_B, si5351.dev_status.LOS, si5351.dev_status.REVID);
+
+	return 0;
+}
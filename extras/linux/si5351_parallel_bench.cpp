@@ -0,0 +1,163 @@
+/*
+ * si5351_parallel_bench.cpp - Time parallel configuration of many devices
+ *
+ * Copyright (C) 2015 - 2019 Jason Milldrum <milldrum@gmail.com>
+ *                           Dana H. Myers <k6jq@comcast.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Configures a number of simulated devices spread over several simulated
+ * buses with Si5351ParallelConfig, first with a single thread and then
+ * with a thread pool, and reports the wall-clock time and the utilization
+ * of each bus. Every transaction on a simulated bus sleeps for the given
+ * latency, which stands in for the time a real adapter takes. Afterwards
+ * all of the outputs are checked against the register models.
+ *
+ * Build and run from the top of the library with:
+ *
+ *   g++ -O2 -pthread -Isrc -Iextras/sim -o si5351_parallel_bench \
+ *       extras/linux/si5351_parallel_bench.cpp src/si5351.cpp src/si5351_parallel.cpp
+ *   ./si5351_parallel_bench [--buses N] [--devices N] [--latency US] [--threads N]
+ *
+ * --devices is the number of devices on each bus (up to 8).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "si5351.h"
+#include "si5351_parallel.h"
+#include "si5351_simbus.h"
+
+static const uint64_t freqs[8] = {1000000000ULL, 1409710000ULL, 2500000000ULL,
+	700000000ULL, 1228800000ULL, 350000000ULL, 2700000000ULL, 4800000000ULL};
+
+// Returns the number of outputs that are off frequency by more than 1 Hz
+static int run(int nbus, int ndev, uint32_t latency, unsigned int threads, bool verbose)
+{
+	Si5351SimBus *sims = new Si5351SimBus[nbus];
+	Si5351ParallelConfig cfg(threads);
+	struct Si5351DeviceConfig dc;
+	int bad = 0;
+
+	memset(&dc, 0, sizeof(dc));
+	dc.xtal_load_c = SI5351_CRYSTAL_LOAD_8PF;
+	for(int clk = 0; clk < SI5351_CLK_COUNT; clk++)
+	{
+		dc.freq[clk] = freqs[clk];
+		dc.drive[clk] = SI5351_DRIVE_8MA;
+	}
+
+	for(int b = 0; b < nbus; b++)
+	{
+		sims[b].set_latency(latency);
+		cfg.add_bus(&sims[b]);
+		for(int d = 0; d < ndev; d++)
+		{
+			sims[b].add_device(SI5351_BUS_BASE_ADDR + d);
+			cfg.add_device(b, SI5351_BUS_BASE_ADDR + d, &dc);
+		}
+	}
+
+	int failed = cfg.run();
+
+	printf("%u thread(s): %d devices on %d buses in %.1f ms, %d failed\n", threads,
+		nbus * ndev, nbus, cfg.wall_ns() / 1e6, failed);
+	if(verbose)
+	{
+		printf("  %-4s %10s %10s %10s %6s\n", "bus", "transfers", "busy ms", "wait ms", "util");
+		for(int b = 0; b < cfg.bus_count(); b++)
+		{
+			struct Si5351BusReport r;
+
+			cfg.get_bus_report(b, &r);
+			printf("  %-4d %10u %10.1f %10.1f %5.0f%%\n", b, r.transfers, r.busy_ns / 1e6,
+				r.wait_ns / 1e6, r.utilization * 100);
+		}
+	}
+
+	for(int b = 0; b < nbus; b++)
+	{
+		for(int d = 0; d < ndev; d++)
+		{
+			Si5351RegSim *sim = sims[b].device(SI5351_BUS_BASE_ADDR + d);
+
+			for(int clk = 0; clk < SI5351_CLK_COUNT; clk++)
+			{
+				long double err = sim->clk_freq(clk) - (long double)freqs[clk] / SI5351_FREQ_MULT;
+
+				if(err > 1 || err < -1 || !sim->clk_enabled(clk))
+				{
+					bad++;
+				}
+			}
+		}
+	}
+
+	delete[] sims;
+	return bad + failed;
+}
+
+int main(int argc, char **argv)
+{
+	int nbus = 4, ndev = 4;
+	uint32_t latency = 100;
+	unsigned int threads = 0;
+
+	for(int i = 1; i < argc; i++)
+	{
+		if(!strcmp(argv[i], "--buses") && i + 1 < argc)
+		{
+			nbus = atoi(argv[++i]);
+		}
+		else if(!strcmp(argv[i], "--devices") && i + 1 < argc)
+		{
+			ndev = atoi(argv[++i]);
+		}
+		else if(!strcmp(argv[i], "--latency") && i + 1 < argc)
+		{
+			latency = strtoul(argv[++i], NULL, 0);
+		}
+		else if(!strcmp(argv[i], "--threads") && i + 1 < argc)
+		{
+			threads = strtoul(argv[++i], NULL, 0);
+		}
+		else
+		{
+			fprintf(stderr, "usage: si5351_parallel_bench [--buses N] [--devices N] [--latency US] [--threads N]\n");
+			return 2;
+		}
+	}
+	if(nbus < 1 || ndev < 1 || ndev > SI5351_SIMBUS_MAX_DEV)
+	{
+		fprintf(stderr, "need at least one bus and 1 to %d devices per bus\n", SI5351_SIMBUS_MAX_DEV);
+		return 2;
+	}
+	if(threads == 0)
+	{
+		threads = nbus * ndev;
+	}
+
+	int bad = run(nbus, ndev, latency, 1, false);
+	bad += run(nbus, ndev, latency, threads, true);
+	if(bad)
+	{
+		printf("%d outputs wrong\n", bad);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,205 @@
+/*
+ * si5351_snapshot_bench.cpp - Read frequency state while another thread retunes
+ *
+ * Copyright (C) 2015 - 2019 Jason Milldrum <milldrum@gmail.com>
+ *                           Dana H. Myers <k6jq@comcast.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * One thread keeps retuning a simulated device through Si5351ThreadSafe,
+ * always setting CLK1 to twice CLK0 and CLK2 to three times CLK0 in a
+ * single apply(). At the same time a growing number of reader threads
+ * take snapshots and check that the three frequencies still agree with
+ * each other and with the version they came with. For each reader count
+ * the snapshot rate and the number of bad snapshots are reported. The
+ * frequencies cross 2^32 (in Hz * 100), so a torn 64-bit value would show
+ * up as well.
+ *
+ * Build and run from the top of the library with:
+ *
+ *   g++ -O2 -pthread -Isrc -Iextras/sim -o si5351_snapshot_bench \
+ *       extras/linux/si5351_snapshot_bench.cpp src/si5351.cpp src/si5351_threadsafe.cpp
+ *   ./si5351_snapshot_bench [--readers N] [--ms N] [--latency US]
+ *
+ * --readers is the largest reader count tried, starting from 1 and doubling.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "si5351.h"
+#include "si5351_threadsafe.h"
+#include "si5351_simbus.h"
+
+// Frequencies of CLK0 the writer steps through, in Hz * 100
+#define STEP_COUNT      64
+#define STEP_FIRST      1200000000ULL
+#define STEP_SIZE       5000000ULL
+
+struct Reader
+{
+	uint64_t reads;
+	uint64_t bad;
+};
+
+static bool consistent(const struct Si5351FreqState *st, uint32_t *last_version)
+{
+	uint64_t f = st->clk_freq[0];
+	bool ok = true;
+
+	if(st->version < *last_version)
+	{
+		ok = false;
+	}
+	*last_version = st->version;
+
+	// Before the first step nothing has been set yet
+	if(f == 0)
+	{
+		return ok && st->clk_freq[1] == 0 && st->clk_freq[2] == 0;
+	}
+
+	if(f < STEP_FIRST || (f - STEP_FIRST) % STEP_SIZE != 0 ||
+		st->clk_freq[1] != 2 * f || st->clk_freq[2] != 3 * f)
+	{
+		ok = false;
+	}
+	return ok;
+}
+
+static void reader(Si5351ThreadSafe *dev, std::atomic<bool> *stop, struct Reader *r)
+{
+	struct Si5351FreqState st;
+	uint32_t last_version = 0;
+
+	r->reads = 0;
+	r->bad = 0;
+	while(!stop->load(std::memory_order_relaxed))
+	{
+		dev->snapshot(&st);
+		if(!consistent(&st, &last_version))
+		{
+			r->bad++;
+		}
+		r->reads++;
+	}
+}
+
+static void writer(Si5351ThreadSafe *dev, std::atomic<bool> *stop, uint64_t *steps)
+{
+	uint64_t n = 0;
+
+	while(!stop->load(std::memory_order_relaxed))
+	{
+		uint64_t f = STEP_FIRST + (n % STEP_COUNT) * STEP_SIZE;
+
+		dev->apply([f](Si5351 &d)
+		{
+			d.set_freq(f, SI5351_CLK0);
+			d.set_freq(2 * f, SI5351_CLK1);
+			d.set_freq(3 * f, SI5351_CLK2);
+		});
+		n++;
+	}
+	*steps = n;
+}
+
+// Returns the number of bad snapshots
+static uint64_t run(int readers, int ms, uint32_t latency)
+{
+	Si5351SimBus bus;
+	Si5351ThreadSafe dev(SI5351_BUS_BASE_ADDR, &bus);
+	std::vector<struct Reader> stats(readers);
+	std::vector<std::thread> pool;
+	std::atomic<bool> stop(false);
+	uint64_t steps = 0, reads = 0, bad = 0;
+
+	bus.add_device(SI5351_BUS_BASE_ADDR);
+	bus.set_latency(latency);
+	dev.init(SI5351_CRYSTAL_LOAD_8PF, 0, 0);
+
+	for(int i = 0; i < readers; i++)
+	{
+		pool.push_back(std::thread(reader, &dev, &stop, &stats[i]));
+	}
+	std::thread w(writer, &dev, &stop, &steps);
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+	stop = true;
+	w.join();
+	for(int i = 0; i < readers; i++)
+	{
+		pool[i].join();
+		reads += stats[i].reads;
+		bad += stats[i].bad;
+	}
+
+	printf("%7d %10llu %14.0f %14.0f %8llu\n", readers, (unsigned long long)steps,
+		reads * 1000.0 / ms, reads * 1000.0 / ms / readers, (unsigned long long)bad);
+	return bad;
+}
+
+int main(int argc, char **argv)
+{
+	int max_readers = 16, ms = 500;
+	uint32_t latency = 0;
+	uint64_t bad = 0;
+
+	for(int i = 1; i < argc; i++)
+	{
+		if(!strcmp(argv[i], "--readers") && i + 1 < argc)
+		{
+			max_readers = atoi(argv[++i]);
+		}
+		else if(!strcmp(argv[i], "--ms") && i + 1 < argc)
+		{
+			ms = atoi(argv[++i]);
+		}
+		else if(!strcmp(argv[i], "--latency") && i + 1 < argc)
+		{
+			latency = strtoul(argv[++i], NULL, 0);
+		}
+		else
+		{
+			fprintf(stderr, "usage: si5351_snapshot_bench [--readers N] [--ms N] [--latency US]\n");
+			return 2;
+		}
+	}
+	if(max_readers < 1 || ms < 1)
+	{
+		fprintf(stderr, "need at least one reader and one millisecond\n");
+		return 2;
+	}
+
+	printf("%7s %10s %14s %14s %8s\n", "readers", "retunes", "reads/s", "reads/s each", "bad");
+	for(int n = 1; n <= max_readers; n *= 2)
+	{
+		bad += run(n, ms, latency);
+	}
+
+	if(bad)
+	{
+		printf("%llu inconsistent snapshots\n", (unsigned long long)bad);
+		return 1;
+	}
+	return 0;
+}
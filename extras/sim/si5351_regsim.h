@@ -0,0 +1,327 @@
+/*
+ * si5351_regsim.h - Register-level Si5351 model for host-side tools
+ *
+ * Copyright (C) 2015 - 2019 Jason Milldrum <milldrum@gmail.com>
+ *                           Dana H. Myers <k6jq@comcast.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * This models the register map of a Si5351 well enough to tell which
+ * frequency each CLK output would produce, as described in AN619. Spread
+ * spectrum on PLLA is modelled as a piecewise-linear sweep of the feedback
+ * ratio. It does not model PLL lock time, glitches or anything analog. It
+ * is used by the host tools in the extras folder and never compiled into
+ * a sketch.
+ */
+
+#ifndef SI5351_REGSIM_H_
+#define SI5351_REGSIM_H_
+
+#include <stdint.h>
+#include <string.h>
+
+class Si5351RegSim
+{
+public:
+	uint8_t regs[256];
+	uint32_t xo_freq;
+	uint32_t clkin_freq;
+
+	Si5351RegSim(uint32_t xo = 25000000UL, uint32_t clkin = 0):
+		xo_freq(xo), clkin_freq(clkin)
+	{
+		power_on();
+	}
+
+	/*
+	 * Approximate power-on register contents: outputs disabled and
+	 * powered down, everything else zero.
+	 */
+	void power_on(void)
+	{
+		memset(regs, 0, sizeof(regs));
+		regs[3] = 0xFF;
+		for(int i = 16; i <= 23; i++)
+		{
+			regs[i] = 0x80;
+		}
+		regs[183] = 0xD2;
+	}
+
+	void write(uint8_t reg, uint8_t len, const uint8_t *data)
+	{
+		for(int i = 0; i < len; i++)
+		{
+			// PLL reset is self-clearing
+			if((uint8_t)(reg + i) != 177)
+			{
+				regs[(uint8_t)(reg + i)] = data[i];
+			}
+		}
+	}
+
+	uint8_t read(uint8_t reg) const
+	{
+		return regs[reg];
+	}
+
+	/*
+	 * Reference frequency seen by a PLL (0 = PLLA, 1 = PLLB) in Hz, after
+	 * the CLKIN divider.
+	 */
+	uint32_t pll_ref(int pll) const
+	{
+		uint8_t src = regs[15];
+
+		if(src & (pll == 0 ? (1 << 2) : (1 << 3)))
+		{
+			return clkin_freq >> ((src >> 6) & 0x03);
+		}
+		return xo_freq;
+	}
+
+	/*
+	 * PLL feedback ratio a + b/c as num/den, decoded from P1/P2/P3.
+	 * (P1 + 512) / 128 + P2 / (128 * P3) == a + b/c
+	 */
+	void pll_ratio(int pll, uint64_t *num, uint64_t *den) const
+	{
+		decode_p(pll == 0 ? 26 : 34, num, den);
+	}
+
+	long double pll_freq(int pll) const
+	{
+		uint64_t num, den;
+
+		pll_ratio(pll, &num, &den);
+		return (long double)pll_ref(pll) * num / den;
+	}
+
+	bool ssc_enabled(void) const
+	{
+		return (regs[149] & 0x80) != 0;
+	}
+
+	/*
+	 * Length of one spread spectrum sweep in reference cycles, 4 * SSUDP
+	 */
+	uint32_t ssc_period(void) const
+	{
+		return 4 * ((((uint32_t)regs[154] & 0xF0) << 4) | regs[155]);
+	}
+
+	/*
+	 * PLL frequency in Hz at a point of the spread spectrum sweep, counted
+	 * in reference cycles. Down spread runs the feedback ratio from R down
+	 * to R - SSDN * SSUDP / 64 and back. Center spread runs it up to
+	 * R + SSUP * SSUDP / 128 at a quarter of the sweep and down to
+	 * R - SSDN * SSUDP / 128 at three quarters. PLLB never spreads.
+	 */
+	long double pll_freq_at(int pll, uint32_t cycle) const
+	{
+		uint32_t udp = ssc_period() / 4;
+		long double up, dn, pos, ratio;
+		uint64_t num, den;
+
+		pll_ratio(pll, &num, &den);
+		ratio = (long double)num / den;
+		if(pll != 0 || !ssc_enabled() || udp == 0)
+		{
+			return pll_ref(pll) * ratio;
+		}
+
+		dn = ssc_value(149, 153, 154) * udp;
+		up = ssc_value(156, 160, 161) * udp / 128.0L;
+		pos = (long double)(cycle % (4 * udp)) / udp;
+		if(!(regs[151] & 0x80))
+		{
+			dn /= 64.0L;
+			ratio -= dn * (pos < 2.0L ? pos : 4.0L - pos) / 2.0L;
+		}
+		else
+		{
+			dn /= 128.0L;
+			if(pos < 1.0L)
+			{
+				ratio += up * pos;
+			}
+			else if(pos < 3.0L)
+			{
+				ratio += up - (up + dn) * (pos - 1.0L) / 2.0L;
+			}
+			else
+			{
+				ratio -= dn * (4.0L - pos);
+			}
+		}
+		return pll_ref(pll) * ratio;
+	}
+
+	/*
+	 * Output frequency of a CLK in Hz at a point of the spread spectrum
+	 * sweep
+	 */
+	long double clk_freq_at(int clk, uint32_t cycle) const
+	{
+		int pll = clk_pll(clk);
+
+		if(pll < 0)
+		{
+			return clk_freq(clk);
+		}
+		return clk_freq(clk) * pll_freq_at(pll, cycle) / pll_freq(pll);
+	}
+
+	/*
+	 * PLL an output runs from, or -1 if it runs from XTAL or CLKIN
+	 */
+	int clk_pll(int clk) const
+	{
+		uint8_t src = (regs[16 + clk] >> 2) & 0x03;
+
+		if(src < 2)
+		{
+			return -1;
+		}
+		return (regs[16 + clk_ms(clk)] & (1 << 5)) ? 1 : 0;
+	}
+
+	/*
+	 * Multisynth divider ratio for MS0-7 as num/den. MS6 and MS7 are
+	 * integer only.
+	 */
+	void ms_ratio(int ms, uint64_t *num, uint64_t *den) const
+	{
+		if(ms >= 6)
+		{
+			*num = regs[90 + (ms - 6)];
+			*den = 1;
+			return;
+		}
+
+		if(((regs[44 + ms * 8] >> 2) & 0x03) == 0x03)
+		{
+			*num = 4;
+			*den = 1;
+			return;
+		}
+
+		decode_p(42 + ms * 8, num, den);
+	}
+
+	uint8_t r_div(int clk) const
+	{
+		if(clk == 6)
+		{
+			return regs[92] & 0x07;
+		}
+		if(clk == 7)
+		{
+			return (regs[92] >> 4) & 0x07;
+		}
+		return (regs[44 + clk * 8] >> 4) & 0x07;
+	}
+
+	bool clk_enabled(int clk) const
+	{
+		return !(regs[3] & (1 << clk)) && !(regs[16 + clk] & 0x80);
+	}
+
+	/*
+	 * Exact output frequency of a CLK as num/den Hz, whether or not the
+	 * output is enabled. Returns false if the output has no usable source.
+	 */
+	bool clk_rational(int clk, unsigned __int128 *num, unsigned __int128 *den) const
+	{
+		uint8_t ctrl = regs[16 + clk];
+		uint64_t pn, pd, mn, md;
+		int ms, pll;
+
+		switch((ctrl >> 2) & 0x03)
+		{
+		case 0:
+			*num = xo_freq;
+			*den = 1;
+			break;
+		case 1:
+			*num = clkin_freq;
+			*den = 1;
+			break;
+		default:
+			ms = clk_ms(clk);
+			pll = clk_pll(clk);
+			pll_ratio(pll, &pn, &pd);
+			ms_ratio(ms, &mn, &md);
+			if(pd == 0 || mn == 0)
+			{
+				return false;
+			}
+			*num = (unsigned __int128)pll_ref(pll) * pn * md;
+			*den = (unsigned __int128)pd * mn;
+			break;
+		}
+
+		*den <<= r_div(clk);
+		return *den != 0;
+	}
+
+	long double clk_freq(int clk) const
+	{
+		unsigned __int128 num, den;
+
+		if(!clk_rational(clk, &num, &den))
+		{
+			return 0;
+		}
+		return (long double)num / (long double)den;
+	}
+
+private:
+	// Multisynth an output runs from: MS0 or MS4 when it takes the shared
+	// multisynth of its group, its own otherwise
+	int clk_ms(int clk) const
+	{
+		if(((regs[16 + clk] >> 2) & 0x03) == 2 && clk != 0 && clk != 4)
+		{
+			return clk < 4 ? 0 : 4;
+		}
+		return clk;
+	}
+
+	// SSDN or SSUP as P1 + P2 / P3, from the registers holding P2 and P3,
+	// P1[7:0] and P1[11:8]
+	long double ssc_value(uint8_t p2_reg, uint8_t p1_low, uint8_t p1_high) const
+	{
+		uint32_t p2 = (((uint32_t)regs[p2_reg] & 0x7F) << 8) | regs[p2_reg + 1];
+		uint32_t p3 = (((uint32_t)regs[p2_reg + 2] & 0x7F) << 8) | regs[p2_reg + 3];
+		uint32_t p1 = (((uint32_t)regs[p1_high] & 0x0F) << 8) | regs[p1_low];
+
+		return p3 ? p1 + (long double)p2 / p3 : p1;
+	}
+
+	void decode_p(uint8_t base, uint64_t *num, uint64_t *den) const
+	{
+		const uint8_t *r = &regs[base];
+		uint64_t p3 = ((uint64_t)(r[5] & 0xF0) << 12) | ((uint64_t)r[0] << 8) | r[1];
+		uint64_t p1 = ((uint64_t)(r[2] & 0x03) << 16) | ((uint64_t)r[3] << 8) | r[4];
+		uint64_t p2 = ((uint64_t)(r[5] & 0x0F) << 16) | ((uint64_t)r[6] << 8) | r[7];
+
+		*num = (p1 + 512) * p3 + p2;
+		*den = 128 * p3;
+	}
+};
+
+#endif /* SI5351_REGSIM_H_ */
@@ -0,0 +1,204 @@
+/*
+ * si5351_simbus.h - Simulated I2C bus with Si5351 register models attached
+ *
+ * Copyright (C) 2015 - 2019 Jason Milldrum <milldrum@gmail.com>
+ *                           Dana H. Myers <k6jq@comcast.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * A Si5351Bus implementation for host-side tools. Any number of simulated
+ * devices (up to SI5351_SIMBUS_MAX_DEV) can sit on the bus at different
+ * addresses. The bus counts transactions and bytes, and keeps a running
+ * total of how long the traffic would have taken at the given SCL rate.
+ * With set_latency(), every transaction also really takes that long, for
+ * timing tools that run several buses in parallel. A tool that needs to
+ * look at individual writes sets an observer with set_observer() instead
+ * of wrapping the bus.
+ */
+
+#ifndef SI5351_SIMBUS_H_
+#define SI5351_SIMBUS_H_
+
+#include <time.h>
+
+#include "si5351.h"
+#include "si5351_regsim.h"
+
+#define SI5351_SIMBUS_MAX_DEV           8
+
+class Si5351SimBus : public Si5351Bus
+{
+public:
+	uint32_t transactions;
+	uint32_t bytes_written;
+	uint32_t bytes_read;
+	uint64_t bus_time_ns;
+	// Value of bus_time_ns when the latest transaction started
+	uint64_t start_ns;
+
+	/*
+	 * scl_hz - Bus clock used for the timing estimate
+	 * combined - Model register reads as one combined write/read
+	 *   transaction (repeated START) instead of two transactions
+	 */
+	Si5351SimBus(uint32_t scl_hz = 400000UL, bool combined = false):
+		scl_hz(scl_hz), combined(combined), latency_us(0), ndev(0), observer(NULL), observer_ctx(NULL)
+	{
+		clear_counters();
+	}
+
+	// Sleep for this long in every transaction
+	void set_latency(uint32_t us)
+	{
+		latency_us = us;
+	}
+
+	/*
+	 * Call observer after every register write, once the simulated device
+	 * has taken it, or stop calling it with NULL. ctx is passed through.
+	 * Writes to an address with no device on it are reported as well.
+	 */
+	void set_observer(void (*observer)(uint8_t, uint8_t, uint8_t, const uint8_t *, void *), void *ctx = NULL)
+	{
+		this->observer = observer;
+		observer_ctx = ctx;
+	}
+
+	Si5351RegSim *add_device(uint8_t addr, uint32_t xo = 25000000UL, uint32_t clkin = 0)
+	{
+		if(ndev >= SI5351_SIMBUS_MAX_DEV)
+		{
+			return NULL;
+		}
+		addrs[ndev] = addr;
+		devs[ndev] = Si5351RegSim(xo, clkin);
+		return &devs[ndev++];
+	}
+
+	Si5351RegSim *device(uint8_t addr)
+	{
+		for(int i = 0; i < ndev; i++)
+		{
+			if(addrs[i] == addr)
+			{
+				return &devs[i];
+			}
+		}
+		return NULL;
+	}
+
+	void clear_counters(void)
+	{
+		transactions = 0;
+		bytes_written = 0;
+		bytes_read = 0;
+		bus_time_ns = 0;
+		start_ns = 0;
+	}
+
+	uint8_t probe(uint8_t dev_addr)
+	{
+		start_ns = bus_time_ns;
+		add_time(0);
+		transactions++;
+		sleep_latency(1);
+		return device(dev_addr) ? 0 : 2;
+	}
+
+	uint8_t write(uint8_t dev_addr, uint8_t reg, uint8_t len, const uint8_t *data)
+	{
+		Si5351RegSim *dev = device(dev_addr);
+
+		start_ns = bus_time_ns;
+		transactions++;
+		bytes_written += len + 1;
+		add_time(len + 1);
+		sleep_latency(1);
+
+		if(dev)
+		{
+			dev->write(reg, len, data);
+		}
+		if(observer)
+		{
+			observer(dev_addr, reg, len, data, observer_ctx);
+		}
+		return dev ? 0 : 2;
+	}
+
+	uint8_t read(uint8_t dev_addr, uint8_t reg, uint8_t len, uint8_t *data)
+	{
+		Si5351RegSim *dev = device(dev_addr);
+
+		start_ns = bus_time_ns;
+		transactions += read_transactions();
+		bytes_written += 1;
+		bytes_read += len;
+		add_time(1);
+		add_time(len);
+		sleep_latency(read_transactions());
+		if(combined)
+		{
+			// Repeated START instead of STOP + START
+			bus_time_ns -= 1000000000ULL / scl_hz;
+		}
+
+		if(!dev)
+		{
+			return 2;
+		}
+		for(int i = 0; i < len; i++)
+		{
+			data[i] = dev->read((uint8_t)(reg + i));
+		}
+		return 0;
+	}
+
+	uint8_t read_transactions(void)
+	{
+		return combined ? 1 : 2;
+	}
+
+private:
+	uint32_t scl_hz;
+	bool combined;
+	uint32_t latency_us;
+	int ndev;
+	uint8_t addrs[SI5351_SIMBUS_MAX_DEV];
+	Si5351RegSim devs[SI5351_SIMBUS_MAX_DEV];
+	void (*observer)(uint8_t, uint8_t, uint8_t, const uint8_t *, void *);
+	void *observer_ctx;
+
+	void sleep_latency(uint8_t count)
+	{
+		if(latency_us)
+		{
+			struct timespec ts;
+
+			ts.tv_sec = (uint64_t)latency_us * count / 1000000UL;
+			ts.tv_nsec = ((uint64_t)latency_us * count % 1000000UL) * 1000UL;
+			nanosleep(&ts, NULL);
+		}
+	}
+
+	// START, address byte, payload bytes with ACKs, STOP
+	void add_time(uint8_t payload)
+	{
+		bus_time_ns += (uint64_t)(2 + 9 * (1 + payload)) * 1000000000ULL / scl_hz;
+	}
+};
+
+#endif /* SI5351_SIMBUS_H_ */
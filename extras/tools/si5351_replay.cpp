@@ -0,0 +1,246 @@
+/*
+ * si5351_replay.cpp - Replay a Si5351Arduino bus trace on the host
+ *
+ * Copyright (C) 2015 - 2019 Jason Milldrum <milldrum@gmail.com>
+ *                           Dana H. Myers <k6jq@comcast.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Feeds a binary log produced by Si5351::trace_export() into the register
+ * model, prints every change of a CLK output frequency with its time stamp
+ * and the API call that caused it, then prints the latency distribution of
+ * each API call.
+ *
+ * Build and run on Linux with:
+ *
+ *   g++ -O2 -o si5351_replay extras/tools/si5351_replay.cpp
+ *   ./si5351_replay [--xo HZ] [--clkin HZ] trace.bin
+ *
+ * The XO and CLKIN frequencies default to the ones recorded in the log.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+#include "../sim/si5351_regsim.h"
+
+// Same order as enum si5351_op in si5351.h
+static const char *op_names[] = {"other", "init", "reset", "set_freq",
+	"set_freq_manual", "set_pll", "set_ms", "output_enable", "drive_strength",
+	"update_status", "set_correction", "set_phase", "pll_reset",
+	"set_ms_source", "set_int", "set_clock_pwr", "set_clock_invert",
+	"set_clock_source", "set_clock_disable", "set_clock_fanout",
+	"set_pll_input", "set_vcxo", "set_freq_pingpong", "set_ssc"};
+
+#define TRACE_READ          (1<<0)
+#define TRACE_CALL_START    (1<<1)
+#define LOG_HEADER_LEN      20
+#define LOG_ENTRY_LEN       10
+
+struct Entry
+{
+	uint32_t time;
+	uint16_t duration;
+	uint8_t op;
+	uint8_t flags;
+	uint8_t reg;
+	uint8_t len;
+	uint8_t data[256];
+};
+
+static const char *op_name(uint8_t op)
+{
+	if(op < sizeof(op_names) / sizeof(op_names[0]))
+	{
+		return op_names[op];
+	}
+	return "?";
+}
+
+static uint32_t get_le(const uint8_t *p, int bytes)
+{
+	uint32_t val = 0;
+
+	for(int i = bytes - 1; i >= 0; i--)
+	{
+		val = (val << 8) | p[i];
+	}
+	return val;
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: si5351_replay [--xo HZ] [--clkin HZ] trace.bin\n");
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	const char *path = NULL;
+	uint32_t xo = 0, clkin = 0;
+
+	for(int i = 1; i < argc; i++)
+	{
+		if(!strcmp(argv[i], "--xo") && i + 1 < argc)
+		{
+			xo = strtoul(argv[++i], NULL, 0);
+		}
+		else if(!strcmp(argv[i], "--clkin") && i + 1 < argc)
+		{
+			clkin = strtoul(argv[++i], NULL, 0);
+		}
+		else if(argv[i][0] == '-' || path)
+		{
+			usage();
+		}
+		else
+		{
+			path = argv[i];
+		}
+	}
+	if(!path)
+	{
+		usage();
+	}
+
+	FILE *f = fopen(path, "rb");
+	if(!f)
+	{
+		perror(path);
+		return 1;
+	}
+	std::vector<uint8_t> log;
+	uint8_t chunk[4096];
+	size_t n;
+	while((n = fread(chunk, 1, sizeof(chunk), f)) > 0)
+	{
+		log.insert(log.end(), chunk, chunk + n);
+	}
+	fclose(f);
+
+	if(log.size() < LOG_HEADER_LEN || memcmp(&log[0], "S5TR", 4) != 0)
+	{
+		fprintf(stderr, "%s: not a Si5351 trace log\n", path);
+		return 1;
+	}
+	if(log[4] != 1)
+	{
+		fprintf(stderr, "%s: unsupported log version %u\n", path, log[4]);
+		return 1;
+	}
+
+	uint16_t count = get_le(&log[6], 2);
+	uint32_t dropped = get_le(&log[8], 4);
+	Si5351RegSim sim(xo ? xo : get_le(&log[12], 4), clkin ? clkin : get_le(&log[16], 4));
+
+	printf("# device 0x%02x, %u entries, %u dropped, XO %u Hz, CLKIN %u Hz\n",
+		log[5], count, dropped, sim.xo_freq, sim.clkin_freq);
+	if(dropped)
+	{
+		printf("# the oldest register writes are missing, so the first frequencies may be wrong\n");
+	}
+
+	// Parse the entries
+	std::vector<Entry> entries;
+	size_t pos = LOG_HEADER_LEN;
+	for(uint16_t i = 0; i < count; i++)
+	{
+		Entry e;
+		if(pos + LOG_ENTRY_LEN > log.size())
+		{
+			fprintf(stderr, "%s: truncated log\n", path);
+			return 1;
+		}
+		e.time = get_le(&log[pos], 4);
+		e.duration = get_le(&log[pos + 4], 2);
+		e.op = log[pos + 6];
+		e.flags = log[pos + 7];
+		e.reg = log[pos + 8];
+		e.len = log[pos + 9];
+		pos += LOG_ENTRY_LEN;
+		if(pos + e.len > log.size())
+		{
+			fprintf(stderr, "%s: truncated log\n", path);
+			return 1;
+		}
+		memcpy(e.data, &log[pos], e.len);
+		pos += e.len;
+		entries.push_back(e);
+	}
+
+	// Apply the writes and report output frequency changes
+	long double last[8];
+	bool last_on[8];
+	for(int clk = 0; clk < 8; clk++)
+	{
+		last[clk] = sim.clk_freq(clk);
+		last_on[clk] = sim.clk_enabled(clk);
+	}
+
+	std::map<uint8_t, std::vector<uint32_t> > latency;
+	size_t call_first = 0;
+
+	for(size_t i = 0; i < entries.size(); i++)
+	{
+		const Entry &e = entries[i];
+
+		if(!(e.flags & TRACE_READ))
+		{
+			sim.write(e.reg, e.len, e.data);
+		}
+
+		for(int clk = 0; clk < 8; clk++)
+		{
+			long double freq = sim.clk_freq(clk);
+			bool on = sim.clk_enabled(clk);
+
+			if(freq != last[clk] || on != last_on[clk])
+			{
+				printf("%10u us  %-18s CLK%d %s %.3Lf Hz\n", e.time, op_name(e.op),
+					clk, on ? "on " : "off", freq);
+				last[clk] = freq;
+				last_on[clk] = on;
+			}
+		}
+
+		// A call ends where the next one starts, or at the end of the log
+		if(i + 1 == entries.size() || (entries[i + 1].flags & TRACE_CALL_START))
+		{
+			const Entry &first = entries[call_first];
+			latency[first.op].push_back(e.time + e.duration - first.time);
+			call_first = i + 1;
+		}
+	}
+
+	printf("\n# per-call latency in trace clock ticks\n");
+	printf("# %-18s %8s %8s %8s %8s %8s\n", "call", "count", "min", "median", "p95", "max");
+	for(std::map<uint8_t, std::vector<uint32_t> >::iterator it = latency.begin(); it != latency.end(); ++it)
+	{
+		std::vector<uint32_t> &v = it->second;
+		std::sort(v.begin(), v.end());
+		printf("  %-18s %8zu %8u %8u %8u %8u\n", op_name(it->first), v.size(), v.front(),
+			v[v.size() / 2], v[(v.size() * 95) / 100 < v.size() ? (v.size() * 95) / 100 : v.size() - 1],
+			v.back());
+	}
+
+	return 0;
+}
@@ -0,0 +1,382 @@
+/*
+ * si5351_scan.cpp - Frequency accuracy and compute cost scanner
+ *
+ * Copyright (C) 2015 - 2019 Jason Milldrum <milldrum@gmail.com>
+ *                           Dana H. Myers <k6jq@comcast.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Sweeps a large number of target frequencies across the output range
+ * through set_freq() on a simulated device, decodes the exact rational
+ * output frequency from the registers and records the error and the time
+ * each call took. The work is split over all cores.
+ *
+ * Every target is tuned from the power-up PLL setting (PLLA at
+ * SI5351_PLL_FIXED), so the results do not depend on the scan order.
+ * The time includes the simulated bus, which is cheap compared with the
+ * calculations.
+ *
+ * Build and run on Linux from the top of the library with:
+ *
+ *   g++ -O2 -pthread -Isrc -Iextras/sim -o si5351_scan extras/tools/si5351_scan.cpp src/si5351.cpp
+ *   ./si5351_scan [--points N] [--threads N] [--clk N] [--xo HZ]
+ *                 [--csv FILE] [--heatmap FILE] [--worst N]
+ *
+ * --csv writes one row per frequency bin (log spaced, 20 per decade) with
+ * the worst absolute and relative error and the mean and worst call time.
+ * --heatmap writes a matrix of target counts with frequency bins as rows
+ * and decades of absolute error (from below 1 uHz to above 100 Hz) as
+ * columns.
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "si5351.h"
+#include "si5351_simbus.h"
+
+#define BINS_PER_DECADE     20
+#define ERR_DECADES         10
+#define ERR_DECADE_MIN      -6
+
+struct Sample
+{
+	uint64_t freq;
+	long double err_hz;
+};
+
+struct Bin
+{
+	uint64_t count;
+	uint64_t refused;
+	long double max_err_hz;
+	long double max_err_ppb;
+	double total_ns;
+	double max_ns;
+	uint64_t err_hist[ERR_DECADES];
+};
+
+struct Worker
+{
+	std::vector<Bin> bins;
+	std::vector<Sample> worst;
+};
+
+static uint64_t f_min, f_max;
+static int n_bins;
+static size_t n_worst = 20;
+
+static int bin_of(uint64_t freq)
+{
+	int bin = (int)(log10((double)freq / f_min) * BINS_PER_DECADE);
+
+	return bin < 0 ? 0 : (bin >= n_bins ? n_bins - 1 : bin);
+}
+
+// Deterministic log-uniform target with a random sub-Hz part
+static uint64_t target(uint64_t i, uint64_t points)
+{
+	uint64_t h = (i + 1) * 0x9E3779B97F4A7C15ULL;
+	h ^= h >> 31;
+	h *= 0xBF58476D1CE4E5B9ULL;
+	h ^= h >> 29;
+	double u = (i + (double)(h >> 11) / (double)(1ULL << 53)) / points;
+	uint64_t f = (uint64_t)(f_min * pow((double)f_max / f_min, u));
+
+	return f < f_min ? f_min : (f > f_max ? f_max : f);
+}
+
+static void keep_worst(std::vector<Sample> &worst, const Sample &s)
+{
+	if(worst.size() < n_worst)
+	{
+		worst.push_back(s);
+		return;
+	}
+	std::vector<Sample>::iterator least = worst.begin();
+	for(std::vector<Sample>::iterator it = worst.begin(); it != worst.end(); ++it)
+	{
+		if(it->err_hz < least->err_hz)
+		{
+			least = it;
+		}
+	}
+	if(s.err_hz > least->err_hz)
+	{
+		*least = s;
+	}
+}
+
+static void scan(Worker *w, uint64_t first, uint64_t last, uint64_t points,
+	enum si5351_clock clk, uint32_t xo)
+{
+	Si5351SimBus bus;
+	Si5351RegSim *dev = bus.add_device(SI5351_BUS_BASE_ADDR, xo);
+	Si5351 si(SI5351_BUS_BASE_ADDR, &bus);
+
+	si.init(SI5351_CRYSTAL_LOAD_8PF, xo, 0);
+	w->bins.assign(n_bins, Bin());
+
+	for(uint64_t i = first; i < last; i++)
+	{
+		uint64_t freq = target(i, points);
+		Bin &bin = w->bins[bin_of(freq)];
+		unsigned __int128 num, den;
+
+		// Start every target from the same PLL state
+		if(si.plla_freq != SI5351_PLL_FIXED)
+		{
+			si.set_pll(SI5351_PLL_FIXED, SI5351_PLLA);
+		}
+		if(clk >= SI5351_CLK6)
+		{
+			si.clk_freq[SI5351_CLK6] = 0;
+			si.clk_freq[SI5351_CLK7] = 0;
+		}
+
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		uint8_t ret = si.set_freq(freq, clk);
+		double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+		bin.count++;
+		bin.total_ns += ns;
+		bin.max_ns = std::max(bin.max_ns, ns);
+
+		if(ret != 0 || !dev->clk_rational(clk, &num, &den))
+		{
+			bin.refused++;
+			continue;
+		}
+
+		// Exact error of num/den Hz against freq/100 Hz
+		unsigned __int128 a = num * SI5351_FREQ_MULT;
+		unsigned __int128 b = (unsigned __int128)freq * den;
+		unsigned __int128 diff = a > b ? a - b : b - a;
+		long double err = (long double)diff / ((long double)den * SI5351_FREQ_MULT);
+		long double ppb = err * 1e9L * SI5351_FREQ_MULT / freq;
+
+		bin.max_err_hz = std::max(bin.max_err_hz, err);
+		bin.max_err_ppb = std::max(bin.max_err_ppb, ppb);
+
+		int decade = err > 0 ? (int)floorl(log10l(err)) - ERR_DECADE_MIN : 0;
+		decade = decade < 0 ? 0 : (decade >= ERR_DECADES ? ERR_DECADES - 1 : decade);
+		bin.err_hist[decade]++;
+
+		Sample s = {freq, err};
+		keep_worst(w->worst, s);
+	}
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: si5351_scan [--points N] [--threads N] [--clk N] [--xo HZ]\n"
+		"                   [--csv FILE] [--heatmap FILE] [--worst N]\n");
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	uint64_t points = 2000000;
+	unsigned threads = std::thread::hardware_concurrency();
+	int clk = 0;
+	uint32_t xo = SI5351_XTAL_FREQ;
+	const char *csv_path = NULL;
+	const char *heatmap_path = NULL;
+
+	for(int i = 1; i < argc; i++)
+	{
+		if(i + 1 >= argc)
+		{
+			usage();
+		}
+		if(!strcmp(argv[i], "--points"))
+		{
+			points = strtoull(argv[++i], NULL, 0);
+		}
+		else if(!strcmp(argv[i], "--threads"))
+		{
+			threads = strtoul(argv[++i], NULL, 0);
+		}
+		else if(!strcmp(argv[i], "--clk"))
+		{
+			clk = atoi(argv[++i]);
+		}
+		else if(!strcmp(argv[i], "--xo"))
+		{
+			xo = strtoul(argv[++i], NULL, 0);
+		}
+		else if(!strcmp(argv[i], "--csv"))
+		{
+			csv_path = argv[++i];
+		}
+		else if(!strcmp(argv[i], "--heatmap"))
+		{
+			heatmap_path = argv[++i];
+		}
+		else if(!strcmp(argv[i], "--worst"))
+		{
+			n_worst = strtoul(argv[++i], NULL, 0);
+		}
+		else
+		{
+			usage();
+		}
+	}
+	if(clk < 0 || clk > 7 || points == 0)
+	{
+		usage();
+	}
+	if(threads == 0)
+	{
+		threads = 1;
+	}
+
+	f_min = (clk >= 6 ? SI5351_CLKOUT67_MIN_FREQ : SI5351_CLKOUT_MIN_FREQ) * SI5351_FREQ_MULT;
+	f_max = (clk >= 6 ? SI5351_CLKOUT67_MAX_FREQ - 1 : SI5351_CLKOUT_MAX_FREQ) * SI5351_FREQ_MULT;
+	n_bins = (int)ceil(log10((double)f_max / f_min) * BINS_PER_DECADE) + 1;
+
+	std::vector<Worker> workers(threads);
+	std::vector<std::thread> pool;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	for(unsigned t = 0; t < threads; t++)
+	{
+		pool.push_back(std::thread(scan, &workers[t], points * t / threads,
+			points * (t + 1) / threads, points, (enum si5351_clock)clk, xo));
+	}
+	for(unsigned t = 0; t < threads; t++)
+	{
+		pool[t].join();
+	}
+
+	double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	// Merge the per-thread results
+	std::vector<Bin> bins(n_bins, Bin());
+	std::vector<Sample> worst;
+	for(unsigned t = 0; t < threads; t++)
+	{
+		for(int b = 0; b < n_bins; b++)
+		{
+			const Bin &src = workers[t].bins[b];
+			Bin &dst = bins[b];
+			dst.count += src.count;
+			dst.refused += src.refused;
+			dst.max_err_hz = std::max(dst.max_err_hz, src.max_err_hz);
+			dst.max_err_ppb = std::max(dst.max_err_ppb, src.max_err_ppb);
+			dst.total_ns += src.total_ns;
+			dst.max_ns = std::max(dst.max_ns, src.max_ns);
+			for(int d = 0; d < ERR_DECADES; d++)
+			{
+				dst.err_hist[d] += src.err_hist[d];
+			}
+		}
+		for(size_t i = 0; i < workers[t].worst.size(); i++)
+		{
+			keep_worst(worst, workers[t].worst[i]);
+		}
+	}
+
+	if(csv_path)
+	{
+		FILE *f = fopen(csv_path, "w");
+		if(!f)
+		{
+			perror(csv_path);
+			return 1;
+		}
+		fprintf(f, "bin_lo_hz,bin_hi_hz,count,refused,max_err_hz,max_err_ppb,mean_ns,max_ns\n");
+		for(int b = 0; b < n_bins; b++)
+		{
+			const Bin &bin = bins[b];
+			fprintf(f, "%.2f,%.2f,%llu,%llu,%.9Lf,%.6Lf,%.1f,%.1f\n",
+				f_min * pow(10.0, (double)b / BINS_PER_DECADE) / SI5351_FREQ_MULT,
+				f_min * pow(10.0, (double)(b + 1) / BINS_PER_DECADE) / SI5351_FREQ_MULT,
+				(unsigned long long)bin.count, (unsigned long long)bin.refused,
+				bin.max_err_hz, bin.max_err_ppb,
+				bin.count ? bin.total_ns / bin.count : 0.0, bin.max_ns);
+		}
+		fclose(f);
+	}
+
+	if(heatmap_path)
+	{
+		FILE *f = fopen(heatmap_path, "w");
+		if(!f)
+		{
+			perror(heatmap_path);
+			return 1;
+		}
+		fprintf(f, "bin_lo_hz");
+		for(int d = 0; d < ERR_DECADES; d++)
+		{
+			fprintf(f, ",err_1e%d", d + ERR_DECADE_MIN);
+		}
+		fprintf(f, "\n");
+		for(int b = 0; b < n_bins; b++)
+		{
+			fprintf(f, "%.2f", f_min * pow(10.0, (double)b / BINS_PER_DECADE) / SI5351_FREQ_MULT);
+			for(int d = 0; d < ERR_DECADES; d++)
+			{
+				fprintf(f, ",%llu", (unsigned long long)bins[b].err_hist[d]);
+			}
+			fprintf(f, "\n");
+		}
+		fclose(f);
+	}
+
+	// Summary per decade of output frequency
+	printf("CLK%d, %llu targets, %u threads, %.2f s\n\n", clk, (unsigned long long)points, threads, wall);
+	printf("%-14s %10s %8s %14s %12s %10s %10s\n", "from Hz", "targets", "refused",
+		"max err Hz", "max err ppb", "mean ns", "max ns");
+	for(int b = 0; b < n_bins; b += BINS_PER_DECADE)
+	{
+		Bin sum = Bin();
+		for(int i = b; i < b + BINS_PER_DECADE && i < n_bins; i++)
+		{
+			sum.count += bins[i].count;
+			sum.refused += bins[i].refused;
+			sum.max_err_hz = std::max(sum.max_err_hz, bins[i].max_err_hz);
+			sum.max_err_ppb = std::max(sum.max_err_ppb, bins[i].max_err_ppb);
+			sum.total_ns += bins[i].total_ns;
+			sum.max_ns = std::max(sum.max_ns, bins[i].max_ns);
+		}
+		printf("%-14.2f %10llu %8llu %14.6Lf %12.3Lf %10.1f %10.1f\n",
+			f_min * pow(10.0, (double)b / BINS_PER_DECADE) / SI5351_FREQ_MULT,
+			(unsigned long long)sum.count, (unsigned long long)sum.refused,
+			sum.max_err_hz, sum.max_err_ppb,
+			sum.count ? sum.total_ns / sum.count : 0.0, sum.max_ns);
+	}
+
+	std::sort(worst.begin(), worst.end(), [](const Sample &a, const Sample &b) {
+		return a.err_hz > b.err_hz;
+	});
+	printf("\nworst cases\n");
+	for(size_t i = 0; i < worst.size(); i++)
+	{
+		printf("  %16.2f Hz  error %.6Lf Hz\n", (double)worst[i].freq / SI5351_FREQ_MULT, worst[i].err_hz);
+	}
+
+	return 0;
+}
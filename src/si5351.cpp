@@ -23,25 +23,164 @@
  */
 
 #include <stdint.h>
+#include <string.h>
 
+#if defined(ARDUINO)
 #include "Arduino.h"
 #include "Wire.h"
+#elif defined(__unix__)
+#include <time.h>
+#endif
 #include "si5351.h"
 
+#if defined(SI5351_OP_TRACKING)
+/*
+ * Marks the public method that is currently driving the bus. Only the
+ * outermost method is recorded, so the set_pll() and set_ms() calls made
+ * from inside of set_freq() are charged to set_freq().
+ */
+class Si5351OpScope
+{
+public:
+	Si5351OpScope(Si5351 *dev, enum si5351_op op): dev(dev)
+	{
+		prev = dev->op_enter(op);
+	}
+	~Si5351OpScope()
+	{
+		dev->op_exit(prev);
+	}
+private:
+	Si5351 *dev;
+	uint8_t prev;
+};
+
+#define SI5351_OP_SCOPE(op) Si5351OpScope op_scope(this, op)
+#else
+#define SI5351_OP_SCOPE(op)
+#endif
+
+#if defined(SI5351_STATS)
+#define SI5351_STAT_ADD(field, n) (stats.op[cur_op].field += (n))
+#else
+#define SI5351_STAT_ADD(field, n)
+#endif
+
+// Buffer for the register parameters of one bulk write
+#if defined(SI5351_COMPACT)
+#define SI5351_PARAMS(name) uint8_t name[20]
+#define SI5351_PARAMS_FREE(name)
+#else
+#define SI5351_PARAMS(name) uint8_t *name = new uint8_t[20]; SI5351_STAT_ADD(allocs, 1)
+#define SI5351_PARAMS_FREE(name) delete[] name
+#endif
+
+// A set_freq_native() frequency in the Hz * 100 the rest of the library uses
+#if SI5351_RESOLUTION == SI5351_RESOLUTION_HZ
+#define SI5351_NATIVE_TO_CENTI(freq) ((uint64_t)(freq) * SI5351_FREQ_MULT)
+#else
+#define SI5351_NATIVE_TO_CENTI(freq) ((freq) / (SI5351_RES_MULT / SI5351_FREQ_MULT))
+#endif
+
+#if defined(SI5351_TRACE)
+#define SI5351_TRACE_BEGIN() uint32_t trace_start = trace_clock()
+#define SI5351_TRACE_END(flags, reg, len, data) \
+	trace_record(flags, reg, len, data, trace_start)
+
+static void si5351_put_le16(uint8_t *buf, uint16_t val)
+{
+	buf[0] = (uint8_t)(val & 0xFF);
+	buf[1] = (uint8_t)((val >> 8) & 0xFF);
+}
+
+static void si5351_put_le32(uint8_t *buf, uint32_t val)
+{
+	si5351_put_le16(buf, (uint16_t)(val & 0xFFFF));
+	si5351_put_le16(buf + 2, (uint16_t)(val >> 16));
+}
+#else
+#define SI5351_TRACE_BEGIN()
+#define SI5351_TRACE_END(flags, reg, len, data)
+#endif
+
+
+#if defined(ARDUINO)
+static Si5351WireBus si5351_wire_bus;
+#endif
 
 /********************/
 /* Public functions */
 /********************/
 
-Si5351::Si5351(uint8_t i2c_addr):
-	i2c_bus_addr(i2c_addr)
+/*
+ * si5351_micros(void)
+ *
+ * Returns microseconds from an arbitrary start, wrapping at 32 bits.
+ */
+uint32_t si5351_micros(void)
+{
+#if defined(ARDUINO)
+	return (uint32_t)micros();
+#elif defined(__unix__)
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint32_t)(ts.tv_sec * 1000000UL + ts.tv_nsec / 1000);
+#else
+	return 0;
+#endif
+}
+
+/*
+ * Si5351(uint8_t i2c_addr, Si5351Bus *bus)
+ *
+ * i2c_addr - I2C address of the device
+ * bus - Transport to reach the device through. On Arduino, NULL selects
+ *   the Wire library. Other platforms must supply one.
+ */
+Si5351::Si5351(uint8_t i2c_addr, Si5351Bus *bus):
+	i2c_bus_addr(i2c_addr),
+	bus(bus)
 {
+#if defined(ARDUINO)
+	if(bus == NULL)
+	{
+		this->bus = &si5351_wire_bus;
+	}
+#endif
+
 	xtal_freq[0] = SI5351_XTAL_FREQ;
+#if !defined(SI5351_HAS_CLKIN)
+	// init() only sets up the references the part has
+	xtal_freq[SI5351_PLL_INPUT_CLKIN] = 0;
+	ref_correction[SI5351_PLL_INPUT_CLKIN] = 0;
+#endif
 
 	// Start by using XO ref osc as default for each PLL
 	plla_ref_osc = SI5351_PLL_INPUT_XO;
 	pllb_ref_osc = SI5351_PLL_INPUT_XO;
 	clkin_div = SI5351_CLKIN_DIV_1;
+	int_mode_mask = 0;
+	ssc_mode = SI5351_SSC_OFF;
+	ssc_spread = 0;
+	ssc_rate = SI5351_SSC_RATE_DEFAULT;
+#if SI5351_RESOLUTION == SI5351_RESOLUTION_HZ
+	pll_hz[0] = 0;
+	pll_hz[1] = 0;
+	pll_hz_from[0] = 0;
+	pll_hz_from[1] = 0;
+#endif
+
+#if defined(SI5351_OP_TRACKING)
+	cur_op = SI5351_OP_OTHER;
+#endif
+#if defined(SI5351_STATS)
+	reset_stats();
+#endif
+#if defined(SI5351_TRACE)
+	trace_clock = si5351_micros;
+	trace_clear();
+#endif
 }
 
 /*
@@ -62,13 +201,14 @@ Si5351::Si5351(uint8_t i2c_addr):
  */
 bool Si5351::init(uint8_t xtal_load_c, uint32_t xo_freq, int32_t corr)
 {
+	SI5351_OP_SCOPE(SI5351_OP_INIT);
+
 	// Start I2C comms
-	Wire.begin();
+	bus->begin();
 
 	// Check for a device on the bus, bail out if it is not there
-	Wire.beginTransmission(i2c_bus_addr);
 	uint8_t reg_val;
-  reg_val = Wire.endTransmission();
+  reg_val = bus->probe(i2c_bus_addr);
 
 	if(reg_val == 0)
 	{
@@ -86,17 +226,23 @@ bool Si5351::init(uint8_t xtal_load_c, uint32_t xo_freq, int32_t corr)
 		if (xo_freq != 0)
 		{
 			set_ref_freq(xo_freq, SI5351_PLL_INPUT_XO);
+#if defined(SI5351_HAS_CLKIN)
             set_ref_freq(xo_freq, SI5351_PLL_INPUT_CLKIN);          //Also CLKIN
+#endif
 		}
 		else
 		{
 			set_ref_freq(SI5351_XTAL_FREQ, SI5351_PLL_INPUT_XO);
+#if defined(SI5351_HAS_CLKIN)
             set_ref_freq(SI5351_XTAL_FREQ, SI5351_PLL_INPUT_CLKIN); //Also CLKIN
+#endif
 		}
 
 		// Set the frequency calibrations for the XO and CLKIN
 		set_correction(corr, SI5351_PLL_INPUT_XO);
+#if defined(SI5351_HAS_CLKIN)
         set_correction(corr, SI5351_PLL_INPUT_CLKIN);
+#endif
 
 		reset();
 
@@ -116,62 +262,54 @@ bool Si5351::init(uint8_t xtal_load_c, uint32_t xo_freq, int32_t corr)
  */
 void Si5351::reset(void)
 {
+	SI5351_OP_SCOPE(SI5351_OP_RESET);
+
+	uint8_t i;
+
 	// Initialize the CLK outputs according to flowchart in datasheet
 	// First, turn them off
-	si5351_write(16, 0x80);
-	si5351_write(17, 0x80);
-	si5351_write(18, 0x80);
-	si5351_write(19, 0x80);
-	si5351_write(20, 0x80);
-	si5351_write(21, 0x80);
-	si5351_write(22, 0x80);
-	si5351_write(23, 0x80);
+	for(i = 0; i < SI5351_CLK_COUNT; i++)
+	{
+		si5351_write(SI5351_CLK0_CTRL + i, 0x80);
+	}
 
 	// Turn the clocks back on...
-	si5351_write(16, 0x0c);
-	si5351_write(17, 0x0c);
-	si5351_write(18, 0x0c);
-	si5351_write(19, 0x0c);
-	si5351_write(20, 0x0c);
-	si5351_write(21, 0x0c);
-	si5351_write(22, 0x0c);
-	si5351_write(23, 0x0c);
+	for(i = 0; i < SI5351_CLK_COUNT; i++)
+	{
+		si5351_write(SI5351_CLK0_CTRL + i, 0x0c);
+	}
+	int_mode_mask = 0;
+
+	// Spread spectrum off, if it was turned on
+	if(ssc_mode != SI5351_SSC_OFF)
+	{
+		set_ssc(SI5351_SSC_OFF, 0);
+	}
 
 	// Set PLLA and PLLB to 800 MHz for automatic tuning
 	set_pll(SI5351_PLL_FIXED, SI5351_PLLA);
 	set_pll(SI5351_PLL_FIXED, SI5351_PLLB);
 
-	// Make PLL to CLK assignments for automatic tuning
-	pll_assignment[0] = SI5351_PLLA;
-	pll_assignment[1] = SI5351_PLLA;
-	pll_assignment[2] = SI5351_PLLA;
-	pll_assignment[3] = SI5351_PLLA;
-	pll_assignment[4] = SI5351_PLLA;
-	pll_assignment[5] = SI5351_PLLA;
-	pll_assignment[6] = SI5351_PLLB;
-	pll_assignment[7] = SI5351_PLLB;
-
-	set_ms_source(SI5351_CLK0, SI5351_PLLA);
-	set_ms_source(SI5351_CLK1, SI5351_PLLA);
-	set_ms_source(SI5351_CLK2, SI5351_PLLA);
-	set_ms_source(SI5351_CLK3, SI5351_PLLA);
-	set_ms_source(SI5351_CLK4, SI5351_PLLA);
-	set_ms_source(SI5351_CLK5, SI5351_PLLA);
-	set_ms_source(SI5351_CLK6, SI5351_PLLB);
-	set_ms_source(SI5351_CLK7, SI5351_PLLB);
+	// Make PLL to CLK assignments for automatic tuning: CLK0-CLK5 on
+	// PLLA, CLK6 and CLK7 on PLLB
+	for(i = 0; i < SI5351_CLK_COUNT; i++)
+	{
+		set_ms_source((enum si5351_clock)i, i < 6 ? SI5351_PLLA : SI5351_PLLB);
+	}
 
+#if defined(SI5351_HAS_VCXO)
 	// Reset the VCXO param
 	si5351_write(SI5351_VXCO_PARAMETERS_LOW, 0);
 	si5351_write(SI5351_VXCO_PARAMETERS_MID, 0);
 	si5351_write(SI5351_VXCO_PARAMETERS_HIGH, 0);
+#endif
 
 	// Then reset the PLLs
 	pll_reset(SI5351_PLLA);
 	pll_reset(SI5351_PLLB);
 
 	// Set initial frequencies
-	uint8_t i;
-	for(i = 0; i < 8; i++)
+	for(i = 0; i < SI5351_CLK_COUNT; i++)
 	{
 		clk_freq[i] = 0;
 		output_enable((enum si5351_clock)i, 0);
@@ -191,12 +329,19 @@ void Si5351::reset(void)
  */
 uint8_t Si5351::set_freq(uint64_t freq, enum si5351_clock clk)
 {
+	SI5351_OP_SCOPE(SI5351_OP_SET_FREQ);
+
 	struct Si5351RegSet ms_reg;
 	uint64_t pll_freq;
 	uint8_t int_mode = 0;
 	uint8_t div_by_4 = 0;
 	uint8_t r_div = 0;
 
+	if((uint8_t)clk >= SI5351_CLK_COUNT)
+	{
+		return 1;
+	}
+
 	// Check which Multisynth is being set
 	if((uint8_t)clk <= (uint8_t)SI5351_CLK5)
 	{
@@ -221,8 +366,8 @@ uint8_t Si5351::set_freq(uint64_t freq, enum si5351_clock clk)
 		if(freq > (SI5351_MULTISYNTH_SHARE_MAX * SI5351_FREQ_MULT))
 		{
 			// Check other clocks on same PLL
-			uint8_t i;
-			for(i = 0; i < 6; i++)
+			uint8_t i, update;
+			for(i = 0; i < SI5351_MS_COUNT; i++)
 			{
 				if(clk_freq[i] > (SI5351_MULTISYNTH_SHARE_MAX * SI5351_FREQ_MULT))
 				{
@@ -246,43 +391,26 @@ uint8_t Si5351::set_freq(uint64_t freq, enum si5351_clock clk)
 			// Calculate the proper PLL frequency
 			pll_freq = multisynth_calc(freq, 0, &ms_reg);
 
-			// Set PLL
-			set_pll(pll_freq, pll_assignment[clk]);
-
-			// Recalculate params for other synths on same PLL
-			for(i = 0; i < 6; i++)
+			// Only the outputs that follow the PLL need new parameters. If the
+			// PLL ends up where it already was, that is just this one.
+			update = 1 << (uint8_t)clk;
+			if(pll_freq != (pll_assignment[clk] == SI5351_PLLA ? plla_freq : pllb_freq))
 			{
-				if(clk_freq[i] != 0)
+				for(i = 0; i < SI5351_MS_COUNT; i++)
 				{
-					if(pll_assignment[i] == pll_assignment[clk])
+					if(clk_freq[i] != 0 && pll_assignment[i] == pll_assignment[clk])
 					{
-						struct Si5351RegSet temp_reg;
-						uint64_t temp_freq;
-
-						// Select the proper R div value
-						temp_freq = clk_freq[i];
-						r_div = select_r_div(&temp_freq);
-
-						multisynth_calc(temp_freq, pll_freq, &temp_reg);
-
-						// If freq > 150 MHz, we need to use DIVBY4 and integer mode
-						if(temp_freq >= SI5351_MULTISYNTH_DIVBY4_FREQ * SI5351_FREQ_MULT)
-						{
-							div_by_4 = 1;
-							int_mode = 1;
-						}
-						else
-						{
-							div_by_4 = 0;
-							int_mode = 0;
-						}
-
-						// Set multisynth registers
-						set_ms((enum si5351_clock)i, temp_reg, int_mode, r_div, div_by_4);
+						update |= 1 << i;
 					}
 				}
 			}
 
+			// Set PLL
+			set_pll(pll_freq, pll_assignment[clk]);
+
+			// Recalculate and write the params for those synths
+			set_ms_shared(update, pll_freq);
+
 			// Reset the PLL
 			pll_reset(pll_assignment[clk]);
 		}
@@ -319,6 +447,7 @@ uint8_t Si5351::set_freq(uint64_t freq, enum si5351_clock clk)
 
 		return 0;
 	}
+#if SI5351_CLK_COUNT > 6
 	else
 	{
 		// MS6 and MS7 logic
@@ -434,6 +563,72 @@ uint8_t Si5351::set_freq(uint64_t freq, enum si5351_clock clk)
 
 		return 0;
 	}
+#else
+	return 1;
+#endif
+}
+
+/*
+ * set_freq_native(si5351_freq_t freq, enum si5351_clock clk)
+ *
+ * Sets the clock frequency of the specified CLK output like set_freq(),
+ * with the frequency in the unit picked by SI5351_RESOLUTION. For CLK0
+ * through CLK5 up to 100 MHz, the multisynth is worked out in that unit.
+ * With SI5351_RESOLUTION_HZ that is 32-bit math, apart from one 64-bit
+ * division each time the PLL changes. With SI5351_RESOLUTION_MICRO it is
+ * 64-bit. Other outputs and frequencies, and PLLs that aren't a whole
+ * number of the unit, go through set_freq(). clk_freq[] still holds
+ * Hz * 100.
+ *
+ * freq - Output frequency in Hz * SI5351_RES_MULT
+ * clk - Clock output
+ *   (use the si5351_clock enum)
+ */
+uint8_t Si5351::set_freq_native(si5351_freq_t freq, enum si5351_clock clk)
+{
+#if SI5351_RESOLUTION == SI5351_RESOLUTION_CENTI
+	return set_freq(freq, clk);
+#else
+	SI5351_OP_SCOPE(SI5351_OP_SET_FREQ);
+
+	struct Si5351RegSet ms_reg;
+	si5351_freq_t pll_freq;
+	uint8_t r_div;
+
+	if((uint8_t)clk >= SI5351_MS_COUNT || freq == 0 ||
+		freq > SI5351_MULTISYNTH_SHARE_MAX * SI5351_RES_MULT)
+	{
+		return set_freq(SI5351_NATIVE_TO_CENTI(freq), clk);
+	}
+
+	// The PLL isn't set up yet, or isn't a whole number of native units
+	pll_freq = pll_freq_native(pll_assignment[clk]);
+	if(pll_freq == 0)
+	{
+		return set_freq(SI5351_NATIVE_TO_CENTI(freq), clk);
+	}
+
+	// Lower bounds check
+	if(freq < SI5351_CLKOUT_MIN_FREQ * SI5351_RES_MULT)
+	{
+		freq = SI5351_CLKOUT_MIN_FREQ * SI5351_RES_MULT;
+	}
+
+	clk_freq[(uint8_t)clk] = SI5351_NATIVE_TO_CENTI(freq);
+
+	// Enable the output on first set_freq only
+	if(clk_first_set[(uint8_t)clk] == false)
+	{
+		output_enable(clk, 1);
+		clk_first_set[(uint8_t)clk] = true;
+	}
+
+	r_div = select_r_div_native(&freq);
+	multisynth_calc_native(freq, pll_freq, &ms_reg);
+	set_ms(clk, ms_reg, 0, r_div, 0);
+
+	return 0;
+#endif
 }
 
 /*
@@ -453,10 +648,17 @@ uint8_t Si5351::set_freq(uint64_t freq, enum si5351_clock clk)
  */
 uint8_t Si5351::set_freq_manual(uint64_t freq, uint64_t pll_freq, enum si5351_clock clk)
 {
+	SI5351_OP_SCOPE(SI5351_OP_SET_FREQ_MANUAL);
+
 	struct Si5351RegSet ms_reg;
 	uint8_t int_mode = 0;
 	uint8_t div_by_4 = 0;
 
+	if((uint8_t)clk >= SI5351_CLK_COUNT)
+	{
+		return 1;
+	}
+
 	// Lower bounds check
 	if(freq > 0 && freq < SI5351_CLKOUT_MIN_FREQ * SI5351_FREQ_MULT)
 	{
@@ -497,6 +699,128 @@ uint8_t Si5351::set_freq_manual(uint64_t freq, uint64_t pll_freq, enum si5351_cl
     return 0;
 }
 
+/*
+ * set_freq_pingpong(uint64_t freq, enum si5351_clock clk)
+ *
+ * Sets the frequency of one of CLK0 through CLK5 like set_freq(), but
+ * without disturbing the output for long when the change needs a new VCO
+ * frequency. Instead of retuning and resetting the PLL the output runs
+ * from, the other PLL is brought up at the new VCO frequency and left to
+ * lock, the multisynth is set up for it, and a single write of the CLK
+ * control register then moves the output over. The PLL that is left keeps
+ * running the outputs still on it, or is free for the next jump, so large
+ * jumps bounce between the two PLLs.
+ *
+ * When no new VCO frequency is needed, this is the same as set_freq().
+ *
+ * freq - Output frequency in Hz * 100
+ * clk - Clock output
+ *   (use the si5351_clock enum)
+ *
+ * Returns 0 on success, 1 if the output isn't one of CLK0 through CLK5 or
+ * another output uses the other PLL, or 2 if the other PLL did not lock
+ * (the output then stays where it was).
+ */
+uint8_t Si5351::set_freq_pingpong(uint64_t freq, enum si5351_clock clk)
+{
+	SI5351_OP_SCOPE(SI5351_OP_SET_FREQ_PINGPONG);
+
+	struct Si5351RegSet ms_reg;
+	enum si5351_pll old_pll, new_pll;
+	uint64_t pll_freq, temp_freq;
+	uint8_t params[8];
+	uint8_t r_div, div_by_4, ctrl, lol, i;
+
+	if((uint8_t)clk >= SI5351_MS_COUNT)
+	{
+		return 1;
+	}
+
+	// Same bounds as set_freq()
+	if(freq > 0 && freq < SI5351_CLKOUT_MIN_FREQ * SI5351_FREQ_MULT)
+	{
+		freq = SI5351_CLKOUT_MIN_FREQ * SI5351_FREQ_MULT;
+	}
+	if(freq > SI5351_MULTISYNTH_MAX_FREQ * SI5351_FREQ_MULT)
+	{
+		freq = SI5351_MULTISYNTH_MAX_FREQ * SI5351_FREQ_MULT;
+	}
+
+	// Only frequencies above 100 MHz choose their own VCO frequency
+	old_pll = pll_assignment[clk];
+	if(freq <= SI5351_MULTISYNTH_SHARE_MAX * SI5351_FREQ_MULT)
+	{
+		return set_freq(freq, clk);
+	}
+	pll_freq = multisynth_calc(freq, 0, &ms_reg);
+	if(pll_freq == (old_pll == SI5351_PLLA ? plla_freq : pllb_freq))
+	{
+		return set_freq(freq, clk);
+	}
+
+	// The other PLL has to be free
+	new_pll = (old_pll == SI5351_PLLA) ? SI5351_PLLB : SI5351_PLLA;
+	for(i = 0; i < SI5351_CLK_COUNT; i++)
+	{
+		if(i != (uint8_t)clk && clk_freq[i] != 0 && pll_assignment[i] == new_pll)
+		{
+			return 1;
+		}
+	}
+
+	// Enable the output on first set_freq only
+	if(clk_first_set[(uint8_t)clk] == false)
+	{
+		output_enable(clk, 1);
+		clk_first_set[(uint8_t)clk] = true;
+	}
+
+	// Bring up the free PLL and wait for it to lock
+	set_pll(pll_freq, new_pll);
+	pll_reset(new_pll);
+	lol = (new_pll == SI5351_PLLA) ? SI5351_STATUS_LOL_A : SI5351_STATUS_LOL_B;
+	for(i = 0; (si5351_read(SI5351_DEVICE_STATUS) & lol) != 0; i++)
+	{
+		if(i == SI5351_PLL_LOCK_POLLS)
+		{
+			return 2;
+		}
+	}
+
+	// Work out the new multisynth and CLK control settings up front, so
+	// that only the two writes of the switch-over touch the output
+	temp_freq = freq;
+	r_div = select_r_div(&temp_freq);
+	multisynth_calc(temp_freq, pll_freq, &ms_reg);
+	div_by_4 = (temp_freq >= SI5351_MULTISYNTH_DIVBY4_FREQ * SI5351_FREQ_MULT) ? 1 : 0;
+	ms_pack(ms_reg, 0, r_div, div_by_4, params);
+
+	ctrl = si5351_read(SI5351_CLK0_CTRL + (uint8_t)clk);
+	ctrl &= ~(SI5351_CLK_PLL_SELECT | SI5351_CLK_INTEGER_MODE);
+	if(new_pll == SI5351_PLLB)
+	{
+		ctrl |= SI5351_CLK_PLL_SELECT;
+	}
+	if(div_by_4 == 1)
+	{
+		ctrl |= SI5351_CLK_INTEGER_MODE;
+		int_mode_mask |= 1 << (uint8_t)clk;
+	}
+	else
+	{
+		int_mode_mask &= ~(1 << (uint8_t)clk);
+	}
+
+	// Switch over
+	si5351_write_bulk(SI5351_CLK0_PARAMETERS + (uint8_t)clk * 8, 8, params);
+	si5351_write(SI5351_CLK0_CTRL + (uint8_t)clk, ctrl);
+
+	clk_freq[(uint8_t)clk] = freq;
+	pll_assignment[(uint8_t)clk] = new_pll;
+
+	return 0;
+}
+
 /*
  * set_pll(uint64_t pll_freq, enum si5351_pll target_pll)
  *
@@ -508,6 +832,8 @@ uint8_t Si5351::set_freq_manual(uint64_t freq, uint64_t pll_freq, enum si5351_cl
  */
 void Si5351::set_pll(uint64_t pll_freq, enum si5351_pll target_pll)
 {
+  SI5351_OP_SCOPE(SI5351_OP_SET_PLL);
+
   struct Si5351RegSet pll_reg;
 
 	if(target_pll == SI5351_PLLA)
@@ -519,56 +845,27 @@ void Si5351::set_pll(uint64_t pll_freq, enum si5351_pll target_pll)
 		pll_calc(SI5351_PLLB, pll_freq, &pll_reg, ref_correction[pllb_ref_osc], 0);
 	}
 
-  // Derive the register values to write
-
   // Prepare an array for parameters to be written to
-  uint8_t *params = new uint8_t[20];
-  uint8_t i = 0;
-  uint8_t temp;
-
-  // Registers 26-27
-  temp = ((pll_reg.p3 >> 8) & 0xFF);
-  params[i++] = temp;
-
-  temp = (uint8_t)(pll_reg.p3  & 0xFF);
-  params[i++] = temp;
-
-  // Register 28
-  temp = (uint8_t)((pll_reg.p1 >> 16) & 0x03);
-  params[i++] = temp;
-
-  // Registers 29-30
-  temp = (uint8_t)((pll_reg.p1 >> 8) & 0xFF);
-  params[i++] = temp;
-
-  temp = (uint8_t)(pll_reg.p1  & 0xFF);
-  params[i++] = temp;
+  SI5351_PARAMS(params);
 
-  // Register 31
-  temp = (uint8_t)((pll_reg.p3 >> 12) & 0xF0);
-  temp += (uint8_t)((pll_reg.p2 >> 16) & 0x0F);
-  params[i++] = temp;
-
-  // Registers 32-33
-  temp = (uint8_t)((pll_reg.p2 >> 8) & 0xFF);
-  params[i++] = temp;
-
-  temp = (uint8_t)(pll_reg.p2  & 0xFF);
-  params[i++] = temp;
+  pll_pack(pll_reg, params);
 
   // Write the parameters
   if(target_pll == SI5351_PLLA)
   {
-    si5351_write_bulk(SI5351_PLLA_PARAMETERS, i, params);
+    si5351_write_bulk(SI5351_PLLA_PARAMETERS, SI5351_PARAMETERS_LENGTH, params);
 		plla_freq = pll_freq;
+
+		// The spread spectrum steps scale with the feedback ratio
+		ssc_refresh(pll_reg);
   }
   else if(target_pll == SI5351_PLLB)
   {
-    si5351_write_bulk(SI5351_PLLB_PARAMETERS, i, params);
+    si5351_write_bulk(SI5351_PLLB_PARAMETERS, SI5351_PARAMETERS_LENGTH, params);
 		pllb_freq = pll_freq;
   }
 
-  delete params;
+  SI5351_PARAMS_FREE(params);
 }
 
 /*
@@ -586,45 +883,26 @@ void Si5351::set_pll(uint64_t pll_freq, enum si5351_pll target_pll)
  */
 void Si5351::set_ms(enum si5351_clock clk, struct Si5351RegSet ms_reg, uint8_t int_mode, uint8_t r_div, uint8_t div_by_4)
 {
-	uint8_t *params = new uint8_t[20];
+	SI5351_OP_SCOPE(SI5351_OP_SET_MS);
+
 	uint8_t i = 0;
- 	uint8_t temp;
+ 	uint8_t temp = 0;
  	uint8_t reg_val;
 
-
-	if((uint8_t)clk <= (uint8_t)SI5351_CLK5)
+	if((uint8_t)clk >= SI5351_CLK_COUNT)
 	{
-		// Registers 42-43 for CLK0
-		temp = (uint8_t)((ms_reg.p3 >> 8) & 0xFF);
-		params[i++] = temp;
+		return;
+	}
 
-		temp = (uint8_t)(ms_reg.p3  & 0xFF);
-		params[i++] = temp;
+	SI5351_PARAMS(params);
 
-		// Register 44 for CLK0
+	if((uint8_t)clk <= (uint8_t)SI5351_CLK5)
+	{
+		// Register 44 for CLK0, which also holds the R divider and DIVBY4
+		// settings so that they go out in the same burst
 		reg_val = si5351_read((SI5351_CLK0_PARAMETERS + 2) + (clk * 8));
-		reg_val &= ~(0x03);
-		temp = reg_val | ((uint8_t)((ms_reg.p1 >> 16) & 0x03));
-		params[i++] = temp;
-
-		// Registers 45-46 for CLK0
-		temp = (uint8_t)((ms_reg.p1 >> 8) & 0xFF);
-		params[i++] = temp;
-
-		temp = (uint8_t)(ms_reg.p1  & 0xFF);
-		params[i++] = temp;
-
-		// Register 47 for CLK0
-		temp = (uint8_t)((ms_reg.p3 >> 12) & 0xF0);
-		temp += (uint8_t)((ms_reg.p2 >> 16) & 0x0F);
-		params[i++] = temp;
-
-		// Registers 48-49 for CLK0
-		temp = (uint8_t)((ms_reg.p2 >> 8) & 0xFF);
-		params[i++] = temp;
-
-		temp = (uint8_t)(ms_reg.p2  & 0xFF);
-		params[i++] = temp;
+		ms_pack(ms_reg, reg_val, r_div, div_by_4, params);
+		i = 8;
 	}
 	else
 	{
@@ -638,32 +916,26 @@ void Si5351::set_ms(enum si5351_clock clk, struct Si5351RegSet ms_reg, uint8_t i
 		case SI5351_CLK0:
 			si5351_write_bulk(SI5351_CLK0_PARAMETERS, i, params);
 			set_int(clk, int_mode);
-			ms_div(clk, r_div, div_by_4);
 			break;
 		case SI5351_CLK1:
 			si5351_write_bulk(SI5351_CLK1_PARAMETERS, i, params);
 			set_int(clk, int_mode);
-			ms_div(clk, r_div, div_by_4);
 			break;
 		case SI5351_CLK2:
 			si5351_write_bulk(SI5351_CLK2_PARAMETERS, i, params);
 			set_int(clk, int_mode);
-			ms_div(clk, r_div, div_by_4);
 			break;
 		case SI5351_CLK3:
 			si5351_write_bulk(SI5351_CLK3_PARAMETERS, i, params);
 			set_int(clk, int_mode);
-			ms_div(clk, r_div, div_by_4);
 			break;
 		case SI5351_CLK4:
 			si5351_write_bulk(SI5351_CLK4_PARAMETERS, i, params);
 			set_int(clk, int_mode);
-			ms_div(clk, r_div, div_by_4);
 			break;
 		case SI5351_CLK5:
 			si5351_write_bulk(SI5351_CLK5_PARAMETERS, i, params);
 			set_int(clk, int_mode);
-			ms_div(clk, r_div, div_by_4);
 			break;
 		case SI5351_CLK6:
 			si5351_write(SI5351_CLK6_PARAMETERS, temp);
@@ -675,7 +947,105 @@ void Si5351::set_ms(enum si5351_clock clk, struct Si5351RegSet ms_reg, uint8_t i
 			break;
 	}
 
-	delete params;
+	SI5351_PARAMS_FREE(params);
+}
+
+/*
+ * set_ms_shared(uint8_t mask, uint64_t pll_freq)
+ *
+ * Recalculate and write the parameters of the synths among MS0 through MS5
+ * in mask, which all run from a PLL now at pll_freq. This is the part of
+ * set_freq() above 100 MHz whose cost grows with the number of outputs,
+ * so it is kept bounded: neighbouring synths go out together in bursts of
+ * up to SI5351_MS_BURST_MAX, which makes at most three bursts for any
+ * mask, and integer mode is only written where it changes, with one
+ * read and one write of the CLK control registers however many change.
+ *
+ * mask - Bit mask of the synths to update
+ * pll_freq - Frequency of their PLL in Hz * 100
+ */
+void Si5351::set_ms_shared(uint8_t mask, uint64_t pll_freq)
+{
+	uint8_t params[SI5351_MS_BURST_MAX * 8];
+	uint8_t ctrl[6];
+	uint8_t int_want = 0;
+	uint8_t change;
+	uint8_t first = 0;
+	uint8_t last = 0;
+	uint8_t n = 0;
+	uint8_t i;
+
+	for(i = 0; i < 6; i++)
+	{
+		if(mask & (1 << i))
+		{
+			struct Si5351RegSet temp_reg;
+			uint64_t temp_freq;
+			uint8_t r_div;
+			uint8_t div_by_4 = 0;
+
+			// Select the proper R div value
+			temp_freq = clk_freq[i];
+			r_div = select_r_div(&temp_freq);
+
+			multisynth_calc(temp_freq, pll_freq, &temp_reg);
+
+			// If freq > 150 MHz, we need to use DIVBY4 and integer mode
+			if(temp_freq >= SI5351_MULTISYNTH_DIVBY4_FREQ * SI5351_FREQ_MULT)
+			{
+				div_by_4 = 1;
+				int_want |= 1 << i;
+			}
+
+			// The rest of register 44 is reserved, so it needn't be read
+			SI5351_STAT_ADD(rmw_reads_avoided, 1);
+			if(n == 0)
+			{
+				first = i;
+			}
+			ms_pack(temp_reg, 0, r_div, div_by_4, &params[n * 8]);
+			n++;
+		}
+
+		// Send the burst once it is full or the next synth isn't in it
+		if(n > 0 && (n == SI5351_MS_BURST_MAX || i == 5 || !(mask & (2 << i))))
+		{
+			si5351_write_bulk(SI5351_CLK0_PARAMETERS + first * 8, n * 8, params);
+			n = 0;
+		}
+	}
+
+	// Integer mode where it changes, in one read and one write of the CLK
+	// control registers from the first such synth to the last
+	change = mask & (int_mode_mask ^ int_want);
+	for(i = 0; i < 6; i++)
+	{
+		if(change & (1 << i))
+		{
+			last = i;
+		}
+		else if(mask & (1 << i))
+		{
+			// Integer mode is already right, so the CLK control isn't read
+			SI5351_STAT_ADD(rmw_reads_avoided, 1);
+		}
+	}
+	if(change)
+	{
+		for(first = 0; !(change & (1 << first)); first++)
+		{
+		}
+		si5351_read_bulk(SI5351_CLK0_CTRL + first, last - first + 1, ctrl);
+		for(i = first; i <= last; i++)
+		{
+			if(change & (1 << i))
+			{
+				ctrl[i - first] ^= SI5351_CLK_INTEGER_MODE;
+			}
+		}
+		si5351_write_bulk(SI5351_CLK0_CTRL + first, last - first + 1, ctrl);
+		int_mode_mask ^= change;
+	}
 }
 
 /*
@@ -688,8 +1058,15 @@ void Si5351::set_ms(enum si5351_clock clk, struct Si5351RegSet ms_reg, uint8_t i
  */
 void Si5351::output_enable(enum si5351_clock clk, uint8_t enable)
 {
+  SI5351_OP_SCOPE(SI5351_OP_OUTPUT_ENABLE);
+
   uint8_t reg_val;
 
+  if((uint8_t)clk >= SI5351_CLK_COUNT)
+  {
+    return;
+  }
+
   reg_val = si5351_read(SI5351_OUTPUT_ENABLE_CTRL);
 
   if(enable == 1)
@@ -716,9 +1093,16 @@ void Si5351::output_enable(enum si5351_clock clk, uint8_t enable)
  */
 void Si5351::drive_strength(enum si5351_clock clk, enum si5351_drive drive)
 {
+  SI5351_OP_SCOPE(SI5351_OP_DRIVE_STRENGTH);
+
   uint8_t reg_val;
   const uint8_t mask = 0x03;
 
+  if((uint8_t)clk >= SI5351_CLK_COUNT)
+  {
+    return;
+  }
+
   reg_val = si5351_read(SI5351_CLK0_CTRL + (uint8_t)clk);
   reg_val &= ~(mask);
 
@@ -753,11 +1137,15 @@ void Si5351::drive_strength(enum si5351_clock clk, enum si5351_drive drive)
  * correspond to the flag names for registers 0 and 1 in
  * the Si5351 datasheet.
  */
+#if defined(SI5351_HAS_STATUS)
 void Si5351::update_status(void)
 {
+	SI5351_OP_SCOPE(SI5351_OP_UPDATE_STATUS);
+
 	update_sys_status(&dev_status);
 	update_int_status(&dev_int_status);
 }
+#endif
 
 /*
  * set_correction(int32_t corr, enum si5351_pll_input ref_osc)
@@ -787,6 +1175,8 @@ void Si5351::update_status(void)
  */
 void Si5351::set_correction(int32_t corr, enum si5351_pll_input ref_osc)
 {
+	SI5351_OP_SCOPE(SI5351_OP_SET_CORRECTION);
+
 	ref_correction[(uint8_t)ref_osc] = corr;
 
 	// Recalculate and set PLL freqs based on correction value
@@ -808,6 +1198,14 @@ void Si5351::set_correction(int32_t corr, enum si5351_pll_input ref_osc)
  */
 void Si5351::set_phase(enum si5351_clock clk, uint8_t phase)
 {
+	SI5351_OP_SCOPE(SI5351_OP_SET_PHASE);
+
+	// Only MS0-MS5 have a phase offset register
+	if((uint8_t)clk >= SI5351_MS_COUNT)
+	{
+		return;
+	}
+
 	// Mask off the upper bit since it is reserved
 	phase = phase & 0b01111111;
 
@@ -839,6 +1237,10 @@ int32_t Si5351::get_correction(enum si5351_pll_input ref_osc)
  */
 void Si5351::pll_reset(enum si5351_pll target_pll)
 {
+	SI5351_OP_SCOPE(SI5351_OP_PLL_RESET);
+
+	SI5351_STAT_ADD(pll_resets, 1);
+
 	if(target_pll == SI5351_PLLA)
  	{
     	si5351_write(SI5351_PLL_RESET, SI5351_PLL_RESET_A);
@@ -861,8 +1263,15 @@ void Si5351::pll_reset(enum si5351_pll target_pll)
  */
 void Si5351::set_ms_source(enum si5351_clock clk, enum si5351_pll pll)
 {
+	SI5351_OP_SCOPE(SI5351_OP_SET_MS_SOURCE);
+
 	uint8_t reg_val;
 
+	if((uint8_t)clk >= SI5351_CLK_COUNT)
+	{
+		return;
+	}
+
 	reg_val = si5351_read(SI5351_CLK0_CTRL + (uint8_t)clk);
 
 	if(pll == SI5351_PLLA)
@@ -890,7 +1299,15 @@ void Si5351::set_ms_source(enum si5351_clock clk, enum si5351_pll pll)
  */
 void Si5351::set_int(enum si5351_clock clk, uint8_t enable)
 {
+	SI5351_OP_SCOPE(SI5351_OP_SET_INT);
+
 	uint8_t reg_val;
+
+	if((uint8_t)clk >= SI5351_CLK_COUNT)
+	{
+		return;
+	}
+
 	reg_val = si5351_read(SI5351_CLK0_CTRL + (uint8_t)clk);
 
 	if(enable == 1)
@@ -904,6 +1321,15 @@ void Si5351::set_int(enum si5351_clock clk, uint8_t enable)
 
 	si5351_write(SI5351_CLK0_CTRL + (uint8_t)clk, reg_val);
 
+	if(enable == 1)
+	{
+		int_mode_mask |= 1 << (uint8_t)clk;
+	}
+	else
+	{
+		int_mode_mask &= ~(1 << (uint8_t)clk);
+	}
+
 	// Integer mode indication
 	/*
 	switch(clk)
@@ -935,7 +1361,15 @@ void Si5351::set_int(enum si5351_clock clk, uint8_t enable)
  */
 void Si5351::set_clock_pwr(enum si5351_clock clk, uint8_t pwr)
 {
+	SI5351_OP_SCOPE(SI5351_OP_SET_CLOCK_PWR);
+
 	uint8_t reg_val; //, reg;
+
+	if((uint8_t)clk >= SI5351_CLK_COUNT)
+	{
+		return;
+	}
+
 	reg_val = si5351_read(SI5351_CLK0_CTRL + (uint8_t)clk);
 
 	if(pwr == 1)
@@ -961,7 +1395,15 @@ void Si5351::set_clock_pwr(enum si5351_clock clk, uint8_t pwr)
  */
 void Si5351::set_clock_invert(enum si5351_clock clk, uint8_t inv)
 {
+	SI5351_OP_SCOPE(SI5351_OP_SET_CLOCK_INVERT);
+
 	uint8_t reg_val;
+
+	if((uint8_t)clk >= SI5351_CLK_COUNT)
+	{
+		return;
+	}
+
 	reg_val = si5351_read(SI5351_CLK0_CTRL + (uint8_t)clk);
 
 	if(inv == 1)
@@ -991,7 +1433,15 @@ void Si5351::set_clock_invert(enum si5351_clock clk, uint8_t inv)
  */
 void Si5351::set_clock_source(enum si5351_clock clk, enum si5351_clock_source src)
 {
+	SI5351_OP_SCOPE(SI5351_OP_SET_CLOCK_SOURCE);
+
 	uint8_t reg_val;
+
+	if((uint8_t)clk >= SI5351_CLK_COUNT)
+	{
+		return;
+	}
+
 	reg_val = si5351_read(SI5351_CLK0_CTRL + (uint8_t)clk);
 
 	// Clear the bits first
@@ -1037,8 +1487,15 @@ void Si5351::set_clock_source(enum si5351_clock clk, enum si5351_clock_source sr
  */
 void Si5351::set_clock_disable(enum si5351_clock clk, enum si5351_clock_disable dis_state)
 {
+	SI5351_OP_SCOPE(SI5351_OP_SET_CLOCK_DISABLE);
+
 	uint8_t reg_val, reg;
 
+	if((uint8_t)clk >= SI5351_CLK_COUNT)
+	{
+		return;
+	}
+
 	if (clk >= SI5351_CLK0 && clk <= SI5351_CLK3)
 	{
 		reg = SI5351_CLK3_0_DISABLE_STATE;
@@ -1080,6 +1537,8 @@ void Si5351::set_clock_disable(enum si5351_clock clk, enum si5351_clock_disable
  */
 void Si5351::set_clock_fanout(enum si5351_clock_fanout fanout, uint8_t enable)
 {
+	SI5351_OP_SCOPE(SI5351_OP_SET_CLOCK_FANOUT);
+
 	uint8_t reg_val;
 	reg_val = si5351_read(SI5351_FANOUT_ENABLE);
 
@@ -1130,8 +1589,11 @@ void Si5351::set_clock_fanout(enum si5351_clock_fanout fanout, uint8_t enable)
  *
  * Set the desired reference oscillator source for the given PLL.
  */
+#if defined(SI5351_HAS_CLKIN)
 void Si5351::set_pll_input(enum si5351_pll pll, enum si5351_pll_input input)
 {
+	SI5351_OP_SCOPE(SI5351_OP_SET_PLL_INPUT);
+
 	uint8_t reg_val;
 	reg_val = si5351_read(SI5351_PLL_INPUT_SOURCE);
 
@@ -1175,6 +1637,7 @@ void Si5351::set_pll_input(enum si5351_pll pll, enum si5351_pll_input input)
 	set_pll(plla_freq, SI5351_PLLA);
 	set_pll(pllb_freq, SI5351_PLLB);
 }
+#endif
 
 /*
  * set_vcxo(uint64_t pll_freq, uint8_t ppm)
@@ -1184,8 +1647,11 @@ void Si5351::set_pll_input(enum si5351_pll pll, enum si5351_pll_input input)
  *
  * Set the parameters for the VCXO on the Si5351B.
  */
+#if defined(SI5351_HAS_VCXO)
 void Si5351::set_vcxo(uint64_t pll_freq, uint8_t ppm)
 {
+	SI5351_OP_SCOPE(SI5351_OP_SET_VCXO);
+
 	struct Si5351RegSet pll_reg;
 	uint64_t vcxo_param;
 
@@ -1206,7 +1672,7 @@ void Si5351::set_vcxo(uint64_t pll_freq, uint8_t ppm)
 	// Derive the register values to write
 
 	// Prepare an array for parameters to be written to
-	uint8_t *params = new uint8_t[20];
+	SI5351_PARAMS(params);
 	uint8_t i = 0;
 	uint8_t temp;
 
@@ -1243,7 +1709,7 @@ void Si5351::set_vcxo(uint64_t pll_freq, uint8_t ppm)
 	// Write the parameters
 	si5351_write_bulk(SI5351_PLLB_PARAMETERS, i, params);
 
-	delete params;
+	SI5351_PARAMS_FREE(params);
 
 	// Write the VCXO parameters
 	vcxo_param = ((vcxo_param * ppm * SI5351_VCXO_MARGIN) / 100ULL) / 1000000ULL;
@@ -1257,6 +1723,58 @@ void Si5351::set_vcxo(uint64_t pll_freq, uint8_t ppm)
 	temp = (uint8_t)((vcxo_param >> 16) & 0x3F);
 	si5351_write(SI5351_VXCO_PARAMETERS_HIGH, temp);
 }
+#endif
+
+/*
+ * set_ssc(enum si5351_ssc_mode mode, uint16_t spread, uint32_t rate)
+ *
+ * mode - Down spread, center spread or off
+ *   (use the si5351_ssc_mode enum)
+ * spread - Total spread for down spread, or the spread either side of the
+ *   nominal frequency for center spread, in hundredths of a percent.
+ *   Down spread goes up to 250 (2.5%), center spread up to 150 (1.5%).
+ * rate - Modulation rate in Hz, 31.5 kHz if left out
+ *
+ * Spread the frequency of PLLA, and of every output that runs from it,
+ * to lower the peaks of its spectrum for EMI. Down spread keeps the
+ * nominal frequency as the highest one; center spread sweeps either side
+ * of it. The parameters are worked out from the PLLA feedback ratio and
+ * reference, written in one burst, and worked out again whenever PLLA is
+ * set. Only PLLA can spread.
+ *
+ * Returns 0 on success, or 1 if the spread or rate is out of range (the
+ * device is then left alone).
+ */
+uint8_t Si5351::set_ssc(enum si5351_ssc_mode mode, uint16_t spread, uint32_t rate)
+{
+	SI5351_OP_SCOPE(SI5351_OP_SET_SSC);
+
+	struct Si5351RegSet pll_reg;
+	uint32_t udp;
+
+	if(mode == SI5351_SSC_OFF)
+	{
+		ssc_mode = SI5351_SSC_OFF;
+		si5351_write(SI5351_SSC_PARAM0, 0);
+		return 0;
+	}
+
+	udp = rate ? xtal_freq[(uint8_t)plla_ref_osc] / (4 * rate) : 0;
+	if(spread == 0 || udp == 0 || udp > SI5351_SSC_UDP_MAX ||
+		spread > (mode == SI5351_SSC_DOWN ? SI5351_SSC_DOWN_MAX : SI5351_SSC_CENTER_MAX))
+	{
+		return 1;
+	}
+
+	ssc_mode = mode;
+	ssc_spread = spread;
+	ssc_rate = rate;
+
+	pll_calc(SI5351_PLLA, plla_freq, &pll_reg, ref_correction[plla_ref_osc], 0);
+	ssc_refresh(pll_reg);
+
+	return 0;
+}
 
 /*
  * set_ref_freq(uint32_t ref_freq, enum si5351_pll_input ref_osc)
@@ -1312,42 +1830,326 @@ void Si5351::set_ref_freq(uint32_t ref_freq, enum si5351_pll_input ref_osc)
 
 uint8_t Si5351::si5351_write_bulk(uint8_t addr, uint8_t bytes, uint8_t *data)
 {
-	Wire.beginTransmission(i2c_bus_addr);
-	Wire.write(addr);
-	for(int i = 0; i < bytes; i++)
-	{
-		Wire.write(data[i]);
-	}
-	return Wire.endTransmission();
+	uint8_t ret;
 
+	SI5351_STAT_ADD(transactions, 1);
+	SI5351_STAT_ADD(bytes_written, bytes + 1);
+	SI5351_TRACE_BEGIN();
+
+	ret = bus->write(i2c_bus_addr, addr, bytes, data);
+
+	SI5351_TRACE_END(0, addr, bytes, data);
+
+	return ret;
 }
 
 uint8_t Si5351::si5351_write(uint8_t addr, uint8_t data)
 {
-	Wire.beginTransmission(i2c_bus_addr);
-	Wire.write(addr);
-	Wire.write(data);
-	return Wire.endTransmission();
+	uint8_t ret;
+
+	SI5351_STAT_ADD(transactions, 1);
+	SI5351_STAT_ADD(bytes_written, 2);
+	SI5351_TRACE_BEGIN();
+
+	ret = bus->write(i2c_bus_addr, addr, 1, &data);
+
+	SI5351_TRACE_END(0, addr, 1, &data);
+
+	return ret;
+}
+
+// Read bytes registers from addr in one transaction, in order to modify them
+void Si5351::si5351_read_bulk(uint8_t addr, uint8_t bytes, uint8_t *data)
+{
+	SI5351_STAT_ADD(transactions, bus->read_transactions());
+	SI5351_STAT_ADD(bytes_written, 1);
+	SI5351_STAT_ADD(bytes_read, bytes);
+	SI5351_STAT_ADD(rmw_reads, bytes);
+	SI5351_TRACE_BEGIN();
+
+	bus->read(i2c_bus_addr, addr, bytes, data);
+
+	SI5351_TRACE_END(SI5351_TRACE_READ, addr, bytes, data);
 }
 
 uint8_t Si5351::si5351_read(uint8_t addr)
 {
 	uint8_t reg_val = 0;
 
-	Wire.beginTransmission(i2c_bus_addr);
-	Wire.write(addr);
-	Wire.endTransmission();
+	SI5351_STAT_ADD(transactions, bus->read_transactions());
+	SI5351_STAT_ADD(bytes_written, 1);
+	SI5351_STAT_ADD(bytes_read, 1);
 
-	Wire.requestFrom(i2c_bus_addr, (uint8_t)1);
-
-	while(Wire.available())
+	// Everything but the status registers is only ever read back in
+	// order to modify it
+	if(addr != SI5351_DEVICE_STATUS && addr != SI5351_INTERRUPT_STATUS)
 	{
-		reg_val = Wire.read();
+		SI5351_STAT_ADD(rmw_reads, 1);
 	}
 
+	SI5351_TRACE_BEGIN();
+
+	bus->read(i2c_bus_addr, addr, 1, &reg_val);
+
+	SI5351_TRACE_END(SI5351_TRACE_READ, addr, 1, &reg_val);
+
 	return reg_val;
 }
 
+#if defined(ARDUINO)
+/*
+ * Si5351WireBus(TwoWire &wire)
+ *
+ * wire - Wire library instance the Si5351 is connected to
+ *
+ * Bus transport over the Arduino Wire library. A register read is a
+ * register address write followed by a separate read transaction.
+ */
+Si5351WireBus::Si5351WireBus(TwoWire &wire):
+	wire(wire)
+{
+}
+
+void Si5351WireBus::begin(void)
+{
+	wire.begin();
+}
+
+uint8_t Si5351WireBus::probe(uint8_t dev_addr)
+{
+	wire.beginTransmission(dev_addr);
+	return wire.endTransmission();
+}
+
+uint8_t Si5351WireBus::write(uint8_t dev_addr, uint8_t reg, uint8_t len, const uint8_t *data)
+{
+	wire.beginTransmission(dev_addr);
+	wire.write(reg);
+	for(int i = 0; i < len; i++)
+	{
+		wire.write(data[i]);
+	}
+	return wire.endTransmission();
+}
+
+uint8_t Si5351WireBus::read(uint8_t dev_addr, uint8_t reg, uint8_t len, uint8_t *data)
+{
+	uint8_t i = 0;
+
+	wire.beginTransmission(dev_addr);
+	wire.write(reg);
+	wire.endTransmission();
+
+	wire.requestFrom(dev_addr, len);
+
+	while(wire.available())
+	{
+		if(i < len)
+		{
+			data[i++] = wire.read();
+		}
+		else
+		{
+			wire.read();
+		}
+	}
+
+	return i == len ? 0 : 4;
+}
+#endif
+
+#if defined(SI5351_STATS)
+/*
+ * get_stats(struct Si5351Stats *out)
+ *
+ * out - Destination for a snapshot of the bus statistics
+ *
+ * Copy the per-method bus counters accumulated since construction or the
+ * last call to reset_stats(). Index the op array with the si5351_op enum.
+ * Only available when the library is built with SI5351_STATS defined.
+ */
+void Si5351::get_stats(struct Si5351Stats *out)
+{
+	memcpy(out, &stats, sizeof(stats));
+}
+
+/*
+ * reset_stats(void)
+ *
+ * Clear all of the bus statistics counters.
+ */
+void Si5351::reset_stats(void)
+{
+	memset(&stats, 0, sizeof(stats));
+}
+#endif
+
+#if defined(SI5351_TRACE)
+/*
+ * set_trace_clock(uint32_t (*clock)(void))
+ *
+ * clock - Function returning the current time, or NULL to go back to the
+ *   default of micros()
+ *
+ * Set the time source used to stamp the bus trace entries. The trace only
+ * ever takes differences of clock values, so any monotonic 32-bit counter
+ * will do.
+ */
+void Si5351::set_trace_clock(uint32_t (*clock)(void))
+{
+	if(clock)
+	{
+		trace_clock = clock;
+	}
+	else
+	{
+		trace_clock = si5351_micros;
+	}
+}
+
+/*
+ * trace_count(void)
+ *
+ * Returns the number of entries held in the bus trace buffer.
+ */
+uint16_t Si5351::trace_count(void)
+{
+	return trace_len;
+}
+
+/*
+ * trace_get(uint16_t index, struct Si5351TraceEntry *entry)
+ *
+ * index - Entry to fetch, with 0 being the oldest one in the buffer
+ * entry - Destination for the entry
+ *
+ * Returns 0 on success, or 1 if there is no entry at that index.
+ */
+uint8_t Si5351::trace_get(uint16_t index, struct Si5351TraceEntry *entry)
+{
+	if(index >= trace_len)
+	{
+		return 1;
+	}
+
+	index = (trace_head + SI5351_TRACE_DEPTH - trace_len + index) % SI5351_TRACE_DEPTH;
+	memcpy(entry, &trace_buf[index], sizeof(struct Si5351TraceEntry));
+
+	return 0;
+}
+
+/*
+ * trace_export(uint8_t *buf, uint16_t buf_len)
+ *
+ * buf - Destination buffer for the binary log
+ * buf_len - Size of the destination buffer in bytes
+ *
+ * Serialize the bus trace into a compact little-endian binary log that can
+ * be fed to the si5351_replay tool in the extras folder. If the buffer is
+ * too small for the whole trace, the newest entries that fit are exported
+ * and the rest are counted as dropped in the log header.
+ *
+ * Header (SI5351_TRACE_LOG_HEADER_LEN bytes):
+ *   "S5TR", version, I2C address, entry count (16 bits), dropped entries
+ *   (32 bits), XO frequency in Hz (32 bits), CLKIN frequency in Hz (32 bits)
+ * Each entry (SI5351_TRACE_LOG_ENTRY_LEN bytes plus its data):
+ *   time (32 bits), duration (16 bits), op, flags, register, length, data
+ *
+ * Returns the number of bytes written to buf.
+ */
+uint16_t Si5351::trace_export(uint8_t *buf, uint16_t buf_len)
+{
+	uint16_t count = 0;
+	uint16_t size = SI5351_TRACE_LOG_HEADER_LEN;
+	uint16_t i;
+	struct Si5351TraceEntry entry;
+
+	if(buf_len < SI5351_TRACE_LOG_HEADER_LEN)
+	{
+		return 0;
+	}
+
+	// Find how many of the newest entries will fit
+	while(count < trace_len)
+	{
+		trace_get(trace_len - count - 1, &entry);
+		if(size + SI5351_TRACE_LOG_ENTRY_LEN + entry.len > buf_len)
+		{
+			break;
+		}
+		size += SI5351_TRACE_LOG_ENTRY_LEN + entry.len;
+		count++;
+	}
+
+	buf[0] = 'S';
+	buf[1] = '5';
+	buf[2] = 'T';
+	buf[3] = 'R';
+	buf[4] = SI5351_TRACE_LOG_VERSION;
+	buf[5] = i2c_bus_addr;
+	si5351_put_le16(buf + 6, count);
+	si5351_put_le32(buf + 8, trace_dropped + (trace_len - count));
+	si5351_put_le32(buf + 12, xtal_freq[SI5351_PLL_INPUT_XO]);
+	si5351_put_le32(buf + 16, xtal_freq[SI5351_PLL_INPUT_CLKIN] << (clkin_div >> 6));
+
+	size = SI5351_TRACE_LOG_HEADER_LEN;
+	for(i = trace_len - count; i < trace_len; i++)
+	{
+		trace_get(i, &entry);
+		si5351_put_le32(buf + size, entry.time);
+		si5351_put_le16(buf + size + 4, entry.duration);
+		buf[size + 6] = entry.op;
+		buf[size + 7] = entry.flags;
+		buf[size + 8] = entry.reg;
+		buf[size + 9] = entry.len;
+		memcpy(buf + size + SI5351_TRACE_LOG_ENTRY_LEN, entry.data, entry.len);
+		size += SI5351_TRACE_LOG_ENTRY_LEN + entry.len;
+	}
+
+	return size;
+}
+
+/*
+ * trace_clear(void)
+ *
+ * Empty the bus trace buffer.
+ */
+void Si5351::trace_clear(void)
+{
+	trace_head = 0;
+	trace_len = 0;
+	trace_dropped = 0;
+	trace_call_start = false;
+}
+#endif
+
+#if defined(SI5351_COMPACT)
+// Out of line so that every use doesn't carry its own 64-bit math
+Si5351Freq::operator uint64_t() const
+{
+	uint64_t freq = 0;
+	uint8_t i;
+
+	for(i = sizeof(b); i > 0; i--)
+	{
+		freq = (freq << 8) | b[i - 1];
+	}
+	return freq;
+}
+
+Si5351Freq &Si5351Freq::operator=(uint64_t freq)
+{
+	uint8_t i;
+
+	for(i = 0; i < sizeof(b); i++)
+	{
+		b[i] = (uint8_t)freq;
+		freq >>= 8;
+	}
+	return *this;
+}
+#endif
+
 /*********************/
 /* Private functions */
 /*********************/
@@ -1366,6 +2168,9 @@ uint64_t Si5351::pll_calc(enum si5351_pll pll, uint64_t freq, struct Si5351RegSe
 	//ref_freq = 15974400ULL * SI5351_FREQ_MULT;
 	uint32_t a, b, c, p1, p2, p3;
 	uint64_t lltmp; //, denom;
+#if !defined(SI5351_HAS_VCXO)
+	(void)vcxo;
+#endif
 
 	// Factor calibration value into nominal crystal frequency
 	// Measured in parts-per-billion
@@ -1401,12 +2206,14 @@ uint64_t Si5351::pll_calc(enum si5351_pll pll, uint64_t freq, struct Si5351RegSe
 	// do_div(lltmp, ref_freq);
 
 	//b = (((uint64_t)(freq % ref_freq)) * RFRAC_DENOM) / ref_freq;
+#if defined(SI5351_HAS_VCXO)
 	if(vcxo)
 	{
 		b = (((uint64_t)(freq % ref_freq)) * 1000000ULL) / ref_freq;
 		c = 1000000ULL;
 	}
 	else
+#endif
 	{
 		b = (((uint64_t)(freq % ref_freq)) * RFRAC_DENOM) / ref_freq;
 		c = b ? RFRAC_DENOM : 1;
@@ -1428,14 +2235,13 @@ uint64_t Si5351::pll_calc(enum si5351_pll pll, uint64_t freq, struct Si5351RegSe
 	reg->p2 = p2;
 	reg->p3 = p3;
 
+#if defined(SI5351_HAS_VCXO)
 	if(vcxo)
 	{
 		return (uint64_t)(128 * a * 1000000ULL + b);
 	}
-	else
-	{
-		return freq;
-	}
+#endif
+	return freq;
 }
 
 uint64_t Si5351::multisynth_calc(uint64_t freq, uint64_t pll_freq, struct Si5351RegSet *reg)
@@ -1536,6 +2342,7 @@ uint64_t Si5351::multisynth_calc(uint64_t freq, uint64_t pll_freq, struct Si5351
 	}
 }
 
+#if SI5351_CLK_COUNT > 6
 uint64_t Si5351::multisynth67_calc(uint64_t freq, uint64_t pll_freq, struct Si5351RegSet *reg)
 {
 	//uint8_t p1;
@@ -1624,7 +2431,83 @@ uint64_t Si5351::multisynth67_calc(uint64_t freq, uint64_t pll_freq, struct Si53
 		}
 	}
 }
+#endif
+
+#if defined(SI5351_OP_TRACKING)
+uint8_t Si5351::op_enter(enum si5351_op op)
+{
+	uint8_t prev = cur_op;
+
+	// Only the outermost public method is tracked
+	if(cur_op == SI5351_OP_OTHER)
+	{
+		cur_op = op;
+#if defined(SI5351_STATS)
+		stats.op[op].calls++;
+#endif
+#if defined(SI5351_TRACE)
+		trace_call_start = true;
+#endif
+	}
+
+	return prev;
+}
+
+void Si5351::op_exit(uint8_t prev)
+{
+	cur_op = prev;
+}
+#endif
+
+#if defined(SI5351_TRACE)
+void Si5351::trace_record(uint8_t flags, uint8_t reg, uint8_t len, const uint8_t *data, uint32_t start)
+{
+	uint32_t duration = trace_clock() - start;
+	struct Si5351TraceEntry *entry;
+	uint8_t chunk;
+
+	if(duration > 0xFFFF)
+	{
+		duration = 0xFFFF;
+	}
+
+	// Split long transfers into consecutive entries
+	do
+	{
+		chunk = len > SI5351_TRACE_DATA_MAX ? SI5351_TRACE_DATA_MAX : len;
+
+		entry = &trace_buf[trace_head];
+		entry->time = start;
+		entry->duration = (uint16_t)duration;
+		entry->op = cur_op;
+		entry->flags = flags;
+		if(trace_call_start)
+		{
+			entry->flags |= SI5351_TRACE_CALL_START;
+			trace_call_start = false;
+		}
+		entry->reg = reg;
+		entry->len = chunk;
+		memcpy(entry->data, data, chunk);
+
+		trace_head = (trace_head + 1) % SI5351_TRACE_DEPTH;
+		if(trace_len < SI5351_TRACE_DEPTH)
+		{
+			trace_len++;
+		}
+		else
+		{
+			trace_dropped++;
+		}
 
+		reg += chunk;
+		data += chunk;
+		len -= chunk;
+	} while(len > 0);
+}
+#endif
+
+#if defined(SI5351_HAS_STATUS)
 void Si5351::update_sys_status(struct Si5351Status *status)
 {
   uint8_t reg_val = 0;
@@ -1651,6 +2534,125 @@ void Si5351::update_int_status(struct Si5351IntStatus *int_status)
   int_status->LOL_A_STKY = (reg_val >> 5) & 0x01;
   int_status->LOS_STKY = (reg_val >> 4) & 0x01;
 }
+#endif
+
+// Lay out the 8 parameter bytes of a PLL, registers 26-33 for PLLA or
+// 34-41 for PLLB
+void Si5351::pll_pack(struct Si5351RegSet pll_reg, uint8_t *params)
+{
+	// Registers 26-27
+	params[0] = (uint8_t)((pll_reg.p3 >> 8) & 0xFF);
+	params[1] = (uint8_t)(pll_reg.p3  & 0xFF);
+
+	// Register 28
+	params[2] = (uint8_t)((pll_reg.p1 >> 16) & 0x03);
+
+	// Registers 29-30
+	params[3] = (uint8_t)((pll_reg.p1 >> 8) & 0xFF);
+	params[4] = (uint8_t)(pll_reg.p1  & 0xFF);
+
+	// Register 31
+	params[5] = (uint8_t)((pll_reg.p3 >> 12) & 0xF0) + (uint8_t)((pll_reg.p2 >> 16) & 0x0F);
+
+	// Registers 32-33
+	params[6] = (uint8_t)((pll_reg.p2 >> 8) & 0xFF);
+	params[7] = (uint8_t)(pll_reg.p2  & 0xFF);
+}
+
+// Lay out the 13 spread spectrum bytes, registers 149-161, for the PLLA
+// feedback ratio in pll_reg (AN619). With R the ratio a + b/c and s the
+// spread as a fraction:
+//   SSUDP = fPFD / (4 * rate)
+//   SSDN = 64 * R * s / ((1 + s) * SSUDP) for down spread
+//   SSDN = 128 * R * s / ((1 + s) * SSUDP) for center spread
+//   SSUP = 128 * R * s / ((1 - s) * SSUDP) for center spread
+// SSDN and SSUP go in as P1 + P2 / P3 with P3 = 32767.
+void Si5351::ssc_pack(struct Si5351RegSet pll_reg, uint8_t *params)
+{
+	uint64_t num = ((uint64_t)pll_reg.p1 + 512) * pll_reg.p3 + pll_reg.p2;
+	uint64_t den = 128ULL * pll_reg.p3;
+	uint32_t udp = xtal_freq[(uint8_t)plla_ref_osc] / (4 * ssc_rate);
+	uint32_t dn, up_p1 = 0, up_p2 = 0, up_p3 = 1;
+	uint64_t step;
+	uint8_t center = ssc_mode == SI5351_SSC_CENTER;
+
+	// num / den is R; the steps come out scaled by P3
+	step = num * (center ? 128 : 64) * ssc_spread * SI5351_SSC_P3;
+	dn = (uint32_t)(step / (den * (10000UL + ssc_spread) * udp));
+	if(center)
+	{
+		up_p3 = (uint32_t)(step / (den * (10000UL - ssc_spread) * udp));
+		up_p1 = up_p3 / SI5351_SSC_P3;
+		up_p2 = up_p3 % SI5351_SSC_P3;
+		up_p3 = SI5351_SSC_P3;
+	}
+
+	// Registers 149-152: SSC_EN, SSDN_P2, SSC_MODE, SSDN_P3
+	params[0] = SI5351_SSC_EN | (uint8_t)(((dn % SI5351_SSC_P3) >> 8) & 0x7F);
+	params[1] = (uint8_t)((dn % SI5351_SSC_P3) & 0xFF);
+	params[2] = (center ? SI5351_SSC_MODE_CENTER : 0) | (uint8_t)((SI5351_SSC_P3 >> 8) & 0x7F);
+	params[3] = (uint8_t)(SI5351_SSC_P3 & 0xFF);
+
+	// Registers 153-155: SSDN_P1, SSUDP
+	params[4] = (uint8_t)((dn / SI5351_SSC_P3) & 0xFF);
+	params[5] = (uint8_t)(((udp >> 4) & 0xF0) | (((dn / SI5351_SSC_P3) >> 8) & 0x0F));
+	params[6] = (uint8_t)(udp & 0xFF);
+
+	// Registers 156-161: SSUP_P2, SSUP_P3, SSUP_P1, SS_NCLK = 0
+	params[7] = (uint8_t)((up_p2 >> 8) & 0x7F);
+	params[8] = (uint8_t)(up_p2 & 0xFF);
+	params[9] = (uint8_t)((up_p3 >> 8) & 0x7F);
+	params[10] = (uint8_t)(up_p3 & 0xFF);
+	params[11] = (uint8_t)(up_p1 & 0xFF);
+	params[12] = (uint8_t)((up_p1 >> 8) & 0x0F);
+}
+
+// Work the spread spectrum parameters out again for the PLLA feedback
+// ratio in pll_reg and write them, if spread spectrum is on. Everything
+// that changes PLLA goes through here. Returns the register bytes written.
+uint8_t Si5351::ssc_refresh(struct Si5351RegSet pll_reg)
+{
+	uint8_t params[SI5351_SSC_LENGTH];
+
+	if(ssc_mode == SI5351_SSC_OFF)
+	{
+		return 0;
+	}
+
+	ssc_pack(pll_reg, params);
+	si5351_write_bulk(SI5351_SSC_PARAM0, SI5351_SSC_LENGTH, params);
+
+	return SI5351_SSC_LENGTH;
+}
+
+// Lay out the 8 parameter bytes of one of MS0 through MS5. reg44 holds the
+// bits of register 44 to keep besides the R divider, DIVBY4 and P1[17:16].
+void Si5351::ms_pack(struct Si5351RegSet ms_reg, uint8_t reg44, uint8_t r_div, uint8_t div_by_4, uint8_t *params)
+{
+	// Registers 42-43 for CLK0
+	params[0] = (uint8_t)((ms_reg.p3 >> 8) & 0xFF);
+	params[1] = (uint8_t)(ms_reg.p3  & 0xFF);
+
+	// Register 44 for CLK0
+	reg44 &= ~(0x03 | SI5351_OUTPUT_CLK_DIV_MASK | SI5351_OUTPUT_CLK_DIVBY4);
+	if(div_by_4 == 1)
+	{
+		reg44 |= (SI5351_OUTPUT_CLK_DIVBY4);
+	}
+	reg44 |= (r_div << SI5351_OUTPUT_CLK_DIV_SHIFT);
+	params[2] = reg44 | ((uint8_t)((ms_reg.p1 >> 16) & 0x03));
+
+	// Registers 45-46 for CLK0
+	params[3] = (uint8_t)((ms_reg.p1 >> 8) & 0xFF);
+	params[4] = (uint8_t)(ms_reg.p1  & 0xFF);
+
+	// Register 47 for CLK0
+	params[5] = (uint8_t)((ms_reg.p3 >> 12) & 0xF0) + (uint8_t)((ms_reg.p2 >> 16) & 0x0F);
+
+	// Registers 48-49 for CLK0
+	params[6] = (uint8_t)((ms_reg.p2 >> 8) & 0xFF);
+	params[7] = (uint8_t)(ms_reg.p2  & 0xFF);
+}
 
 void Si5351::ms_div(enum si5351_clock clk, uint8_t r_div, uint8_t div_by_4)
 {
@@ -1765,6 +2767,7 @@ uint8_t Si5351::select_r_div(uint64_t *freq)
 	return r_div;
 }
 
+#if SI5351_CLK_COUNT > 6
 uint8_t Si5351::select_r_div_ms67(uint64_t *freq)
 {
 	uint8_t r_div = SI5351_OUTPUT_CLK_DIV_1;
@@ -1808,3 +2811,89 @@ uint8_t Si5351::select_r_div_ms67(uint64_t *freq)
 
 	return r_div;
 }
+#endif
+
+#if SI5351_RESOLUTION != SI5351_RESOLUTION_CENTI
+// floor(num * RFRAC_DENOM / denom) for num < denom. Where the product needs
+// more than a register, it is built up one bit of RFRAC_DENOM at a time
+// and reduced as it goes, so it never has to fit in si5351_freq_t.
+static uint32_t si5351_frac_native(si5351_freq_t num, si5351_freq_t denom)
+{
+#if SI5351_RESOLUTION == SI5351_RESOLUTION_HZ && UINTPTR_MAX > 0xFFFFFFFFUL
+	return (uint32_t)((uint64_t)num * RFRAC_DENOM / denom);
+#elif SI5351_RESOLUTION == SI5351_RESOLUTION_MICRO && defined(__SIZEOF_INT128__)
+	return (uint32_t)((unsigned __int128)num * RFRAC_DENOM / denom);
+#else
+	si5351_freq_t rem = 0;
+	uint32_t quot = 0;
+	int8_t bit;
+
+	for(bit = 19; bit >= 0; bit--)
+	{
+		quot <<= 1;
+		rem <<= 1;
+		if(RFRAC_DENOM & (1UL << bit))
+		{
+			rem += num;
+		}
+		while(rem >= denom)
+		{
+			rem -= denom;
+			quot++;
+		}
+	}
+
+	return quot;
+#endif
+}
+
+// Frequency of a PLL in Hz * SI5351_RES_MULT, or 0 if it can't be given
+// exactly in that unit
+si5351_freq_t Si5351::pll_freq_native(enum si5351_pll pll)
+{
+	uint64_t freq = (pll == SI5351_PLLA) ? plla_freq : pllb_freq;
+
+#if SI5351_RESOLUTION == SI5351_RESOLUTION_HZ
+	// Keep the last conversion, keyed on the Hz * 100 it came from, so that
+	// the 64-bit division is only done when the PLL changes
+	if(pll_hz_from[(uint8_t)pll] != freq)
+	{
+		pll_hz_from[(uint8_t)pll] = freq;
+		pll_hz[(uint8_t)pll] = (freq % SI5351_FREQ_MULT) ? 0 : (uint32_t)(freq / SI5351_FREQ_MULT);
+	}
+	return pll_hz[(uint8_t)pll];
+#else
+	return freq * (SI5351_RES_MULT / SI5351_FREQ_MULT);
+#endif
+}
+
+// multisynth_calc() with a preset PLL, for a multisynth frequency between
+// 512 kHz and 100 MHz, where the divider is always within range
+void Si5351::multisynth_calc_native(si5351_freq_t freq, si5351_freq_t pll_freq, struct Si5351RegSet *reg)
+{
+	uint32_t a, b, c;
+
+	a = (uint32_t)(pll_freq / freq);
+	b = si5351_frac_native(pll_freq % freq, freq);
+	c = b ? RFRAC_DENOM : 1;
+
+	reg->p1 = 128 * a + ((128 * b) / c) - 512;
+	reg->p2 = 128 * b - c * ((128 * b) / c);
+	reg->p3 = c;
+}
+
+// select_r_div() in Hz * SI5351_RES_MULT
+uint8_t Si5351::select_r_div_native(si5351_freq_t *freq)
+{
+	uint8_t r_div = SI5351_OUTPUT_CLK_DIV_1;
+
+	// Double up into the multisynth range, up to 128 times
+	while(r_div < SI5351_OUTPUT_CLK_DIV_128 && *freq < SI5351_CLKOUT_MIN_FREQ * SI5351_RES_MULT * 128)
+	{
+		*freq <<= 1;
+		r_div++;
+	}
+
+	return r_div;
+}
+#endif
@@ -29,9 +29,111 @@
 #ifndef SI5351_H_
 #define SI5351_H_
 
+#if defined(ARDUINO)
 #include "Arduino.h"
 #include "Wire.h"
+#endif
 #include <stdint.h>
+#include <stddef.h>
+
+/* Optional features */
+
+// Uncomment (or define in your build flags) to count bus traffic per public
+// method. See get_stats() and reset_stats().
+//#define SI5351_STATS
+
+// Uncomment (or define in your build flags) to record every bus operation
+// in a ring buffer of SI5351_TRACE_DEPTH entries. See trace_export().
+//#define SI5351_TRACE
+
+#ifndef SI5351_TRACE_DEPTH
+#define SI5351_TRACE_DEPTH              32
+#endif
+
+#if defined(SI5351_STATS) || defined(SI5351_TRACE)
+#define SI5351_OP_TRACKING
+#endif
+
+// Uncomment (or define in your build flags) to pack the state of each
+// Si5351 object for parts with little RAM and flash. Frequencies are kept
+// in 5 bytes and the PLL assignments and first-set flags in one bit per
+// output, the register parameter buffers go on the stack instead of the
+// heap, and the status mirrors are left out unless SI5351_STATUS is
+// defined too.
+//#define SI5351_COMPACT
+
+// Uncomment (or define in your build flags) to keep dev_status,
+// dev_int_status and update_status() in a compact build
+//#define SI5351_STATUS
+
+#if !defined(SI5351_COMPACT) || defined(SI5351_STATUS)
+#define SI5351_HAS_STATUS
+#endif
+
+/*
+ * Frequency resolution policies, for SI5351_RESOLUTION
+ *
+ * SI5351_RESOLUTION_HZ - 1 Hz, in a uint32_t
+ * SI5351_RESOLUTION_CENTI - 0.01 Hz, in a uint64_t (default)
+ * SI5351_RESOLUTION_MICRO - 1 uHz, in a uint64_t
+ */
+#define SI5351_RESOLUTION_HZ            1
+#define SI5351_RESOLUTION_CENTI         2
+#define SI5351_RESOLUTION_MICRO         3
+
+// Uncomment (or define in your build flags) to pick the unit and type
+// that set_freq_native() takes. Everything else keeps taking 0.01 Hz.
+//#define SI5351_RESOLUTION               SI5351_RESOLUTION_HZ
+
+#ifndef SI5351_RESOLUTION
+#define SI5351_RESOLUTION               SI5351_RESOLUTION_CENTI
+#endif
+
+/*
+ * SiLabs Si5351 chip variants, for SI5351_VARIANT
+ *
+ * SI5351_VARIANT_A - Si5351A (8 output clocks, XTAL input)
+ * SI5351_VARIANT_A3 - Si5351A MSOP10 (3 output clocks, XTAL input)
+ * SI5351_VARIANT_B - Si5351B (8 output clocks, XTAL/VXCO input)
+ * SI5351_VARIANT_C - Si5351C (8 output clocks, XTAL/CLKIN input)
+ */
+#define SI5351_VARIANT_A                1
+#define SI5351_VARIANT_A3               2
+#define SI5351_VARIANT_B                3
+#define SI5351_VARIANT_C                4
+
+// Uncomment (or define in your build flags) to build for a single chip
+// variant. The code and state for what it doesn't have are left out, and
+// set_vcxo() (B only) and set_pll_input() (C only) don't exist to call.
+// Without it, every variant is supported.
+//#define SI5351_VARIANT                  SI5351_VARIANT_A3
+
+// Number of CLK outputs the library handles. Define it in your build
+// flags for a package with a different count.
+#ifndef SI5351_CLK_COUNT
+#if defined(SI5351_VARIANT) && SI5351_VARIANT == SI5351_VARIANT_A3
+#define SI5351_CLK_COUNT                3
+#else
+#define SI5351_CLK_COUNT                8
+#endif
+#endif
+#if SI5351_CLK_COUNT < 1 || SI5351_CLK_COUNT == 7 || SI5351_CLK_COUNT > 8
+#error "SI5351_CLK_COUNT must be 8, or 6 or fewer"
+#endif
+
+// Number of outputs among CLK0-CLK5, whose multisynths can be fractional
+#if SI5351_CLK_COUNT < 6
+#define SI5351_MS_COUNT                 SI5351_CLK_COUNT
+#else
+#define SI5351_MS_COUNT                 6
+#endif
+
+#if !defined(SI5351_VARIANT) || SI5351_VARIANT == SI5351_VARIANT_B
+#define SI5351_HAS_VCXO
+#endif
+#if !defined(SI5351_VARIANT) || SI5351_VARIANT == SI5351_VARIANT_C
+#define SI5351_HAS_CLKIN
+#endif
 
 /* Define definitions */
 
@@ -39,6 +141,18 @@
 #define SI5351_XTAL_FREQ                25000000
 #define SI5351_PLL_FIXED                80000000000ULL
 #define SI5351_FREQ_MULT                100ULL
+
+// Units per Hz of si5351_freq_t, the type set_freq_native() takes
+#if SI5351_RESOLUTION == SI5351_RESOLUTION_HZ
+#define SI5351_RES_MULT                 1UL
+typedef uint32_t si5351_freq_t;
+#elif SI5351_RESOLUTION == SI5351_RESOLUTION_MICRO
+#define SI5351_RES_MULT                 1000000ULL
+typedef uint64_t si5351_freq_t;
+#else
+#define SI5351_RES_MULT                 SI5351_FREQ_MULT
+typedef uint64_t si5351_freq_t;
+#endif
 #define SI5351_DEFAULT_CLK              1000000000ULL
 
 #define SI5351_PLL_VCO_MIN              600000000
@@ -70,6 +184,25 @@
 #define SI5351_VCXO_PULL_MIN            30
 #define SI5351_VCXO_PULL_MAX            240
 #define SI5351_VCXO_MARGIN              103
+#define SI5351_SSC_DOWN_MAX             250
+#define SI5351_SSC_CENTER_MAX           150
+#define SI5351_SSC_RATE_DEFAULT         31500UL
+#define SI5351_SSC_UDP_MAX              4095
+#define SI5351_SSC_P3                   32767
+
+// Most multisynths written in one burst when set_freq() above 100 MHz
+// retunes a PLL, and the resulting bound on the bus transactions of such a
+// set_freq() (reads counted as two): output enable on the first call (3),
+// PLL (1), spread spectrum parameters while it is on (1), multisynth
+// bursts (3), integer mode of all the outputs that change in one read and
+// one write (3), PLL reset (1)
+#define SI5351_MS_BURST_MAX             3
+#define SI5351_SET_FREQ_HIGH_MAX_TX     12
+
+// Status reads set_freq_pingpong() makes while waiting for a PLL to lock
+#ifndef SI5351_PLL_LOCK_POLLS
+#define SI5351_PLL_LOCK_POLLS           50
+#endif
 
 #define SI5351_DEVICE_STATUS            0
 #define SI5351_INTERRUPT_STATUS         1
@@ -159,6 +292,9 @@
 #define SI5351_SSC_PARAM10              159
 #define SI5351_SSC_PARAM11              160
 #define SI5351_SSC_PARAM12              161
+#define SI5351_SSC_LENGTH               13
+#define SI5351_SSC_EN                   (1<<7)
+#define SI5351_SSC_MODE_CENTER          (1<<7)
 
 #define SI5351_VXCO_PARAMETERS_LOW      162
 #define SI5351_VXCO_PARAMETERS_MID      163
@@ -187,6 +323,13 @@
 #define SI5351_XTAL_ENABLE              (1<<6)
 #define SI5351_MULTISYNTH_ENABLE        (1<<4)
 
+#define SI5351_TRACE_DATA_MAX           8
+#define SI5351_TRACE_READ               (1<<0)
+#define SI5351_TRACE_CALL_START         (1<<1)
+#define SI5351_TRACE_LOG_VERSION        1
+#define SI5351_TRACE_LOG_HEADER_LEN     20
+#define SI5351_TRACE_LOG_ENTRY_LEN      10
+
 
 /* Macro definitions */
 
@@ -219,22 +362,6 @@
 
 /* Enum definitions */
 
-/*
- * enum si5351_variant - SiLabs Si5351 chip variant
- * @SI5351_VARIANT_A: Si5351A (8 output clocks, XTAL input)
- * @SI5351_VARIANT_A3: Si5351A MSOP10 (3 output clocks, XTAL input)
- * @SI5351_VARIANT_B: Si5351B (8 output clocks, XTAL/VXCO input)
- * @SI5351_VARIANT_C: Si5351C (8 output clocks, XTAL/CLKIN input)
- */
-/*
-enum si5351_variant {
-	SI5351_VARIANT_A = 1,
-	SI5351_VARIANT_A3 = 2,
-	SI5351_VARIANT_B = 3,
-	SI5351_VARIANT_C = 4,
-};
-*/
-
 enum si5351_clock {SI5351_CLK0, SI5351_CLK1, SI5351_CLK2, SI5351_CLK3,
 	SI5351_CLK4, SI5351_CLK5, SI5351_CLK6, SI5351_CLK7};
 
@@ -250,6 +377,25 @@ enum si5351_clock_fanout {SI5351_FANOUT_CLKIN, SI5351_FANOUT_XO, SI5351_FANOUT_M
 
 enum si5351_pll_input {SI5351_PLL_INPUT_XO, SI5351_PLL_INPUT_CLKIN};
 
+enum si5351_ssc_mode {SI5351_SSC_OFF, SI5351_SSC_DOWN, SI5351_SSC_CENTER};
+
+/*
+ * enum si5351_op - Public method that caused a bus operation
+ *
+ * Used to break down the statistics by API call. Bus operations issued
+ * outside of any of these methods (raw si5351_write() and friends) are
+ * accounted to SI5351_OP_OTHER.
+ */
+enum si5351_op {SI5351_OP_OTHER, SI5351_OP_INIT, SI5351_OP_RESET,
+	SI5351_OP_SET_FREQ, SI5351_OP_SET_FREQ_MANUAL, SI5351_OP_SET_PLL,
+	SI5351_OP_SET_MS, SI5351_OP_OUTPUT_ENABLE, SI5351_OP_DRIVE_STRENGTH,
+	SI5351_OP_UPDATE_STATUS, SI5351_OP_SET_CORRECTION, SI5351_OP_SET_PHASE,
+	SI5351_OP_PLL_RESET, SI5351_OP_SET_MS_SOURCE, SI5351_OP_SET_INT,
+	SI5351_OP_SET_CLOCK_PWR, SI5351_OP_SET_CLOCK_INVERT,
+	SI5351_OP_SET_CLOCK_SOURCE, SI5351_OP_SET_CLOCK_DISABLE,
+	SI5351_OP_SET_CLOCK_FANOUT, SI5351_OP_SET_PLL_INPUT, SI5351_OP_SET_VCXO,
+	SI5351_OP_SET_FREQ_PINGPONG, SI5351_OP_SET_SSC, SI5351_OP_COUNT};
+
 /* Struct definitions */
 
 struct Si5351RegSet
@@ -276,19 +422,170 @@ struct Si5351IntStatus
 	uint8_t LOS_STKY;
 };
 
+/*
+ * Bus traffic counters for one public method
+ *
+ * calls - Number of top-level calls of the method
+ * transactions - I2C transactions (START to STOP)
+ * bytes_written - Register address and data bytes sent
+ * bytes_read - Data bytes received
+ * rmw_reads - Register reads done as part of a read-modify-write
+ * rmw_reads_avoided - Register 44 and CLK control reads that a retune of
+ *   the outputs sharing a PLL left out, because their contents were known
+ * pll_resets - Writes to the PLL reset register
+ * allocs - Heap allocations of register parameter buffers
+ */
+struct Si5351OpStats
+{
+	uint32_t calls;
+	uint32_t transactions;
+	uint32_t bytes_written;
+	uint32_t bytes_read;
+	uint32_t rmw_reads;
+	uint32_t rmw_reads_avoided;
+	uint32_t pll_resets;
+	uint32_t allocs;
+};
+
+struct Si5351Stats
+{
+	struct Si5351OpStats op[SI5351_OP_COUNT];
+};
+
+/*
+ * One recorded bus operation
+ *
+ * time - Trace clock value when the operation started
+ * duration - Trace clock ticks spent on the bus
+ * op - Public method that caused it (enum si5351_op)
+ * flags - SI5351_TRACE_READ, SI5351_TRACE_CALL_START
+ * reg - First register address
+ * len - Number of data bytes in this entry
+ * data - Register contents written or read
+ *
+ * Transfers longer than SI5351_TRACE_DATA_MAX are split over consecutive
+ * entries with increasing register addresses.
+ */
+struct Si5351TraceEntry
+{
+	uint32_t time;
+	uint16_t duration;
+	uint8_t op;
+	uint8_t flags;
+	uint8_t reg;
+	uint8_t len;
+	uint8_t data[SI5351_TRACE_DATA_MAX];
+};
+
+/*
+ * si5351_micros(void)
+ *
+ * Microseconds from an arbitrary start, wrapping at 32 bits. micros() on
+ * Arduino, CLOCK_MONOTONIC on other Unix hosts and always 0 elsewhere.
+ * It is the default clock of the tracing, the queue, the coalescer, the
+ * async driver, the sequencer and the discipline loop.
+ */
+uint32_t si5351_micros(void);
+
+/*
+ * Si5351Bus - Transport used to reach the chip
+ *
+ * All register access goes through one of these. On Arduino the default is
+ * Si5351WireBus, which uses the Wire library. Other platforms (and the
+ * simulators in the extras folder) supply their own. The return values
+ * follow Wire.endTransmission(): 0 on success, non-zero on error.
+ */
+class Si5351Bus
+{
+public:
+	virtual ~Si5351Bus() {}
+	virtual void begin(void) {}
+	virtual uint8_t probe(uint8_t dev_addr) = 0;
+	virtual uint8_t write(uint8_t dev_addr, uint8_t reg, uint8_t len, const uint8_t *data) = 0;
+	virtual uint8_t read(uint8_t dev_addr, uint8_t reg, uint8_t len, uint8_t *data) = 0;
+	// Number of I2C transactions a register read costs on this bus
+	virtual uint8_t read_transactions(void) { return 2; }
+};
+
+#if defined(ARDUINO)
+class Si5351WireBus : public Si5351Bus
+{
+public:
+	Si5351WireBus(TwoWire &wire = Wire);
+	void begin(void);
+	uint8_t probe(uint8_t dev_addr);
+	uint8_t write(uint8_t dev_addr, uint8_t reg, uint8_t len, const uint8_t *data);
+	uint8_t read(uint8_t dev_addr, uint8_t reg, uint8_t len, uint8_t *data);
+private:
+	TwoWire &wire;
+};
+#endif
+
+#if defined(SI5351_COMPACT)
+/*
+ * Si5351Freq - Frequency in Hz * 100, stored in 5 bytes
+ *
+ * Reads and assigns like the uint64_t it stands in for. Only the low 40
+ * bits are kept, which holds frequencies below 10.9 GHz.
+ */
+class Si5351Freq
+{
+public:
+	operator uint64_t() const;
+	Si5351Freq &operator=(uint64_t);
+private:
+	uint8_t b[5];
+};
+
+/*
+ * Si5351Bits - One bit per output, indexed like an array of T
+ *
+ * T is bool or enum si5351_pll. Indexing gives a reference that reads and
+ * assigns the bit of that output.
+ */
+template <typename T>
+class Si5351Bits
+{
+public:
+	class Ref
+	{
+	public:
+		Ref(uint8_t *bits, uint8_t mask): bits(bits), mask(mask) {}
+		operator T() const { return (T)((*bits & mask) != 0); }
+		Ref &operator=(T val)
+		{
+			*bits = val ? (*bits | mask) : (*bits & ~mask);
+			return *this;
+		}
+		Ref &operator=(const Ref &r) { return *this = (T)r; }
+	private:
+		uint8_t *bits;
+		uint8_t mask;
+	};
+	Ref operator[](uint8_t i) { return Ref(&bits, (uint8_t)(1 << i)); }
+	T operator[](uint8_t i) const { return (T)((bits >> i) & 1); }
+private:
+	uint8_t bits;
+};
+#endif
+
 class Si5351
 {
 public:
-  Si5351(uint8_t i2c_addr = SI5351_BUS_BASE_ADDR);
+  Si5351(uint8_t i2c_addr = SI5351_BUS_BASE_ADDR, Si5351Bus *bus = NULL);
 	bool init(uint8_t, uint32_t, int32_t);
 	void reset(void);
 	uint8_t set_freq(uint64_t, enum si5351_clock);
+	uint8_t set_freq_native(si5351_freq_t, enum si5351_clock);
 	uint8_t set_freq_manual(uint64_t, uint64_t, enum si5351_clock);
+	uint8_t set_freq_pingpong(uint64_t, enum si5351_clock);
 	void set_pll(uint64_t, enum si5351_pll);
 	void set_ms(enum si5351_clock, struct Si5351RegSet, uint8_t, uint8_t, uint8_t);
 	void output_enable(enum si5351_clock, uint8_t);
 	void drive_strength(enum si5351_clock, enum si5351_drive);
+#if defined(SI5351_HAS_STATUS)
 	void update_status(void);
+#endif
 	void set_correction(int32_t, enum si5351_pll_input);
 	void set_phase(enum si5351_clock, uint8_t);
 	int32_t get_correction(enum si5351_pll_input);
@@ -300,36 +597,115 @@ public:
 	void set_clock_source(enum si5351_clock, enum si5351_clock_source);
 	void set_clock_disable(enum si5351_clock, enum si5351_clock_disable);
 	void set_clock_fanout(enum si5351_clock_fanout, uint8_t);
+#if defined(SI5351_HAS_CLKIN)
 	void set_pll_input(enum si5351_pll, enum si5351_pll_input);
+#endif
+#if defined(SI5351_HAS_VCXO)
 	void set_vcxo(uint64_t, uint8_t);
+#endif
+	uint8_t set_ssc(enum si5351_ssc_mode, uint16_t, uint32_t = SI5351_SSC_RATE_DEFAULT);
   void set_ref_freq(uint32_t, enum si5351_pll_input);
 	uint8_t si5351_write_bulk(uint8_t, uint8_t, uint8_t *);
 	uint8_t si5351_write(uint8_t, uint8_t);
 	uint8_t si5351_read(uint8_t);
+#if defined(SI5351_STATS)
+	void get_stats(struct Si5351Stats *);
+	void reset_stats(void);
+#endif
+#if defined(SI5351_TRACE)
+	void set_trace_clock(uint32_t (*)(void));
+	uint16_t trace_count(void);
+	uint8_t trace_get(uint16_t, struct Si5351TraceEntry *);
+	uint16_t trace_export(uint8_t *, uint16_t);
+	void trace_clear(void);
+#endif
+#if defined(SI5351_HAS_STATUS)
 	struct Si5351Status dev_status = {.SYS_INIT = 0, .LOL_B = 0, .LOL_A = 0,
     .LOS = 0, .REVID = 0};
 	struct Si5351IntStatus dev_int_status = {.SYS_INIT_STKY = 0, .LOL_B_STKY = 0,
     .LOL_A_STKY = 0, .LOS_STKY = 0};
-	enum si5351_pll pll_assignment[8];
-	uint64_t clk_freq[8];
+#endif
+#if defined(SI5351_COMPACT)
+	Si5351Bits<enum si5351_pll> pll_assignment;
+	Si5351Freq clk_freq[SI5351_CLK_COUNT];
+	Si5351Freq plla_freq;
+	Si5351Freq pllb_freq;
+#else
+	enum si5351_pll pll_assignment[SI5351_CLK_COUNT];
+	uint64_t clk_freq[SI5351_CLK_COUNT];
 	uint64_t plla_freq;
 	uint64_t pllb_freq;
+#endif
   enum si5351_pll_input plla_ref_osc;
   enum si5351_pll_input pllb_ref_osc;
 	uint32_t xtal_freq[2];
 private:
 	uint64_t pll_calc(enum si5351_pll, uint64_t, struct Si5351RegSet *, int32_t, uint8_t);
 	uint64_t multisynth_calc(uint64_t, uint64_t, struct Si5351RegSet *);
+#if SI5351_CLK_COUNT > 6
 	uint64_t multisynth67_calc(uint64_t, uint64_t, struct Si5351RegSet *);
+#endif
+#if defined(SI5351_HAS_STATUS)
 	void update_sys_status(struct Si5351Status *);
 	void update_int_status(struct Si5351IntStatus *);
+#endif
 	void ms_div(enum si5351_clock, uint8_t, uint8_t);
+	void pll_pack(struct Si5351RegSet, uint8_t *);
+	void ms_pack(struct Si5351RegSet, uint8_t, uint8_t, uint8_t, uint8_t *);
+	void ssc_pack(struct Si5351RegSet, uint8_t *);
+	uint8_t ssc_refresh(struct Si5351RegSet);
+	void set_ms_shared(uint8_t, uint64_t);
+	void si5351_read_bulk(uint8_t, uint8_t, uint8_t *);
 	uint8_t select_r_div(uint64_t *);
+#if SI5351_CLK_COUNT > 6
 	uint8_t select_r_div_ms67(uint64_t *);
+#endif
+#if SI5351_RESOLUTION != SI5351_RESOLUTION_CENTI
+	si5351_freq_t pll_freq_native(enum si5351_pll);
+	void multisynth_calc_native(si5351_freq_t, si5351_freq_t, struct Si5351RegSet *);
+	uint8_t select_r_div_native(si5351_freq_t *);
+#endif
+#if SI5351_RESOLUTION == SI5351_RESOLUTION_HZ
+	si5351_freq_t pll_hz[2];
+	uint64_t pll_hz_from[2];
+#endif
 	int32_t ref_correction[2];
   uint8_t clkin_div;
   uint8_t i2c_bus_addr;
-  bool clk_first_set[8];
+  Si5351Bus *bus;
+#if defined(SI5351_COMPACT)
+  Si5351Bits<bool> clk_first_set;
+#else
+  bool clk_first_set[SI5351_CLK_COUNT];
+#endif
+	uint8_t int_mode_mask;
+	enum si5351_ssc_mode ssc_mode;
+	uint16_t ssc_spread;
+	uint32_t ssc_rate;
+  friend class Si5351Group;
+  friend class Si5351Profiles;
+  friend class Si5351Sequence;
+  friend class Si5351PhasePlan;
+  friend class Si5351Discipline;
+  friend class Si5351Calibrator;
+#if defined(SI5351_OP_TRACKING)
+	friend class Si5351OpScope;
+	uint8_t op_enter(enum si5351_op);
+	void op_exit(uint8_t);
+	uint8_t cur_op;
+#endif
+#if defined(SI5351_STATS)
+	struct Si5351Stats stats;
+#endif
+#if defined(SI5351_TRACE)
+	void trace_record(uint8_t, uint8_t, uint8_t, const uint8_t *, uint32_t);
+	uint32_t (*trace_clock)(void);
+	struct Si5351TraceEntry trace_buf[SI5351_TRACE_DEPTH];
+	uint16_t trace_head;
+	uint16_t trace_len;
+	uint32_t trace_dropped;
+	bool trace_call_start;
+#endif
 };
 
 #endif /* SI5351_H_ */
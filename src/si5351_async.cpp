@@ -0,0 +1,603 @@
+/*
+ * si5351_async.cpp - Non-blocking interface to the Si5351 library
+ *
+ * Copyright (C) 2015 - 2019 Jason Milldrum <milldrum@gmail.com>
+ *                           Dana H. Myers <k6jq@comcast.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "si5351_async.h"
+
+enum {SI5351_ASYNC_OP_INIT, SI5351_ASYNC_OP_RESET, SI5351_ASYNC_OP_SET_FREQ,
+	SI5351_ASYNC_OP_SET_PLL, SI5351_ASYNC_OP_PLL_RESET,
+	SI5351_ASYNC_OP_UPDATE_STATUS};
+
+enum {SI5351_ASYNC_ST_START, SI5351_ASYNC_ST_PROBE, SI5351_ASYNC_ST_WAIT_INIT,
+	SI5351_ASYNC_ST_FETCH, SI5351_ASYNC_ST_WRITE, SI5351_ASYNC_ST_STATUS};
+
+/*
+ * Registers that the library reads back in order to modify them: the
+ * output enable, the PLL input source, the CLK controls and disable
+ * states, the R dividers and the fanout enable. They are read once, in as
+ * few transfers as possible, and tracked from then on.
+ */
+static const struct
+{
+	uint8_t reg;
+	uint8_t len;
+	uint8_t index;
+} si5351_async_fetch[SI5351_ASYNC_FETCH_GROUPS] = {
+	{SI5351_OUTPUT_ENABLE_CTRL, 1, 0},
+	{SI5351_PLL_INPUT_SOURCE, 11, 1},
+	{SI5351_CLK0_PARAMETERS + 2, 1, 12},
+	{SI5351_CLK1_PARAMETERS + 2, 1, 13},
+	{SI5351_CLK2_PARAMETERS + 2, 1, 14},
+	{SI5351_CLK3_PARAMETERS + 2, 1, 15},
+	{SI5351_CLK4_PARAMETERS + 2, 1, 16},
+	{SI5351_CLK5_PARAMETERS + 2, 1, 17},
+	{SI5351_CLK6_7_OUTPUT_DIVIDER, 1, 18},
+	{SI5351_FANOUT_ENABLE, 1, 19}
+};
+
+// Returns the shadow index of a register, or 0xFF if it isn't tracked
+static uint8_t si5351_async_shadow_index(uint8_t reg)
+{
+	uint8_t i;
+
+	for(i = 0; i < SI5351_ASYNC_FETCH_GROUPS; i++)
+	{
+		if(reg >= si5351_async_fetch[i].reg &&
+			reg < si5351_async_fetch[i].reg + si5351_async_fetch[i].len)
+		{
+			return si5351_async_fetch[i].index + (reg - si5351_async_fetch[i].reg);
+		}
+	}
+
+	return 0xFF;
+}
+
+#if defined(ARDUINO)
+static Si5351WireBus si5351_async_wire_bus;
+static Si5351AsyncAdapter si5351_async_wire_adapter(&si5351_async_wire_bus);
+#endif
+
+/*
+ * Si5351AsyncAdapter(Si5351Bus *bus)
+ *
+ * bus - Blocking transport to run each transfer on
+ */
+Si5351AsyncAdapter::Si5351AsyncAdapter(Si5351Bus *bus):
+	bus(bus),
+	result(0)
+{
+}
+
+void Si5351AsyncAdapter::begin(void)
+{
+	bus->begin();
+}
+
+uint8_t Si5351AsyncAdapter::start_probe(uint8_t dev_addr)
+{
+	result = bus->probe(dev_addr);
+	return 0;
+}
+
+uint8_t Si5351AsyncAdapter::start_write(uint8_t dev_addr, uint8_t reg, uint8_t len, const uint8_t *data)
+{
+	result = bus->write(dev_addr, reg, len, data);
+	return 0;
+}
+
+uint8_t Si5351AsyncAdapter::start_read(uint8_t dev_addr, uint8_t reg, uint8_t len, uint8_t *data)
+{
+	result = bus->read(dev_addr, reg, len, data);
+	return 0;
+}
+
+uint8_t Si5351AsyncAdapter::poll(void)
+{
+	return result;
+}
+
+Si5351Async::Recorder::Recorder(Si5351Async *owner):
+	owner(owner)
+{
+}
+
+// The device was already found by the probe step
+uint8_t Si5351Async::Recorder::probe(uint8_t)
+{
+	return 0;
+}
+
+uint8_t Si5351Async::Recorder::write(uint8_t, uint8_t reg, uint8_t len, const uint8_t *data)
+{
+	struct Xfer *x;
+	uint8_t i, index;
+
+	if(owner->xfer_count == SI5351_ASYNC_MAX_XFER ||
+		owner->data_len + len > SI5351_ASYNC_MAX_DATA)
+	{
+		owner->overflow = true;
+		return 4;
+	}
+
+	x = &owner->xfers[owner->xfer_count++];
+	x->reg = reg;
+	x->len = len;
+	x->offset = owner->data_len;
+	memcpy(&owner->data[owner->data_len], data, len);
+	owner->data_len += len;
+
+	for(i = 0; i < len; i++)
+	{
+		index = si5351_async_shadow_index(reg + i);
+		if(index != 0xFF)
+		{
+			owner->shadow[index] = data[i];
+		}
+	}
+
+	return 0;
+}
+
+uint8_t Si5351Async::Recorder::read(uint8_t, uint8_t reg, uint8_t len, uint8_t *data)
+{
+	uint8_t i, index;
+
+	for(i = 0; i < len; i++)
+	{
+		if(reg + i <= SI5351_INTERRUPT_STATUS)
+		{
+			data[i] = owner->status_regs[reg + i];
+			continue;
+		}
+		index = si5351_async_shadow_index(reg + i);
+		data[i] = index != 0xFF ? owner->shadow[index] : 0;
+	}
+
+	return 0;
+}
+
+/*
+ * Si5351Async(uint8_t i2c_addr, Si5351AsyncBus *bus)
+ *
+ * i2c_addr - I2C address of the device
+ * bus - Transport to reach the device through. On Arduino, NULL selects
+ *   the Wire library, one transfer per step.
+ */
+Si5351Async::Si5351Async(uint8_t i2c_addr, Si5351AsyncBus *bus):
+	recorder(this),
+	dev(i2c_addr, &recorder),
+	bus(bus),
+	i2c_bus_addr(i2c_addr),
+	clock(si5351_micros),
+	head(NULL),
+	tail(NULL),
+	state(SI5351_ASYNC_ST_START),
+	in_flight(false),
+	started(0),
+	result(SI5351_ASYNC_OK),
+	fetch(0),
+	fetched(0),
+	xfer_count(0),
+	xfer_next(0),
+	data_len(0),
+	overflow(false)
+{
+#if defined(ARDUINO)
+	if(bus == NULL)
+	{
+		this->bus = &si5351_async_wire_adapter;
+	}
+#endif
+
+	memset(shadow, 0, sizeof(shadow));
+	memset(status_regs, 0, sizeof(status_regs));
+}
+
+/*
+ * init(struct Si5351AsyncOp *op, uint8_t xtal_load_c, uint32_t xo_freq,
+ *   int32_t corr, uint16_t timeout_ms)
+ *
+ * Queue Si5351::init(). The first three parameters are as there.
+ *
+ * op - Operation block to use
+ * timeout_ms - How long to wait for the device to finish its own
+ *   initialization before giving up with SI5351_ASYNC_TIMEOUT
+ *
+ * Returns op, or NULL if op is still queued from an earlier call. Ends
+ * with SI5351_ASYNC_NOT_FOUND if nothing answers at the address.
+ */
+struct Si5351AsyncOp *Si5351Async::init(struct Si5351AsyncOp *op, uint8_t xtal_load_c,
+	uint32_t xo_freq, int32_t corr, uint16_t timeout_ms)
+{
+	if(op->status == SI5351_ASYNC_PENDING)
+	{
+		return NULL;
+	}
+
+	op->arg = xtal_load_c;
+	op->xo_freq = xo_freq;
+	op->corr = corr;
+	op->timeout_ms = timeout_ms;
+	return enqueue(op, SI5351_ASYNC_OP_INIT);
+}
+
+/*
+ * reset(struct Si5351AsyncOp *op)
+ *
+ * Queue Si5351::reset().
+ */
+struct Si5351AsyncOp *Si5351Async::reset(struct Si5351AsyncOp *op)
+{
+	if(op->status == SI5351_ASYNC_PENDING)
+	{
+		return NULL;
+	}
+
+	return enqueue(op, SI5351_ASYNC_OP_RESET);
+}
+
+/*
+ * set_freq(struct Si5351AsyncOp *op, uint64_t freq, enum si5351_clock clk)
+ *
+ * Queue Si5351::set_freq(). Ends with SI5351_ASYNC_REJECTED if set_freq()
+ * refuses the frequency.
+ */
+struct Si5351AsyncOp *Si5351Async::set_freq(struct Si5351AsyncOp *op, uint64_t freq, enum si5351_clock clk)
+{
+	if(op->status == SI5351_ASYNC_PENDING)
+	{
+		return NULL;
+	}
+
+	op->freq = freq;
+	op->arg = (uint8_t)clk;
+	return enqueue(op, SI5351_ASYNC_OP_SET_FREQ);
+}
+
+/*
+ * set_pll(struct Si5351AsyncOp *op, uint64_t pll_freq, enum si5351_pll target_pll)
+ *
+ * Queue Si5351::set_pll().
+ */
+struct Si5351AsyncOp *Si5351Async::set_pll(struct Si5351AsyncOp *op, uint64_t pll_freq, enum si5351_pll target_pll)
+{
+	if(op->status == SI5351_ASYNC_PENDING)
+	{
+		return NULL;
+	}
+
+	op->freq = pll_freq;
+	op->arg = (uint8_t)target_pll;
+	return enqueue(op, SI5351_ASYNC_OP_SET_PLL);
+}
+
+/*
+ * pll_reset(struct Si5351AsyncOp *op, enum si5351_pll target_pll)
+ *
+ * Queue Si5351::pll_reset().
+ */
+struct Si5351AsyncOp *Si5351Async::pll_reset(struct Si5351AsyncOp *op, enum si5351_pll target_pll)
+{
+	if(op->status == SI5351_ASYNC_PENDING)
+	{
+		return NULL;
+	}
+
+	op->arg = (uint8_t)target_pll;
+	return enqueue(op, SI5351_ASYNC_OP_PLL_RESET);
+}
+
+/*
+ * update_status(struct Si5351AsyncOp *op)
+ *
+ * Queue Si5351::update_status(). When it is over, the results are in
+ * dev_status and dev_int_status of device().
+ */
+#if defined(SI5351_HAS_STATUS)
+struct Si5351AsyncOp *Si5351Async::update_status(struct Si5351AsyncOp *op)
+{
+	if(op->status == SI5351_ASYNC_PENDING)
+	{
+		return NULL;
+	}
+
+	return enqueue(op, SI5351_ASYNC_OP_UPDATE_STATUS);
+}
+#endif
+
+/*
+ * step(void)
+ *
+ * Move the operation at the head of the queue along. Starts at most one
+ * bus transfer, or checks on the one in progress. Call it from the main
+ * loop, as often as you like.
+ *
+ * Returns true while there is work left in the queue.
+ */
+bool Si5351Async::step(void)
+{
+	struct Si5351AsyncOp *op = head;
+	uint8_t ret;
+
+	if(op == NULL)
+	{
+		return false;
+	}
+
+	if(!in_flight && !issue(op))
+	{
+		return head != NULL;
+	}
+
+	ret = bus->poll();
+	if(ret == SI5351_ASYNC_BUS_BUSY)
+	{
+		return true;
+	}
+	in_flight = false;
+	complete(op, ret);
+
+	return head != NULL;
+}
+
+/*
+ * busy(void)
+ *
+ * Returns true while operations are queued.
+ */
+bool Si5351Async::busy(void)
+{
+	return head != NULL;
+}
+
+/*
+ * device(void)
+ *
+ * Returns the Si5351 object that holds the state of the device, such as
+ * clk_freq[] and dev_status. Its state is updated as soon as an operation
+ * reaches the head of the queue. Don't call its methods, since nothing
+ * they write would reach the device.
+ */
+Si5351 *Si5351Async::device(void)
+{
+	return &dev;
+}
+
+/*
+ * set_clock(uint32_t (*clock)(void))
+ *
+ * clock - Function returning the current time in microseconds, or NULL to
+ *   go back to the default of micros()
+ *
+ * The init() timeout is measured with this clock.
+ */
+void Si5351Async::set_clock(uint32_t (*clock)(void))
+{
+	this->clock = clock ? clock : si5351_micros;
+}
+
+struct Si5351AsyncOp *Si5351Async::enqueue(struct Si5351AsyncOp *op, uint8_t type)
+{
+	op->type = type;
+	op->status = SI5351_ASYNC_PENDING;
+	op->next = NULL;
+
+	if(tail)
+	{
+		tail->next = op;
+	}
+	else
+	{
+		head = op;
+	}
+	tail = op;
+
+	return op;
+}
+
+// Start the next transfer of op. Returns false if none was started,
+// either because op is over or because it is waiting for nothing.
+bool Si5351Async::issue(struct Si5351AsyncOp *op)
+{
+	uint8_t ret = 0;
+	struct Xfer *x;
+
+	switch(state)
+	{
+	case SI5351_ASYNC_ST_START:
+		if(op->type == SI5351_ASYNC_OP_INIT)
+		{
+			bus->begin();
+			started = clock();
+			state = SI5351_ASYNC_ST_PROBE;
+			ret = bus->start_probe(i2c_bus_addr);
+			break;
+		}
+		if(op->type == SI5351_ASYNC_OP_UPDATE_STATUS)
+		{
+			state = SI5351_ASYNC_ST_STATUS;
+			ret = bus->start_read(i2c_bus_addr, SI5351_DEVICE_STATUS, 2, status_regs);
+			break;
+		}
+		state = SI5351_ASYNC_ST_FETCH;
+		// Fall through
+
+	case SI5351_ASYNC_ST_FETCH:
+		for(fetch = 0; fetch < SI5351_ASYNC_FETCH_GROUPS; fetch++)
+		{
+			if(!(fetched & (1 << fetch)))
+			{
+				break;
+			}
+		}
+		if(fetch < SI5351_ASYNC_FETCH_GROUPS)
+		{
+			ret = bus->start_read(i2c_bus_addr, si5351_async_fetch[fetch].reg,
+				si5351_async_fetch[fetch].len, &shadow[si5351_async_fetch[fetch].index]);
+			break;
+		}
+
+		if(!record(op))
+		{
+			return false;
+		}
+		state = SI5351_ASYNC_ST_WRITE;
+		// Fall through
+
+	case SI5351_ASYNC_ST_WRITE:
+		if(xfer_next == xfer_count)
+		{
+			finish(op, result);
+			return false;
+		}
+		x = &xfers[xfer_next];
+		ret = bus->start_write(i2c_bus_addr, x->reg, x->len, &data[x->offset]);
+		break;
+
+	case SI5351_ASYNC_ST_WAIT_INIT:
+		ret = bus->start_read(i2c_bus_addr, SI5351_DEVICE_STATUS, 1, status_regs);
+		break;
+	}
+
+	if(ret != 0)
+	{
+		finish(op, SI5351_ASYNC_BUS_ERROR);
+		return false;
+	}
+
+	in_flight = true;
+	return true;
+}
+
+// Act on the end of the transfer that issue() started
+void Si5351Async::complete(struct Si5351AsyncOp *op, uint8_t ret)
+{
+	if(state == SI5351_ASYNC_ST_PROBE)
+	{
+		if(ret != 0)
+		{
+			finish(op, SI5351_ASYNC_NOT_FOUND);
+			return;
+		}
+		state = SI5351_ASYNC_ST_WAIT_INIT;
+		return;
+	}
+
+	if(ret != 0)
+	{
+		finish(op, SI5351_ASYNC_BUS_ERROR);
+		return;
+	}
+
+	switch(state)
+	{
+	case SI5351_ASYNC_ST_WAIT_INIT:
+		// Wait for SYS_INIT to clear, indicating that the device is ready
+		if(status_regs[0] >> 7 == 0)
+		{
+			state = SI5351_ASYNC_ST_FETCH;
+		}
+		else if(clock() - started >= (uint32_t)op->timeout_ms * 1000)
+		{
+			finish(op, SI5351_ASYNC_TIMEOUT);
+		}
+		break;
+	case SI5351_ASYNC_ST_FETCH:
+		fetched |= 1 << fetch;
+		break;
+	case SI5351_ASYNC_ST_WRITE:
+		xfer_next++;
+		break;
+	case SI5351_ASYNC_ST_STATUS:
+#if defined(SI5351_HAS_STATUS)
+		dev.update_status();
+#endif
+		finish(op, SI5351_ASYNC_OK);
+		break;
+	}
+}
+
+// Run the operation against the recorder, which leaves the transfers it
+// needs in xfers[]. Returns false if they did not fit.
+bool Si5351Async::record(struct Si5351AsyncOp *op)
+{
+	xfer_count = 0;
+	xfer_next = 0;
+	data_len = 0;
+	overflow = false;
+	result = SI5351_ASYNC_OK;
+
+	switch(op->type)
+	{
+	case SI5351_ASYNC_OP_INIT:
+		dev.init(op->arg, op->xo_freq, op->corr);
+		break;
+	case SI5351_ASYNC_OP_RESET:
+		dev.reset();
+		break;
+	case SI5351_ASYNC_OP_SET_FREQ:
+		if(dev.set_freq(op->freq, (enum si5351_clock)op->arg) != 0)
+		{
+			result = SI5351_ASYNC_REJECTED;
+		}
+		break;
+	case SI5351_ASYNC_OP_SET_PLL:
+		dev.set_pll(op->freq, (enum si5351_pll)op->arg);
+		break;
+	case SI5351_ASYNC_OP_PLL_RESET:
+		dev.pll_reset((enum si5351_pll)op->arg);
+		break;
+	}
+
+	if(overflow)
+	{
+		finish(op, SI5351_ASYNC_OVERFLOW);
+		return false;
+	}
+
+	return true;
+}
+
+// Take op off the queue and report its result. op may be reused or go
+// away as soon as its callback runs, so it isn't touched after that.
+void Si5351Async::finish(struct Si5351AsyncOp *op, uint8_t status)
+{
+	head = op->next;
+	if(head == NULL)
+	{
+		tail = NULL;
+	}
+	state = SI5351_ASYNC_ST_START;
+	in_flight = false;
+
+	// Part of the recorded writes may not have reached the device, so read
+	// the tracked registers again before the next operation
+	if(status == SI5351_ASYNC_BUS_ERROR || status == SI5351_ASYNC_OVERFLOW)
+	{
+		fetched = 0;
+	}
+
+	op->status = status;
+	if(op->done)
+	{
+		op->done(op);
+	}
+}
@@ -0,0 +1,191 @@
+/*
+ * si5351_async.h - Non-blocking interface to the Si5351 library
+ *
+ * Copyright (C) 2015 - 2019 Jason Milldrum <milldrum@gmail.com>
+ *                           Dana H. Myers <k6jq@comcast.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SI5351_ASYNC_H_
+#define SI5351_ASYNC_H_
+
+#include "si5351.h"
+
+// Room for the transfers of one operation. init() needs the most, with
+// about 40 transfers and 60 data bytes.
+#ifndef SI5351_ASYNC_MAX_XFER
+#define SI5351_ASYNC_MAX_XFER           48
+#endif
+#ifndef SI5351_ASYNC_MAX_DATA
+#define SI5351_ASYNC_MAX_DATA           96
+#endif
+
+// Returned by Si5351AsyncBus::poll() while a transfer is in progress
+#define SI5351_ASYNC_BUS_BUSY           0xFF
+
+// Status of an operation
+#define SI5351_ASYNC_OK                 0
+#define SI5351_ASYNC_PENDING            1
+#define SI5351_ASYNC_NOT_FOUND          2
+#define SI5351_ASYNC_TIMEOUT            3
+#define SI5351_ASYNC_BUS_ERROR          4
+#define SI5351_ASYNC_REJECTED           5
+#define SI5351_ASYNC_OVERFLOW           6
+
+// Number of register groups read once to serve read-modify-writes
+#define SI5351_ASYNC_FETCH_GROUPS       10
+#define SI5351_ASYNC_SHADOW_LEN         20
+
+/*
+ * Si5351AsyncBus - Transport that can run a transfer in the background
+ *
+ * start_*() begins a transfer and returns 0, or non-zero if it could not
+ * be started. poll() then returns SI5351_ASYNC_BUS_BUSY until the transfer
+ * is over, and after that its result in the style of
+ * Wire.endTransmission(). Only one transfer is ever in progress. Buffers
+ * passed to start_*() stay valid until poll() reports the end.
+ */
+class Si5351AsyncBus
+{
+public:
+	virtual ~Si5351AsyncBus() {}
+	virtual void begin(void) {}
+	virtual uint8_t start_probe(uint8_t dev_addr) = 0;
+	virtual uint8_t start_write(uint8_t dev_addr, uint8_t reg, uint8_t len, const uint8_t *data) = 0;
+	virtual uint8_t start_read(uint8_t dev_addr, uint8_t reg, uint8_t len, uint8_t *data) = 0;
+	virtual uint8_t poll(void) = 0;
+};
+
+/*
+ * Si5351AsyncAdapter - Runs an ordinary Si5351Bus behind Si5351AsyncBus
+ *
+ * Each transfer still blocks, but for one transfer only, so every call of
+ * Si5351Async::step() takes at most one transfer worth of time.
+ */
+class Si5351AsyncAdapter : public Si5351AsyncBus
+{
+public:
+	Si5351AsyncAdapter(Si5351Bus *bus);
+	void begin(void);
+	uint8_t start_probe(uint8_t dev_addr);
+	uint8_t start_write(uint8_t dev_addr, uint8_t reg, uint8_t len, const uint8_t *data);
+	uint8_t start_read(uint8_t dev_addr, uint8_t reg, uint8_t len, uint8_t *data);
+	uint8_t poll(void);
+private:
+	Si5351Bus *bus;
+	uint8_t result;
+};
+
+/*
+ * One operation for Si5351Async
+ *
+ * done - Called from step() when the operation is over, or NULL
+ * ctx - For the caller's use
+ * status - SI5351_ASYNC_PENDING until the operation is over, then its
+ *   result
+ *
+ * The remaining fields belong to Si5351Async. The struct must stay around
+ * until the operation is over, and must be zeroed before its first use.
+ */
+struct Si5351AsyncOp
+{
+	void (*done)(struct Si5351AsyncOp *);
+	void *ctx;
+	volatile uint8_t status;
+	uint8_t type;
+	uint8_t arg;
+	uint16_t timeout_ms;
+	uint32_t xo_freq;
+	int32_t corr;
+	uint64_t freq;
+	struct Si5351AsyncOp *next;
+};
+
+/*
+ * Si5351Async - Si5351 operations that never wait for the bus
+ *
+ * Each call only puts the operation in a queue and returns a handle to it.
+ * step(), called regularly from the main loop, moves the operation at the
+ * head of the queue along by at most one bus transfer at a time. The
+ * frequency calculations are those of Si5351 itself: they run in one go
+ * when an operation reaches the head of the queue, and produce the list of
+ * register writes that the following steps send out.
+ */
+class Si5351Async
+{
+public:
+	Si5351Async(uint8_t i2c_addr = SI5351_BUS_BASE_ADDR, Si5351AsyncBus *bus = NULL);
+	struct Si5351AsyncOp *init(struct Si5351AsyncOp *, uint8_t, uint32_t, int32_t, uint16_t);
+	struct Si5351AsyncOp *reset(struct Si5351AsyncOp *);
+	struct Si5351AsyncOp *set_freq(struct Si5351AsyncOp *, uint64_t, enum si5351_clock);
+	struct Si5351AsyncOp *set_pll(struct Si5351AsyncOp *, uint64_t, enum si5351_pll);
+	struct Si5351AsyncOp *pll_reset(struct Si5351AsyncOp *, enum si5351_pll);
+#if defined(SI5351_HAS_STATUS)
+	struct Si5351AsyncOp *update_status(struct Si5351AsyncOp *);
+#endif
+	bool step(void);
+	bool busy(void);
+	Si5351 *device(void);
+	void set_clock(uint32_t (*)(void));
+private:
+	/*
+	 * Bus the Si5351 object runs against. Writes are recorded for step()
+	 * to send out, and reads are answered from the shadow copy.
+	 */
+	class Recorder : public Si5351Bus
+	{
+	public:
+		Recorder(Si5351Async *owner);
+		uint8_t probe(uint8_t dev_addr);
+		uint8_t write(uint8_t dev_addr, uint8_t reg, uint8_t len, const uint8_t *data);
+		uint8_t read(uint8_t dev_addr, uint8_t reg, uint8_t len, uint8_t *data);
+	private:
+		Si5351Async *owner;
+	};
+	struct Xfer
+	{
+		uint8_t reg;
+		uint8_t len;
+		uint8_t offset;
+	};
+	struct Si5351AsyncOp *enqueue(struct Si5351AsyncOp *, uint8_t);
+	bool issue(struct Si5351AsyncOp *);
+	void complete(struct Si5351AsyncOp *, uint8_t);
+	bool record(struct Si5351AsyncOp *);
+	void finish(struct Si5351AsyncOp *, uint8_t);
+	Recorder recorder;
+	Si5351 dev;
+	Si5351AsyncBus *bus;
+	uint8_t i2c_bus_addr;
+	uint32_t (*clock)(void);
+	struct Si5351AsyncOp *head;
+	struct Si5351AsyncOp *tail;
+	uint8_t state;
+	bool in_flight;
+	uint32_t started;
+	uint8_t result;
+	uint8_t fetch;
+	uint16_t fetched;
+	uint8_t shadow[SI5351_ASYNC_SHADOW_LEN];
+	uint8_t status_regs[2];
+	struct Xfer xfers[SI5351_ASYNC_MAX_XFER];
+	uint8_t data[SI5351_ASYNC_MAX_DATA];
+	uint8_t xfer_count;
+	uint8_t xfer_next;
+	uint8_t data_len;
+	bool overflow;
+};
+
+#endif /* SI5351_ASYNC_H_ */
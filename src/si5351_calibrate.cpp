@@ -0,0 +1,219 @@
+/*
+ * si5351_calibrate.cpp - Automatic calibration for the Si5351 library
+ *
+ * Copyright (C) 2015 - 2019 Jason Milldrum <milldrum@gmail.com>
+ *                           Dana H. Myers <k6jq@comcast.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "si5351_calibrate.h"
+
+/*
+ * Si5351Calibrator(Si5351 *dev, uint8_t (*measure)(uint64_t *, void *), void *ctx)
+ *
+ * dev - Device to calibrate. It must already be initialized.
+ * measure - Called to measure the output. It stores the frequency in
+ *   Hz * 100 through its first argument and returns 0, or returns 1 if
+ *   no measurement could be made.
+ * ctx - Passed to measure as its second argument
+ *
+ * The defaults are CLK0 at 10 MHz and a counter resolution of 1 Hz.
+ */
+Si5351Calibrator::Si5351Calibrator(Si5351 *dev, uint8_t (*measure)(uint64_t *, void *), void *ctx):
+	dev(dev),
+	measure(measure),
+	ctx(ctx),
+	clk(SI5351_CLK0),
+	freq(1000000000ULL),
+	resolution(SI5351_FREQ_MULT)
+{
+}
+
+/*
+ * set_output(enum si5351_clock clk, uint64_t freq)
+ *
+ * Choose the output that is measured and its frequency. A higher
+ * frequency gives more ppb of resolution for the same counter.
+ *
+ * clk - Clock output
+ *   (use the si5351_clock enum)
+ * freq - Output frequency in Hz * 100
+ */
+void Si5351Calibrator::set_output(enum si5351_clock clk, uint64_t freq)
+{
+	this->clk = clk;
+	this->freq = freq;
+}
+
+/*
+ * set_resolution(uint64_t resolution)
+ *
+ * Set the resolution of the measurements, which decides when the search
+ * stops. A counter with a 1 s gate resolves 1 Hz, or 100 ppb at 10 MHz;
+ * a 10 s gate gives 10 ppb at the cost of ten times as long per
+ * measurement.
+ *
+ * resolution - Smallest step the measurement can show, in Hz * 100
+ */
+void Si5351Calibrator::set_resolution(uint64_t resolution)
+{
+	this->resolution = resolution;
+}
+
+/*
+ * run(struct Si5351CalResult *result, enum si5351_pll_input ref_osc)
+ *
+ * Drive the output, measure it and search for the correction of ref_osc
+ * that puts it on frequency. The correction found is left applied with
+ * set_correction(), and the output is left running.
+ *
+ * result - Where to store the outcome
+ * ref_osc - Reference whose correction is searched. The PLL of the
+ *   output must run from it.
+ *   (use the si5351_pll_input enum)
+ *
+ * Returns 0 if the search converged. Returns 1 if it did not within
+ * SI5351_CAL_MAX_MEASUREMENTS, with the best estimate applied, or if a
+ * measurement failed, with the correction put back as it was. Also
+ * returns 1, without measuring, if the output can't be set.
+ */
+uint8_t Si5351Calibrator::run(struct Si5351CalResult *result, enum si5351_pll_input ref_osc)
+{
+	int32_t start = dev->get_correction(ref_osc);
+	int32_t corr = start, lo = -SI5351_CAL_RANGE, hi = SI5351_CAL_RANGE;
+	int32_t count, resid, est, prev = 0;
+	uint32_t spread;
+	uint64_t meas;
+
+	memset(result, 0, sizeof(*result));
+	count = ppb_of(freq + resolution, freq);
+	if(count < 1)
+	{
+		count = 1;
+	}
+
+	if(dev->set_freq(freq, clk) != 0)
+	{
+		result->correction = start;
+		return 1;
+	}
+	while(result->measurements < SI5351_CAL_MAX_MEASUREMENTS)
+	{
+		dev->set_correction(corr, ref_osc);
+		if(measure(&meas, ctx) != 0)
+		{
+			dev->set_correction(start, ref_osc);
+			result->correction = start;
+			return 1;
+		}
+		result->measurements++;
+
+		// The output scales with (1 + error) / (1 + correction)
+		resid = ppb_of(meas, expected(corr));
+		est = corr + resid + (int32_t)((int64_t)resid * corr / 1000000000LL);
+
+		spread = 0;
+		if(result->measurements > 1)
+		{
+			spread = (uint32_t)(est > prev ? est - prev : prev - est);
+		}
+		result->correction = corr;
+		result->residual = ppb_of(meas, freq);
+		result->uncertainty = spread > (uint32_t)count ? spread : (uint32_t)count;
+
+		if(2 * resid <= count && 2 * resid >= -count)
+		{
+			result->converged = 1;
+			return 0;
+		}
+
+		// Two estimates in a row that agree to within a count
+		if(result->measurements > 1 && spread <= (uint32_t)count)
+		{
+			corr = prev + (est - prev) / 2;
+			dev->set_correction(corr, ref_osc);
+			result->correction = corr;
+			result->converged = 1;
+			return 0;
+		}
+		prev = est;
+
+		// Only a reading more than a count off says for certain which side
+		// of corr the correction is on. A reading above the expected one
+		// means the reference is faster than corr assumes.
+		if(resid > count)
+		{
+			lo = corr;
+		}
+		else if(resid < -count)
+		{
+			hi = corr;
+		}
+		if(hi - lo <= 1)
+		{
+			break;
+		}
+
+		// Fall back to halving the bracket when a reading points outside it
+		corr = (est > lo && est < hi) ? est : lo + (hi - lo) / 2;
+	}
+
+	dev->set_correction(corr, ref_osc);
+	result->correction = corr;
+	return 1;
+}
+
+/******************************/
+/* Private methods            */
+/******************************/
+
+// Frequency the output has for a correction if the reference is exactly
+// as corrected, in Hz * 100. It differs from the target by the step of
+// the PLL feedback divider.
+uint64_t Si5351Calibrator::expected(int32_t corr)
+{
+	struct Si5351RegSet reg;
+	enum si5351_pll pll = dev->pll_assignment[(uint8_t)clk];
+	uint64_t pll_freq = pll == SI5351_PLLA ? dev->plla_freq : dev->pllb_freq;
+	int64_t vco;
+
+	if(pll_freq == 0)
+	{
+		return freq;
+	}
+	vco = (int64_t)dev->pll_calc(pll, pll_freq, &reg, corr, 0);
+
+	return (uint64_t)((int64_t)freq + (int64_t)freq * (vco - (int64_t)pll_freq) / (int64_t)pll_freq);
+}
+
+// Difference of a measured frequency from a reference one in ppb, limited
+// to 1000 ppm either way
+int32_t Si5351Calibrator::ppb_of(uint64_t meas, uint64_t ref)
+{
+	int64_t diff = (int64_t)meas - (int64_t)ref;
+	int64_t lim = (int64_t)(ref / 1000);
+
+	if(diff > lim)
+	{
+		diff = lim;
+	}
+	else if(diff < -lim)
+	{
+		diff = -lim;
+	}
+	return (int32_t)(diff * 1000000000LL / (int64_t)ref);
+}
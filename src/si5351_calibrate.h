@@ -0,0 +1,97 @@
+/*
+ * si5351_calibrate.h - Automatic calibration for the Si5351 library
+ *
+ * Copyright (C) 2015 - 2019 Jason Milldrum <milldrum@gmail.com>
+ *                           Dana H. Myers <k6jq@comcast.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SI5351_CALIBRATE_H_
+#define SI5351_CALIBRATE_H_
+
+#include "si5351.h"
+
+// Most measurements run() takes before giving up on converging
+#ifndef SI5351_CAL_MAX_MEASUREMENTS
+#define SI5351_CAL_MAX_MEASUREMENTS     8
+#endif
+
+// Corrections searched, in ppb either side of zero
+#ifndef SI5351_CAL_RANGE
+#define SI5351_CAL_RANGE                300000L
+#endif
+
+/*
+ * Outcome of a calibration
+ *
+ * correction - Correction found, in ppb. It is left applied to the device.
+ * uncertainty - How far off the correction may be, in ppb: the counter
+ *   resolution, or the difference between the last two estimates if that
+ *   is larger
+ * measurements - Number of measurements taken
+ * residual - Error of the last measurement from the target, in ppb
+ * converged - 1 if the last measurement was within half the counter
+ *   resolution of what the correction in use should give, or the last two
+ *   estimates agreed to within the resolution
+ */
+struct Si5351CalResult
+{
+	int32_t correction;
+	uint32_t uncertainty;
+	uint8_t measurements;
+	int32_t residual;
+	uint8_t converged;
+};
+
+/*
+ * Si5351Calibrator - Find the reference correction with a frequency counter
+ *
+ * The calibrator drives one output at a known frequency and has it
+ * measured by a callback: a hardware counter, a GPS gated timer, or a
+ * person at a bench counter. Since the output scales exactly with the
+ * error of the reference, a single measurement gives an estimate of the
+ * correction. The estimate is applied and measured again, keeping every
+ * reading that is more than a count off as a bound on the correction. An
+ * estimate that falls outside the bounds, because of a bad reading, is
+ * replaced by the middle of them. It stops when a reading lands on target
+ * within the counter resolution or two estimates in a row agree, which
+ * usually takes two measurements.
+ *
+ * The PLL can only be set in steps of about 30 ppb, so the output is
+ * rarely exactly on target. Each reading is compared with the frequency
+ * the registers give for the correction in use rather than the target,
+ * which keeps the step out of the estimate. Pick an output frequency
+ * that divides the PLL exactly, such as the default 10 MHz, so that the
+ * multisynth adds no error of its own.
+ */
+class Si5351Calibrator
+{
+public:
+	Si5351Calibrator(Si5351 *dev, uint8_t (*measure)(uint64_t *, void *), void *ctx = NULL);
+	void set_output(enum si5351_clock, uint64_t);
+	void set_resolution(uint64_t);
+	uint8_t run(struct Si5351CalResult *, enum si5351_pll_input = SI5351_PLL_INPUT_XO);
+private:
+	uint64_t expected(int32_t);
+	int32_t ppb_of(uint64_t, uint64_t);
+	Si5351 *dev;
+	uint8_t (*measure)(uint64_t *, void *);
+	void *ctx;
+	enum si5351_clock clk;
+	uint64_t freq;
+	uint64_t resolution;
+};
+
+#endif /* SI5351_CALIBRATE_H_ */
@@ -0,0 +1,299 @@
+/*
+ * si5351_coalesce.cpp - Latest-value-wins tuning for the Si5351 library
+ *
+ * Copyright (C) 2015 - 2019 Jason Milldrum <milldrum@gmail.com>
+ *                           Dana H. Myers <k6jq@comcast.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "si5351_coalesce.h"
+
+/*
+ * Si5351Coalescer(Si5351 *dev)
+ *
+ * dev - Device to tune. It must already be initialized.
+ *
+ * The budget starts out unlimited; see set_budget().
+ */
+Si5351Coalescer::Si5351Coalescer(Si5351 *dev):
+	dev(dev),
+	clock(si5351_micros),
+	freq_dirty(0),
+	enable_dirty(0),
+	disable_dirty(0),
+	next(0),
+	rate(0),
+	tokens(0),
+	cap(0),
+	last_refill(0)
+{
+	memset(target, 0, sizeof(target));
+	memset(since, 0, sizeof(since));
+	memset(&stats, 0, sizeof(stats));
+}
+
+/*
+ * set_budget(uint16_t bytes_per_ms, uint16_t burst)
+ *
+ * Limit how much bus traffic service() generates.
+ *
+ * bytes_per_ms - Average number of bus bytes allowed per millisecond, or
+ *   0 for no limit
+ * burst - Most bytes that may go out at once after an idle period
+ *
+ * For reference, a 100 kHz I2C bus moves about 11 bytes per millisecond.
+ */
+void Si5351Coalescer::set_budget(uint16_t bytes_per_ms, uint16_t burst)
+{
+	rate = bytes_per_ms;
+	cap = (int32_t)burst * 1000;
+	tokens = cap;
+	last_refill = clock();
+}
+
+/*
+ * set_freq(uint64_t freq, enum si5351_clock clk)
+ *
+ * Make freq the target of an output. A target that was still waiting is
+ * dropped, and asking for the frequency the output already has cancels
+ * the change.
+ *
+ * freq - Output frequency in Hz * 100
+ * clk - Clock output
+ */
+void Si5351Coalescer::set_freq(uint64_t freq, enum si5351_clock clk)
+{
+	uint8_t bit;
+
+	stats.requested++;
+	if((uint8_t)clk >= SI5351_CLK_COUNT)
+	{
+		stats.rejected++;
+		return;
+	}
+	bit = 1 << (uint8_t)clk;
+	if(freq_dirty & bit)
+	{
+		stats.coalesced++;
+	}
+	else
+	{
+		since[(uint8_t)clk] = clock();
+	}
+
+	target[(uint8_t)clk] = freq;
+	if(freq == dev->clk_freq[(uint8_t)clk])
+	{
+		freq_dirty &= ~bit;
+	}
+	else
+	{
+		freq_dirty |= bit;
+	}
+}
+
+/*
+ * output_enable(enum si5351_clock clk, uint8_t enable)
+ *
+ * clk - Clock output
+ * enable - 1 to enable, 0 to disable
+ *
+ * A disable is written on the next service() regardless of the budget. An
+ * enable is written after any waiting frequency change of the same output,
+ * so that the output never comes up on a stale frequency.
+ */
+void Si5351Coalescer::output_enable(enum si5351_clock clk, uint8_t enable)
+{
+	uint8_t bit;
+
+	if((uint8_t)clk >= SI5351_CLK_COUNT)
+	{
+		return;
+	}
+	bit = 1 << (uint8_t)clk;
+
+	if(enable)
+	{
+		enable_dirty |= bit;
+		disable_dirty &= ~bit;
+	}
+	else
+	{
+		disable_dirty |= bit;
+		enable_dirty &= ~bit;
+	}
+}
+
+/*
+ * service(void)
+ *
+ * Write waiting changes to the device. Disables go first. Then, for each
+ * output in turn (starting after the one that was served last, so that a
+ * busy output can't starve the others), its newest target and any enable
+ * are written as long as the budget allows. Call it from the main loop.
+ *
+ * Returns the number of operations written.
+ */
+uint8_t Si5351Coalescer::service(void)
+{
+	uint32_t now = clock();
+	uint32_t elapsed, staleness;
+	uint8_t n = 0;
+	uint8_t i, clk, bit;
+	int32_t room;
+
+	// Tokens are kept in thousandths of a byte, so that bytes per
+	// millisecond are also thousandths of a byte per microsecond
+	if(rate)
+	{
+		elapsed = now - last_refill;
+		last_refill = now;
+		room = cap - tokens;
+		if(room > 0)
+		{
+			if(elapsed >= (uint32_t)room / rate)
+			{
+				tokens = cap;
+			}
+			else
+			{
+				tokens += (int32_t)(elapsed * rate);
+			}
+		}
+	}
+
+	for(clk = 0; disable_dirty; clk++)
+	{
+		bit = 1 << clk;
+		if(disable_dirty & bit)
+		{
+			dev->output_enable((enum si5351_clock)clk, 0);
+			tokens -= (int32_t)SI5351_COALESCE_ENABLE_COST * 1000;
+			disable_dirty &= ~bit;
+			stats.urgent++;
+			n++;
+		}
+	}
+
+	for(i = 0; i < SI5351_CLK_COUNT && (freq_dirty | enable_dirty); i++)
+	{
+		clk = (next + i) % SI5351_CLK_COUNT;
+		bit = 1 << clk;
+
+		if(freq_dirty & bit)
+		{
+			if(!charge(SI5351_COALESCE_FREQ_COST))
+			{
+				break;
+			}
+			if(dev->set_freq(target[clk], (enum si5351_clock)clk) != 0)
+			{
+				stats.rejected++;
+			}
+			freq_dirty &= ~bit;
+			staleness = clock() - since[clk];
+			stats.staleness_last = staleness;
+			if(staleness > stats.staleness_max)
+			{
+				stats.staleness_max = staleness;
+			}
+			stats.applied++;
+			n++;
+		}
+		if(enable_dirty & bit)
+		{
+			if(!charge(SI5351_COALESCE_ENABLE_COST))
+			{
+				break;
+			}
+			dev->output_enable((enum si5351_clock)clk, 1);
+			enable_dirty &= ~bit;
+			n++;
+		}
+	}
+	next = (next + i) % SI5351_CLK_COUNT;
+
+	if(freq_dirty | enable_dirty)
+	{
+		stats.deferred++;
+	}
+
+	return n;
+}
+
+/*
+ * pending(void)
+ *
+ * Returns a bit mask of the outputs that still have changes waiting.
+ */
+uint8_t Si5351Coalescer::pending(void)
+{
+	return freq_dirty | enable_dirty | disable_dirty;
+}
+
+/*
+ * set_clock(uint32_t (*clock)(void))
+ *
+ * clock - Function returning the current time in microseconds, or NULL to
+ *   go back to the default of micros()
+ *
+ * The budget is worked out from this clock, so it has to count in
+ * microseconds.
+ */
+void Si5351Coalescer::set_clock(uint32_t (*clock)(void))
+{
+	this->clock = clock ? clock : si5351_micros;
+	last_refill = this->clock();
+}
+
+/*
+ * get_stats(struct Si5351CoalesceStats *out)
+ *
+ * out - Receives the counters since the last reset_stats()
+ */
+void Si5351Coalescer::get_stats(struct Si5351CoalesceStats *out)
+{
+	*out = stats;
+}
+
+/*
+ * reset_stats(void)
+ *
+ * Zero the counters.
+ */
+void Si5351Coalescer::reset_stats(void)
+{
+	memset(&stats, 0, sizeof(stats));
+}
+
+// Take cost bytes from the budget if there is enough left. A full bucket
+// always pays, so that a burst smaller than one operation can't stall.
+bool Si5351Coalescer::charge(int32_t cost)
+{
+	if(rate == 0)
+	{
+		return true;
+	}
+
+	cost *= 1000;
+	if(tokens < cost && tokens < cap)
+	{
+		return false;
+	}
+	tokens -= cost;
+	return true;
+}
@@ -0,0 +1,101 @@
+/*
+ * si5351_coalesce.h - Latest-value-wins tuning for the Si5351 library
+ *
+ * Copyright (C) 2015 - 2019 Jason Milldrum <milldrum@gmail.com>
+ *                           Dana H. Myers <k6jq@comcast.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SI5351_COALESCE_H_
+#define SI5351_COALESCE_H_
+
+#include "si5351.h"
+
+// Bus bytes charged against the budget for each operation. A retune of an
+// output that is already running costs about 15 bytes of register
+// addresses and data; an enable or disable is a read-modify-write.
+#ifndef SI5351_COALESCE_FREQ_COST
+#define SI5351_COALESCE_FREQ_COST       16
+#endif
+#ifndef SI5351_COALESCE_ENABLE_COST
+#define SI5351_COALESCE_ENABLE_COST     3
+#endif
+
+/*
+ * Coalescer counters since the last reset_stats()
+ *
+ * requested - set_freq() calls
+ * applied - Frequency changes written to the device
+ * coalesced - Targets replaced by a newer one before they were written
+ * urgent - Disables written ahead of everything else
+ * deferred - service() calls that left work waiting for the budget
+ * rejected - Frequency changes that Si5351::set_freq() refused
+ * staleness_last, staleness_max - Clock ticks from the oldest unwritten
+ *   request of an output until its newest target was written, for the
+ *   latest write and the worst one
+ *
+ * requested / applied is the coalesce ratio.
+ */
+struct Si5351CoalesceStats
+{
+	uint32_t requested;
+	uint32_t applied;
+	uint32_t coalesced;
+	uint32_t urgent;
+	uint32_t deferred;
+	uint32_t rejected;
+	uint32_t staleness_last;
+	uint32_t staleness_max;
+};
+
+/*
+ * Si5351Coalescer - Keep only the newest frequency of each output
+ *
+ * set_freq() only records the target of an output, replacing whatever
+ * was still waiting for it. service(), called from the main loop, writes
+ * the waiting targets while staying within a budget of bus bytes per
+ * millisecond. Disables skip the budget and go out first; enables wait
+ * until the frequency of their output has been written.
+ */
+class Si5351Coalescer
+{
+public:
+	Si5351Coalescer(Si5351 *dev);
+	void set_budget(uint16_t, uint16_t);
+	void set_freq(uint64_t, enum si5351_clock);
+	void output_enable(enum si5351_clock, uint8_t);
+	uint8_t service(void);
+	uint8_t pending(void);
+	void set_clock(uint32_t (*)(void));
+	void get_stats(struct Si5351CoalesceStats *);
+	void reset_stats(void);
+private:
+	bool charge(int32_t);
+	Si5351 *dev;
+	uint32_t (*clock)(void);
+	uint64_t target[SI5351_CLK_COUNT];
+	uint32_t since[SI5351_CLK_COUNT];
+	uint8_t freq_dirty;
+	uint8_t enable_dirty;
+	uint8_t disable_dirty;
+	uint8_t next;
+	uint16_t rate;
+	int32_t tokens;
+	int32_t cap;
+	uint32_t last_refill;
+	struct Si5351CoalesceStats stats;
+};
+
+#endif /* SI5351_COALESCE_H_ */
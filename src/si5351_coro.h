@@ -0,0 +1,146 @@
+/*
+ * si5351_coro.h - C++20 coroutine front end for Si5351Async
+ *
+ * Copyright (C) 2015 - 2019 Jason Milldrum <milldrum@gmail.com>
+ *                           Dana H. Myers <k6jq@comcast.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SI5351_CORO_H_
+#define SI5351_CORO_H_
+
+#if defined(__linux__) && !defined(ARDUINO) && defined(__cpp_impl_coroutine)
+
+#include <coroutine>
+#include <exception>
+#include <functional>
+
+#include "si5351_async.h"
+
+/*
+ * Si5351Task - Coroutine that drives Si5351Async operations
+ *
+ * Write the coroutine as returning Si5351Task and co_await the
+ * si5351_co_*() calls in it. It runs until its first co_await when
+ * called, and is resumed from Si5351Async::step() as each operation ends.
+ */
+class Si5351Task
+{
+public:
+	struct promise_type
+	{
+		Si5351Task get_return_object(void)
+		{
+			return Si5351Task(std::coroutine_handle<promise_type>::from_promise(*this));
+		}
+		std::suspend_never initial_suspend(void) { return {}; }
+		std::suspend_always final_suspend(void) noexcept { return {}; }
+		void return_void(void) {}
+		void unhandled_exception(void) { std::terminate(); }
+	};
+
+	Si5351Task(Si5351Task &&other) : handle(other.handle) { other.handle = nullptr; }
+	Si5351Task(const Si5351Task &) = delete;
+	~Si5351Task()
+	{
+		if(handle)
+		{
+			handle.destroy();
+		}
+	}
+
+	// True once the coroutine has run to its end
+	bool done(void) const { return !handle || handle.done(); }
+private:
+	explicit Si5351Task(std::coroutine_handle<promise_type> h) : handle(h) {}
+	std::coroutine_handle<promise_type> handle;
+};
+
+/*
+ * Si5351Await - One queued operation, as something to co_await
+ *
+ * co_await gives the status of the operation (SI5351_ASYNC_OK and so on).
+ */
+class Si5351Await
+{
+public:
+	typedef std::function<struct Si5351AsyncOp *(Si5351Async &, struct Si5351AsyncOp *)> Start;
+
+	Si5351Await(Si5351Async &dev, Start start) : dev(dev), start(start), op() {}
+
+	bool await_ready(void) { return false; }
+	bool await_suspend(std::coroutine_handle<> h)
+	{
+		waiter = h;
+		op.done = resume;
+		op.ctx = this;
+
+		// Don't suspend if the operation could not be queued
+		return start(dev, &op) != NULL;
+	}
+	uint8_t await_resume(void) { return op.status; }
+private:
+	static void resume(struct Si5351AsyncOp *op)
+	{
+		static_cast<Si5351Await *>(op->ctx)->waiter.resume();
+	}
+	Si5351Async &dev;
+	Start start;
+	struct Si5351AsyncOp op;
+	std::coroutine_handle<> waiter;
+};
+
+inline Si5351Await si5351_co_init(Si5351Async &dev, uint8_t xtal_load_c, uint32_t xo_freq,
+	int32_t corr, uint16_t timeout_ms)
+{
+	return Si5351Await(dev, [=](Si5351Async &d, struct Si5351AsyncOp *op)
+		{ return d.init(op, xtal_load_c, xo_freq, corr, timeout_ms); });
+}
+
+inline Si5351Await si5351_co_reset(Si5351Async &dev)
+{
+	return Si5351Await(dev, [](Si5351Async &d, struct Si5351AsyncOp *op)
+		{ return d.reset(op); });
+}
+
+inline Si5351Await si5351_co_set_freq(Si5351Async &dev, uint64_t freq, enum si5351_clock clk)
+{
+	return Si5351Await(dev, [=](Si5351Async &d, struct Si5351AsyncOp *op)
+		{ return d.set_freq(op, freq, clk); });
+}
+
+inline Si5351Await si5351_co_set_pll(Si5351Async &dev, uint64_t pll_freq, enum si5351_pll target_pll)
+{
+	return Si5351Await(dev, [=](Si5351Async &d, struct Si5351AsyncOp *op)
+		{ return d.set_pll(op, pll_freq, target_pll); });
+}
+
+inline Si5351Await si5351_co_pll_reset(Si5351Async &dev, enum si5351_pll target_pll)
+{
+	return Si5351Await(dev, [=](Si5351Async &d, struct Si5351AsyncOp *op)
+		{ return d.pll_reset(op, target_pll); });
+}
+
+#if defined(SI5351_HAS_STATUS)
+inline Si5351Await si5351_co_update_status(Si5351Async &dev)
+{
+	return Si5351Await(dev, [](Si5351Async &d, struct Si5351AsyncOp *op)
+		{ return d.update_status(op); });
+}
+#endif
+
+#endif
+
+#endif /* SI5351_CORO_H_ */
@@ -0,0 +1,179 @@
+/*
+ * si5351_discipline.cpp - Live reference correction for the Si5351 library
+ *
+ * Copyright (C) 2015 - 2019 Jason Milldrum <milldrum@gmail.com>
+ *                           Dana H. Myers <k6jq@comcast.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "si5351_discipline.h"
+
+/*
+ * Si5351Discipline(Si5351 *dev, enum si5351_pll_input ref_osc)
+ *
+ * dev - Device to correct. It must already be initialized.
+ * ref_osc - Reference whose correction is steered
+ *   (use the si5351_pll_input enum)
+ */
+Si5351Discipline::Si5351Discipline(Si5351 *dev, enum si5351_pll_input ref_osc):
+	dev(dev),
+	ref_osc(ref_osc),
+	clock(si5351_micros)
+{
+	memset(&stats, 0, sizeof(stats));
+}
+
+/*
+ * set_correction(int32_t corr)
+ *
+ * Change the correction of the reference and bring the running PLLs that
+ * use it to the corrected frequency right away. The bytes the chip holds
+ * are worked out from the correction in use until now, so only those
+ * that differ are written. After this, the device object uses the new
+ * correction for everything it calculates, as if Si5351::set_correction()
+ * had been called.
+ *
+ * With spread spectrum on, its parameters are written again whenever PLLA
+ * changes. A PLL set up by set_vcxo() is not recalculated correctly; keep
+ * the VCXO on the other reference.
+ *
+ * corr - Correction factor in ppb
+ *
+ * Returns the number of register bytes written.
+ */
+uint8_t Si5351Discipline::set_correction(int32_t corr)
+{
+	uint32_t start = clock();
+	int32_t old = dev->ref_correction[(uint8_t)ref_osc];
+	uint8_t bytes = 0;
+
+	stats.updates++;
+	if(corr != old)
+	{
+		if(dev->plla_ref_osc == ref_osc && dev->plla_freq)
+		{
+			bytes += update_pll(SI5351_PLLA, dev->plla_freq, old, corr);
+		}
+		if(dev->pllb_ref_osc == ref_osc && dev->pllb_freq)
+		{
+			bytes += update_pll(SI5351_PLLB, dev->pllb_freq, old, corr);
+		}
+		dev->ref_correction[(uint8_t)ref_osc] = corr;
+	}
+	if(bytes == 0)
+	{
+		stats.unchanged++;
+	}
+
+	stats.latency_last = clock() - start;
+	if(stats.latency_last > stats.latency_max)
+	{
+		stats.latency_max = stats.latency_last;
+	}
+
+	return bytes;
+}
+
+/*
+ * get_correction(void)
+ *
+ * Returns the correction in use, in ppb.
+ */
+int32_t Si5351Discipline::get_correction(void)
+{
+	return dev->ref_correction[(uint8_t)ref_osc];
+}
+
+/*
+ * set_clock(uint32_t (*clock)(void))
+ *
+ * clock - Function returning the current time, or NULL to go back to the
+ *   default of micros(). The latencies are counted in its ticks.
+ */
+void Si5351Discipline::set_clock(uint32_t (*clock)(void))
+{
+	this->clock = clock ? clock : si5351_micros;
+}
+
+/*
+ * get_stats(struct Si5351DisciplineStats *stats)
+ *
+ * stats - Where to copy the counters
+ */
+void Si5351Discipline::get_stats(struct Si5351DisciplineStats *stats)
+{
+	*stats = this->stats;
+}
+
+/*
+ * reset_stats(void)
+ *
+ * Zero the counters.
+ */
+void Si5351Discipline::reset_stats(void)
+{
+	memset(&stats, 0, sizeof(stats));
+}
+
+/******************************/
+/* Private methods            */
+/******************************/
+
+// Write the bytes of one PLL that differ between the old and the new
+// correction, and the spread spectrum parameters of PLLA if it is on, and
+// return how many were written
+uint8_t Si5351Discipline::update_pll(enum si5351_pll pll, uint64_t freq, int32_t old_corr, int32_t new_corr)
+{
+	struct Si5351RegSet reg;
+	uint8_t before[SI5351_PARAMETERS_LENGTH];
+	uint8_t after[SI5351_PARAMETERS_LENGTH];
+	uint8_t first, last, ssc = 0;
+
+	dev->pll_calc(pll, freq, &reg, old_corr, 0);
+	dev->pll_pack(reg, before);
+	dev->pll_calc(pll, freq, &reg, new_corr, 0);
+	dev->pll_pack(reg, after);
+
+	for(first = 0; first < SI5351_PARAMETERS_LENGTH && before[first] == after[first]; first++)
+	{
+	}
+	if(first == SI5351_PARAMETERS_LENGTH)
+	{
+		return 0;
+	}
+	for(last = SI5351_PARAMETERS_LENGTH - 1; before[last] == after[last]; last--)
+	{
+	}
+
+	dev->si5351_write_bulk((pll == SI5351_PLLA ? SI5351_PLLA_PARAMETERS : SI5351_PLLB_PARAMETERS) + first,
+		last - first + 1, &after[first]);
+	stats.writes++;
+	stats.bytes += last - first + 1;
+
+	// Spread spectrum follows the new PLLA feedback ratio
+	if(pll == SI5351_PLLA)
+	{
+		ssc = dev->ssc_refresh(reg);
+		if(ssc)
+		{
+			stats.writes++;
+			stats.bytes += ssc;
+		}
+	}
+
+	return last - first + 1 + ssc;
+}
@@ -0,0 +1,73 @@
+/*
+ * si5351_discipline.h - Live reference correction for the Si5351 library
+ *
+ * Copyright (C) 2015 - 2019 Jason Milldrum <milldrum@gmail.com>
+ *                           Dana H. Myers <k6jq@comcast.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SI5351_DISCIPLINE_H_
+#define SI5351_DISCIPLINE_H_
+
+#include "si5351.h"
+
+/*
+ * Counters of Si5351Discipline since the last reset_stats()
+ *
+ * updates - set_correction() calls
+ * unchanged - Updates that didn't change any register
+ * writes - Register bursts written
+ * bytes - PLL and spread spectrum register bytes written
+ * latency_last, latency_max - Clock ticks from the start of an update to
+ *   the end of its last write, for the latest update and the worst one
+ */
+struct Si5351DisciplineStats
+{
+	uint32_t updates;
+	uint32_t unchanged;
+	uint32_t writes;
+	uint32_t bytes;
+	uint32_t latency_last;
+	uint32_t latency_max;
+};
+
+/*
+ * Si5351Discipline - Apply a new reference correction while running
+ *
+ * For a loop that steers the reference, such as a GPS disciplined
+ * oscillator updated every second. set_correction() recalculates the
+ * feedback dividers of only the PLLs that run from the corrected
+ * reference, and writes only the bytes of them that change, in a single
+ * burst per PLL. The multisynths are left alone and the PLLs aren't
+ * reset, so the outputs move smoothly to the new frequency.
+ */
+class Si5351Discipline
+{
+public:
+	Si5351Discipline(Si5351 *dev, enum si5351_pll_input ref_osc = SI5351_PLL_INPUT_XO);
+	uint8_t set_correction(int32_t);
+	int32_t get_correction(void);
+	void set_clock(uint32_t (*)(void));
+	void get_stats(struct Si5351DisciplineStats *);
+	void reset_stats(void);
+private:
+	uint8_t update_pll(enum si5351_pll, uint64_t, int32_t, int32_t);
+	Si5351 *dev;
+	enum si5351_pll_input ref_osc;
+	uint32_t (*clock)(void);
+	struct Si5351DisciplineStats stats;
+};
+
+#endif /* SI5351_DISCIPLINE_H_ */
@@ -0,0 +1,1145 @@
+/*
+ * si5351_group.cpp - Joint frequency planning for several Si5351 devices
+ *
+ * Copyright (C) 2015 - 2019 Jason Milldrum <milldrum@gmail.com>
+ *                           Dana H. Myers <k6jq@comcast.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "si5351_group.h"
+
+#define SI5351_GROUP_VCO_MIN            (SI5351_PLL_VCO_MIN * SI5351_FREQ_MULT)
+#define SI5351_GROUP_VCO_MAX            (SI5351_PLL_VCO_MAX * SI5351_FREQ_MULT)
+#define SI5351_GROUP_DIVBY4_FREQ        (SI5351_MULTISYNTH_DIVBY4_FREQ * SI5351_FREQ_MULT)
+
+// Offset of a register in the image
+#define SI5351_GROUP_IMG(reg)           ((reg) - SI5351_GROUP_IMG_FIRST)
+
+static uint64_t si5351_group_gcd(uint64_t a, uint64_t b)
+{
+	while(b != 0)
+	{
+		uint64_t t = a % b;
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+/*
+ * Range of VCO frequencies from which a multisynth can reach freq with an
+ * even integer divider
+ */
+static void si5351_group_limits(uint64_t freq, uint64_t *lo, uint64_t *hi)
+{
+	if(freq >= SI5351_GROUP_DIVBY4_FREQ)
+	{
+		*lo = freq * 4;
+		*hi = freq * 4;
+	}
+	else
+	{
+		*lo = freq * SI5351_MULTISYNTH_A_MIN;
+		*hi = freq * SI5351_MULTISYNTH_A_MAX;
+	}
+
+	if(*lo < SI5351_GROUP_VCO_MIN)
+	{
+		*lo = SI5351_GROUP_VCO_MIN;
+	}
+	if(*hi > SI5351_GROUP_VCO_MAX)
+	{
+		*hi = SI5351_GROUP_VCO_MAX;
+	}
+}
+
+/*
+ * Lowest multiple of step in [lo, hi], or 0 if there is none
+ */
+static uint64_t si5351_group_multiple(uint64_t step, uint64_t lo, uint64_t hi)
+{
+	uint64_t vco = ((lo + step - 1) / step) * step;
+
+	return vco <= hi ? vco : 0;
+}
+
+static bool si5351_group_fits(uint64_t freq, uint64_t vco)
+{
+	uint64_t lo, hi;
+
+	si5351_group_limits(freq, &lo, &hi);
+	return vco >= lo && vco <= hi && vco % (freq * 2) == 0;
+}
+
+/*
+ * Closest fraction to b / c (below 1) with a denominator that fits in
+ * 20 bits, from the continued fraction expansion
+ */
+static void si5351_group_approx(uint64_t *b, uint64_t *c)
+{
+	uint64_t p0 = 0, q0 = 1, p1 = 1, q1 = 0;
+	uint64_t n = *b, d = *c, k, t;
+
+	while(d != 0)
+	{
+		k = n / d;
+		if(k * q1 + q0 > SI5351_MULTISYNTH_C_MAX)
+		{
+			break;
+		}
+		t = k * p1 + p0;
+		p0 = p1;
+		p1 = t;
+		t = k * q1 + q0;
+		q0 = q1;
+		q1 = t;
+		t = n - k * d;
+		n = d;
+		d = t;
+	}
+
+	// The best semiconvergent may beat the last convergent
+	k = (SI5351_MULTISYNTH_C_MAX - q0) / q1;
+	t = k * q1 + q0;
+	if(k != 0)
+	{
+		uint64_t pk = k * p1 + p0;
+		uint64_t err1 = p1 * *c > *b * q1 ? p1 * *c - *b * q1 : *b * q1 - p1 * *c;
+		uint64_t errk = pk * *c > *b * t ? pk * *c - *b * t : *b * t - pk * *c;
+
+		// Compare err1 / q1 with errk / t
+		if(errk * q1 < err1 * t)
+		{
+			p1 = pk;
+			q1 = t;
+		}
+	}
+
+	*b = p1;
+	*c = q1;
+}
+
+/*
+ * Feedback or multisynth parameters for the ratio num / den. The fraction
+ * is exact whenever its reduced denominator fits in 20 bits.
+ */
+static void si5351_group_ratio(uint64_t num, uint64_t den, struct Si5351RegSet *reg)
+{
+	uint32_t a = num / den;
+	uint64_t b = num % den;
+	uint64_t c = 1;
+
+	if(b != 0)
+	{
+		uint64_t g = si5351_group_gcd(b, den);
+
+		b /= g;
+		c = den / g;
+		if(c > SI5351_MULTISYNTH_C_MAX)
+		{
+			si5351_group_approx(&b, &c);
+		}
+	}
+
+	reg->p1 = 128 * a + (uint32_t)((128 * b) / c) - 512;
+	reg->p2 = (uint32_t)(128 * b - c * ((128 * b) / c));
+	reg->p3 = (uint32_t)c;
+}
+
+/********************/
+/* Public functions */
+/********************/
+
+/*
+ * Si5351Group(Si5351Bus *bus)
+ *
+ * bus - Transport shared by all of the devices. On Arduino, NULL selects
+ *   the Wire library.
+ */
+Si5351Group::Si5351Group(Si5351Bus *bus):
+	bus(bus),
+	ndev(0),
+	nout(0),
+	planned(false),
+	bypass(SI5351_GROUP_BYPASS_EXACT),
+	ref_freq(SI5351_XTAL_FREQ * SI5351_FREQ_MULT)
+{
+	memset(shadow, 0, sizeof(shadow));
+	memset(shadow_oe, 0xFF, sizeof(shadow_oe));
+	memset(shadow_fanout, SI5351_MULTISYNTH_ENABLE, sizeof(shadow_fanout));
+	memset(shadow_valid, 0, sizeof(shadow_valid));
+}
+
+/*
+ * add_device(uint8_t i2c_addr)
+ *
+ * i2c_addr - I2C address of another Si5351 on the bus
+ *
+ * Returns the index of the device, or SI5351_GROUP_ANY if there is no
+ * room for more than SI5351_GROUP_MAX_DEV devices.
+ */
+uint8_t Si5351Group::add_device(uint8_t i2c_addr)
+{
+	if(ndev >= SI5351_GROUP_MAX_DEV)
+	{
+		return SI5351_GROUP_ANY;
+	}
+
+	devs[ndev] = Si5351(i2c_addr, bus);
+	return ndev++;
+}
+
+/*
+ * init(uint8_t xtal_load_c, uint32_t xo_freq, int32_t corr)
+ *
+ * Initialize every device as Si5351::init() does. All of the devices are
+ * expected to run from the same reference.
+ *
+ * xtal_load_c - Crystal load capacitance. Use the SI5351_CRYSTAL_LOAD_*PF
+ * defines in the header file
+ * xo_freq - Reference oscillator frequency in 1 Hz increments.
+ * Defaults to 25000000 if a 0 is used here.
+ * corr - Frequency correction constant in parts-per-billion
+ *
+ * Returns true if all of the devices were found.
+ */
+bool Si5351Group::init(uint8_t xtal_load_c, uint32_t xo_freq, int32_t corr)
+{
+	bool found = true;
+	uint8_t d, c;
+
+	for(d = 0; d < ndev; d++)
+	{
+		if(!devs[d].init(xtal_load_c, xo_freq, corr))
+		{
+			found = false;
+		}
+
+		// The CLK control registers as reset() leaves them, all 8 of them
+		// since they are in the image whatever the variant
+		for(c = 0; c < 8; c++)
+		{
+			shadow[d][c] = SI5351_CLK_INPUT_MULTISYNTH_N | (c >= 6 ? SI5351_CLK_PLL_SELECT : 0);
+		}
+		shadow_oe[d] = 0xFF;
+		shadow_fanout[d] = SI5351_MULTISYNTH_ENABLE;
+		shadow_valid[d] = false;
+		vco_written[d][SI5351_PLLA] = SI5351_PLL_FIXED;
+		vco_written[d][SI5351_PLLB] = SI5351_PLL_FIXED;
+	}
+
+	set_correction(corr);
+
+	return found;
+}
+
+/*
+ * set_correction(int32_t corr)
+ *
+ * corr - Correction factor of the shared reference in ppb
+ *
+ * Sets the correction of the shared reference for all of the devices.
+ * The corrected reference frequency is calculated once here and used for
+ * every PLL. The new PLL settings are written by the next commit().
+ */
+void Si5351Group::set_correction(int32_t corr)
+{
+	uint8_t d;
+
+	ref_freq = (ndev ? devs[0].xtal_freq[SI5351_PLL_INPUT_XO] : SI5351_XTAL_FREQ) * SI5351_FREQ_MULT;
+	ref_freq = ref_freq + (int32_t)((((((int64_t)corr) << 31) / 1000000000LL) * ref_freq) >> 31);
+
+	for(d = 0; d < ndev; d++)
+	{
+		devs[d].ref_correction[SI5351_PLL_INPUT_XO] = corr;
+	}
+}
+
+/*
+ * set_bypass(uint8_t policy)
+ *
+ * policy - When plan() may run an output from the crystal through its R
+ *   divider alone: SI5351_GROUP_BYPASS_OFF, SI5351_GROUP_BYPASS_EXACT
+ *   (the default; only while the correction is 0) or
+ *   SI5351_GROUP_BYPASS_ALWAYS
+ *
+ * An output at the crystal frequency, or at that divided by 2 to 128,
+ * needs neither a PLL nor a multisynth. Running it straight from the
+ * crystal lowers its jitter and power, and leaves the PLL and multisynth
+ * to the other outputs. The crystal isn't corrected, though, so with a
+ * correction in place the output differs from what a PLL would give by
+ * that correction. Takes effect with the next plan().
+ */
+void Si5351Group::set_bypass(uint8_t policy)
+{
+	bypass = policy;
+	planned = false;
+}
+
+/*
+ * clear(void)
+ *
+ * Forget all of the requested outputs. The devices keep running until the
+ * next commit().
+ */
+void Si5351Group::clear(void)
+{
+	nout = 0;
+	planned = false;
+}
+
+/*
+ * add_output(uint64_t freq, uint8_t dev, uint8_t clk)
+ *
+ * Request an output frequency. By default the planner is free to put it on
+ * any output of any device.
+ *
+ * freq - Output frequency in Hz * 100
+ * dev - Device index the output has to be on, or SI5351_GROUP_ANY
+ * clk - CLK output it has to be on, or SI5351_GROUP_ANY. Only valid
+ *   together with a device index.
+ *
+ * Returns the index of the request, or SI5351_GROUP_ANY if the request is
+ * invalid or there are already SI5351_GROUP_MAX_OUT of them.
+ */
+uint8_t Si5351Group::add_output(uint64_t freq, uint8_t dev, uint8_t clk)
+{
+	if(nout >= SI5351_GROUP_MAX_OUT || freq == 0)
+	{
+		return SI5351_GROUP_ANY;
+	}
+	if((dev != SI5351_GROUP_ANY && dev >= ndev) ||
+		(clk != SI5351_GROUP_ANY && (dev == SI5351_GROUP_ANY || clk >= SI5351_CLK_COUNT)))
+	{
+		return SI5351_GROUP_ANY;
+	}
+
+	// Same bounds as set_freq()
+	if(freq < SI5351_CLKOUT_MIN_FREQ * SI5351_FREQ_MULT)
+	{
+		freq = SI5351_CLKOUT_MIN_FREQ * SI5351_FREQ_MULT;
+	}
+	if(freq > SI5351_MULTISYNTH_MAX_FREQ * SI5351_FREQ_MULT)
+	{
+		freq = SI5351_MULTISYNTH_MAX_FREQ * SI5351_FREQ_MULT;
+	}
+
+	out[nout].freq = freq;
+	out[nout].dev = SI5351_GROUP_ANY;
+	out[nout].clk = SI5351_GROUP_ANY;
+	out[nout].pll = SI5351_PLLA;
+	out[nout].integer = 0;
+	out[nout].bypass = 0;
+	pin_dev[nout] = dev;
+	pin_clk[nout] = clk;
+	ms_freq[nout] = freq;
+	r_div[nout] = devs[0].select_r_div(&ms_freq[nout]);
+
+	planned = false;
+
+	return nout++;
+}
+
+/*
+ * plan(void)
+ *
+ * Assign the requested outputs to devices, PLLs and CLK outputs. Outputs
+ * whose frequencies are even integer divisions of a common VCO frequency
+ * are grouped on the same PLL, largest groups first, so that as many
+ * multisynths as possible run in integer mode. The rest are fitted
+ * fractionally onto the PLLs that are left. Outputs at the crystal
+ * frequency divided by 1 to 128 run straight from the crystal as
+ * set_bypass() allows, and are placed last on any output that is still
+ * free. Nothing is written to the devices until commit().
+ *
+ * Returns 0 on success, or 1 if some output could not be placed.
+ */
+uint8_t Si5351Group::plan(void)
+{
+	uint8_t members[SI5351_CLK_COUNT];
+	bool skip[SI5351_GROUP_MAX_OUT];
+	uint8_t i, j, k, n, d, p;
+	uint64_t v;
+
+	planned = false;
+	memset(slot, SI5351_GROUP_ANY, sizeof(slot));
+	memset(vco, 0, sizeof(vco));
+
+	for(i = 0; i < nout; i++)
+	{
+		out[i].dev = SI5351_GROUP_ANY;
+		out[i].clk = SI5351_GROUP_ANY;
+		out[i].integer = 0;
+		out[i].bypass = bypass_shift(i) != SI5351_GROUP_ANY;
+		skip[i] = out[i].bypass;
+
+		// Reserve the outputs that were asked for by number
+		if(pin_clk[i] != SI5351_GROUP_ANY)
+		{
+			if(slot[pin_dev[i]][pin_clk[i]] != SI5351_GROUP_ANY)
+			{
+				return 1;
+			}
+			slot[pin_dev[i]][pin_clk[i]] = i;
+		}
+
+		// Highest multisynth frequency first, since those have the fewest
+		// usable VCO frequencies
+		for(j = i; j > 0 && ms_freq[order[j - 1]] < ms_freq[i]; j--)
+		{
+			order[j] = order[j - 1];
+		}
+		order[j] = i;
+	}
+
+	// Integer groups, each on a PLL of its own
+	while(true)
+	{
+		uint8_t best = SI5351_GROUP_ANY;
+		uint8_t best_n = 0;
+
+		for(k = 0; k < nout; k++)
+		{
+			i = order[k];
+			if(out[i].dev != SI5351_GROUP_ANY || skip[i])
+			{
+				continue;
+			}
+			n = build_cluster(i, members, &v, &d);
+			if(n > best_n)
+			{
+				best = i;
+				best_n = n;
+			}
+		}
+		if(best == SI5351_GROUP_ANY)
+		{
+			break;
+		}
+
+		n = build_cluster(best, members, &v, &d);
+		if(d == SI5351_GROUP_ANY)
+		{
+			// The device with a free PLL and the most free outputs
+			uint8_t most = 0;
+
+			for(j = 0; j < ndev; j++)
+			{
+				uint8_t free = 0;
+
+				if(vco[j][SI5351_PLLA] != 0 && vco[j][SI5351_PLLB] != 0)
+				{
+					continue;
+				}
+				for(k = 0; k < SI5351_CLK_COUNT; k++)
+				{
+					free += slot[j][k] == SI5351_GROUP_ANY;
+				}
+				if(free > most)
+				{
+					most = free;
+					d = j;
+				}
+			}
+		}
+		if(d == SI5351_GROUP_ANY)
+		{
+			skip[best] = true;
+			continue;
+		}
+
+		p = vco[d][SI5351_PLLA] == 0 ? SI5351_PLLA : SI5351_PLLB;
+		vco[d][p] = v;
+		if(!place(members[0], d, p, v))
+		{
+			vco[d][p] = 0;
+			skip[best] = true;
+			continue;
+		}
+		for(k = 1; k < n; k++)
+		{
+			place(members[k], d, p, v);
+		}
+	}
+
+	// Fractional leftovers on the PLLs already in use
+	for(k = 0; k < nout; k++)
+	{
+		uint8_t frac_d = SI5351_GROUP_ANY;
+		uint8_t frac_p = 0;
+
+		i = order[k];
+		if(out[i].dev != SI5351_GROUP_ANY || out[i].bypass)
+		{
+			continue;
+		}
+		for(d = 0; d < ndev && out[i].dev == SI5351_GROUP_ANY; d++)
+		{
+			if(pin_dev[i] != SI5351_GROUP_ANY && pin_dev[i] != d)
+			{
+				continue;
+			}
+			for(p = 0; p < 2; p++)
+			{
+				v = vco[d][p];
+				if(v == 0)
+				{
+					continue;
+				}
+				if(si5351_group_fits(ms_freq[i], v))
+				{
+					if(place(i, d, p, v))
+					{
+						break;
+					}
+				}
+				else if(frac_d == SI5351_GROUP_ANY && ms_freq[i] < SI5351_GROUP_DIVBY4_FREQ &&
+					v >= ms_freq[i] * 8 && v <= ms_freq[i] * SI5351_MULTISYNTH_A_MAX &&
+					free_slot(i, d, 0) != SI5351_GROUP_ANY)
+				{
+					frac_d = d;
+					frac_p = p;
+				}
+			}
+		}
+		if(out[i].dev == SI5351_GROUP_ANY && frac_d != SI5351_GROUP_ANY)
+		{
+			place(i, frac_d, frac_p, vco[frac_d][frac_p]);
+		}
+		if(out[i].dev == SI5351_GROUP_ANY)
+		{
+			return 1;
+		}
+	}
+
+	// Outputs straight from the crystal can go on any output left
+	for(i = 0; i < nout; i++)
+	{
+		if(out[i].bypass && !place_bypass(i))
+		{
+			return 1;
+		}
+	}
+
+	planned = true;
+
+	return 0;
+}
+
+/*
+ * commit(void)
+ *
+ * Write the current plan to all of the devices. Only the registers that
+ * differ from what was last written are sent, in as few bursts as
+ * possible, and only the PLLs whose settings changed are reset.
+ *
+ * Returns 0 on success, or 1 if there is no valid plan.
+ */
+uint8_t Si5351Group::commit(void)
+{
+	uint8_t img[SI5351_GROUP_IMG_LEN];
+	uint8_t d, c, p, i, oe, pll_rst, fanout;
+
+	if(!planned)
+	{
+		return 1;
+	}
+
+	for(d = 0; d < ndev; d++)
+	{
+		Si5351 &dev = devs[d];
+
+		build_image(d, img, &oe);
+
+		// After init() nothing in the image is known to be on the chip
+		if(!shadow_valid[d])
+		{
+			for(i = 0; i < SI5351_GROUP_IMG_LEN; i++)
+			{
+				shadow[d][i] = ~img[i];
+			}
+			shadow_oe[d] = ~oe;
+		}
+
+		pll_rst = 0;
+		if(memcmp(&img[SI5351_GROUP_IMG(SI5351_PLLA_PARAMETERS)],
+			&shadow[d][SI5351_GROUP_IMG(SI5351_PLLA_PARAMETERS)], SI5351_PARAMETERS_LENGTH) != 0)
+		{
+			pll_rst |= SI5351_PLL_RESET_A;
+		}
+		if(memcmp(&img[SI5351_GROUP_IMG(SI5351_PLLB_PARAMETERS)],
+			&shadow[d][SI5351_GROUP_IMG(SI5351_PLLB_PARAMETERS)], SI5351_PARAMETERS_LENGTH) != 0)
+		{
+			pll_rst |= SI5351_PLL_RESET_B;
+		}
+
+		// PLL and multisynth parameters, then the CLK control registers
+		write_diff(d, SI5351_PLLA_PARAMETERS, SI5351_CLK6_7_OUTPUT_DIVIDER - SI5351_PLLA_PARAMETERS + 1,
+			&img[SI5351_GROUP_IMG(SI5351_PLLA_PARAMETERS)], &shadow[d][SI5351_GROUP_IMG(SI5351_PLLA_PARAMETERS)]);
+		write_diff(d, SI5351_CLK0_CTRL, 8, &img[SI5351_GROUP_IMG(SI5351_CLK0_CTRL)],
+			&shadow[d][SI5351_GROUP_IMG(SI5351_CLK0_CTRL)]);
+
+		// Both PLLs can be reset with a single write
+		if(pll_rst)
+		{
+			dev.si5351_write(SI5351_PLL_RESET, pll_rst);
+		}
+
+		// The crystal fanout only while an output runs from it
+		fanout = shadow_fanout[d] & ~SI5351_XTAL_ENABLE;
+		for(c = 0; c < SI5351_CLK_COUNT; c++)
+		{
+			i = slot[d][c];
+			if(i != SI5351_GROUP_ANY && out[i].dev == d && out[i].bypass)
+			{
+				fanout |= SI5351_XTAL_ENABLE;
+			}
+		}
+		if(fanout != shadow_fanout[d])
+		{
+			dev.si5351_write(SI5351_FANOUT_ENABLE, fanout);
+			shadow_fanout[d] = fanout;
+		}
+		if(oe != shadow_oe[d])
+		{
+			dev.si5351_write(SI5351_OUTPUT_ENABLE_CTRL, oe);
+			shadow_oe[d] = oe;
+		}
+		shadow_valid[d] = true;
+
+		// Keep the device object in step with what it is running
+		for(p = 0; p < 2; p++)
+		{
+			if(vco[d][p] != 0)
+			{
+				vco_written[d][p] = vco[d][p];
+			}
+		}
+		dev.plla_freq = vco_written[d][SI5351_PLLA];
+		dev.pllb_freq = vco_written[d][SI5351_PLLB];
+		for(c = 0; c < SI5351_CLK_COUNT; c++)
+		{
+			i = slot[d][c];
+			if(i != SI5351_GROUP_ANY && out[i].dev == d && !out[i].bypass)
+			{
+				dev.clk_freq[c] = out[i].freq;
+				dev.pll_assignment[c] = (enum si5351_pll)out[i].pll;
+				dev.clk_first_set[c] = true;
+			}
+			else
+			{
+				dev.clk_freq[c] = 0;
+				dev.clk_first_set[c] = false;
+			}
+		}
+		dev.int_mode_mask = 0;
+		for(c = 0; c < SI5351_CLK_COUNT; c++)
+		{
+			if(img[SI5351_GROUP_IMG(SI5351_CLK0_CTRL + c)] & SI5351_CLK_INTEGER_MODE)
+			{
+				dev.int_mode_mask |= 1 << c;
+			}
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * get_output(uint8_t index, struct Si5351GroupOutput *output)
+ *
+ * index - Index returned by add_output()
+ * output - Receives the request and where plan() put it
+ *
+ * Returns 0 on success, or 1 if index is out of range.
+ */
+uint8_t Si5351Group::get_output(uint8_t index, struct Si5351GroupOutput *output)
+{
+	if(index >= nout)
+	{
+		return 1;
+	}
+
+	*output = out[index];
+	return 0;
+}
+
+/*
+ * integer_count(void)
+ *
+ * Returns the number of planned outputs that run their multisynth in
+ * integer mode.
+ */
+uint8_t Si5351Group::integer_count(void)
+{
+	uint8_t i, n = 0;
+
+	for(i = 0; i < nout; i++)
+	{
+		if(out[i].dev != SI5351_GROUP_ANY && out[i].integer)
+		{
+			n++;
+		}
+	}
+	return n;
+}
+
+/*
+ * drive_strength(uint8_t dev, enum si5351_clock clk, enum si5351_drive drive)
+ *
+ * Sets the drive strength of an output. Use this instead of the method
+ * of the device itself, so that commit() keeps the setting.
+ *
+ * dev - Device index
+ * clk - Clock output
+ *   (use the si5351_clock enum)
+ * drive - Desired drive level
+ *   (use the si5351_drive enum)
+ */
+void Si5351Group::drive_strength(uint8_t dev, enum si5351_clock clk, enum si5351_drive drive)
+{
+	uint8_t *ctrl;
+
+	if(dev >= ndev)
+	{
+		return;
+	}
+
+	ctrl = &shadow[dev][SI5351_GROUP_IMG(SI5351_CLK0_CTRL + (uint8_t)clk)];
+	*ctrl = (*ctrl & ~SI5351_CLK_DRIVE_STRENGTH_MASK) | (uint8_t)drive;
+	devs[dev].si5351_write(SI5351_CLK0_CTRL + (uint8_t)clk, *ctrl);
+}
+
+/*
+ * device(uint8_t index)
+ *
+ * Returns the device object at index, or NULL. Use it for status and
+ * for the features the group does not manage, such as phase offsets.
+ */
+Si5351 *Si5351Group::device(uint8_t index)
+{
+	return index < ndev ? &devs[index] : NULL;
+}
+
+uint8_t Si5351Group::device_count(void)
+{
+	return ndev;
+}
+
+/*********************/
+/* Private functions */
+/*********************/
+
+/*
+ * Greedily collect the unplaced requests that can share an integer VCO
+ * with seed. Returns the number of members (0 if the seed has no PLL to
+ * go on), the VCO frequency and the device all pinned members require.
+ */
+uint8_t Si5351Group::build_cluster(uint8_t seed, uint8_t *members, uint64_t *vco_out, uint8_t *dev_out)
+{
+	uint64_t step = ms_freq[seed] * 2;
+	uint64_t lo, hi, v;
+	uint8_t dev = pin_dev[seed];
+	uint8_t n = 1;
+	uint8_t k, j;
+	bool free_pll = false;
+
+	for(k = 0; k < ndev; k++)
+	{
+		if((dev == SI5351_GROUP_ANY || dev == k) &&
+			(vco[k][SI5351_PLLA] == 0 || vco[k][SI5351_PLLB] == 0))
+		{
+			free_pll = true;
+		}
+	}
+	if(!free_pll)
+	{
+		return 0;
+	}
+
+	si5351_group_limits(ms_freq[seed], &lo, &hi);
+	v = si5351_group_multiple(step, lo, hi);
+	if(v == 0)
+	{
+		return 0;
+	}
+	members[0] = seed;
+
+	for(k = 0; k < nout && n < SI5351_CLK_COUNT; k++)
+	{
+		uint64_t f, g, q, jlo, jhi, jv;
+
+		j = order[k];
+		if(j == seed || out[j].dev != SI5351_GROUP_ANY || out[j].bypass)
+		{
+			continue;
+		}
+		if(pin_dev[j] != SI5351_GROUP_ANY && dev != SI5351_GROUP_ANY && pin_dev[j] != dev)
+		{
+			continue;
+		}
+		if(pin_dev[j] != SI5351_GROUP_ANY && vco[pin_dev[j]][SI5351_PLLA] != 0 &&
+			vco[pin_dev[j]][SI5351_PLLB] != 0)
+		{
+			continue;
+		}
+
+		// Least common multiple of the even dividers, if still in range
+		f = ms_freq[j] * 2;
+		g = si5351_group_gcd(step, f);
+		q = step / g;
+		if(q > SI5351_GROUP_VCO_MAX / f)
+		{
+			continue;
+		}
+		si5351_group_limits(ms_freq[j], &jlo, &jhi);
+		jlo = jlo > lo ? jlo : lo;
+		jhi = jhi < hi ? jhi : hi;
+		jv = si5351_group_multiple(q * f, jlo, jhi);
+		if(jv == 0)
+		{
+			continue;
+		}
+
+		step = q * f;
+		lo = jlo;
+		hi = jhi;
+		v = jv;
+		if(pin_dev[j] != SI5351_GROUP_ANY)
+		{
+			dev = pin_dev[j];
+		}
+		members[n++] = j;
+	}
+
+	// Prefer a VCO frequency the PLL can hit exactly, and among those the
+	// one with the most factors of two, so that MS6 and MS7 can reach the
+	// members through their R dividers
+	for(k = SI5351_OUTPUT_CLK_DIV_128 + 1; k > 0; k--)
+	{
+		uint64_t kv = si5351_group_multiple(step << (k - 1), lo, hi);
+
+		if(kv != 0 && ref_freq / si5351_group_gcd(kv % ref_freq, ref_freq) <= SI5351_PLL_C_MAX)
+		{
+			v = kv;
+			break;
+		}
+	}
+
+	*vco_out = v;
+	*dev_out = dev;
+	return n;
+}
+
+/*
+ * Put request i on PLL p of device d, if there is a suitable output free.
+ * Returns 1 if it was placed.
+ */
+uint8_t Si5351Group::place(uint8_t i, uint8_t d, uint8_t p, uint64_t v)
+{
+	uint8_t integer = si5351_group_fits(ms_freq[i], v) ? 1 : 0;
+	uint8_t c = free_slot(i, d, integer ? (uint32_t)(v / ms_freq[i]) : 0);
+
+	if(c == SI5351_GROUP_ANY)
+	{
+		return 0;
+	}
+
+	slot[d][c] = i;
+	r_shift[i] = c >= SI5351_CLK6 ? ms67_shift(i, (uint32_t)(v / ms_freq[i])) : 0;
+	out[i].dev = d;
+	out[i].clk = c;
+	out[i].pll = p;
+	out[i].integer = integer;
+	return 1;
+}
+
+/*
+ * Extra R divider stages MS6 or MS7 needs to run request i with the even
+ * integer divider div, since those only go up to 254. Returns
+ * SI5351_GROUP_ANY if they can't run it.
+ */
+uint8_t Si5351Group::ms67_shift(uint8_t i, uint32_t div)
+{
+	uint8_t shift = 0;
+
+	if(div == 0 || ms_freq[i] >= SI5351_GROUP_DIVBY4_FREQ)
+	{
+		return SI5351_GROUP_ANY;
+	}
+	while((div >> shift) > SI5351_MULTISYNTH67_A_MAX)
+	{
+		shift++;
+	}
+	if(div % (2UL << shift) != 0 || r_div[i] + shift > SI5351_OUTPUT_CLK_DIV_128)
+	{
+		return SI5351_GROUP_ANY;
+	}
+	return shift;
+}
+
+/*
+ * R divider stages that bring the crystal down to the frequency of
+ * request i, or SI5351_GROUP_ANY if it can't run from the crystal under
+ * the bypass policy
+ */
+uint8_t Si5351Group::bypass_shift(uint8_t i)
+{
+	uint64_t xo = (ndev ? devs[0].xtal_freq[SI5351_PLL_INPUT_XO] : SI5351_XTAL_FREQ) * SI5351_FREQ_MULT;
+	uint8_t shift;
+
+	if(bypass == SI5351_GROUP_BYPASS_OFF ||
+		(bypass == SI5351_GROUP_BYPASS_EXACT && ndev && devs[0].ref_correction[SI5351_PLL_INPUT_XO] != 0))
+	{
+		return SI5351_GROUP_ANY;
+	}
+	for(shift = 0; shift <= SI5351_OUTPUT_CLK_DIV_128; shift++)
+	{
+		if((out[i].freq << shift) == xo)
+		{
+			return shift;
+		}
+	}
+	return SI5351_GROUP_ANY;
+}
+
+/*
+ * Put request i, which runs from the crystal, on any free output, taking
+ * CLK6 and CLK7 first since their multisynths are the least capable.
+ * Returns 1 if it was placed.
+ */
+uint8_t Si5351Group::place_bypass(uint8_t i)
+{
+	uint8_t d, c, k;
+
+	for(d = 0; d < ndev; d++)
+	{
+		if(pin_dev[i] != SI5351_GROUP_ANY && pin_dev[i] != d)
+		{
+			continue;
+		}
+		for(k = 0; k < SI5351_CLK_COUNT; k++)
+		{
+			c = pin_clk[i] != SI5351_GROUP_ANY ? pin_clk[i] : (k + SI5351_CLK6) % SI5351_CLK_COUNT;
+			if(pin_clk[i] != SI5351_GROUP_ANY || slot[d][c] == SI5351_GROUP_ANY)
+			{
+				slot[d][c] = i;
+				r_shift[i] = bypass_shift(i);
+				out[i].dev = d;
+				out[i].clk = c;
+				out[i].pll = SI5351_PLLA;
+				return 1;
+			}
+		}
+	}
+	return 0;
+}
+
+/*
+ * Output on device d that request i can use. div is the even integer
+ * divider it would run with, or 0 for a fractional divider. MS6 and MS7
+ * are kept for integer dividers they can reach, so that MS0-5 stay free
+ * for the fractional ones.
+ */
+uint8_t Si5351Group::free_slot(uint8_t i, uint8_t d, uint32_t div)
+{
+	bool ms67_ok = ms67_shift(i, div) != SI5351_GROUP_ANY;
+	uint8_t c;
+
+	if(pin_dev[i] != SI5351_GROUP_ANY && pin_dev[i] != d)
+	{
+		return SI5351_GROUP_ANY;
+	}
+	if(pin_clk[i] != SI5351_GROUP_ANY)
+	{
+		if(pin_clk[i] >= SI5351_CLK6 && !ms67_ok)
+		{
+			return SI5351_GROUP_ANY;
+		}
+		return pin_clk[i];
+	}
+
+	if(ms67_ok)
+	{
+		for(c = SI5351_CLK6; c < SI5351_CLK_COUNT; c++)
+		{
+			if(slot[d][c] == SI5351_GROUP_ANY)
+			{
+				return c;
+			}
+		}
+	}
+	for(c = SI5351_CLK0; c < SI5351_MS_COUNT; c++)
+	{
+		if(slot[d][c] == SI5351_GROUP_ANY)
+		{
+			return c;
+		}
+	}
+	return SI5351_GROUP_ANY;
+}
+
+/*
+ * Register contents (16-92) and output enable mask that device d should
+ * have under the current plan. Registers of unused outputs are left as
+ * they are, and the outputs are powered down.
+ */
+void Si5351Group::build_image(uint8_t d, uint8_t *img, uint8_t *oe)
+{
+	struct Si5351RegSet reg;
+	uint8_t c, i, p, ctrl, bits, div_by_4;
+	uint64_t v, f;
+
+	memcpy(img, shadow[d], SI5351_GROUP_IMG_LEN);
+	*oe = 0xFF;
+
+	for(p = 0; p < 2; p++)
+	{
+		v = vco[d][p] ? vco[d][p] : vco_written[d][p];
+		si5351_group_ratio(v, ref_freq, &reg);
+		devs[d].pll_pack(reg, &img[SI5351_GROUP_IMG(p == SI5351_PLLA ?
+			SI5351_PLLA_PARAMETERS : SI5351_PLLB_PARAMETERS)]);
+	}
+
+	// All 8 CLK control registers are in the image, and those of outputs
+	// the variant lacks are powered down like any unused one
+	for(c = 0; c < 8; c++)
+	{
+		i = c < SI5351_CLK_COUNT ? slot[d][c] : SI5351_GROUP_ANY;
+		ctrl = (img[c] & (SI5351_CLK_INVERT | SI5351_CLK_DRIVE_STRENGTH_MASK)) |
+			SI5351_CLK_INPUT_MULTISYNTH_N;
+
+		if(i == SI5351_GROUP_ANY || out[i].dev != d)
+		{
+			img[c] = ctrl | SI5351_CLK_POWERDOWN;
+			continue;
+		}
+
+		// Only the R divider, after the source select, is in the path
+		if(out[i].bypass)
+		{
+			if(c <= SI5351_CLK5)
+			{
+				bits = img[SI5351_GROUP_IMG(SI5351_CLK0_PARAMETERS + c * 8 + 2)];
+				img[SI5351_GROUP_IMG(SI5351_CLK0_PARAMETERS + c * 8 + 2)] =
+					(bits & ~SI5351_OUTPUT_CLK_DIV_MASK) | (r_shift[i] << SI5351_OUTPUT_CLK_DIV_SHIFT);
+			}
+			else
+			{
+				bits = img[SI5351_GROUP_IMG(SI5351_CLK6_7_OUTPUT_DIVIDER)];
+				if(c == SI5351_CLK6)
+				{
+					bits = (bits & ~SI5351_OUTPUT_CLK6_DIV_MASK) | (r_shift[i] << SI5351_OUTPUT_CLK_DIV6_SHIFT);
+				}
+				else
+				{
+					bits = (bits & ~SI5351_OUTPUT_CLK_DIV_MASK) | (r_shift[i] << SI5351_OUTPUT_CLK_DIV_SHIFT);
+				}
+				img[SI5351_GROUP_IMG(SI5351_CLK6_7_OUTPUT_DIVIDER)] = bits;
+			}
+			img[c] = (ctrl & ~SI5351_CLK_INPUT_MASK) | SI5351_CLK_INPUT_XTAL;
+			*oe &= ~(1 << c);
+			continue;
+		}
+
+		v = vco[d][out[i].pll];
+		f = ms_freq[i];
+		if(c <= SI5351_CLK5)
+		{
+			div_by_4 = f >= SI5351_GROUP_DIVBY4_FREQ ? 1 : 0;
+			if(div_by_4)
+			{
+				reg.p1 = 0;
+				reg.p2 = 0;
+				reg.p3 = 1;
+			}
+			else
+			{
+				si5351_group_ratio(v, f, &reg);
+			}
+			devs[d].ms_pack(reg, 0, r_div[i], div_by_4, &img[SI5351_GROUP_IMG(SI5351_CLK0_PARAMETERS + c * 8)]);
+			if(out[i].integer)
+			{
+				ctrl |= SI5351_CLK_INTEGER_MODE;
+			}
+		}
+		else
+		{
+			img[SI5351_GROUP_IMG(SI5351_CLK6_PARAMETERS + c - SI5351_CLK6)] = (uint8_t)((v / f) >> r_shift[i]);
+			bits = img[SI5351_GROUP_IMG(SI5351_CLK6_7_OUTPUT_DIVIDER)];
+			if(c == SI5351_CLK6)
+			{
+				bits = (bits & ~SI5351_OUTPUT_CLK6_DIV_MASK) |
+					((r_div[i] + r_shift[i]) << SI5351_OUTPUT_CLK_DIV6_SHIFT);
+			}
+			else
+			{
+				bits = (bits & ~SI5351_OUTPUT_CLK_DIV_MASK) |
+					((r_div[i] + r_shift[i]) << SI5351_OUTPUT_CLK_DIV_SHIFT);
+			}
+			img[SI5351_GROUP_IMG(SI5351_CLK6_7_OUTPUT_DIVIDER)] = bits;
+		}
+
+		if(out[i].pll == SI5351_PLLB)
+		{
+			ctrl |= SI5351_CLK_PLL_SELECT;
+		}
+		img[c] = ctrl;
+		*oe &= ~(1 << c);
+	}
+}
+
+/*
+ * Write the bytes of img that differ from prev, starting at register
+ * reg. Runs of changes separated by up to SI5351_GROUP_MERGE_GAP
+ * unchanged bytes go out as one burst.
+ */
+void Si5351Group::write_diff(uint8_t d, uint8_t reg, uint8_t len, const uint8_t *img, uint8_t *prev)
+{
+	uint8_t i = 0;
+
+	while(i < len)
+	{
+		uint8_t start, end, gap, j;
+
+		if(img[i] == prev[i])
+		{
+			i++;
+			continue;
+		}
+
+		start = i;
+		end = i + 1;
+		gap = 0;
+		for(j = i + 1; j < len && j - start < SI5351_GROUP_BURST_MAX; j++)
+		{
+			if(img[j] != prev[j])
+			{
+				end = j + 1;
+				gap = 0;
+			}
+			else if(++gap > SI5351_GROUP_MERGE_GAP)
+			{
+				break;
+			}
+		}
+
+		memcpy(&prev[start], &img[start], end - start);
+		devs[d].si5351_write_bulk(reg + start, end - start, &prev[start]);
+		i = end;
+	}
+}
@@ -0,0 +1,123 @@
+/*
+ * si5351_group.h - Joint frequency planning for several Si5351 devices
+ *
+ * Copyright (C) 2015 - 2019 Jason Milldrum <milldrum@gmail.com>
+ *                           Dana H. Myers <k6jq@comcast.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SI5351_GROUP_H_
+#define SI5351_GROUP_H_
+
+#include "si5351.h"
+
+#ifndef SI5351_GROUP_MAX_DEV
+#define SI5351_GROUP_MAX_DEV            4
+#endif
+
+#define SI5351_GROUP_MAX_OUT            (SI5351_GROUP_MAX_DEV * SI5351_CLK_COUNT)
+#define SI5351_GROUP_ANY                0xFF
+
+// Register image kept per device: CLK control (16-23) through the
+// CLK6/7 R dividers (92)
+#define SI5351_GROUP_IMG_FIRST          SI5351_CLK0_CTRL
+#define SI5351_GROUP_IMG_LEN            (SI5351_CLK6_7_OUTPUT_DIVIDER - SI5351_CLK0_CTRL + 1)
+
+// Longest register burst. The Wire library buffers 32 bytes, including
+// the register address.
+#define SI5351_GROUP_BURST_MAX          31
+
+// Unchanged bytes that are rewritten rather than starting a new burst
+#define SI5351_GROUP_MERGE_GAP          2
+
+// When plan() may run an output straight from the crystal: never, only
+// when the reference has no correction (so the output is the same as
+// through a PLL), or always (the output then carries the error of the
+// crystal)
+#define SI5351_GROUP_BYPASS_OFF         0
+#define SI5351_GROUP_BYPASS_EXACT       1
+#define SI5351_GROUP_BYPASS_ALWAYS      2
+
+/*
+ * Where the planner put one requested output
+ *
+ * freq - Requested frequency in Hz * 100
+ * dev - Device index, in the order of add_device()
+ * clk - CLK output on that device
+ * pll - PLL driving the output (enum si5351_pll), unless bypass is set
+ * integer - 1 if the multisynth divides its PLL by an even integer
+ * bypass - 1 if the output runs from the crystal through its R divider
+ *   alone, without a PLL or multisynth
+ */
+struct Si5351GroupOutput
+{
+	uint64_t freq;
+	uint8_t dev;
+	uint8_t clk;
+	uint8_t pll;
+	uint8_t integer;
+	uint8_t bypass;
+};
+
+class Si5351Group
+{
+public:
+	Si5351Group(Si5351Bus *bus = NULL);
+	uint8_t add_device(uint8_t);
+	bool init(uint8_t, uint32_t, int32_t);
+	void set_correction(int32_t);
+	void set_bypass(uint8_t);
+	void clear(void);
+	uint8_t add_output(uint64_t, uint8_t = SI5351_GROUP_ANY, uint8_t = SI5351_GROUP_ANY);
+	uint8_t plan(void);
+	uint8_t commit(void);
+	uint8_t get_output(uint8_t, struct Si5351GroupOutput *);
+	uint8_t integer_count(void);
+	void drive_strength(uint8_t, enum si5351_clock, enum si5351_drive);
+	Si5351 *device(uint8_t);
+	uint8_t device_count(void);
+private:
+	uint8_t build_cluster(uint8_t, uint8_t *, uint64_t *, uint8_t *);
+	uint8_t place(uint8_t, uint8_t, uint8_t, uint64_t);
+	uint8_t free_slot(uint8_t, uint8_t, uint32_t);
+	uint8_t ms67_shift(uint8_t, uint32_t);
+	uint8_t bypass_shift(uint8_t);
+	uint8_t place_bypass(uint8_t);
+	void build_image(uint8_t, uint8_t *, uint8_t *);
+	void write_diff(uint8_t, uint8_t, uint8_t, const uint8_t *, uint8_t *);
+	Si5351Bus *bus;
+	Si5351 devs[SI5351_GROUP_MAX_DEV];
+	uint8_t ndev;
+	uint8_t nout;
+	bool planned;
+	uint8_t bypass;
+	uint64_t ref_freq;
+	struct Si5351GroupOutput out[SI5351_GROUP_MAX_OUT];
+	uint8_t pin_dev[SI5351_GROUP_MAX_OUT];
+	uint8_t pin_clk[SI5351_GROUP_MAX_OUT];
+	uint64_t ms_freq[SI5351_GROUP_MAX_OUT];
+	uint8_t r_div[SI5351_GROUP_MAX_OUT];
+	uint8_t r_shift[SI5351_GROUP_MAX_OUT];
+	uint8_t order[SI5351_GROUP_MAX_OUT];
+	uint8_t slot[SI5351_GROUP_MAX_DEV][SI5351_CLK_COUNT];
+	uint64_t vco[SI5351_GROUP_MAX_DEV][2];
+	uint64_t vco_written[SI5351_GROUP_MAX_DEV][2];
+	uint8_t shadow[SI5351_GROUP_MAX_DEV][SI5351_GROUP_IMG_LEN];
+	uint8_t shadow_oe[SI5351_GROUP_MAX_DEV];
+	uint8_t shadow_fanout[SI5351_GROUP_MAX_DEV];
+	bool shadow_valid[SI5351_GROUP_MAX_DEV];
+};
+
+#endif /* SI5351_GROUP_H_ */
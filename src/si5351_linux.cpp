@@ -0,0 +1,144 @@
+/*
+ * si5351_linux.cpp - Linux userspace I2C transport for the Si5351 library
+ *
+ * Copyright (C) 2015 - 2019 Jason Milldrum <milldrum@gmail.com>
+ *                           Dana H. Myers <k6jq@comcast.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#if defined(__linux__) && !defined(ARDUINO)
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+
+#include "si5351_linux.h"
+
+static int si5351_ioctl(int fd, unsigned long req, void *arg)
+{
+	return ioctl(fd, req, arg);
+}
+
+/*
+ * Si5351LinuxBus(const char *dev_path)
+ *
+ * dev_path - I2C adapter device node, such as "/dev/i2c-1"
+ *
+ * Open the adapter. Use is_open() to find out whether that worked.
+ */
+Si5351LinuxBus::Si5351LinuxBus(const char *dev_path):
+	own_fd(true),
+	xfer(si5351_ioctl)
+{
+	fd = open(dev_path, O_RDWR);
+}
+
+/*
+ * Si5351LinuxBus(int fd, si5351_ioctl_fn ioctl_fn)
+ *
+ * fd - Already open adapter (it is not closed by the destructor)
+ * ioctl_fn - Replacement for ioctl(2), or NULL to use the real one
+ */
+Si5351LinuxBus::Si5351LinuxBus(int fd, si5351_ioctl_fn ioctl_fn):
+	fd(fd),
+	own_fd(false),
+	xfer(ioctl_fn ? ioctl_fn : si5351_ioctl)
+{
+}
+
+Si5351LinuxBus::~Si5351LinuxBus()
+{
+	if(own_fd && fd >= 0)
+	{
+		close(fd);
+	}
+}
+
+bool Si5351LinuxBus::is_open(void)
+{
+	return fd >= 0;
+}
+
+uint8_t Si5351LinuxBus::probe(uint8_t dev_addr)
+{
+	uint8_t val;
+
+	// Not every adapter can do zero-length writes, so read the status
+	// register instead
+	return read(dev_addr, SI5351_DEVICE_STATUS, 1, &val);
+}
+
+uint8_t Si5351LinuxBus::write(uint8_t dev_addr, uint8_t reg, uint8_t len, const uint8_t *data)
+{
+	uint8_t buf[257];
+	struct i2c_msg msg;
+	struct i2c_rdwr_ioctl_data xfer_data;
+
+	if(fd < 0)
+	{
+		return 4;
+	}
+
+	buf[0] = reg;
+	memcpy(buf + 1, data, len);
+
+	msg.addr = dev_addr;
+	msg.flags = 0;
+	msg.len = len + 1;
+	msg.buf = buf;
+
+	xfer_data.msgs = &msg;
+	xfer_data.nmsgs = 1;
+
+	return xfer(fd, I2C_RDWR, &xfer_data) < 0 ? 4 : 0;
+}
+
+uint8_t Si5351LinuxBus::read(uint8_t dev_addr, uint8_t reg, uint8_t len, uint8_t *data)
+{
+	struct i2c_msg msgs[2];
+	struct i2c_rdwr_ioctl_data xfer_data;
+
+	if(fd < 0)
+	{
+		return 4;
+	}
+
+	// Register address write and data read joined by a repeated START
+	msgs[0].addr = dev_addr;
+	msgs[0].flags = 0;
+	msgs[0].len = 1;
+	msgs[0].buf = &reg;
+
+	msgs[1].addr = dev_addr;
+	msgs[1].flags = I2C_M_RD;
+	msgs[1].len = len;
+	msgs[1].buf = data;
+
+	xfer_data.msgs = msgs;
+	xfer_data.nmsgs = 2;
+
+	return xfer(fd, I2C_RDWR, &xfer_data) < 0 ? 4 : 0;
+}
+
+uint8_t Si5351LinuxBus::read_transactions(void)
+{
+	return 1;
+}
+
+#endif
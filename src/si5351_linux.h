@@ -0,0 +1,60 @@
+/*
+ * si5351_linux.h - Linux userspace I2C transport for the Si5351 library
+ *
+ * Copyright (C) 2015 - 2019 Jason Milldrum <milldrum@gmail.com>
+ *                           Dana H. Myers <k6jq@comcast.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SI5351_LINUX_H_
+#define SI5351_LINUX_H_
+
+#if defined(__linux__) && !defined(ARDUINO)
+
+#include "si5351.h"
+
+/*
+ * Function with the signature of ioctl(2), used for every transfer. It can
+ * be swapped out to run the transport against a fake device.
+ */
+typedef int (*si5351_ioctl_fn)(int, unsigned long, void *);
+
+/*
+ * Si5351LinuxBus - Transport over a Linux /dev/i2c-N adapter
+ *
+ * Every access is one I2C_RDWR ioctl. A register read is sent as a single
+ * combined message (register address write, repeated START, read), and a
+ * bulk write is a single message.
+ */
+class Si5351LinuxBus : public Si5351Bus
+{
+public:
+	Si5351LinuxBus(const char *dev_path);
+	Si5351LinuxBus(int fd, si5351_ioctl_fn ioctl_fn = NULL);
+	~Si5351LinuxBus();
+	bool is_open(void);
+	uint8_t probe(uint8_t dev_addr);
+	uint8_t write(uint8_t dev_addr, uint8_t reg, uint8_t len, const uint8_t *data);
+	uint8_t read(uint8_t dev_addr, uint8_t reg, uint8_t len, uint8_t *data);
+	uint8_t read_transactions(void);
+private:
+	int fd;
+	bool own_fd;
+	si5351_ioctl_fn xfer;
+};
+
+#endif
+
+#endif /* SI5351_LINUX_H_ */
@@ -0,0 +1,360 @@
+/*
+ * si5351_parallel.cpp - Configure many Si5351 devices concurrently on Linux
+ *
+ * Copyright (C) 2015 - 2019 Jason Milldrum <milldrum@gmail.com>
+ *                           Dana H. Myers <k6jq@comcast.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#if defined(__linux__) && !defined(ARDUINO)
+
+#include <chrono>
+#include <thread>
+
+#include "si5351_parallel.h"
+
+static uint64_t si5351_now_ns(void)
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/*
+ * Holds the bus lock for one transfer and charges the time to the bus
+ */
+class Si5351BusTimer
+{
+public:
+	Si5351BusTimer(std::mutex &lock, uint64_t &busy_ns, uint64_t &wait_ns, uint32_t &transfers):
+		guard(lock, std::defer_lock), busy_ns(busy_ns)
+	{
+		uint64_t t = si5351_now_ns();
+
+		guard.lock();
+		start = si5351_now_ns();
+		wait_ns += start - t;
+		transfers++;
+	}
+	~Si5351BusTimer()
+	{
+		busy_ns += si5351_now_ns() - start;
+	}
+private:
+	std::unique_lock<std::mutex> guard;
+	uint64_t &busy_ns;
+	uint64_t start;
+};
+
+/*
+ * Si5351LockedBus(Si5351Bus *bus)
+ *
+ * bus - Bus to serialize access to
+ */
+Si5351LockedBus::Si5351LockedBus(Si5351Bus *bus):
+	bus(bus)
+{
+	clear_report();
+}
+
+void Si5351LockedBus::begin(void)
+{
+	std::lock_guard<std::mutex> guard(lock);
+
+	bus->begin();
+}
+
+uint8_t Si5351LockedBus::probe(uint8_t dev_addr)
+{
+	Si5351BusTimer timer(lock, busy_ns, wait_ns, transfers);
+
+	return bus->probe(dev_addr);
+}
+
+uint8_t Si5351LockedBus::write(uint8_t dev_addr, uint8_t reg, uint8_t len, const uint8_t *data)
+{
+	Si5351BusTimer timer(lock, busy_ns, wait_ns, transfers);
+
+	return bus->write(dev_addr, reg, len, data);
+}
+
+uint8_t Si5351LockedBus::read(uint8_t dev_addr, uint8_t reg, uint8_t len, uint8_t *data)
+{
+	Si5351BusTimer timer(lock, busy_ns, wait_ns, transfers);
+
+	return bus->read(dev_addr, reg, len, data);
+}
+
+uint8_t Si5351LockedBus::read_transactions(void)
+{
+	return bus->read_transactions();
+}
+
+void Si5351LockedBus::clear_report(void)
+{
+	std::lock_guard<std::mutex> guard(lock);
+
+	transfers = 0;
+	busy_ns = 0;
+	wait_ns = 0;
+}
+
+/*
+ * get_report(struct Si5351BusReport *report, uint64_t wall_ns)
+ *
+ * report - Receives the counters since clear_report()
+ * wall_ns - Length of the period the utilization is relative to
+ */
+void Si5351LockedBus::get_report(struct Si5351BusReport *report, uint64_t wall_ns)
+{
+	std::lock_guard<std::mutex> guard(lock);
+
+	report->transfers = transfers;
+	report->busy_ns = busy_ns;
+	report->wait_ns = wait_ns;
+	report->utilization = wall_ns ? (float)busy_ns / wall_ns : 0;
+}
+
+/*
+ * Si5351ParallelConfig(unsigned int threads)
+ *
+ * threads - Number of worker threads. 0 uses one per CPU.
+ */
+Si5351ParallelConfig::Si5351ParallelConfig(unsigned int threads):
+	threads(threads),
+	next(0),
+	run_ns(0)
+{
+	if(this->threads == 0)
+	{
+		this->threads = std::thread::hardware_concurrency();
+	}
+	if(this->threads == 0)
+	{
+		this->threads = 1;
+	}
+}
+
+Si5351ParallelConfig::~Si5351ParallelConfig()
+{
+	for(size_t i = 0; i < jobs.size(); i++)
+	{
+		delete jobs[i].dev;
+	}
+	for(size_t i = 0; i < buses.size(); i++)
+	{
+		delete buses[i];
+	}
+}
+
+/*
+ * add_bus(Si5351Bus *bus)
+ *
+ * bus - Transport for one I2C adapter. It must stay around for as long as
+ *   this object does.
+ *
+ * Returns the index of the bus.
+ */
+int Si5351ParallelConfig::add_bus(Si5351Bus *bus)
+{
+	buses.push_back(new Si5351LockedBus(bus));
+	return (int)buses.size() - 1;
+}
+
+/*
+ * add_device(int bus, uint8_t i2c_addr, const struct Si5351DeviceConfig *cfg)
+ *
+ * bus - Index returned by add_bus()
+ * i2c_addr - I2C address of the device on that bus
+ * cfg - Settings to apply (copied)
+ *
+ * Returns the index of the device, or -1 if bus is not valid.
+ */
+int Si5351ParallelConfig::add_device(int bus, uint8_t i2c_addr, const struct Si5351DeviceConfig *cfg)
+{
+	struct Job job;
+
+	if(bus < 0 || bus >= (int)buses.size())
+	{
+		return -1;
+	}
+
+	job.bus = bus;
+	job.dev = new Si5351(i2c_addr, buses[bus]);
+	job.cfg = *cfg;
+	job.result = SI5351_PARALLEL_OK;
+	jobs.push_back(job);
+
+	return (int)jobs.size() - 1;
+}
+
+/*
+ * run(void)
+ *
+ * Configure all of the devices and wait for them to finish.
+ *
+ * Returns the number of devices that failed. See result().
+ */
+int Si5351ParallelConfig::run(void)
+{
+	std::vector<std::thread> pool;
+	unsigned int n = threads;
+	uint64_t start;
+	int failed = 0;
+	size_t i, round;
+
+	// Take the devices round-robin across the buses, so that the first
+	// jobs handed out keep all of the buses busy
+	order.clear();
+	for(round = 0; order.size() < jobs.size(); round++)
+	{
+		for(size_t b = 0; b < buses.size(); b++)
+		{
+			size_t seen = 0;
+
+			for(i = 0; i < jobs.size(); i++)
+			{
+				if(jobs[i].bus == (int)b && seen++ == round)
+				{
+					order.push_back(i);
+					break;
+				}
+			}
+		}
+	}
+
+	for(i = 0; i < buses.size(); i++)
+	{
+		buses[i]->clear_report();
+	}
+	next = 0;
+
+	if(n > jobs.size())
+	{
+		n = jobs.size();
+	}
+
+	start = si5351_now_ns();
+	for(i = 1; i < n; i++)
+	{
+		pool.push_back(std::thread(&Si5351ParallelConfig::worker, this));
+	}
+	worker();
+	for(i = 0; i < pool.size(); i++)
+	{
+		pool[i].join();
+	}
+	run_ns = si5351_now_ns() - start;
+
+	for(i = 0; i < jobs.size(); i++)
+	{
+		if(jobs[i].result != SI5351_PARALLEL_OK)
+		{
+			failed++;
+		}
+	}
+
+	return failed;
+}
+
+/*
+ * result(int dev)
+ *
+ * Returns SI5351_PARALLEL_OK if the device was configured by the last
+ * run(), SI5351_PARALLEL_NOT_FOUND if it did not answer, or
+ * SI5351_PARALLEL_FREQ_FAILED if one of its frequencies was rejected.
+ */
+uint8_t Si5351ParallelConfig::result(int dev)
+{
+	return jobs[dev].result;
+}
+
+/*
+ * device(int dev)
+ *
+ * Returns the Si5351 object of a device, for use after run(). Its bus
+ * accesses stay serialized with the other devices on the same bus.
+ */
+Si5351 *Si5351ParallelConfig::device(int dev)
+{
+	return jobs[dev].dev;
+}
+
+int Si5351ParallelConfig::bus_count(void)
+{
+	return (int)buses.size();
+}
+
+/*
+ * get_bus_report(int bus, struct Si5351BusReport *report)
+ *
+ * Fill in how busy a bus was during the last run().
+ */
+void Si5351ParallelConfig::get_bus_report(int bus, struct Si5351BusReport *report)
+{
+	buses[bus]->get_report(report, run_ns);
+}
+
+/*
+ * wall_ns(void)
+ *
+ * Returns the wall-clock time the last run() took, in nanoseconds.
+ */
+uint64_t Si5351ParallelConfig::wall_ns(void)
+{
+	return run_ns;
+}
+
+void Si5351ParallelConfig::worker(void)
+{
+	size_t i;
+
+	while((i = next++) < order.size())
+	{
+		configure(&jobs[order[i]]);
+	}
+}
+
+void Si5351ParallelConfig::configure(struct Job *job)
+{
+	uint8_t clk;
+
+	if(!job->dev->init(job->cfg.xtal_load_c, job->cfg.xo_freq, job->cfg.corr))
+	{
+		job->result = SI5351_PARALLEL_NOT_FOUND;
+		return;
+	}
+
+	job->result = SI5351_PARALLEL_OK;
+	for(clk = 0; clk < SI5351_CLK_COUNT; clk++)
+	{
+		if(job->cfg.freq[clk] == 0)
+		{
+			continue;
+		}
+		job->dev->drive_strength((enum si5351_clock)clk, job->cfg.drive[clk]);
+		if(job->dev->set_freq(job->cfg.freq[clk], (enum si5351_clock)clk) != 0)
+		{
+			job->result = SI5351_PARALLEL_FREQ_FAILED;
+		}
+
+		// set_freq() only turns on CLK0-5 by itself
+		if(clk >= SI5351_CLK6)
+		{
+			job->dev->output_enable((enum si5351_clock)clk, 1);
+		}
+	}
+}
+
+#endif
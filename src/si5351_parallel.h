@@ -0,0 +1,133 @@
+/*
+ * si5351_parallel.h - Configure many Si5351 devices concurrently on Linux
+ *
+ * Copyright (C) 2015 - 2019 Jason Milldrum <milldrum@gmail.com>
+ *                           Dana H. Myers <k6jq@comcast.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SI5351_PARALLEL_H_
+#define SI5351_PARALLEL_H_
+
+#if defined(__linux__) && !defined(ARDUINO)
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+#include "si5351.h"
+
+#define SI5351_PARALLEL_OK              0
+#define SI5351_PARALLEL_NOT_FOUND       1
+#define SI5351_PARALLEL_FREQ_FAILED     2
+
+/*
+ * Settings for one device
+ *
+ * xtal_load_c, xo_freq, corr - Passed to Si5351::init()
+ * freq - Frequency of each CLK output in Hz * 100, or 0 to leave it off
+ * drive - Drive strength of each output that is used
+ */
+struct Si5351DeviceConfig
+{
+	uint8_t xtal_load_c;
+	uint32_t xo_freq;
+	int32_t corr;
+	uint64_t freq[SI5351_CLK_COUNT];
+	enum si5351_drive drive[SI5351_CLK_COUNT];
+};
+
+/*
+ * How busy one bus was during Si5351ParallelConfig::run()
+ *
+ * transfers - Bus operations (probes, reads and writes)
+ * busy_ns - Time spent inside the underlying bus
+ * wait_ns - Time threads spent waiting for the bus to be free
+ * utilization - busy_ns as a fraction of the whole run
+ */
+struct Si5351BusReport
+{
+	uint32_t transfers;
+	uint64_t busy_ns;
+	uint64_t wait_ns;
+	float utilization;
+};
+
+/*
+ * Si5351LockedBus - Serializes access to another bus between threads
+ *
+ * Each transfer holds a lock on the underlying bus for as long as it
+ * takes, and is timed for the utilization report.
+ */
+class Si5351LockedBus : public Si5351Bus
+{
+public:
+	Si5351LockedBus(Si5351Bus *bus);
+	void begin(void);
+	uint8_t probe(uint8_t dev_addr);
+	uint8_t write(uint8_t dev_addr, uint8_t reg, uint8_t len, const uint8_t *data);
+	uint8_t read(uint8_t dev_addr, uint8_t reg, uint8_t len, uint8_t *data);
+	uint8_t read_transactions(void);
+	void clear_report(void);
+	void get_report(struct Si5351BusReport *, uint64_t);
+private:
+	Si5351Bus *bus;
+	std::mutex lock;
+	uint32_t transfers;
+	uint64_t busy_ns;
+	uint64_t wait_ns;
+};
+
+/*
+ * Si5351ParallelConfig - Bring up devices on several buses at once
+ *
+ * Each device is set up by a worker thread of its own, so the frequency
+ * calculations for different devices run in parallel. Transfers are
+ * serialized per bus, while transfers on different buses overlap.
+ */
+class Si5351ParallelConfig
+{
+public:
+	Si5351ParallelConfig(unsigned int threads = 0);
+	~Si5351ParallelConfig();
+	int add_bus(Si5351Bus *);
+	int add_device(int, uint8_t, const struct Si5351DeviceConfig *);
+	int run(void);
+	uint8_t result(int);
+	Si5351 *device(int);
+	int bus_count(void);
+	void get_bus_report(int, struct Si5351BusReport *);
+	uint64_t wall_ns(void);
+private:
+	struct Job
+	{
+		int bus;
+		Si5351 *dev;
+		struct Si5351DeviceConfig cfg;
+		uint8_t result;
+	};
+	void worker(void);
+	void configure(struct Job *);
+	unsigned int threads;
+	std::vector<Si5351LockedBus *> buses;
+	std::vector<struct Job> jobs;
+	std::vector<size_t> order;
+	std::atomic<size_t> next;
+	uint64_t run_ns;
+};
+
+#endif
+
+#endif /* SI5351_PARALLEL_H_ */
@@ -0,0 +1,343 @@
+/*
+ * si5351_phase.cpp - Phase-related outputs for the Si5351 library
+ *
+ * Copyright (C) 2015 - 2019 Jason Milldrum <milldrum@gmail.com>
+ *                           Dana H. Myers <k6jq@comcast.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "si5351_phase.h"
+
+// VCO frequency the divider choice aims for when nothing else decides,
+// leaving the most room to retune either way
+#define SI5351_PHASE_VCO_MID            ((SI5351_PLL_VCO_MIN + SI5351_PLL_VCO_MAX) / 2)
+
+/*
+ * Si5351PhasePlan(Si5351 *dev, enum si5351_pll pll)
+ *
+ * dev - Device with the outputs. It must already be initialized.
+ * pll - PLL that the outputs of the plan run from
+ */
+Si5351PhasePlan::Si5351PhasePlan(Si5351 *dev, enum si5351_pll pll):
+	dev(dev),
+	pll(pll),
+	nout(0),
+	ref(0),
+	band_lo(0),
+	band_hi(0),
+	div(0),
+	err(0)
+{
+	memset(&stats, 0, sizeof(stats));
+}
+
+/*
+ * clear(void)
+ *
+ * Remove all outputs and the band. The next set_freq() sets everything up
+ * again.
+ */
+void Si5351PhasePlan::clear(void)
+{
+	nout = 0;
+	ref = 0;
+	band_lo = 0;
+	band_hi = 0;
+	div = 0;
+	err = 0;
+}
+
+/*
+ * add_output(enum si5351_clock clk, uint16_t degrees)
+ *
+ * Add an output to the plan. Only the differences between the phases
+ * matter. The new output takes effect with the next set_freq().
+ *
+ * clk - Clock output, CLK0 through CLK5
+ *   (use the si5351_clock enum)
+ * degrees - Phase of the output, 0 to 359
+ *
+ * Returns 0 on success, or 1 if the output can't be used or the plan is
+ * full.
+ */
+uint8_t Si5351PhasePlan::add_output(enum si5351_clock clk, uint16_t degrees)
+{
+	uint16_t worst, best = 0xFFFF;
+	uint8_t i, r, best_ref = 0;
+
+	if((uint8_t)clk >= SI5351_MS_COUNT || nout == SI5351_PHASE_MAX_OUT || degrees >= 360)
+	{
+		return 1;
+	}
+	for(i = 0; i < nout; i++)
+	{
+		if(this->clk[i] == clk)
+		{
+			return 1;
+		}
+	}
+
+	this->clk[nout] = clk;
+	this->degrees[nout] = degrees;
+	nout++;
+
+	// Measure from the output that keeps the largest offset smallest
+	for(r = 0; r < nout; r++)
+	{
+		ref = r;
+		worst = 0;
+		for(i = 0; i < nout; i++)
+		{
+			if(offset(i) > worst)
+			{
+				worst = offset(i);
+			}
+		}
+		if(worst < best)
+		{
+			best = worst;
+			best_ref = r;
+		}
+	}
+	ref = best_ref;
+	div = 0;
+
+	return 0;
+}
+
+/*
+ * set_band(uint64_t lo, uint64_t hi)
+ *
+ * Say which frequencies the plan will be tuned over, so that when a new
+ * divider is needed, one is picked that reaches all of them without
+ * another PLL reset if there is one.
+ *
+ * lo - Lowest frequency in Hz * 100
+ * hi - Highest frequency in Hz * 100
+ */
+void Si5351PhasePlan::set_band(uint64_t lo, uint64_t hi)
+{
+	band_lo = lo;
+	band_hi = hi;
+}
+
+/*
+ * set_freq(uint64_t freq)
+ *
+ * Tune all outputs of the plan to freq with their phases. If the divider
+ * in use reaches freq, only the PLL is rewritten. Otherwise a new divider
+ * is picked, every output is programmed as an even integer divider of the
+ * PLL with its phase offset, and the PLL is reset once to line them up.
+ *
+ * freq - Output frequency in Hz * 100
+ *
+ * Returns 0 on success, or 1 if there are no outputs or no divider can
+ * give the phases at this frequency (the device is then left alone). A 90
+ * degree offset, for example, takes the divider itself as its offset, so
+ * quadrature works from about 4.8 MHz up to 150 MHz.
+ */
+uint8_t Si5351PhasePlan::set_freq(uint64_t freq)
+{
+	struct Si5351RegSet ms_reg;
+	uint16_t words[SI5351_PHASE_MAX_OUT];
+	uint16_t new_div, new_err;
+	uint64_t vco;
+	uint8_t i;
+
+	if(nout == 0)
+	{
+		return 1;
+	}
+
+	vco = freq * div;
+	if(div && vco >= SI5351_PLL_VCO_MIN * SI5351_FREQ_MULT && vco <= SI5351_PLL_VCO_MAX * SI5351_FREQ_MULT)
+	{
+		dev->set_pll(vco, pll);
+		for(i = 0; i < nout; i++)
+		{
+			dev->clk_freq[(uint8_t)clk[i]] = freq;
+		}
+		stats.retunes++;
+		stats.pll_only++;
+		return 0;
+	}
+
+	new_div = choose(freq, &new_err);
+	if(new_div == 0)
+	{
+		return 1;
+	}
+	for(i = 0; i < nout; i++)
+	{
+		words[i] = (offset(i) * new_div + 45) / 90;
+	}
+	div = new_div;
+	err = new_err;
+	vco = freq * div;
+
+	// Even integer divider: P1 = 128 * div - 512, P2 = 0, P3 = 1
+	ms_reg.p1 = 128UL * div - 512;
+	ms_reg.p2 = 0;
+	ms_reg.p3 = 1;
+
+	dev->set_pll(vco, pll);
+	for(i = 0; i < nout; i++)
+	{
+		dev->set_ms(clk[i], ms_reg, 1, SI5351_OUTPUT_CLK_DIV_1, 0);
+		dev->set_ms_source(clk[i], pll);
+		dev->set_clock_invert(clk[i], inverted(i) ? 1 : 0);
+		dev->set_phase(clk[i], (uint8_t)words[i]);
+		dev->clk_freq[(uint8_t)clk[i]] = freq;
+		if(!dev->clk_first_set[(uint8_t)clk[i]])
+		{
+			dev->output_enable(clk[i], 1);
+			dev->clk_first_set[(uint8_t)clk[i]] = true;
+		}
+	}
+	dev->pll_reset(pll);
+
+	stats.retunes++;
+	stats.replans++;
+	return 0;
+}
+
+/*
+ * get_divider(void)
+ *
+ * Returns the multisynth divider in use, or 0 before the first set_freq().
+ */
+uint16_t Si5351PhasePlan::get_divider(void)
+{
+	return div;
+}
+
+/*
+ * phase_error(void)
+ *
+ * Returns the largest difference between a requested phase and the one
+ * the offset registers give, in hundredths of a degree. It is 0 whenever
+ * the phases are whole multiples of 90 / divider degrees.
+ */
+uint16_t Si5351PhasePlan::phase_error(void)
+{
+	return err;
+}
+
+/*
+ * get_stats(struct Si5351PhaseStats *stats)
+ *
+ * stats - Where to copy the counters
+ */
+void Si5351PhasePlan::get_stats(struct Si5351PhaseStats *stats)
+{
+	*stats = this->stats;
+}
+
+/*
+ * reset_stats(void)
+ *
+ * Zero the counters.
+ */
+void Si5351PhasePlan::reset_stats(void)
+{
+	memset(&stats, 0, sizeof(stats));
+}
+
+/******************************/
+/* Private methods            */
+/******************************/
+
+// Phase of an output measured from the reference output, 0 to 179
+// degrees; see inverted() for the other half of the circle
+uint16_t Si5351PhasePlan::offset(uint8_t i)
+{
+	uint16_t off = (degrees[i] + 360 - degrees[ref]) % 360;
+
+	return off >= 180 ? off - 180 : off;
+}
+
+// Whether an output is inverted to reach 180 degrees or more
+bool Si5351PhasePlan::inverted(uint8_t i)
+{
+	return (degrees[i] + 360 - degrees[ref]) % 360 >= 180;
+}
+
+// Best even integer divider for freq, or 0 if none fits the phases. The
+// smallest phase error wins, then covering the band, then a VCO nearest
+// the middle of its range.
+uint16_t Si5351PhasePlan::choose(uint64_t freq, uint16_t *best_err)
+{
+	uint64_t vco, dist, best_dist = 0;
+	uint32_t word, got, want, e, worst;
+	uint16_t d, off, best = 0;
+	bool covers, best_covers = false;
+	uint8_t i;
+
+	*best_err = 0xFFFF;
+	for(d = SI5351_MULTISYNTH_A_MIN; d <= SI5351_MULTISYNTH_A_MAX; d += 2)
+	{
+		vco = freq * d;
+		if(vco < SI5351_PLL_VCO_MIN * SI5351_FREQ_MULT)
+		{
+			continue;
+		}
+		if(vco > SI5351_PLL_VCO_MAX * SI5351_FREQ_MULT)
+		{
+			break;
+		}
+
+		worst = 0;
+		for(i = 0; i < nout; i++)
+		{
+			off = offset(i);
+			word = ((uint32_t)off * d + 45) / 90;
+			if(word > SI5351_PHASE_WORD_MAX)
+			{
+				break;
+			}
+			got = (word * 9000 + d / 2) / d;
+			want = (uint32_t)off * 100;
+			e = got > want ? got - want : want - got;
+			if(e > worst)
+			{
+				worst = e;
+			}
+		}
+		if(i < nout)
+		{
+			continue;
+		}
+
+		covers = band_hi && band_lo * d >= SI5351_PLL_VCO_MIN * SI5351_FREQ_MULT &&
+			band_hi * d <= SI5351_PLL_VCO_MAX * SI5351_FREQ_MULT;
+		dist = vco > SI5351_PHASE_VCO_MID * SI5351_FREQ_MULT ?
+			vco - SI5351_PHASE_VCO_MID * SI5351_FREQ_MULT :
+			SI5351_PHASE_VCO_MID * SI5351_FREQ_MULT - vco;
+
+		if(best == 0 || worst < *best_err ||
+			(worst == *best_err && covers && !best_covers) ||
+			(worst == *best_err && covers == best_covers && dist < best_dist))
+		{
+			best = d;
+			*best_err = (uint16_t)worst;
+			best_covers = covers;
+			best_dist = dist;
+		}
+	}
+
+	return best;
+}
@@ -0,0 +1,90 @@
+/*
+ * si5351_phase.h - Phase-related outputs for the Si5351 library
+ *
+ * Copyright (C) 2015 - 2019 Jason Milldrum <milldrum@gmail.com>
+ *                           Dana H. Myers <k6jq@comcast.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SI5351_PHASE_H_
+#define SI5351_PHASE_H_
+
+#include "si5351.h"
+
+// Outputs in one phase plan. Only CLK0-CLK5 have phase offset registers.
+#define SI5351_PHASE_MAX_OUT            6
+
+// Largest value of the 7-bit phase offset registers
+#define SI5351_PHASE_WORD_MAX           127
+
+/*
+ * Counters of Si5351PhasePlan since the last reset_stats()
+ *
+ * retunes - Successful set_freq() calls
+ * pll_only - Retunes that only rewrote the PLL, keeping the divider
+ * replans - Retunes that needed a new divider, and so a PLL reset
+ */
+struct Si5351PhaseStats
+{
+	uint32_t retunes;
+	uint32_t pll_only;
+	uint32_t replans;
+};
+
+/*
+ * Si5351PhasePlan - Outputs on one PLL at a common frequency and set phases
+ *
+ * Each output is given a phase in degrees. set_freq() picks an even
+ * integer divider, and with it a PLL frequency, for which all of the
+ * phases fit in the 7-bit offset registers, and programs all of the
+ * outputs with a single PLL reset. An output whose phase is 180 degrees
+ * or more from the reference is inverted, so only the rest has to come
+ * from the offset register. As long as the next frequency can be reached
+ * with the same divider, a retune only rewrites the PLL: the offsets count
+ * VCO periods, so the phases in degrees stay where they are and no reset
+ * is needed. set_band() lets the divider be picked to cover a whole band.
+ *
+ * The plan owns its PLL; other outputs must not use it.
+ */
+class Si5351PhasePlan
+{
+public:
+	Si5351PhasePlan(Si5351 *dev, enum si5351_pll pll = SI5351_PLLA);
+	void clear(void);
+	uint8_t add_output(enum si5351_clock, uint16_t);
+	void set_band(uint64_t, uint64_t);
+	uint8_t set_freq(uint64_t);
+	uint16_t get_divider(void);
+	uint16_t phase_error(void);
+	void get_stats(struct Si5351PhaseStats *);
+	void reset_stats(void);
+private:
+	uint16_t choose(uint64_t, uint16_t *);
+	uint16_t offset(uint8_t);
+	bool inverted(uint8_t);
+	Si5351 *dev;
+	enum si5351_pll pll;
+	uint8_t nout;
+	uint8_t ref;
+	enum si5351_clock clk[SI5351_PHASE_MAX_OUT];
+	uint16_t degrees[SI5351_PHASE_MAX_OUT];
+	uint64_t band_lo;
+	uint64_t band_hi;
+	uint16_t div;
+	uint16_t err;
+	struct Si5351PhaseStats stats;
+};
+
+#endif /* SI5351_PHASE_H_ */
@@ -0,0 +1,280 @@
+/*
+ * si5351_power.cpp - Power management for the Si5351 library
+ *
+ * Copyright (C) 2015 - 2019 Jason Milldrum <milldrum@gmail.com>
+ *                           Dana H. Myers <k6jq@comcast.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "si5351_power.h"
+
+// Fanout enables that apply() and sleep() manage
+#define SI5351_POWER_FANOUTS            (SI5351_CLKIN_ENABLE | SI5351_XTAL_ENABLE | SI5351_MULTISYNTH_ENABLE)
+
+/*
+ * Si5351Power(Si5351 *dev)
+ *
+ * dev - Device to manage. It must already be initialized.
+ */
+Si5351Power::Si5351Power(Si5351 *dev):
+	dev(dev),
+	asleep(false),
+	saved_oe(0xFF),
+	saved_fanout(0)
+{
+	memset(load, 0, sizeof(load));
+	memset(saved_ctrl, SI5351_CLK_POWERDOWN, sizeof(saved_ctrl));
+}
+
+/*
+ * set_load(enum si5351_clock clk, uint8_t pf)
+ *
+ * Give the capacitance an output drives, so that apply() can pick its
+ * drive strength. The weakest drive is used whose 20-80% edges, taken as
+ * 0.6 * C * VDDO / I, last no more than SI5351_POWER_EDGE_PCT percent of
+ * the period at the frequency the output is set to. If not even 8 mA
+ * manages that, 8 mA is used. Outputs without a load keep the drive
+ * strength they have.
+ *
+ * clk - Clock output
+ *   (use the si5351_clock enum)
+ * pf - Load in pF, including the trace, or 0 to leave the drive alone
+ */
+void Si5351Power::set_load(enum si5351_clock clk, uint8_t pf)
+{
+	load[(uint8_t)clk] = pf;
+}
+
+/*
+ * apply(void)
+ *
+ * Read back the output enables, the CLK control registers and the fanout
+ * enables, and power down whatever the enabled outputs don't need. An
+ * enabled output that was powered down is powered up. Does nothing while
+ * asleep.
+ *
+ * Returns the number of register bytes written.
+ */
+uint8_t Si5351Power::apply(void)
+{
+	uint8_t ctrl[SI5351_CLK_COUNT], old_ctrl[SI5351_CLK_COUNT];
+	uint8_t oe, fanout, used, keep, need = 0;
+	uint8_t c, src;
+
+	if(asleep)
+	{
+		return 0;
+	}
+
+	read_state(old_ctrl, &oe, &fanout);
+	used = (uint8_t)~oe & (uint8_t)((1 << SI5351_CLK_COUNT) - 1);
+	keep = used;
+
+	for(c = 0; c < SI5351_CLK_COUNT; c++)
+	{
+		if(!(used & (1 << c)))
+		{
+			continue;
+		}
+		src = old_ctrl[c] & SI5351_CLK_INPUT_MASK;
+		if(src == SI5351_CLK_INPUT_XTAL)
+		{
+			need |= SI5351_XTAL_ENABLE;
+		}
+		else if(src == SI5351_CLK_INPUT_CLKIN)
+		{
+			need |= SI5351_CLKIN_ENABLE;
+		}
+		else if(src == SI5351_CLK_INPUT_MULTISYNTH_0_4 && c != 0 && c != 4)
+		{
+			// MS0 feeds CLK1-CLK3 and MS4 feeds CLK5-CLK7
+			need |= SI5351_MULTISYNTH_ENABLE;
+			keep |= c < 4 ? (1 << 0) : (1 << 4);
+		}
+	}
+
+	for(c = 0; c < SI5351_CLK_COUNT; c++)
+	{
+		ctrl[c] = old_ctrl[c];
+		if(!(keep & (1 << c)))
+		{
+			ctrl[c] |= SI5351_CLK_POWERDOWN;
+			continue;
+		}
+		ctrl[c] &= ~SI5351_CLK_POWERDOWN;
+		if((used & (1 << c)) && load[c] && dev->clk_freq[c])
+		{
+			ctrl[c] &= ~SI5351_CLK_DRIVE_STRENGTH_MASK;
+			ctrl[c] |= (uint8_t)drive_for(load[c], dev->clk_freq[c]);
+		}
+	}
+
+	return write_state(ctrl, old_ctrl, oe, oe, (fanout & ~SI5351_POWER_FANOUTS) | need, fanout);
+}
+
+/*
+ * sleep(void)
+ *
+ * Disable and power down every output and switch off the fanouts,
+ * remembering how they were. The PLLs keep running. Does nothing if
+ * already asleep.
+ *
+ * Returns the number of register bytes written.
+ */
+uint8_t Si5351Power::sleep(void)
+{
+	uint8_t ctrl[SI5351_CLK_COUNT];
+	uint8_t c;
+
+	if(asleep)
+	{
+		return 0;
+	}
+
+	read_state(saved_ctrl, &saved_oe, &saved_fanout);
+	for(c = 0; c < SI5351_CLK_COUNT; c++)
+	{
+		ctrl[c] = saved_ctrl[c] | SI5351_CLK_POWERDOWN;
+	}
+	asleep = true;
+
+	return write_state(ctrl, saved_ctrl, 0xFF, saved_oe,
+		saved_fanout & ~SI5351_POWER_FANOUTS, saved_fanout);
+}
+
+/*
+ * resume(void)
+ *
+ * Put the outputs and fanouts back the way they were before sleep(),
+ * enabling the outputs last. Nothing is read from the device, and only
+ * the registers sleep() changed are written. Does nothing if not asleep.
+ *
+ * Returns the number of register bytes written.
+ */
+uint8_t Si5351Power::resume(void)
+{
+	uint8_t ctrl[SI5351_CLK_COUNT], slept[SI5351_CLK_COUNT];
+	uint8_t c;
+
+	if(!asleep)
+	{
+		return 0;
+	}
+
+	for(c = 0; c < SI5351_CLK_COUNT; c++)
+	{
+		ctrl[c] = saved_ctrl[c];
+		slept[c] = saved_ctrl[c] | SI5351_CLK_POWERDOWN;
+	}
+	asleep = false;
+
+	return write_state(ctrl, slept, saved_oe, 0xFF,
+		saved_fanout, saved_fanout & ~SI5351_POWER_FANOUTS);
+}
+
+/*
+ * sleeping(void)
+ *
+ * Returns true between sleep() and resume().
+ */
+bool Si5351Power::sleeping(void)
+{
+	return asleep;
+}
+
+/******************************/
+/* Private methods            */
+/******************************/
+
+// Weakest drive strength whose edges into pf are short enough at freq
+// (in Hz * 100)
+enum si5351_drive Si5351Power::drive_for(uint8_t pf, uint64_t freq)
+{
+	uint64_t need_ua;
+	uint8_t d;
+
+	// I = 0.6 * C * V / (pct / 100 / f), in uA with C in pF and V in mV
+	need_ua = (uint64_t)pf * SI5351_POWER_VDDO_MV * (freq / SI5351_FREQ_MULT) * 6 /
+		(SI5351_POWER_EDGE_PCT * 100000000ULL);
+
+	for(d = 0; d < (uint8_t)SI5351_DRIVE_8MA; d++)
+	{
+		if(need_ua <= (d + 1) * SI5351_POWER_DRIVE_STEP_UA)
+		{
+			break;
+		}
+	}
+
+	return (enum si5351_drive)d;
+}
+
+// Read the CLK control registers, the output enables and the fanout
+// enables
+void Si5351Power::read_state(uint8_t *ctrl, uint8_t *oe, uint8_t *fanout)
+{
+	uint8_t c;
+
+	*oe = dev->si5351_read(SI5351_OUTPUT_ENABLE_CTRL);
+	for(c = 0; c < SI5351_CLK_COUNT; c++)
+	{
+		ctrl[c] = dev->si5351_read(SI5351_CLK0_CTRL + c);
+	}
+	*fanout = dev->si5351_read(SI5351_FANOUT_ENABLE);
+}
+
+// Write the registers that differ from what the device holds. Outputs
+// are disabled before anything else and enabled after everything else,
+// and the CLK control registers that change go out in one burst. Returns
+// the number of bytes written.
+uint8_t Si5351Power::write_state(uint8_t *ctrl, const uint8_t *old_ctrl, uint8_t oe, uint8_t old_oe,
+	uint8_t fanout, uint8_t old_fanout)
+{
+	uint8_t first, last, bytes = 0;
+
+	if((old_oe | oe) != old_oe)
+	{
+		old_oe |= oe;
+		dev->si5351_write(SI5351_OUTPUT_ENABLE_CTRL, old_oe);
+		bytes++;
+	}
+
+	for(first = 0; first < SI5351_CLK_COUNT && ctrl[first] == old_ctrl[first]; first++)
+	{
+	}
+	if(first < SI5351_CLK_COUNT)
+	{
+		for(last = SI5351_CLK_COUNT - 1; ctrl[last] == old_ctrl[last]; last--)
+		{
+		}
+		dev->si5351_write_bulk(SI5351_CLK0_CTRL + first, last - first + 1, &ctrl[first]);
+		bytes += last - first + 1;
+	}
+
+	if(fanout != old_fanout)
+	{
+		dev->si5351_write(SI5351_FANOUT_ENABLE, fanout);
+		bytes++;
+	}
+
+	if(oe != old_oe)
+	{
+		dev->si5351_write(SI5351_OUTPUT_ENABLE_CTRL, oe);
+		bytes++;
+	}
+
+	return bytes;
+}
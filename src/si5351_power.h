@@ -0,0 +1,78 @@
+/*
+ * si5351_power.h - Power management for the Si5351 library
+ *
+ * Copyright (C) 2015 - 2019 Jason Milldrum <milldrum@gmail.com>
+ *                           Dana H. Myers <k6jq@comcast.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SI5351_POWER_H_
+#define SI5351_POWER_H_
+
+#include "si5351.h"
+
+// Output supply voltage (VDDO) the drive strength is picked for, in mV
+#ifndef SI5351_POWER_VDDO_MV
+#define SI5351_POWER_VDDO_MV            3300
+#endif
+
+// Longest 20-80% edge allowed on a loaded output, in percent of its period
+#ifndef SI5351_POWER_EDGE_PCT
+#define SI5351_POWER_EDGE_PCT           10
+#endif
+
+// Current of the weakest drive strength in uA; the others are multiples
+#define SI5351_POWER_DRIVE_STEP_UA      2000UL
+
+/*
+ * Si5351Power - Keep only what the enabled outputs need powered up
+ *
+ * apply() reads back how the outputs are set up and powers down the
+ * driver of every output that is disabled, unless an enabled output takes
+ * its multisynth through the MS0/MS4 fanout. The fanouts of the crystal,
+ * CLKIN and MS0/MS4 are switched on only while an enabled output uses
+ * them. Outputs given a load with set_load() get the weakest drive that
+ * still makes clean edges into it. Only the bytes that change are
+ * written, with the CLK control registers in a single burst.
+ *
+ * sleep() disables and powers down every output and fanout, and resume()
+ * puts back what they were. The PLLs have no power down bit, so they keep
+ * running, and come back locked.
+ *
+ * Call apply() again after setting up or enabling outputs. Don't change
+ * the device between sleep() and resume().
+ */
+class Si5351Power
+{
+public:
+	Si5351Power(Si5351 *dev);
+	void set_load(enum si5351_clock, uint8_t);
+	uint8_t apply(void);
+	uint8_t sleep(void);
+	uint8_t resume(void);
+	bool sleeping(void);
+private:
+	enum si5351_drive drive_for(uint8_t, uint64_t);
+	void read_state(uint8_t *, uint8_t *, uint8_t *);
+	uint8_t write_state(uint8_t *, const uint8_t *, uint8_t, uint8_t, uint8_t, uint8_t);
+	Si5351 *dev;
+	uint8_t load[SI5351_CLK_COUNT];
+	bool asleep;
+	uint8_t saved_ctrl[SI5351_CLK_COUNT];
+	uint8_t saved_oe;
+	uint8_t saved_fanout;
+};
+
+#endif /* SI5351_POWER_H_ */
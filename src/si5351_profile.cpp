@@ -0,0 +1,535 @@
+/*
+ * si5351_profile.cpp - Precompiled configurations for the Si5351 library
+ *
+ * Copyright (C) 2015 - 2019 Jason Milldrum <milldrum@gmail.com>
+ *                           Dana H. Myers <k6jq@comcast.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "si5351_profile.h"
+
+// Longest register burst. The Wire library buffers 32 bytes, including
+// the register address.
+#define SI5351_PROFILE_BURST_MAX        31
+
+// Unchanged bytes that are rewritten rather than starting a new burst
+#define SI5351_PROFILE_MERGE_GAP        2
+
+/*
+ * Register blocks of the image in the order a switch writes them: the PLL
+ * reference and fanout, then the PLLs, then the multisynths, spread
+ * spectrum, VCXO and phase offsets, and the CLK control registers last,
+ * so that an output is only powered up or moved to another PLL once
+ * everything behind it is set. The output enables are handled on their
+ * own around all of this.
+ */
+static const struct
+{
+	uint8_t first;
+	uint8_t last;
+} si5351_profile_blocks[] = {
+	{SI5351_PLL_INPUT_SOURCE, SI5351_PLL_INPUT_SOURCE},
+	{SI5351_FANOUT_ENABLE, SI5351_FANOUT_ENABLE},
+	{SI5351_PLLA_PARAMETERS, SI5351_PLLB_PARAMETERS + SI5351_PARAMETERS_LENGTH - 1},
+	{SI5351_CLK0_PARAMETERS, SI5351_CLK6_7_OUTPUT_DIVIDER},
+	{SI5351_SSC_PARAM0, SI5351_CLK5_PHASE_OFFSET},
+	{SI5351_CLK0_CTRL, SI5351_CLK7_4_DISABLE_STATE},
+};
+
+#define SI5351_PROFILE_BLOCKS           (sizeof(si5351_profile_blocks) / sizeof(si5351_profile_blocks[0]))
+
+// Offset of a register in the image, or SI5351_PROFILE_NONE
+static uint8_t si5351_profile_off(uint8_t reg)
+{
+	if(reg == SI5351_OUTPUT_ENABLE_CTRL)
+	{
+		return 0;
+	}
+	if(reg >= SI5351_PLL_INPUT_SOURCE && reg <= SI5351_CLK6_7_OUTPUT_DIVIDER)
+	{
+		return 1 + reg - SI5351_PLL_INPUT_SOURCE;
+	}
+	if(reg >= SI5351_SSC_PARAM0 && reg <= SI5351_CLK5_PHASE_OFFSET)
+	{
+		return 79 + reg - SI5351_SSC_PARAM0;
+	}
+	if(reg == SI5351_FANOUT_ENABLE)
+	{
+		return 101;
+	}
+	return SI5351_PROFILE_NONE;
+}
+
+/*
+ * Bus a scratch Si5351 object runs against while a profile is compiled.
+ * Writes land in the image, and reads come back from it.
+ */
+class Si5351ProfileImageBus : public Si5351Bus
+{
+public:
+	Si5351ProfileImageBus(uint8_t *img) : img(img) {}
+	uint8_t probe(uint8_t)
+	{
+		return 0;
+	}
+	uint8_t write(uint8_t, uint8_t reg, uint8_t len, const uint8_t *data)
+	{
+		uint8_t i, off;
+
+		for(i = 0; i < len; i++)
+		{
+			off = si5351_profile_off(reg + i);
+			if(off != SI5351_PROFILE_NONE)
+			{
+				img[off] = data[i];
+			}
+		}
+		return 0;
+	}
+	uint8_t read(uint8_t, uint8_t reg, uint8_t len, uint8_t *data)
+	{
+		uint8_t i, off;
+
+		for(i = 0; i < len; i++)
+		{
+			off = si5351_profile_off(reg + i);
+			data[i] = (off != SI5351_PROFILE_NONE) ? img[off] : 0;
+		}
+		return 0;
+	}
+private:
+	uint8_t *img;
+};
+
+/*
+ * Si5351Profiles(Si5351 *dev)
+ *
+ * dev - Device to configure. It must already be initialized.
+ */
+Si5351Profiles::Si5351Profiles(Si5351 *dev):
+	dev(dev),
+	count(0),
+	cur(SI5351_PROFILE_NONE),
+	use_count(0)
+{
+	memset(profiles, 0, sizeof(profiles));
+	memset(cache, 0, sizeof(cache));
+	memset(&stats, 0, sizeof(stats));
+	for(uint8_t i = 0; i < SI5351_PROFILE_CACHE; i++)
+	{
+		cache[i].from = SI5351_PROFILE_NONE;
+	}
+}
+
+/*
+ * add(struct Si5351Profile *profile, const char *name, void (*build)(Si5351 &))
+ *
+ * Compile a profile.
+ *
+ * profile - Storage for the profile
+ * name - Name for find()
+ * build - Function that sets up the Si5351 it is given the way the profile
+ *   should be, using the usual methods. It starts from the state that
+ *   reset() leaves, and the object it gets is not the real device, so it
+ *   must not keep a pointer to it.
+ *
+ * Returns the index of the new profile, or SI5351_PROFILE_NONE if there
+ * is no room for it.
+ */
+uint8_t Si5351Profiles::add(struct Si5351Profile *profile, const char *name, void (*build)(Si5351 &))
+{
+	if(count == SI5351_PROFILE_MAX)
+	{
+		return SI5351_PROFILE_NONE;
+	}
+
+	profile->name = name;
+	profile->build = build;
+	compile(profile);
+	profiles[count] = profile;
+
+	return count++;
+}
+
+/*
+ * find(const char *name)
+ *
+ * Returns the index of the profile called name, or SI5351_PROFILE_NONE.
+ * Look the indices up once and keep them if you switch often.
+ */
+uint8_t Si5351Profiles::find(const char *name)
+{
+	uint8_t i;
+
+	for(i = 0; i < count; i++)
+	{
+		if(strcmp(profiles[i]->name, name) == 0)
+		{
+			return i;
+		}
+	}
+	return SI5351_PROFILE_NONE;
+}
+
+/*
+ * select(uint8_t index)
+ *
+ * Switch the device to a profile. Outputs that the new profile turns off
+ * are disabled first, then the registers that differ are written in the
+ * order of PLL reference, PLLs, multisynths and CLK control, the PLLs
+ * whose settings changed are reset, and the outputs of the new profile
+ * are enabled last. The first switch, and the first one after
+ * invalidate(), writes all of the profile.
+ *
+ * Afterwards the Si5351 object is in step with the new profile, so its
+ * methods can be used as usual until the next switch.
+ *
+ * index - Profile index returned by add()
+ *
+ * Returns 0 on success, or 1 if there is no such profile.
+ */
+uint8_t Si5351Profiles::select(uint8_t index)
+{
+	struct Si5351Profile *to;
+	struct Diff full;
+	uint8_t i;
+
+	if(index >= count)
+	{
+		return 1;
+	}
+	if(index == cur)
+	{
+		return 0;
+	}
+
+	to = profiles[index];
+	stats.switches++;
+	if(cur == SI5351_PROFILE_NONE)
+	{
+		make_full(&full);
+		send(&full, to, 0xFF);
+		stats.full_writes++;
+	}
+	else
+	{
+		send(lookup(cur, index), to, profiles[cur]->img[0]);
+	}
+	cur = index;
+
+	// Bring the device object in step with the profile
+	for(i = 0; i < SI5351_CLK_COUNT; i++)
+	{
+		dev->clk_freq[i] = to->clk_freq[i];
+		dev->pll_assignment[i] = (to->pllb_mask & (1 << i)) ? SI5351_PLLB : SI5351_PLLA;
+		dev->clk_first_set[i] = (to->first_set_mask & (1 << i)) ? true : false;
+	}
+	dev->plla_freq = to->plla_freq;
+	dev->pllb_freq = to->pllb_freq;
+	dev->int_mode_mask = to->int_mode_mask;
+	dev->ssc_mode = to->ssc_mode;
+	dev->ssc_spread = to->ssc_spread;
+	dev->ssc_rate = to->ssc_rate;
+
+	return 0;
+}
+
+/*
+ * current(void)
+ *
+ * Returns the index of the profile selected last, or SI5351_PROFILE_NONE.
+ */
+uint8_t Si5351Profiles::current(void)
+{
+	return cur;
+}
+
+/*
+ * invalidate(void)
+ *
+ * Forget which profile the device is in, so that the next select() writes
+ * all of the profile. Call it after changing the device other than
+ * through select(), for example with set_freq().
+ */
+void Si5351Profiles::invalidate(void)
+{
+	cur = SI5351_PROFILE_NONE;
+}
+
+/*
+ * recompile(void)
+ *
+ * Compile all profiles again, for instance after set_correction() or
+ * set_ref_freq() on the device, and drop the cached transfer lists. The
+ * next select() writes all of the profile.
+ */
+void Si5351Profiles::recompile(void)
+{
+	uint8_t i;
+
+	for(i = 0; i < count; i++)
+	{
+		compile(profiles[i]);
+	}
+	for(i = 0; i < SI5351_PROFILE_CACHE; i++)
+	{
+		cache[i].from = SI5351_PROFILE_NONE;
+	}
+	cur = SI5351_PROFILE_NONE;
+}
+
+/*
+ * get_stats(struct Si5351ProfileStats *out)
+ *
+ * out - Receives the counters since the last reset_stats()
+ */
+void Si5351Profiles::get_stats(struct Si5351ProfileStats *out)
+{
+	*out = stats;
+}
+
+/*
+ * reset_stats(void)
+ *
+ * Zero the counters.
+ */
+void Si5351Profiles::reset_stats(void)
+{
+	memset(&stats, 0, sizeof(stats));
+}
+
+// Run the build function of a profile on a scratch device that writes
+// into the image, with the same references and corrections as the real one
+void Si5351Profiles::compile(struct Si5351Profile *profile)
+{
+	Si5351ProfileImageBus bus(profile->img);
+	Si5351 scratch(dev->i2c_bus_addr, &bus);
+	uint8_t i;
+
+	scratch.xtal_freq[0] = dev->xtal_freq[0];
+	scratch.xtal_freq[1] = dev->xtal_freq[1];
+	scratch.ref_correction[0] = dev->ref_correction[0];
+	scratch.ref_correction[1] = dev->ref_correction[1];
+	scratch.clkin_div = dev->clkin_div;
+	scratch.plla_ref_osc = dev->plla_ref_osc;
+	scratch.pllb_ref_osc = dev->pllb_ref_osc;
+
+	// Power-on contents, apart from the two registers that init() and the
+	// application may have set up and that reset() leaves alone
+	memset(profile->img, 0, SI5351_PROFILE_IMG_LEN);
+	profile->img[0] = 0xFF;
+
+	// All 8 CLK control registers are in the image whatever the variant
+	for(i = 0; i < 8; i++)
+	{
+		profile->img[si5351_profile_off(SI5351_CLK0_CTRL + i)] = SI5351_CLK_POWERDOWN;
+	}
+	profile->img[si5351_profile_off(SI5351_PLL_INPUT_SOURCE)] = dev->si5351_read(SI5351_PLL_INPUT_SOURCE);
+	profile->img[si5351_profile_off(SI5351_FANOUT_ENABLE)] = dev->si5351_read(SI5351_FANOUT_ENABLE);
+
+	scratch.reset();
+	profile->build(scratch);
+
+	profile->pllb_mask = 0;
+	profile->first_set_mask = 0;
+	for(i = 0; i < SI5351_CLK_COUNT; i++)
+	{
+		profile->clk_freq[i] = scratch.clk_freq[i];
+		if(scratch.pll_assignment[i] == SI5351_PLLB)
+		{
+			profile->pllb_mask |= 1 << i;
+		}
+		if(scratch.clk_first_set[i])
+		{
+			profile->first_set_mask |= 1 << i;
+		}
+	}
+	profile->plla_freq = scratch.plla_freq;
+	profile->pllb_freq = scratch.pllb_freq;
+	profile->int_mode_mask = scratch.int_mode_mask;
+	profile->ssc_mode = scratch.ssc_mode;
+	profile->ssc_spread = scratch.ssc_spread;
+	profile->ssc_rate = scratch.ssc_rate;
+}
+
+// Transfer list from one profile to another, from the cache if it is
+// there, or else worked out into the least recently used slot
+struct Si5351Profiles::Diff *Si5351Profiles::lookup(uint8_t from, uint8_t to)
+{
+	struct Diff *d;
+	uint8_t i;
+
+	for(i = 0; i < SI5351_PROFILE_CACHE; i++)
+	{
+		if(cache[i].from == from && cache[i].to == to)
+		{
+			cache[i].used = ++use_count;
+			stats.cache_hits++;
+			return &cache[i];
+		}
+	}
+
+	d = &cache[0];
+	for(i = 0; i < SI5351_PROFILE_CACHE; i++)
+	{
+		if(cache[i].from == SI5351_PROFILE_NONE)
+		{
+			d = &cache[i];
+			break;
+		}
+		if((uint16_t)(use_count - cache[i].used) > (uint16_t)(use_count - d->used))
+		{
+			d = &cache[i];
+		}
+	}
+
+	make_diff(d, profiles[from]->img, profiles[to]->img);
+	d->from = from;
+	d->to = to;
+	d->used = ++use_count;
+	stats.cache_misses++;
+
+	return d;
+}
+
+// Transfers for the bytes where b differs from a. Runs of changes with up
+// to SI5351_PROFILE_MERGE_GAP unchanged bytes between them share a burst.
+void Si5351Profiles::make_diff(struct Diff *d, const uint8_t *a, const uint8_t *b)
+{
+	uint8_t k, i, j, start, end, gap, last, off;
+
+	d->count = 0;
+	d->pll_rst = 0;
+	if(memcmp(&a[si5351_profile_off(SI5351_PLLA_PARAMETERS)], &b[si5351_profile_off(SI5351_PLLA_PARAMETERS)],
+		SI5351_PARAMETERS_LENGTH) != 0)
+	{
+		d->pll_rst |= SI5351_PLL_RESET_A;
+	}
+	if(memcmp(&a[si5351_profile_off(SI5351_PLLB_PARAMETERS)], &b[si5351_profile_off(SI5351_PLLB_PARAMETERS)],
+		SI5351_PARAMETERS_LENGTH) != 0)
+	{
+		d->pll_rst |= SI5351_PLL_RESET_B;
+	}
+	off = si5351_profile_off(SI5351_PLL_INPUT_SOURCE);
+	if(a[off] != b[off])
+	{
+		d->pll_rst = SI5351_PLL_RESET_A | SI5351_PLL_RESET_B;
+	}
+
+	for(k = 0; k < SI5351_PROFILE_BLOCKS; k++)
+	{
+		off = si5351_profile_off(si5351_profile_blocks[k].first);
+		last = si5351_profile_blocks[k].last - si5351_profile_blocks[k].first;
+		i = 0;
+		while(i <= last)
+		{
+			if(a[off + i] == b[off + i])
+			{
+				i++;
+				continue;
+			}
+
+			start = i;
+			end = i + 1;
+			gap = 0;
+			for(j = i + 1; j <= last && j - start < SI5351_PROFILE_BURST_MAX; j++)
+			{
+				if(a[off + j] != b[off + j])
+				{
+					end = j + 1;
+					gap = 0;
+				}
+				else if(++gap > SI5351_PROFILE_MERGE_GAP)
+				{
+					break;
+				}
+			}
+
+			// Too scattered to list: write the blocks whole instead
+			if(d->count == SI5351_PROFILE_MAX_XFER)
+			{
+				make_full(d);
+				return;
+			}
+			d->xfer[d->count].reg = si5351_profile_blocks[k].first + start;
+			d->xfer[d->count].len = end - start;
+			d->count++;
+			i = end;
+		}
+	}
+}
+
+// Transfers that write every register of the image
+void Si5351Profiles::make_full(struct Diff *d)
+{
+	uint8_t k, reg, len;
+
+	d->count = 0;
+	d->pll_rst = SI5351_PLL_RESET_A | SI5351_PLL_RESET_B;
+	for(k = 0; k < SI5351_PROFILE_BLOCKS; k++)
+	{
+		for(reg = si5351_profile_blocks[k].first; reg <= si5351_profile_blocks[k].last; reg += len)
+		{
+			len = si5351_profile_blocks[k].last - reg + 1;
+			if(len > SI5351_PROFILE_BURST_MAX)
+			{
+				len = SI5351_PROFILE_BURST_MAX;
+			}
+			d->xfer[d->count].reg = reg;
+			d->xfer[d->count].len = len;
+			d->count++;
+		}
+	}
+}
+
+// Carry out a transfer list towards profile to, with the output enables
+// of the device currently at oe
+void Si5351Profiles::send(const struct Diff *d, const struct Si5351Profile *to, uint8_t oe)
+{
+	uint8_t pre, i;
+
+	// Outputs that go off in the new profile go off first
+	pre = oe | to->img[0];
+	if(pre != oe || cur == SI5351_PROFILE_NONE)
+	{
+		dev->si5351_write(SI5351_OUTPUT_ENABLE_CTRL, pre);
+		stats.transfers++;
+		stats.bytes++;
+	}
+
+	for(i = 0; i < d->count; i++)
+	{
+		dev->si5351_write_bulk(d->xfer[i].reg, d->xfer[i].len,
+			(uint8_t *)&to->img[si5351_profile_off(d->xfer[i].reg)]);
+		stats.transfers++;
+		stats.bytes += d->xfer[i].len;
+	}
+
+	if(d->pll_rst)
+	{
+		dev->si5351_write(SI5351_PLL_RESET, d->pll_rst);
+		stats.transfers++;
+		stats.bytes++;
+	}
+
+	if(to->img[0] != pre)
+	{
+		dev->si5351_write(SI5351_OUTPUT_ENABLE_CTRL, to->img[0]);
+		stats.transfers++;
+		stats.bytes++;
+	}
+}
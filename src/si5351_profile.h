@@ -0,0 +1,142 @@
+/*
+ * si5351_profile.h - Precompiled configurations for the Si5351 library
+ *
+ * Copyright (C) 2015 - 2019 Jason Milldrum <milldrum@gmail.com>
+ *                           Dana H. Myers <k6jq@comcast.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SI5351_PROFILE_H_
+#define SI5351_PROFILE_H_
+
+#include "si5351.h"
+
+// Number of profiles one Si5351Profiles can hold
+#ifndef SI5351_PROFILE_MAX
+#define SI5351_PROFILE_MAX              8
+#endif
+
+// Number of profile pairs whose transfer lists are kept
+#ifndef SI5351_PROFILE_CACHE
+#define SI5351_PROFILE_CACHE            4
+#endif
+
+// Transfers in a cached list. A switch that would need more writes the
+// changed register blocks whole instead, which never takes more than 7.
+#ifndef SI5351_PROFILE_MAX_XFER
+#define SI5351_PROFILE_MAX_XFER         16
+#endif
+
+// Registers kept in a profile: 3, 15-92, 149-170 and 187
+#define SI5351_PROFILE_IMG_LEN          102
+
+#define SI5351_PROFILE_NONE             0xFF
+
+/*
+ * One compiled configuration
+ *
+ * Declare one for each profile and pass it to Si5351Profiles::add(),
+ * which fills it in. It must stay around as long as the Si5351Profiles
+ * object uses it.
+ */
+struct Si5351Profile
+{
+	const char *name;
+	void (*build)(Si5351 &);
+	uint8_t img[SI5351_PROFILE_IMG_LEN];
+	uint64_t clk_freq[SI5351_CLK_COUNT];
+	uint64_t plla_freq;
+	uint64_t pllb_freq;
+	uint8_t pllb_mask;
+	uint8_t first_set_mask;
+	uint8_t int_mode_mask;
+	enum si5351_ssc_mode ssc_mode;
+	uint16_t ssc_spread;
+	uint32_t ssc_rate;
+};
+
+/*
+ * Counters of Si5351Profiles
+ *
+ * switches - Calls of select() that changed the profile
+ * cache_hits - Switches that found their transfer list in the cache
+ * cache_misses - Switches that had to work out their transfer list
+ * full_writes - Switches from an unknown state, which write everything
+ * transfers - Register writes made by switches
+ * bytes - Register bytes written by switches
+ */
+struct Si5351ProfileStats
+{
+	uint32_t switches;
+	uint32_t cache_hits;
+	uint32_t cache_misses;
+	uint32_t full_writes;
+	uint32_t transfers;
+	uint32_t bytes;
+};
+
+/*
+ * Si5351Profiles - Named device configurations, switched with register diffs
+ *
+ * Each profile is described by a function that sets up the device with
+ * the usual Si5351 methods, starting from the state reset() leaves it in.
+ * add() runs it once against a register image instead of the chip. After
+ * that, select() changes the device from one profile to another by writing
+ * only the registers that differ between the two images. The list of
+ * transfers for a pair of profiles is kept in a small cache, so switching
+ * back and forth between the same profiles is nothing but bus writes.
+ */
+class Si5351Profiles
+{
+public:
+	Si5351Profiles(Si5351 *dev);
+	uint8_t add(struct Si5351Profile *, const char *, void (*)(Si5351 &));
+	uint8_t find(const char *);
+	uint8_t select(uint8_t);
+	uint8_t current(void);
+	void invalidate(void);
+	void recompile(void);
+	void get_stats(struct Si5351ProfileStats *);
+	void reset_stats(void);
+private:
+	struct Xfer
+	{
+		uint8_t reg;
+		uint8_t len;
+	};
+	struct Diff
+	{
+		uint8_t from;
+		uint8_t to;
+		uint8_t count;
+		uint8_t pll_rst;
+		uint16_t used;
+		struct Xfer xfer[SI5351_PROFILE_MAX_XFER];
+	};
+	void compile(struct Si5351Profile *);
+	struct Diff *lookup(uint8_t, uint8_t);
+	void make_diff(struct Diff *, const uint8_t *, const uint8_t *);
+	void make_full(struct Diff *);
+	void send(const struct Diff *, const struct Si5351Profile *, uint8_t);
+	Si5351 *dev;
+	struct Si5351Profile *profiles[SI5351_PROFILE_MAX];
+	uint8_t count;
+	uint8_t cur;
+	uint16_t use_count;
+	struct Diff cache[SI5351_PROFILE_CACHE];
+	struct Si5351ProfileStats stats;
+};
+
+#endif /* SI5351_PROFILE_H_ */
@@ -0,0 +1,245 @@
+/*
+ * si5351_queue.cpp - Interrupt-safe command queue for the Si5351 library
+ *
+ * Copyright (C) 2015 - 2019 Jason Milldrum <milldrum@gmail.com>
+ *                           Dana H. Myers <k6jq@comcast.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "si5351_queue.h"
+
+#define SI5351_QUEUE_MASK               (SI5351_QUEUE_DEPTH - 1)
+
+/*
+ * Si5351Queue(Si5351 *dev)
+ *
+ * dev - Device that poll() carries the commands out on. It must already
+ *   be initialized.
+ */
+Si5351Queue::Si5351Queue(Si5351 *dev):
+	dev(dev),
+	clock(si5351_micros),
+	head(0),
+	tail(0),
+	overflows(0),
+	overflow_base(0)
+{
+	memset(&stats, 0, sizeof(stats));
+}
+
+/*
+ * set_freq(uint64_t freq, enum si5351_clock clk)
+ *
+ * Queue a call to Si5351::set_freq(). Safe to call from an interrupt.
+ *
+ * freq - Output frequency in Hz * 100
+ * clk - Clock output
+ *
+ * Returns false if the queue was full and the command was dropped.
+ */
+bool Si5351Queue::set_freq(uint64_t freq, enum si5351_clock clk)
+{
+	return push(SI5351_CMD_FREQ, clk, 0, freq);
+}
+
+/*
+ * output_enable(enum si5351_clock clk, uint8_t enable)
+ *
+ * Queue a call to Si5351::output_enable(). Safe to call from an interrupt.
+ *
+ * clk - Clock output
+ * enable - 1 to enable, 0 to disable
+ *
+ * Returns false if the queue was full and the command was dropped.
+ */
+bool Si5351Queue::output_enable(enum si5351_clock clk, uint8_t enable)
+{
+	return push(SI5351_CMD_ENABLE, clk, enable, 0);
+}
+
+/*
+ * set_phase(enum si5351_clock clk, uint8_t phase)
+ *
+ * Queue a call to Si5351::set_phase(). Safe to call from an interrupt.
+ * poll() resets the PLL of the output afterwards, so that the new phase
+ * takes effect.
+ *
+ * clk - Clock output
+ * phase - 7-bit phase word (in units of VCO/4 period)
+ *
+ * Returns false if the queue was full and the command was dropped.
+ */
+bool Si5351Queue::set_phase(enum si5351_clock clk, uint8_t phase)
+{
+	return push(SI5351_CMD_PHASE, clk, phase & 0x7f, 0);
+}
+
+/*
+ * poll(void)
+ *
+ * Carry out the commands that were waiting when the call started, in the
+ * order they were queued. Commands queued while it runs are left for the
+ * next call, so the time it takes is bounded. If any phases changed, each
+ * PLL involved is reset once at the end. Call it from the main loop only.
+ *
+ * Returns the number of commands carried out.
+ */
+uint8_t Si5351Queue::poll(void)
+{
+	uint8_t t = tail;
+	uint8_t h = __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+	uint8_t n = h - t;
+	uint8_t reset = 0;
+	struct Si5351Command c;
+	uint32_t latency;
+
+	if(n > stats.max_depth)
+	{
+		stats.max_depth = n;
+	}
+
+	while(t != h)
+	{
+		// Copy the command out and hand its slot back before touching the
+		// bus, so that the producer has the most room while we are busy
+		c = cmds[t & SI5351_QUEUE_MASK];
+		t++;
+		__atomic_store_n(&tail, t, __ATOMIC_RELEASE);
+
+		switch(c.type)
+		{
+		case SI5351_CMD_FREQ:
+			if(dev->set_freq(c.freq, (enum si5351_clock)c.clk) != 0)
+			{
+				stats.rejected++;
+			}
+			break;
+		case SI5351_CMD_ENABLE:
+			dev->output_enable((enum si5351_clock)c.clk, c.arg);
+			break;
+		case SI5351_CMD_PHASE:
+			if(c.clk < SI5351_MS_COUNT)
+			{
+				dev->set_phase((enum si5351_clock)c.clk, c.arg);
+				reset |= dev->pll_assignment[c.clk] == SI5351_PLLB ? 2 : 1;
+			}
+			break;
+		}
+
+		latency = clock() - c.stamp;
+		stats.latency_last = latency;
+		stats.latency_sum += latency;
+		if(latency > stats.latency_max)
+		{
+			stats.latency_max = latency;
+		}
+		stats.applied++;
+	}
+
+	if(reset & 1)
+	{
+		dev->pll_reset(SI5351_PLLA);
+	}
+	if(reset & 2)
+	{
+		dev->pll_reset(SI5351_PLLB);
+	}
+
+	return n;
+}
+
+/*
+ * depth(void)
+ *
+ * Returns the number of commands waiting.
+ */
+uint8_t Si5351Queue::depth(void)
+{
+	return __atomic_load_n(&head, __ATOMIC_ACQUIRE) - __atomic_load_n(&tail, __ATOMIC_ACQUIRE);
+}
+
+/*
+ * set_clock(uint32_t (*clock)(void))
+ *
+ * clock - Function returning the current time, or NULL to go back to the
+ *   default of micros()
+ *
+ * Set the time source used to measure latency. It is called from the
+ * producer as well, so it must be safe to call from an interrupt.
+ */
+void Si5351Queue::set_clock(uint32_t (*clock)(void))
+{
+	this->clock = clock ? clock : si5351_micros;
+}
+
+/*
+ * get_stats(struct Si5351QueueStats *out)
+ *
+ * out - Receives the counters since the last reset_stats(). Call it from
+ *   the same context as poll().
+ */
+void Si5351Queue::get_stats(struct Si5351QueueStats *out)
+{
+	uint32_t o;
+
+	// The producer may bump the counter between the bytes of a read on an
+	// 8-bit CPU, so read it until two reads agree
+	do
+	{
+		o = __atomic_load_n(&overflows, __ATOMIC_RELAXED);
+	} while(o != __atomic_load_n(&overflows, __ATOMIC_RELAXED));
+
+	*out = stats;
+	out->depth = depth();
+	out->overflows = o - overflow_base;
+}
+
+/*
+ * reset_stats(void)
+ *
+ * Zero the counters. Call it from the same context as poll().
+ */
+void Si5351Queue::reset_stats(void)
+{
+	struct Si5351QueueStats s;
+
+	get_stats(&s);
+	overflow_base += s.overflows;
+	memset(&stats, 0, sizeof(stats));
+}
+
+bool Si5351Queue::push(uint8_t type, enum si5351_clock clk, uint8_t arg, uint64_t freq)
+{
+	uint8_t h = head;
+	struct Si5351Command *c;
+
+	if((uint8_t)(h - __atomic_load_n(&tail, __ATOMIC_ACQUIRE)) >= SI5351_QUEUE_DEPTH)
+	{
+		__atomic_fetch_add(&overflows, 1, __ATOMIC_RELAXED);
+		return false;
+	}
+
+	c = &cmds[h & SI5351_QUEUE_MASK];
+	c->freq = freq;
+	c->stamp = clock();
+	c->type = type;
+	c->clk = (uint8_t)clk;
+	c->arg = arg;
+	__atomic_store_n(&head, (uint8_t)(h + 1), __ATOMIC_RELEASE);
+
+	return true;
+}
@@ -0,0 +1,115 @@
+/*
+ * si5351_queue.h - Interrupt-safe command queue for the Si5351 library
+ *
+ * Copyright (C) 2015 - 2019 Jason Milldrum <milldrum@gmail.com>
+ *                           Dana H. Myers <k6jq@comcast.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SI5351_QUEUE_H_
+#define SI5351_QUEUE_H_
+
+#include "si5351.h"
+
+// Number of commands the queue holds. Must be a power of two, no larger
+// than 128. Each command takes sizeof(struct Si5351Command) bytes of RAM,
+// which is 15 on AVR and 24 on ARM, where uint64_t is 8-byte aligned.
+#ifndef SI5351_QUEUE_DEPTH
+#define SI5351_QUEUE_DEPTH              16
+#endif
+
+#if (SI5351_QUEUE_DEPTH & (SI5351_QUEUE_DEPTH - 1)) || SI5351_QUEUE_DEPTH > 128
+#error "SI5351_QUEUE_DEPTH must be a power of two no larger than 128"
+#endif
+
+enum si5351_cmd {SI5351_CMD_FREQ, SI5351_CMD_ENABLE, SI5351_CMD_PHASE};
+
+/*
+ * One queued operation
+ *
+ * freq - New frequency in Hz * 100, for SI5351_CMD_FREQ
+ * stamp - Clock value when it was queued
+ * type - What to do, from enum si5351_cmd
+ * clk - Output it applies to
+ * arg - Enable flag or phase register value
+ */
+struct Si5351Command
+{
+	uint64_t freq;
+	uint32_t stamp;
+	uint8_t type;
+	uint8_t clk;
+	uint8_t arg;
+};
+
+/*
+ * Queue counters since the last reset_stats()
+ *
+ * depth - Commands waiting right now
+ * max_depth - Most commands that were ever waiting at the start of a poll()
+ * overflows - Commands dropped because the queue was full
+ * applied - Commands carried out by poll()
+ * rejected - Frequency commands that set_freq() refused
+ * latency_last, latency_max - Clock ticks from queueing a command to
+ *   carrying it out, for the latest one and the worst one
+ * latency_sum - Total of the latencies, to divide by applied for the mean
+ */
+struct Si5351QueueStats
+{
+	uint8_t depth;
+	uint8_t max_depth;
+	uint32_t overflows;
+	uint32_t applied;
+	uint32_t rejected;
+	uint32_t latency_last;
+	uint32_t latency_max;
+	uint32_t latency_sum;
+};
+
+/*
+ * Si5351Queue - Put commands for a Si5351 in from interrupt handlers
+ *
+ * The library talks to the chip over I2C and cannot be used from an
+ * interrupt. Instead, an interrupt handler calls set_freq(),
+ * output_enable() or set_phase() here, which only copies the command into
+ * a ring buffer and never blocks. The main loop then calls poll(), which
+ * carries out everything that is waiting. One context may queue commands
+ * and one other context may poll, without any locking.
+ */
+class Si5351Queue
+{
+public:
+	Si5351Queue(Si5351 *dev);
+	bool set_freq(uint64_t, enum si5351_clock);
+	bool output_enable(enum si5351_clock, uint8_t);
+	bool set_phase(enum si5351_clock, uint8_t);
+	uint8_t poll(void);
+	uint8_t depth(void);
+	void set_clock(uint32_t (*)(void));
+	void get_stats(struct Si5351QueueStats *);
+	void reset_stats(void);
+private:
+	bool push(uint8_t, enum si5351_clock, uint8_t, uint64_t);
+	Si5351 *dev;
+	uint32_t (*clock)(void);
+	struct Si5351Command cmds[SI5351_QUEUE_DEPTH];
+	uint8_t head;
+	uint8_t tail;
+	uint32_t overflows;
+	uint32_t overflow_base;
+	struct Si5351QueueStats stats;
+};
+
+#endif /* SI5351_QUEUE_H_ */
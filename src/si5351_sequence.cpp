@@ -0,0 +1,410 @@
+/*
+ * si5351_sequence.cpp - Timed register sequences for the Si5351 library
+ *
+ * Copyright (C) 2015 - 2019 Jason Milldrum <milldrum@gmail.com>
+ *                           Dana H. Myers <k6jq@comcast.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "si5351_sequence.h"
+
+/*
+ * Si5351Sequence(Si5351 *dev)
+ *
+ * dev - Device the sequence is written to. It must already be initialized.
+ */
+Si5351Sequence::Si5351Sequence(Si5351 *dev):
+	dev(dev),
+	clock(si5351_micros),
+	step_count(0),
+	xfer_count(0),
+	data_len(0),
+	error(0),
+	shadow_count(0),
+	plla_freq(0),
+	pllb_freq(0),
+	pllb_mask(0),
+	first_set_mask(0),
+	int_mode_mask(0),
+	next(0),
+	t0(0)
+{
+	memset(clk_freq, 0, sizeof(clk_freq));
+	memset(timing, 0, sizeof(timing));
+}
+
+/*
+ * compile(void (*script)(Si5351 &, Si5351Sequence &))
+ *
+ * Work out the register writes of a script, replacing the sequence held
+ * before.
+ *
+ * script - Function that calls at() with the time of each step, in
+ *   microseconds from start() and never going backwards, and after each
+ *   at() the Si5351 methods that make up the step. Calls made before the
+ *   first at() belong to time 0. The Si5351 it gets is a copy of the
+ *   device that starts out in the state the device is in now; it must not
+ *   keep a pointer to it, and it can't wait on the device (a status read
+ *   returns the status at compile time).
+ *
+ * The registers a step reads are read from the device once here, so the
+ * sequence itself only writes.
+ *
+ * Returns 0 on success, 1 if the script needs more steps or register
+ * writes than the sequence has room for, or 2 if its times go backwards.
+ * On failure the sequence is empty.
+ */
+uint8_t Si5351Sequence::compile(void (*script)(Si5351 &, Si5351Sequence &))
+{
+	Recorder rec(this);
+	Si5351 scratch(dev->i2c_bus_addr, &rec);
+	uint8_t i;
+
+	step_count = 0;
+	xfer_count = 0;
+	data_len = 0;
+	error = 0;
+	shadow_count = 0;
+
+	// While compiling, t0 is the time given to the last at()
+	t0 = 0;
+
+	scratch.xtal_freq[0] = dev->xtal_freq[0];
+	scratch.xtal_freq[1] = dev->xtal_freq[1];
+	scratch.ref_correction[0] = dev->ref_correction[0];
+	scratch.ref_correction[1] = dev->ref_correction[1];
+	scratch.clkin_div = dev->clkin_div;
+	scratch.plla_ref_osc = dev->plla_ref_osc;
+	scratch.pllb_ref_osc = dev->pllb_ref_osc;
+	for(i = 0; i < SI5351_CLK_COUNT; i++)
+	{
+		scratch.clk_freq[i] = dev->clk_freq[i];
+		scratch.pll_assignment[i] = dev->pll_assignment[i];
+		scratch.clk_first_set[i] = dev->clk_first_set[i];
+	}
+	scratch.plla_freq = dev->plla_freq;
+	scratch.pllb_freq = dev->pllb_freq;
+	scratch.int_mode_mask = dev->int_mode_mask;
+
+	script(scratch, *this);
+
+	// State to hand to the device object once the sequence has run
+	pllb_mask = 0;
+	first_set_mask = 0;
+	for(i = 0; i < SI5351_CLK_COUNT; i++)
+	{
+		clk_freq[i] = scratch.clk_freq[i];
+		if(scratch.pll_assignment[i] == SI5351_PLLB)
+		{
+			pllb_mask |= 1 << i;
+		}
+		if(scratch.clk_first_set[i])
+		{
+			first_set_mask |= 1 << i;
+		}
+	}
+	plla_freq = scratch.plla_freq;
+	pllb_freq = scratch.pllb_freq;
+	int_mode_mask = scratch.int_mode_mask;
+
+	if(error)
+	{
+		step_count = 0;
+	}
+	next = step_count;
+
+	return error;
+}
+
+/*
+ * at(uint32_t us)
+ *
+ * Only for use inside a script: the calls that follow are due us
+ * microseconds after start().
+ *
+ * us - Time of the step
+ */
+void Si5351Sequence::at(uint32_t us)
+{
+	if(us < t0)
+	{
+		error = 2;
+		return;
+	}
+	t0 = us;
+}
+
+/*
+ * start(void)
+ *
+ * Start running the sequence. Steps due at time 0 are written by the
+ * next tick().
+ */
+void Si5351Sequence::start(void)
+{
+	memset(timing, 0, sizeof(timing));
+	next = 0;
+	t0 = clock();
+}
+
+/*
+ * tick(void)
+ *
+ * Write every step whose time has come. Call it as often as possible
+ * while the sequence runs, from the main loop or from a timer callback
+ * that is allowed to use the bus; how often it is called sets how late
+ * the steps can be. After the last step the Si5351 object is brought in
+ * step with what the sequence did, so its methods can be used as usual.
+ *
+ * Returns the number of steps still to come.
+ */
+uint8_t Si5351Sequence::tick(void)
+{
+	while(next < step_count && clock() - t0 >= step[next].at)
+	{
+		exec(next++);
+		if(next == step_count)
+		{
+			sync();
+		}
+	}
+
+	return step_count - next;
+}
+
+/*
+ * run(void)
+ *
+ * Run the whole sequence, waiting for each step in a busy loop. This
+ * gives the tightest timing, at the cost of the CPU for the length of
+ * the sequence.
+ */
+void Si5351Sequence::run(void)
+{
+	start();
+	while(tick())
+	{
+	}
+}
+
+/*
+ * steps(void)
+ *
+ * Returns the number of steps in the sequence.
+ */
+uint8_t Si5351Sequence::steps(void)
+{
+	return step_count;
+}
+
+/*
+ * get_timing(uint8_t index, struct Si5351SeqTiming *timing)
+ *
+ * Find out when a step of the last run was written.
+ *
+ * index - Step number, in order of time from 0
+ * timing - Where to put the times
+ *
+ * Returns 0 on success, or 1 if the step hasn't run.
+ */
+uint8_t Si5351Sequence::get_timing(uint8_t index, struct Si5351SeqTiming *timing)
+{
+	if(index >= step_count || index >= next)
+	{
+		return 1;
+	}
+	*timing = this->timing[index];
+	return 0;
+}
+
+/*
+ * late_max(void)
+ *
+ * Returns how many microseconds the latest step of the last run started
+ * after its time.
+ */
+uint32_t Si5351Sequence::late_max(void)
+{
+	uint32_t late = 0;
+	uint8_t i;
+
+	for(i = 0; i < next && i < step_count; i++)
+	{
+		if(timing[i].start - timing[i].at > late)
+		{
+			late = timing[i].start - timing[i].at;
+		}
+	}
+	return late;
+}
+
+/*
+ * set_clock(uint32_t (*clock)(void))
+ *
+ * clock - Function returning the current time in microseconds, or NULL to
+ *   go back to the default of micros()
+ */
+void Si5351Sequence::set_clock(uint32_t (*clock)(void))
+{
+	this->clock = clock ? clock : si5351_micros;
+}
+
+/******************************/
+/* Private methods            */
+/******************************/
+
+// Write the registers of one step and note when that happened
+void Si5351Sequence::exec(uint8_t index)
+{
+	struct Step *s = &step[index];
+	uint8_t i;
+
+	timing[index].at = s->at;
+	timing[index].start = clock() - t0;
+	for(i = s->first; i < s->first + s->count; i++)
+	{
+		dev->si5351_write_bulk(xfers[i].reg, xfers[i].len, &data[xfers[i].offset]);
+	}
+	timing[index].end = clock() - t0;
+}
+
+// Bring the device object in step with the end of the sequence
+void Si5351Sequence::sync(void)
+{
+	uint8_t i;
+
+	for(i = 0; i < SI5351_CLK_COUNT; i++)
+	{
+		dev->clk_freq[i] = clk_freq[i];
+		dev->pll_assignment[i] = (pllb_mask & (1 << i)) ? SI5351_PLLB : SI5351_PLLA;
+		dev->clk_first_set[i] = (first_set_mask & (1 << i)) ? true : false;
+	}
+	dev->plla_freq = plla_freq;
+	dev->pllb_freq = pllb_freq;
+	dev->int_mode_mask = int_mode_mask;
+}
+
+// Register contents as the script left them, read from the device the
+// first time
+uint8_t Si5351Sequence::shadow_get(uint8_t reg)
+{
+	uint8_t i, val;
+
+	for(i = 0; i < shadow_count; i++)
+	{
+		if(shadow_reg[i] == reg)
+		{
+			return shadow_val[i];
+		}
+	}
+
+	val = dev->si5351_read(reg);
+	shadow_set(reg, val);
+	return val;
+}
+
+void Si5351Sequence::shadow_set(uint8_t reg, uint8_t val)
+{
+	uint8_t i;
+
+	for(i = 0; i < shadow_count; i++)
+	{
+		if(shadow_reg[i] == reg)
+		{
+			shadow_val[i] = val;
+			return;
+		}
+	}
+
+	if(shadow_count == SI5351_SEQ_SHADOW)
+	{
+		error = 1;
+		return;
+	}
+	shadow_reg[shadow_count] = reg;
+	shadow_val[shadow_count++] = val;
+}
+
+uint8_t Si5351Sequence::Recorder::probe(uint8_t)
+{
+	return 0;
+}
+
+// Add a write to the step being compiled. A write of the output enable
+// register right after another one replaces it.
+uint8_t Si5351Sequence::Recorder::write(uint8_t, uint8_t reg, uint8_t len, const uint8_t *data)
+{
+	struct Step *s;
+	struct Xfer *x;
+	uint8_t i;
+
+	if(owner->step_count == 0 || owner->step[owner->step_count - 1].at != owner->t0)
+	{
+		if(owner->step_count == SI5351_SEQ_MAX_STEPS)
+		{
+			owner->error = 1;
+			return 4;
+		}
+		s = &owner->step[owner->step_count++];
+		s->at = owner->t0;
+		s->first = owner->xfer_count;
+		s->count = 0;
+	}
+	s = &owner->step[owner->step_count - 1];
+
+	for(i = 0; i < len; i++)
+	{
+		owner->shadow_set(reg + i, data[i]);
+	}
+
+	if(s->count && reg == SI5351_OUTPUT_ENABLE_CTRL && len == 1)
+	{
+		x = &owner->xfers[owner->xfer_count - 1];
+		if(x->reg == SI5351_OUTPUT_ENABLE_CTRL && x->len == 1)
+		{
+			owner->data[x->offset] = data[0];
+			return 0;
+		}
+	}
+
+	if(owner->xfer_count == SI5351_SEQ_MAX_XFER ||
+		owner->data_len + len > SI5351_SEQ_MAX_DATA)
+	{
+		owner->error = 1;
+		return 4;
+	}
+	x = &owner->xfers[owner->xfer_count++];
+	x->reg = reg;
+	x->len = len;
+	x->offset = owner->data_len;
+	memcpy(&owner->data[owner->data_len], data, len);
+	owner->data_len += len;
+	s->count++;
+
+	return 0;
+}
+
+uint8_t Si5351Sequence::Recorder::read(uint8_t, uint8_t reg, uint8_t len, uint8_t *data)
+{
+	uint8_t i;
+
+	for(i = 0; i < len; i++)
+	{
+		data[i] = owner->shadow_get(reg + i);
+	}
+	return 0;
+}
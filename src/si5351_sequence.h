@@ -0,0 +1,140 @@
+/*
+ * si5351_sequence.h - Timed register sequences for the Si5351 library
+ *
+ * Copyright (C) 2015 - 2019 Jason Milldrum <milldrum@gmail.com>
+ *                           Dana H. Myers <k6jq@comcast.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SI5351_SEQUENCE_H_
+#define SI5351_SEQUENCE_H_
+
+#include "si5351.h"
+
+// Timed steps in one sequence
+#ifndef SI5351_SEQ_MAX_STEPS
+#define SI5351_SEQ_MAX_STEPS            8
+#endif
+
+// Register writes in one sequence, over all of its steps
+#ifndef SI5351_SEQ_MAX_XFER
+#define SI5351_SEQ_MAX_XFER             16
+#endif
+
+// Register bytes in one sequence. A retune that keeps its PLL takes 8.
+#ifndef SI5351_SEQ_MAX_DATA
+#define SI5351_SEQ_MAX_DATA             64
+#endif
+
+// Registers whose contents are followed while a script is compiled
+#ifndef SI5351_SEQ_SHADOW
+#define SI5351_SEQ_SHADOW               24
+#endif
+
+/*
+ * When one step of the last run happened, in microseconds from start()
+ *
+ * at - When the script asked for it
+ * start - When its first register write began
+ * end - When its last register write finished
+ *
+ * start - at is how late the step was.
+ */
+struct Si5351SeqTiming
+{
+	uint32_t at;
+	uint32_t start;
+	uint32_t end;
+};
+
+/*
+ * Si5351Sequence - Register writes at fixed times, worked out in advance
+ *
+ * A script is a function that makes the usual Si5351 calls, with at()
+ * calls in between to say when the calls that follow are due. compile()
+ * runs it once against a copy of the device and keeps the register
+ * writes it would have made, grouped into timed steps. Running the
+ * sequence is then nothing but those writes: no read-modify-write, and no
+ * frequency arithmetic. Consecutive output enable changes of a step are
+ * folded into one write of the output enable register.
+ *
+ * The writes hold whole register values as they were when the script was
+ * compiled, so compile the script again after changing anything it
+ * touches outside of the sequence.
+ */
+class Si5351Sequence
+{
+public:
+	Si5351Sequence(Si5351 *dev);
+	uint8_t compile(void (*)(Si5351 &, Si5351Sequence &));
+	void at(uint32_t);
+	void start(void);
+	uint8_t tick(void);
+	void run(void);
+	uint8_t steps(void);
+	uint8_t get_timing(uint8_t, struct Si5351SeqTiming *);
+	uint32_t late_max(void);
+	void set_clock(uint32_t (*)(void));
+private:
+	class Recorder : public Si5351Bus
+	{
+	public:
+		Recorder(Si5351Sequence *owner) : owner(owner) {}
+		uint8_t probe(uint8_t dev_addr);
+		uint8_t write(uint8_t dev_addr, uint8_t reg, uint8_t len, const uint8_t *data);
+		uint8_t read(uint8_t dev_addr, uint8_t reg, uint8_t len, uint8_t *data);
+	private:
+		Si5351Sequence *owner;
+	};
+	struct Step
+	{
+		uint32_t at;
+		uint8_t first;
+		uint8_t count;
+	};
+	struct Xfer
+	{
+		uint8_t reg;
+		uint8_t len;
+		uint8_t offset;
+	};
+	uint8_t shadow_get(uint8_t);
+	void shadow_set(uint8_t, uint8_t);
+	void exec(uint8_t);
+	void sync(void);
+	Si5351 *dev;
+	uint32_t (*clock)(void);
+	struct Step step[SI5351_SEQ_MAX_STEPS];
+	struct Xfer xfers[SI5351_SEQ_MAX_XFER];
+	uint8_t data[SI5351_SEQ_MAX_DATA];
+	uint8_t step_count;
+	uint8_t xfer_count;
+	uint8_t data_len;
+	uint8_t error;
+	uint8_t shadow_reg[SI5351_SEQ_SHADOW];
+	uint8_t shadow_val[SI5351_SEQ_SHADOW];
+	uint8_t shadow_count;
+	uint64_t clk_freq[SI5351_CLK_COUNT];
+	uint64_t plla_freq;
+	uint64_t pllb_freq;
+	uint8_t pllb_mask;
+	uint8_t first_set_mask;
+	uint8_t int_mode_mask;
+	uint8_t next;
+	uint32_t t0;
+	struct Si5351SeqTiming timing[SI5351_SEQ_MAX_STEPS];
+};
+
+#endif /* SI5351_SEQUENCE_H_ */
@@ -0,0 +1,164 @@
+/*
+ * si5351_tempco.cpp - Temperature compensation for the Si5351 library
+ *
+ * Copyright (C) 2015 - 2019 Jason Milldrum <milldrum@gmail.com>
+ *                           Dana H. Myers <k6jq@comcast.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "si5351_tempco.h"
+
+/*
+ * Si5351TempComp(Si5351Discipline *disc, const struct Si5351TempPoint *curve, uint8_t count)
+ *
+ * disc - Corrector of the reference to compensate
+ * curve - Points of the temperature curve, in order of rising
+ *   temperature. On AVR it must be declared with SI5351_TEMPCO_PROGMEM.
+ * count - Number of points, at least 1
+ */
+Si5351TempComp::Si5351TempComp(Si5351Discipline *disc, const struct Si5351TempPoint *curve, uint8_t count):
+	disc(disc),
+	curve(curve),
+	count(count),
+	offset(0),
+	threshold(SI5351_TEMPCO_THRESHOLD),
+	applied(false),
+	applied_ppb(0)
+{
+	memset(&stats, 0, sizeof(stats));
+}
+
+/*
+ * set_offset(int32_t ppb)
+ *
+ * ppb - Correction added to the curve, such as the one found by
+ *   calibrating at a known temperature
+ */
+void Si5351TempComp::set_offset(int32_t ppb)
+{
+	offset = ppb;
+}
+
+/*
+ * set_threshold(uint16_t ppb)
+ *
+ * ppb - How far the correction must move from the one in use before it
+ *   is written again. This keeps a noisy sensor from writing the chip on
+ *   every sample. The default is SI5351_TEMPCO_THRESHOLD.
+ */
+void Si5351TempComp::set_threshold(uint16_t ppb)
+{
+	threshold = ppb;
+}
+
+/*
+ * correction(int16_t temp)
+ *
+ * temp - Temperature in tenths of a degree Celsius
+ *
+ * Returns the correction for temp in ppb, including the offset. Outside
+ * of the curve, the nearest end point holds.
+ */
+int32_t Si5351TempComp::correction(int16_t temp)
+{
+	struct Si5351TempPoint lo, hi;
+	uint8_t i;
+
+	point(0, &lo);
+	if(count < 2 || temp <= lo.temp)
+	{
+		return lo.ppb + offset;
+	}
+
+	for(i = 1; i < count; i++)
+	{
+		point(i, &hi);
+		if(temp <= hi.temp)
+		{
+			return lo.ppb + (int32_t)((int64_t)(hi.ppb - lo.ppb) * (temp - lo.temp) / (hi.temp - lo.temp)) + offset;
+		}
+		lo = hi;
+	}
+
+	return hi.ppb + offset;
+}
+
+/*
+ * update(int16_t temp)
+ *
+ * Take a temperature sample, and correct the reference if the correction
+ * for it differs from the one in use by the threshold or more. The first
+ * sample always sets the correction.
+ *
+ * temp - Temperature in tenths of a degree Celsius
+ *
+ * Returns 1 if a new correction was applied, or 0 if not.
+ */
+uint8_t Si5351TempComp::update(int16_t temp)
+{
+	int32_t ppb = correction(temp);
+	int32_t change = ppb - applied_ppb;
+
+	stats.samples++;
+	stats.ppb_last = ppb;
+	if(applied && change < (int32_t)threshold && -change < (int32_t)threshold)
+	{
+		stats.held++;
+		return 0;
+	}
+
+	disc->set_correction(ppb);
+	applied = true;
+	applied_ppb = ppb;
+	stats.applied++;
+
+	return 1;
+}
+
+/*
+ * get_stats(struct Si5351TempCompStats *stats)
+ *
+ * stats - Where to copy the counters
+ */
+void Si5351TempComp::get_stats(struct Si5351TempCompStats *stats)
+{
+	*stats = this->stats;
+}
+
+/*
+ * reset_stats(void)
+ *
+ * Zero the counters.
+ */
+void Si5351TempComp::reset_stats(void)
+{
+	memset(&stats, 0, sizeof(stats));
+}
+
+/******************************/
+/* Private methods            */
+/******************************/
+
+// Copy a point of the curve, from flash on AVR
+void Si5351TempComp::point(uint8_t i, struct Si5351TempPoint *p)
+{
+#if defined(__AVR__)
+	memcpy_P(p, &curve[i], sizeof(*p));
+#else
+	*p = curve[i];
+#endif
+}
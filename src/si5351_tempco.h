@@ -0,0 +1,104 @@
+/*
+ * si5351_tempco.h - Temperature compensation for the Si5351 library
+ *
+ * Copyright (C) 2015 - 2019 Jason Milldrum <milldrum@gmail.com>
+ *                           Dana H. Myers <k6jq@comcast.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SI5351_TEMPCO_H_
+#define SI5351_TEMPCO_H_
+
+#include "si5351.h"
+#include "si5351_discipline.h"
+
+#if defined(__AVR__)
+#include <avr/pgmspace.h>
+#define SI5351_TEMPCO_PROGMEM           PROGMEM
+#else
+#define SI5351_TEMPCO_PROGMEM
+#endif
+
+// Smallest change of the correction, in ppb, that is written to the chip
+#ifndef SI5351_TEMPCO_THRESHOLD
+#define SI5351_TEMPCO_THRESHOLD         20
+#endif
+
+/*
+ * One point of a temperature curve
+ *
+ * temp - Temperature in tenths of a degree Celsius
+ * ppb - Frequency error of the reference at that temperature, in ppb,
+ *   as it would be passed to set_correction()
+ *
+ * Declare the curve with SI5351_TEMPCO_PROGMEM to keep it in flash on AVR:
+ *
+ *   const struct Si5351TempPoint curve[] SI5351_TEMPCO_PROGMEM = {...};
+ */
+struct Si5351TempPoint
+{
+	int16_t temp;
+	int32_t ppb;
+};
+
+/*
+ * Counters of Si5351TempComp since the last reset_stats()
+ *
+ * samples - update() calls
+ * applied - Samples that changed the correction of the chip
+ * held - Samples whose correction was within the threshold of the one in
+ *   use, so nothing was written
+ * ppb_last - Correction worked out for the latest sample
+ */
+struct Si5351TempCompStats
+{
+	uint32_t samples;
+	uint32_t applied;
+	uint32_t held;
+	int32_t ppb_last;
+};
+
+/*
+ * Si5351TempComp - Follow a temperature curve of the reference
+ *
+ * Each temperature sample is turned into a correction by linear
+ * interpolation between the points of a curve, plus a fixed offset from
+ * calibration. When it has moved by at least the threshold from the
+ * correction in use, it goes to the chip through Si5351Discipline, which
+ * only writes the PLL register bytes that change.
+ */
+class Si5351TempComp
+{
+public:
+	Si5351TempComp(Si5351Discipline *disc, const struct Si5351TempPoint *curve, uint8_t count);
+	void set_offset(int32_t);
+	void set_threshold(uint16_t);
+	int32_t correction(int16_t);
+	uint8_t update(int16_t);
+	void get_stats(struct Si5351TempCompStats *);
+	void reset_stats(void);
+private:
+	void point(uint8_t, struct Si5351TempPoint *);
+	Si5351Discipline *disc;
+	const struct Si5351TempPoint *curve;
+	uint8_t count;
+	int32_t offset;
+	uint16_t threshold;
+	bool applied;
+	int32_t applied_ppb;
+	struct Si5351TempCompStats stats;
+};
+
+#endif /* SI5351_TEMPCO_H_ */
@@ -0,0 +1,202 @@
+/*
+ * si5351_threadsafe.cpp - Si5351 wrapper for multi-threaded hosts
+ *
+ * Copyright (C) 2015 - 2019 Jason Milldrum <milldrum@gmail.com>
+ *                           Dana H. Myers <k6jq@comcast.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#if defined(__linux__) && !defined(ARDUINO)
+
+#include "si5351_threadsafe.h"
+
+/*
+ * Si5351ThreadSafe(uint8_t i2c_addr, Si5351Bus *bus)
+ *
+ * i2c_addr - I2C address of the device
+ * bus - Transport to reach the device through
+ */
+Si5351ThreadSafe::Si5351ThreadSafe(uint8_t i2c_addr, Si5351Bus *bus):
+	dev(i2c_addr, bus),
+	seq(0)
+{
+	for(int i = 0; i < SI5351_SNAPSHOT_WORDS; i++)
+	{
+		words[i].store(0, std::memory_order_relaxed);
+	}
+}
+
+bool Si5351ThreadSafe::init(uint8_t xtal_load_c, uint32_t xo_freq, int32_t corr)
+{
+	std::lock_guard<std::mutex> guard(lock);
+	bool found = dev.init(xtal_load_c, xo_freq, corr);
+
+	publish();
+	return found;
+}
+
+void Si5351ThreadSafe::reset(void)
+{
+	std::lock_guard<std::mutex> guard(lock);
+
+	dev.reset();
+	publish();
+}
+
+uint8_t Si5351ThreadSafe::set_freq(uint64_t freq, enum si5351_clock clk)
+{
+	std::lock_guard<std::mutex> guard(lock);
+	uint8_t ret = dev.set_freq(freq, clk);
+
+	publish();
+	return ret;
+}
+
+uint8_t Si5351ThreadSafe::set_freq_manual(uint64_t freq, uint64_t pll_freq, enum si5351_clock clk)
+{
+	std::lock_guard<std::mutex> guard(lock);
+	uint8_t ret = dev.set_freq_manual(freq, pll_freq, clk);
+
+	publish();
+	return ret;
+}
+
+void Si5351ThreadSafe::set_pll(uint64_t pll_freq, enum si5351_pll target_pll)
+{
+	std::lock_guard<std::mutex> guard(lock);
+
+	dev.set_pll(pll_freq, target_pll);
+	publish();
+}
+
+void Si5351ThreadSafe::set_correction(int32_t corr, enum si5351_pll_input ref_osc)
+{
+	std::lock_guard<std::mutex> guard(lock);
+
+	dev.set_correction(corr, ref_osc);
+	publish();
+}
+
+void Si5351ThreadSafe::output_enable(enum si5351_clock clk, uint8_t enable)
+{
+	std::lock_guard<std::mutex> guard(lock);
+
+	dev.output_enable(clk, enable);
+}
+
+void Si5351ThreadSafe::drive_strength(enum si5351_clock clk, enum si5351_drive drive)
+{
+	std::lock_guard<std::mutex> guard(lock);
+
+	dev.drive_strength(clk, drive);
+}
+
+/*
+ * update_status(void)
+ *
+ * Read the status registers. Returns a copy of dev_status, since the
+ * member itself is overwritten by the next call.
+ */
+#if defined(SI5351_HAS_STATUS)
+struct Si5351Status Si5351ThreadSafe::update_status(void)
+{
+	std::lock_guard<std::mutex> guard(lock);
+
+	dev.update_status();
+	return dev.dev_status;
+}
+#endif
+
+/*
+ * snapshot(struct Si5351FreqState *state)
+ *
+ * state - Receives the frequency state as of the last completed operation
+ *
+ * Never blocks. If an operation is being published while this runs, the
+ * copy is simply taken again.
+ */
+void Si5351ThreadSafe::snapshot(struct Si5351FreqState *state) const
+{
+	uint32_t w[SI5351_SNAPSHOT_WORDS];
+	uint32_t s1, s2;
+	int i;
+
+	do
+	{
+		s1 = seq.load(std::memory_order_acquire);
+		for(i = 0; i < SI5351_SNAPSHOT_WORDS; i++)
+		{
+			w[i] = words[i].load(std::memory_order_relaxed);
+		}
+		std::atomic_thread_fence(std::memory_order_acquire);
+		s2 = seq.load(std::memory_order_relaxed);
+	} while((s1 & 1) || s1 != s2);
+
+	for(i = 0; i < SI5351_CLK_COUNT; i++)
+	{
+		state->clk_freq[i] = ((uint64_t)w[2 * i + 1] << 32) | w[2 * i];
+		state->pll_assignment[i] = (w[20] >> i) & 1 ? SI5351_PLLB : SI5351_PLLA;
+	}
+	state->plla_freq = ((uint64_t)w[17] << 32) | w[16];
+	state->pllb_freq = ((uint64_t)w[19] << 32) | w[18];
+	state->version = s1 / 2;
+}
+
+/*
+ * version(void)
+ *
+ * Returns the number of operations published so far. It only changes
+ * when the frequency state may have changed.
+ */
+uint32_t Si5351ThreadSafe::version(void) const
+{
+	return seq.load(std::memory_order_acquire) / 2;
+}
+
+/*
+ * Copy the frequency state out of the device for snapshot(). Only ever
+ * called with the device lock held, so there is a single writer. The
+ * sequence number is odd while the words are being changed.
+ */
+void Si5351ThreadSafe::publish(void)
+{
+	uint32_t w[SI5351_SNAPSHOT_WORDS] = {0};
+	uint32_t s = seq.load(std::memory_order_relaxed);
+	int i;
+
+	for(i = 0; i < SI5351_CLK_COUNT; i++)
+	{
+		w[2 * i] = (uint32_t)dev.clk_freq[i];
+		w[2 * i + 1] = (uint32_t)(dev.clk_freq[i] >> 32);
+		if(dev.pll_assignment[i] == SI5351_PLLB)
+		{
+			w[20] |= 1UL << i;
+		}
+	}
+	w[16] = (uint32_t)dev.plla_freq;
+	w[17] = (uint32_t)(dev.plla_freq >> 32);
+	w[18] = (uint32_t)dev.pllb_freq;
+	w[19] = (uint32_t)(dev.pllb_freq >> 32);
+
+	seq.store(s + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	for(i = 0; i < SI5351_SNAPSHOT_WORDS; i++)
+	{
+		words[i].store(w[i], std::memory_order_relaxed);
+	}
+	seq.store(s + 2, std::memory_order_release);
+}
+
+#endif
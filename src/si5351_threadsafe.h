@@ -0,0 +1,104 @@
+/*
+ * si5351_threadsafe.h - Si5351 wrapper for multi-threaded hosts
+ *
+ * Copyright (C) 2015 - 2019 Jason Milldrum <milldrum@gmail.com>
+ *                           Dana H. Myers <k6jq@comcast.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SI5351_THREADSAFE_H_
+#define SI5351_THREADSAFE_H_
+
+#if defined(__linux__) && !defined(ARDUINO)
+
+#include <atomic>
+#include <mutex>
+
+#include "si5351.h"
+
+// 32-bit words in a published state: 8 CLK frequencies and 2 PLL
+// frequencies of 2 words each, plus the PLL assignments. The layout is
+// the same for every variant; the slots of absent outputs stay zero.
+#define SI5351_SNAPSHOT_WORDS           21
+
+/*
+ * Frequency state of a device as of the end of one operation
+ *
+ * clk_freq, plla_freq, pllb_freq, pll_assignment - As in Si5351
+ * version - Number of operations published before this one
+ */
+struct Si5351FreqState
+{
+	uint64_t clk_freq[SI5351_CLK_COUNT];
+	uint64_t plla_freq;
+	uint64_t pllb_freq;
+	enum si5351_pll pll_assignment[SI5351_CLK_COUNT];
+	uint32_t version;
+};
+
+/*
+ * Si5351ThreadSafe - Si5351 that many threads can use at once
+ *
+ * Operations that change the device are serialized on a mutex of their
+ * own. The calculations inside of them run outside of any bus lock, so
+ * when several devices share one Si5351LockedBus (see si5351_parallel.h),
+ * only the transfers themselves are serialized on the bus. When an
+ * operation finishes, the frequency state is published through a
+ * sequence lock, and snapshot() reads it without taking any lock and
+ * without ever seeing a half-finished update.
+ */
+class Si5351ThreadSafe
+{
+public:
+	Si5351ThreadSafe(uint8_t i2c_addr = SI5351_BUS_BASE_ADDR, Si5351Bus *bus = NULL);
+	bool init(uint8_t, uint32_t, int32_t);
+	void reset(void);
+	uint8_t set_freq(uint64_t, enum si5351_clock);
+	uint8_t set_freq_manual(uint64_t, uint64_t, enum si5351_clock);
+	void set_pll(uint64_t, enum si5351_pll);
+	void set_correction(int32_t, enum si5351_pll_input);
+	void output_enable(enum si5351_clock, uint8_t);
+	void drive_strength(enum si5351_clock, enum si5351_drive);
+#if defined(SI5351_HAS_STATUS)
+	struct Si5351Status update_status(void);
+#endif
+	void snapshot(struct Si5351FreqState *) const;
+	uint32_t version(void) const;
+
+	/*
+	 * apply(fn)
+	 *
+	 * Run fn(Si5351 &) under the device lock and publish the result. Use
+	 * it for the methods that have no wrapper here, or to make several
+	 * changes that readers should only ever see together.
+	 */
+	template <class F> void apply(F fn)
+	{
+		std::lock_guard<std::mutex> guard(lock);
+
+		fn(dev);
+		publish();
+	}
+private:
+	void publish(void);
+	Si5351 dev;
+	std::mutex lock;
+	std::atomic<uint32_t> seq;
+	std::atomic<uint32_t> words[SI5351_SNAPSHOT_WORDS];
+};
+
+#endif
+
+#endif /* SI5351_THREADSAFE_H_ */